@@ -17,12 +17,13 @@
 #
 
 from libcpp.string cimport string
+from libcpp.vector cimport vector
 from libcpp cimport bool
 
 from ParameterObjects cimport _ParameterSet, ParameterSet
 from CSProperties cimport _CSProperties, CSProperties
 from CSTransform cimport _CSTransform, CSTransform
-from CSRectGrid cimport CoordinateSystem
+from CSRectGrid cimport _CSRectGrid, CoordinateSystem
 
 cdef extern from "CSXCAD/CSPrimitives.h":
     cpdef enum PrimitiveType "CSPrimitives::PrimitiveType":
@@ -41,6 +42,7 @@ cdef extern from "CSXCAD/CSPrimitives.h":
         WIRE              "CSPrimitives::WIRE"
         USERDEFINED       "CSPrimitives::USERDEFINED"
         POLYHEDRONREADER  "CSPrimitives::POLYHEDRONREADER"
+        GROUP             "CSPrimitives::GROUP"
 
 
 cdef extern from "CSXCAD/CSPrimitives.h":
@@ -51,12 +53,15 @@ cdef extern from "CSXCAD/CSPrimitives.h":
             string GetTypeName()
 
             _CSProperties* GetProperty()
+            _CSPrimitives* GetCopy(_CSProperties* prop)
 
             void SetPriority(int val)
             int GetPriority()
             bool Update(string *ErrStr)
 
             bool GetBoundBox(double dBoundBox[6])
+            bool GetWorldBoundBox(double dBoundBox[6])
+            int IsInsideBox(double* boundbox)
 
             int GetDimension()
 
@@ -67,6 +72,7 @@ cdef extern from "CSXCAD/CSPrimitives.h":
 
             void SetCoordinateSystem(CoordinateSystem cs_type)
             CoordinateSystem GetCoordinateSystem()
+            void SetCoordInputType(CoordinateSystem cs_type, bool doUpdate)
 
             _CSTransform* GetTransform()
 
@@ -96,6 +102,18 @@ cdef extern from "CSXCAD/CSPrimBox.h":
 cdef class CSPrimBox(CSPrimitives):
     pass
 
+###############################################################################
+cdef extern from "CSXCAD/CSPrimMultiBox.h":
+    cdef cppclass _CSPrimMultiBox "CSPrimMultiBox" (_CSPrimitives):
+            _CSPrimMultiBox(_ParameterSet*, _CSProperties*) except +
+            void   SetCoord(int idx, double val)
+            double GetCoord(int idx)
+            void   AddBox(int initBox)
+            unsigned int GetQtyBoxes()
+
+cdef class CSPrimMultiBox(CSPrimitives):
+    pass
+
 ###############################################################################
 cdef extern from "CSXCAD/CSPrimCylinder.h":
     cdef cppclass _CSPrimCylinder "CSPrimCylinder" (_CSPrimitives):
@@ -153,6 +171,7 @@ cdef extern from "CSXCAD/CSPrimPolygon.h":
             int GetNormDir()
             void SetElevation(double val)
             double GetElevation()
+            bool GetInsideMask(const double* const* lines, const unsigned int* numLines, vector[unsigned char] &mask)
 
 cdef class CSPrimPolygon(CSPrimitives):
     pass
@@ -209,11 +228,14 @@ cdef extern from "CSXCAD/CSPrimPolyhedron.h":
             _CSPrimPolyhedron(_ParameterSet*, _CSProperties*) except +
             void Reset()
             void AddVertex(float px, float py, float pz)
-            float* GetVertex(unsigned int n)
+            const float* GetVertex(unsigned int n)
             unsigned int GetNumVertices()
             void AddFace(int numVertex, int* vertices)
-            int* GetFace(unsigned int n, unsigned int &numVertices)
+            const int* GetFace(unsigned int n, unsigned int &numVertices)
             unsigned int GetNumFaces()
+            void ShareMesh(_CSPrimPolyhedron* primPolyhedron)
+            unsigned int GetMeshUseCount()
+            bool GetGridIntersections(_CSRectGrid* grid, vector[size_t]* edges, vector[size_t]* faces)
 
 cdef class CSPrimPolyhedron(CSPrimitives):
     pass
@@ -231,6 +253,23 @@ cdef extern from "CSXCAD/CSPrimPolyhedronReader.h":
         void SetFileType(FileType ft)
         FileType GetFileType()
         bool ReadFile()
+        @staticmethod
+        void SetCacheDirectory(string dir)
+        @staticmethod
+        string GetCacheDirectory()
 
 cdef class CSPrimPolyhedronReader(CSPrimPolyhedron):
     pass
+
+###############################################################################
+cdef extern from "CSXCAD/CSPrimGroup.h":
+    cdef cppclass _CSPrimGroup "CSPrimGroup" (_CSPrimitives):
+            _CSPrimGroup(_ParameterSet*, _CSProperties*) except +
+            bool AddChild(_CSPrimitives* prim)
+            void DeleteChild(size_t index)
+            size_t GetQtyChildren()
+            _CSPrimitives* GetChild(size_t index)
+            long GetQtyInstances()
+
+cdef class CSPrimGroup(CSPrimitives):
+    pass
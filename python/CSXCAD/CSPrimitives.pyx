@@ -37,6 +37,7 @@ Create a metal box:
 import numpy as np
 import sys
 from libcpp.string cimport string
+from libcpp.vector cimport vector
 from libcpp cimport bool
 
 cimport CSPrimitives
@@ -67,7 +68,7 @@ cdef class CSPrimitives:
         elif prim_type == BOX:
             prim = CSPrimBox(pset, prop, no_init=no_init, **kw)
         elif prim_type == MULTIBOX:
-            raise Exception('Primitive type "MULTIBOX" not yet implemented!')
+            prim = CSPrimMultiBox(pset, prop, no_init=no_init, **kw)
         elif prim_type == SPHERE:
             prim = CSPrimSphere(pset, prop, no_init=no_init, **kw)
         elif prim_type == SPHERICALSHELL:
@@ -92,6 +93,8 @@ cdef class CSPrimitives:
             raise Exception('Primitive type "USERDEFINED" not yet implemented!')
         elif prim_type == POLYHEDRONREADER:
             prim = CSPrimPolyhedronReader(pset, prop, no_init=no_init, **kw)
+        elif prim_type == GROUP:
+            prim = CSPrimGroup(pset, prop, no_init=no_init, **kw)
         return prim
 
     def __init__(self, ParameterSet pset, CSProperties prop, *args, no_init=False, **kw):
@@ -138,6 +141,22 @@ cdef class CSPrimitives:
 
         return self.__prop
 
+    def GetCopy(self, CSProperties prop=None):
+        """ GetCopy(prop=None)
+
+        Create a copy of this primitive.
+
+        :param prop: CSProperties -- property for the copy, use the property of this primitive if None
+        :returns: CSPrimitives -- the new primitive
+        """
+        cdef _CSProperties* _prop = NULL
+        if prop is not None:
+            _prop = prop.thisptr
+        cdef _CSPrimitives* _prim = self.thisptr.GetCopy(_prop)
+        cdef CSPrimitives prim = CSPrimitives.fromType(_prim.GetType(), pset=None, prop=prop, no_init=True)
+        prim.thisptr = _prim
+        return prim
+
     def GetType(self):
         """
         Get the type as int for this primitive
@@ -185,6 +204,35 @@ cdef class CSPrimitives:
             bb[1,n] = _bb[2*n+1]
         return bb
 
+    def GetWorldBoundBox(self):
+        """
+        Get a conservative Cartesian bounding box for this primitive including its transformation
+
+        :returns: (2,3) ndarray -- world bounding box or None if unknown
+        """
+        cdef double _bb[6]
+        if not self.thisptr.GetWorldBoundBox(_bb):
+            return None
+        bb = np.zeros([2,3])
+        for n in range(3):
+            bb[0,n] = _bb[2*n]
+            bb[1,n] = _bb[2*n+1]
+        return bb
+
+    def IsInsideBox(self, box):
+        """ IsInsideBox(box)
+
+        Check if this primitive may be inside the given box. The box must be given in the coordinate input type.
+
+        :param box: (2,3) array -- start and stop coordinates
+        :returns: int -- -1 if not, +1 if it may be inside, 0 if unknown
+        """
+        cdef double _bb[6]
+        for n in range(3):
+            _bb[2*n]   = box[0][n]
+            _bb[2*n+1] = box[1][n]
+        return self.thisptr.IsInsideBox(_bb)
+
     def GetDimension(self):
         """
         Get the dimension of this primitive
@@ -293,6 +341,17 @@ cdef class CSPrimitives:
             return None
         return cs_type
 
+    def SetCoordInputType(self, cs_type):
+        """ SetCoordInputType(cs_type)
+
+        Set the coordinate system type (Cartesian or cylindrical) of all coordinates
+        given to e.g. IsInside. Update() has to be called afterwards.
+
+        :param cs_type: coordinate system (0 : Cartesian, 1 : Cylindrical)
+        """
+        assert cs_type in [CSRectGrid.CARTESIAN, CSRectGrid.CYLINDRICAL], 'Unknown coordinate system: {}'.format(cs_type)
+        self.thisptr.SetCoordInputType(cs_type, False)
+
     def Update(self):
         """ Trigger an internal update and report success and error message
 
@@ -430,6 +489,76 @@ cdef class CSPrimBox(CSPrimitives):
             coord[n] = ptr.GetCoord(2*n+1)
         return coord
 
+###############################################################################
+cdef class CSPrimMultiBox(CSPrimitives):
+    """ Multi-Box Primitive
+
+    A multi-box is a set of boxes, each defined by its start and stop coordinate.
+
+    Parameters
+    ----------
+    start : (N,3) array
+        Start points of all boxes
+    stop : (N,3) array
+        Stop points of all boxes
+
+    """
+    def __init__(self, ParameterSet pset, CSProperties prop, *args, no_init=False, **kw):
+        if no_init:
+            self.thisptr = NULL
+            return
+        if not self.thisptr:
+            self.thisptr   = new _CSPrimMultiBox(pset.thisptr, prop.thisptr)
+        if 'start' in kw and 'stop' in kw:
+            for start, stop in zip(kw['start'], kw['stop']):
+                self.AddBox(start, stop)
+            del kw['start']
+            del kw['stop']
+        super(CSPrimMultiBox, self).__init__(pset, prop, *args, **kw)
+
+    def AddBox(self, start, stop):
+        """ AddBox(start, stop)
+
+        Add a box to this primitive.
+
+        :param start: list/array of float -- Start point coordinate
+        :param stop: list/array of float -- Stop point coordinate
+        """
+        ptr = <_CSPrimMultiBox*>self.thisptr
+        assert len(start)==3, "CSPrimMultiBox:AddBox: length of start needs to be 3"
+        assert len(stop)==3, "CSPrimMultiBox:AddBox: length of stop needs to be 3"
+        idx = 6*ptr.GetQtyBoxes()
+        ptr.AddBox(-1)
+        for n in range(3):
+            ptr.SetCoord(idx+2*n, start[n])
+            ptr.SetCoord(idx+2*n+1, stop[n])
+
+    def GetQtyBoxes(self):
+        """
+        Get the number of boxes of this primitive.
+
+        :returns: int -- Number of boxes
+        """
+        ptr = <_CSPrimMultiBox*>self.thisptr
+        return ptr.GetQtyBoxes()
+
+    def GetBox(self, idx):
+        """ GetBox(idx)
+
+        Get the start and stop coordinate of a box.
+
+        :param idx: int -- Box index
+        :returns: (3,) ndarray, (3,) ndarray -- Start and stop coordinate
+        """
+        ptr = <_CSPrimMultiBox*>self.thisptr
+        assert idx>=0 and idx<ptr.GetQtyBoxes(), "CSPrimMultiBox:GetBox: invalid box index"
+        start = np.zeros(3)
+        stop  = np.zeros(3)
+        for n in range(3):
+            start[n] = ptr.GetCoord(6*idx+2*n)
+            stop[n]  = ptr.GetCoord(6*idx+2*n+1)
+        return start, stop
+
 ###############################################################################
 cdef class CSPrimCylinder(CSPrimitives):
     """ Cylinder Primitive
@@ -814,6 +943,28 @@ cdef class CSPrimPolygon(CSPrimitives):
         ptr = <_CSPrimPolygon*>self.thisptr
         return ptr.GetElevation()
 
+    def GetInsideMask(self, lines):
+        """ GetInsideMask(lines)
+
+        Check all nodes of a grid at once, this is much faster than calling
+        IsInside for every node. Requires a previous Update().
+
+        :param lines: list of three sorted arrays -- Grid lines in all three directions
+        :returns: (Nx,Ny,Nz) ndarray of bool or None if not supported (e.g. for a transformed primitive)
+        """
+        cdef vector[double] c_lines[3]
+        cdef const double* c_ptr[3]
+        cdef unsigned int c_num[3]
+        cdef vector[unsigned char] mask
+        for n in range(3):
+            c_lines[n] = list(np.asarray(lines[n], dtype=float))
+            c_num[n]   = c_lines[n].size()
+            c_ptr[n]   = c_lines[n].data()
+        ptr = <_CSPrimPolygon*>self.thisptr
+        if not ptr.GetInsideMask(c_ptr, c_num, mask):
+            return None
+        return np.array(mask, dtype=np.bool_).reshape(c_num[2], c_num[1], c_num[0]).transpose()
+
 ###############################################################################
 cdef class CSPrimLinPoly(CSPrimPolygon):
     """ Linear Extruded Polygon
@@ -1124,7 +1275,7 @@ cdef class CSPrimPolyhedron(CSPrimitives):
         """
         ptr = <_CSPrimPolyhedron*>self.thisptr
         assert idx>=0 and idx<ptr.GetNumVertices(), "Error: invalid vertex index"
-        cdef float* p
+        cdef const float* p
         p = ptr.GetVertex(idx)
         assert p!=NULL
         pyp = np.zeros(3)
@@ -1167,11 +1318,11 @@ cdef class CSPrimPolyhedron(CSPrimitives):
         """
         ptr = <_CSPrimPolyhedron*>self.thisptr
         assert idx>=0 and idx<ptr.GetNumFaces(), "Error: invalid face index"
-        cdef int *i_v
+        cdef const int *i_v
         cdef unsigned int numVert=0
         i_v = ptr.GetFace(idx, numVert)
         assert i_v!=NULL
-        face = np.zeros(numVert, np.int)
+        face = np.zeros(numVert, int)
         for n in range(numVert):
             face[n] = i_v[n]
         return face
@@ -1185,6 +1336,42 @@ cdef class CSPrimPolyhedron(CSPrimitives):
         ptr = <_CSPrimPolyhedron*>self.thisptr
         return ptr.GetNumFaces()
 
+    def ShareMesh(self, CSPrimPolyhedron other):
+        """ ShareMesh(other)
+
+        Use the (immutable) mesh of another polyhedron instead of an own copy.
+
+        :param other: CSPrimPolyhedron -- polyhedron to share the mesh with
+        """
+        ptr = <_CSPrimPolyhedron*>self.thisptr
+        ptr.ShareMesh(<_CSPrimPolyhedron*>other.thisptr)
+
+    def GetMeshUseCount(self):
+        """
+        Get the number of polyhedrons using the mesh of this polyhedron.
+
+        :return num: int -- mesh use count
+        """
+        ptr = <_CSPrimPolyhedron*>self.thisptr
+        return ptr.GetMeshUseCount()
+
+    def GetGridIntersections(self, CSRectGrid.CSRectGrid grid):
+        """ GetGridIntersections(grid)
+
+        Find all grid edges and grid faces cut by the surface of this polyhedron.
+        Only cartesian grids are supported.
+
+        :param grid: CSRectGrid -- Grid to test against
+        :returns: (edges, faces) -- Lists of the sorted linear indices of the lower node of all cut edges
+                                    in and all cut faces normal to x, y and z, None if the grid is not supported
+        """
+        ptr = <_CSPrimPolyhedron*>self.thisptr
+        cdef vector[size_t] edges[3]
+        cdef vector[size_t] faces[3]
+        if not ptr.GetGridIntersections(grid.thisptr, edges, faces):
+            return None
+        return [np.array(edges[n], dtype=np.uint64) for n in range(3)], [np.array(faces[n], dtype=np.uint64) for n in range(3)]
+
 ###############################################################################
 cdef class CSPrimPolyhedronReader(CSPrimPolyhedron):
     """ Polyhedron Reader
@@ -1259,3 +1446,103 @@ cdef class CSPrimPolyhedronReader(CSPrimPolyhedron):
         """
         ptr = <_CSPrimPolyhedronReader*>self.thisptr
         return ptr.ReadFile()
+
+    @staticmethod
+    def SetCacheDirectory(cache_dir):
+        """ SetCacheDirectory(cache_dir)
+
+        Set a directory to cache parsed meshes in, an empty string disables the cache.
+
+        :param cache_dir: str -- Cache directory
+        """
+        _CSPrimPolyhedronReader.SetCacheDirectory(cache_dir.encode('UTF-8'))
+
+    @staticmethod
+    def GetCacheDirectory():
+        """
+        Get the directory to cache parsed meshes in.
+
+        :returns cache_dir: str -- Cache directory, empty if the cache is disabled
+        """
+        return _CSPrimPolyhedronReader.GetCacheDirectory().decode('UTF-8')
+
+###############################################################################
+cdef class CSPrimGroup(CSPrimitives):
+    """ Group
+
+    This primitive is an instance of a set of child primitives, placed by the
+    transformation of the group. The children are defined in the Cartesian
+    coordinate system of the group. Copies of a group (see GetCopy) share the
+    same children.
+
+    Parameters
+    ----------
+    children : list
+        List of child primitives to add (see AddChild)
+    """
+    def __init__(self, ParameterSet pset, CSProperties prop, *args, no_init=False, **kw):
+        if no_init:
+            self.thisptr = NULL
+            return
+        if not self.thisptr:
+            self.thisptr = new _CSPrimGroup(pset.thisptr, prop.thisptr)
+        children = kw.pop('children', [])
+        super(CSPrimGroup, self).__init__(pset, prop, *args, **kw)
+        for child in children:
+            assert self.AddChild(child), 'Error, unable to add child primitive'
+
+    def AddChild(self, CSPrimitives prim):
+        """ AddChild(prim)
+
+        Add a child primitive to this group. The group takes ownership and
+        the child is removed from its property.
+
+        :param prim: CSPrimitives -- child primitive
+        :returns: bool -- False if the primitive is already a child or a group containing the children of this group
+        """
+        ptr = <_CSPrimGroup*>self.thisptr
+        return ptr.AddChild(prim.thisptr)
+
+    def DeleteChild(self, index):
+        """ DeleteChild(index)
+
+        Remove and delete the child primitive with the given index.
+
+        :param index: int -- child index
+        """
+        ptr = <_CSPrimGroup*>self.thisptr
+        ptr.DeleteChild(index)
+
+    def GetQtyChildren(self):
+        """
+        Get the number of child primitives.
+
+        :returns: int -- number of children
+        """
+        ptr = <_CSPrimGroup*>self.thisptr
+        return ptr.GetQtyChildren()
+
+    def GetChild(self, index):
+        """ GetChild(index)
+
+        Get the child primitive with the given index.
+
+        :param index: int -- child index
+        :returns: CSPrimitives -- child primitive or None
+        """
+        ptr = <_CSPrimGroup*>self.thisptr
+        cdef _CSPrimitives* _prim = ptr.GetChild(index)
+        if _prim==NULL:
+            return None
+        cdef CSPrimitives prim = CSPrimitives.fromType(_prim.GetType(), pset=None, prop=None, no_init=True)
+        prim.thisptr = _prim
+        return prim
+
+    def GetQtyInstances(self):
+        """
+        Get the number of group instances sharing the children of this group (including this group).
+
+        :returns: int -- number of instances
+        """
+        ptr = <_CSPrimGroup*>self.thisptr
+        return ptr.GetQtyInstances()
@@ -23,6 +23,8 @@ from libcpp cimport bool
 from ParameterObjects cimport _ParameterSet, ParameterSet
 from CSPrimitives cimport _CSPrimitives, CSPrimitives
 from CSXCAD cimport ContinuousStructure
+from CSRectGrid cimport _CSRectGrid, CSRectGrid, CoordinateSystem
+from CSTransform cimport _CSTransform, CSTransform
 
 cdef extern from "CSXCAD/CSProperties.h":
     cpdef enum PropertyType "CSProperties::PropertyType":
@@ -102,9 +104,65 @@ cdef extern from "CSXCAD/CSPropMaterial.h":
             void SetIsotropy(bool val)
             bool GetIsotropy()
 
+            double GetEpsilonWeighted(int ny, const double* coords)
+            double GetMueWeighted(int ny, const double* coords)
+            double GetKappaWeighted(int ny, const double* coords)
+            double GetSigmaWeighted(int ny, const double* coords)
+            double GetDensityWeighted(const double* coords)
+
+            void GetWeightedValues(const double* coords, _WeightedValues &values)
+            void GetWeightedValues(const double* coords, unsigned int numCoords, _WeightedValues* values)
+
+    cdef cppclass _WeightedValues "CSPropMaterial::WeightedValues":
+            double Epsilon[3]
+            double Mue[3]
+            double Kappa[3]
+            double Sigma[3]
+            double Density
+
 cdef class CSPropMaterial(CSProperties):
     pass
 
+##############################################################################
+cdef extern from "CSXCAD/CSPropDiscMaterial.h":
+    cdef cppclass _CSPropDiscMaterial "CSPropDiscMaterial" (_CSPropMaterial):
+            _CSPropDiscMaterial(_ParameterSet*) except +
+            bool ReadHDF5(string filename)
+
+            unsigned int GetDBSize()
+            void SetUseDataBaseForBackground(bool val)
+
+            _CSTransform* GetTransform()
+            void SetScale(double val)
+            double GetScale()
+
+            bool SharesData(_CSPropDiscMaterial* other)
+            @staticmethod
+            unsigned int GetNumberOfSharedData()
+
+            void SetOutOfCore(bool val, unsigned int cacheSize)
+            bool GetOutOfCore()
+            void SetCompressed(bool val)
+            bool GetCompressed()
+            void SetReadThreads(unsigned int val)
+            unsigned int GetReadThreads()
+
+            void SetPyramidLevels(unsigned int levels)
+            unsigned int GetPyramidLevels()
+            bool GetPyramidSize(unsigned int level, unsigned int* size)
+            int GetPyramidDBPos(unsigned int level, const unsigned int* pos, bool &mixed)
+
+            bool GetDBPositions(const double* const* lines, const unsigned int* numLines, CoordinateSystem cs, int* dbPos)
+            bool GetDBPositions(_CSRectGrid* grid, int* dbPos, bool cellCenters)
+
+            bool SetAlignedGrid(_CSRectGrid* grid)
+            int GetAlignedDBPos(const unsigned int* pos, bool cellCenter)
+
+            void CreateSurfaceModel(vector[double] &coords, vector[unsigned int] &quads, bool mergeQuads, unsigned int level, unsigned int numThreads)
+
+cdef class CSPropDiscMaterial(CSPropMaterial):
+    pass
+
 ##############################################################################
 cdef extern from "CSXCAD/CSPropLumpedElement.h":
     cdef cppclass _CSPropLumpedElement "CSPropLumpedElement" (_CSProperties):
@@ -35,7 +35,10 @@ Create a metal property:
 """
 
 import numpy as np
+from libcpp.vector cimport vector
+from libcpp cimport bool
 from ParameterObjects cimport _ParameterSet, ParameterSet
+from CSTransform cimport _CSTransform, CSTransform
 cimport CSProperties
 cimport CSPrimitives as c_CSPrimitives
 from CSPrimitives import CSPrimitives
@@ -70,6 +73,8 @@ cdef class CSProperties:
             prop = CSPropConductingSheet(pset, no_init=no_init, **kw)
         elif p_type == METAL:
             prop = CSPropMetal(pset, no_init=no_init, **kw)
+        elif p_type == DISCRETE_MATERIAL + MATERIAL:
+            prop = CSPropDiscMaterial(pset, no_init=no_init, **kw)
         elif p_type == MATERIAL:
             prop = CSPropMaterial(pset, no_init=no_init, **kw)
         elif p_type == LUMPED_ELEMENT:
@@ -96,6 +101,8 @@ cdef class CSProperties:
         prop = None
         if type_str=='Material':
             prop = CSPropMaterial(pset, no_init=no_init, **kw)
+        elif type_str=='Discrete-Material':
+            prop = CSPropDiscMaterial(pset, no_init=no_init, **kw)
         elif type_str=='LumpedElement':
             prop = CSPropLumpedElement(pset, no_init=no_init, **kw)
         elif type_str=='Metal':
@@ -399,6 +406,17 @@ cdef class CSProperties:
         """
         return self.__CreatePrimitive(c_CSPrimitives.POLYHEDRONREADER, filename=filename, **kw)
 
+    def AddGroup(self, **kw):
+        """ AddGroup(**kw)
+
+        Add a group of child primitives to this property.
+
+        See Also
+        --------
+        CSXCAD.CSPrimitives.CSPrimGroup : See here for details on primitive arguments
+        """
+        return self.__CreatePrimitive(c_CSPrimitives.GROUP, **kw)
+
     def __CreatePrimitive(self, prim_type, **kw):
         pset = self.GetParameterSet()
         prim = CSPrimitives.fromType(prim_type, pset, self, **kw)
@@ -548,6 +566,66 @@ cdef class CSPropMaterial(CSProperties):
             val[n] = self.__GetMaterialPropertyDir(prop_name, n)
         return val
 
+    def GetWeightedMaterialProperty(self, prop_name, coord):
+        """ GetWeightedMaterialProperty(prop_name, coord)
+        Get the weighted material property of type `prop_name` at a coordinate.
+
+        :params prop_name: str -- material property type
+        :params coord: (3,) array -- coordinate
+        :returns: float for `density` or else (3,) array
+        """
+        cdef double _coord[3]
+        for n in range(3):
+            _coord[n] = coord[n]
+        ptr = <_CSPropMaterial*>self.thisptr
+        if prop_name == 'density':
+            return ptr.GetDensityWeighted(_coord)
+        val = np.zeros(3)
+        for n in range(3):
+            if prop_name=='epsilon':
+                val[n] = ptr.GetEpsilonWeighted(n, _coord)
+            elif prop_name=='mue':
+                val[n] = ptr.GetMueWeighted(n, _coord)
+            elif prop_name=='kappa':
+                val[n] = ptr.GetKappaWeighted(n, _coord)
+            elif prop_name=='sigma':
+                val[n] = ptr.GetSigmaWeighted(n, _coord)
+            else:
+                raise Exception('GetWeightedMaterialProperty: Error, unknown material property')
+        return val
+
+    def GetWeightedValues(self, coords):
+        """ GetWeightedValues(coords)
+        Get all weighted material properties at once.
+
+        :params coords: (3,) array -- coordinate, or (N,3) array -- N coordinates
+        :returns: dict -- `epsilon`, `mue`, `kappa` and `sigma` as (3,) or (N,3) arrays and `density` as float or (N,) array
+        """
+        cdef double[:,::1] _coords = np.array(coords, dtype=np.float64, order='C').reshape(-1,3)
+        cdef unsigned int num = _coords.shape[0]
+        cdef vector[_WeightedValues] values
+        values.resize(max(num, 1))
+        ptr = <_CSPropMaterial*>self.thisptr
+        if np.ndim(coords)==1:
+            ptr.GetWeightedValues(&_coords[0,0], values[0])
+        elif num>0:
+            ptr.GetWeightedValues(&_coords[0,0], num, values.data())
+        out = {}
+        for name in ['epsilon', 'mue', 'kappa', 'sigma']:
+            out[name] = np.zeros((num,3))
+        out['density'] = np.zeros(num)
+        for i in range(num):
+            for n in range(3):
+                out['epsilon'][i,n] = values[i].Epsilon[n]
+                out['mue'][i,n]     = values[i].Mue[n]
+                out['kappa'][i,n]   = values[i].Kappa[n]
+                out['sigma'][i,n]   = values[i].Sigma[n]
+            out['density'][i] = values[i].Density
+        if np.ndim(coords)==1:
+            for name in out:
+                out[name] = out[name][0]
+        return out
+
     def __GetMaterialPropertyDir(self, prop_name, ny):
         if prop_name=='epsilon':
             return (<_CSPropMaterial*>self.thisptr).GetEpsilon(ny)
@@ -589,6 +667,293 @@ cdef class CSPropMaterial(CSProperties):
             raise Exception('GetMaterialWeightDir: Error, unknown material property')
 
 
+###############################################################################
+cdef class CSPropDiscMaterial(CSPropMaterial):
+    """ Discrete material property
+
+    A material defined by a voxel volume of material indices and a database
+    of material values, read from a HDF5 file. Voxel with an index not found
+    in the database use the values of the (background) material.
+
+    :params filename: str - HDF5 file to read
+    """
+    def __init__(self, ParameterSet pset, *args, no_init=False, **kw):
+        if no_init:
+            self.thisptr = NULL
+            return
+        if not self.thisptr:
+            self.thisptr = <_CSProperties*> new _CSPropDiscMaterial(pset.thisptr)
+
+        filename = None
+        if 'filename' in kw:
+            filename = kw['filename']
+            del kw['filename']
+        super(CSPropDiscMaterial, self).__init__(pset, *args, **kw)
+        if filename is not None:
+            self.ReadHDF5(filename)
+
+    def ReadHDF5(self, filename):
+        """ ReadHDF5(filename)
+
+        Read a discrete material file.
+
+        :param filename: str -- HDF5 file name
+        :returns: bool -- True if the file was read successfully
+        """
+        return (<_CSPropDiscMaterial*>self.thisptr).ReadHDF5(filename.encode('UTF-8'))
+
+    def SetOutOfCore(self, val, cache_size=64):
+        """ SetOutOfCore(val, cache_size=64)
+
+        Keep the voxel data in the file and read it on demand, takes effect
+        at the next ReadHDF5.
+
+        :param val: bool -- enable/disable out-of-core access
+        :param cache_size: int -- size of the brick cache in MB
+        """
+        (<_CSPropDiscMaterial*>self.thisptr).SetOutOfCore(val, cache_size)
+
+    def GetOutOfCore(self):
+        return (<_CSPropDiscMaterial*>self.thisptr).GetOutOfCore()
+
+    def SetCompressed(self, val):
+        """ SetCompressed(val)
+
+        Keep the voxel data in memory as compressed bricks, takes effect at
+        the next ReadHDF5.
+
+        :param val: bool -- enable/disable compressed storage
+        """
+        (<_CSPropDiscMaterial*>self.thisptr).SetCompressed(val)
+
+    def GetCompressed(self):
+        return (<_CSPropDiscMaterial*>self.thisptr).GetCompressed()
+
+    def SetReadThreads(self, val):
+        """ SetReadThreads(val)
+
+        Set the number of threads used to decompress the voxel data while
+        reading it, takes effect at the next ReadHDF5.
+
+        :param val: int -- number of threads, 0 for the number of cores, 1 for a single H5Dread
+        """
+        (<_CSPropDiscMaterial*>self.thisptr).SetReadThreads(val)
+
+    def GetReadThreads(self):
+        return (<_CSPropDiscMaterial*>self.thisptr).GetReadThreads()
+
+    def SetPyramidLevels(self, levels):
+        """ SetPyramidLevels(levels)
+
+        Set the number of downsampled volumes (at most 3), takes effect at the
+        next ReadHDF5.
+
+        :param levels: int -- number of levels, 0 to disable
+        """
+        (<_CSPropDiscMaterial*>self.thisptr).SetPyramidLevels(levels)
+
+    def GetPyramidLevels(self):
+        return (<_CSPropDiscMaterial*>self.thisptr).GetPyramidLevels()
+
+    def GetDBSize(self):
+        """
+        Get the number of materials in the database.
+
+        :returns: int -- database size
+        """
+        return (<_CSPropDiscMaterial*>self.thisptr).GetDBSize()
+
+    def SetUseDataBaseForBackground(self, val):
+        """ SetUseDataBaseForBackground(val)
+
+        Use the database material with index 0 as background material (default),
+        or use the (background) material for all voxel with index 0.
+
+        :param val: bool -- use the database for the background
+        """
+        (<_CSPropDiscMaterial*>self.thisptr).SetUseDataBaseForBackground(val)
+
+    def GetTransform(self):
+        """ GetTransform()
+
+        Get the transformation of the voxel mesh.
+        If this property does not have any, it will be created.
+
+        :return: CSTransform class
+
+        See Also
+        --------
+        CSXCAD.CSTransform.CSTransform
+        """
+        tr = CSTransform(no_init=True)
+        tr.thisptr = (<_CSPropDiscMaterial*>self.thisptr).GetTransform()
+        return tr
+
+    def AddTransform(self, transform, *args, **kw):
+        """ AddTransform(transform, *args, **kw)
+
+        Add a transformation to the voxel mesh.
+
+        See Also
+        --------
+        CSXCAD.CSTransform.CSTransform.AddTransform
+        """
+        self.GetTransform().AddTransform(transform, *args, **kw)
+
+    def SetScale(self, val):
+        """ SetScale(val)
+
+        Set the scaling of the voxel mesh.
+
+        :param val: float -- scale
+        """
+        (<_CSPropDiscMaterial*>self.thisptr).SetScale(val)
+
+    def GetScale(self):
+        return (<_CSPropDiscMaterial*>self.thisptr).GetScale()
+
+    def SharesData(self, CSPropDiscMaterial other):
+        """ SharesData(other)
+
+        Check if this property shares its voxel data with another property.
+
+        :param other: CSPropDiscMaterial
+        :returns: bool
+        """
+        return (<_CSPropDiscMaterial*>self.thisptr).SharesData(<_CSPropDiscMaterial*>other.thisptr)
+
+    @staticmethod
+    def GetNumberOfSharedData():
+        """
+        Get the number of voxel data sets currently registered for sharing.
+
+        :returns: int
+        """
+        return _CSPropDiscMaterial.GetNumberOfSharedData()
+
+    def GetEpsilonWeighted(self, ny, coord):
+        """ GetEpsilonWeighted(ny, coord)
+
+        Get the relative electric permittivity at a coordinate.
+
+        :param ny: int or str -- direction
+        :param coord: (3,) array -- coordinate
+        :returns: float -- permittivity
+        """
+        cdef double _coord[3]
+        for n in range(3):
+            _coord[n] = coord[n]
+        return (<_CSPropDiscMaterial*>self.thisptr).GetEpsilonWeighted(CheckNyDir(ny), _coord)
+
+    def GetDBPositions(self, lines, cs_type=0):
+        """ GetDBPositions(lines, cs_type=0)
+
+        Get the database position of all combinations of the given lines.
+
+        :param lines: list of three arrays -- coordinates in x/r, y/a and z
+        :param cs_type: int -- coordinate system of the lines
+        :returns: ndarray of int -- database positions, -1 for background material, None on error
+        """
+        cdef vector[double] _lines[3]
+        cdef const double* _ptr[3]
+        cdef unsigned int _num[3]
+        for n in range(3):
+            _lines[n] = np.asarray(lines[n], dtype=np.double)
+            _num[n] = _lines[n].size()
+            _ptr[n] = _lines[n].data()
+        cdef vector[int] dbPos
+        dbPos.resize(_num[0]*_num[1]*_num[2])
+        if not (<_CSPropDiscMaterial*>self.thisptr).GetDBPositions(_ptr, _num, cs_type, dbPos.data()):
+            return None
+        return np.array(dbPos, dtype=np.int32).reshape(_num[2], _num[1], _num[0]).transpose()
+
+    def GetGridDBPositions(self, CSRectGrid grid, cell_centers=True):
+        """ GetGridDBPositions(grid, cell_centers=True)
+
+        Get the database position of all cell centers (or grid points) of a
+        rectilinear grid.
+
+        :param grid: CSRectGrid -- the grid
+        :param cell_centers: bool -- use the cell centers or the grid points
+        :returns: ndarray of int -- database positions, -1 for background material, None on error
+        """
+        cdef unsigned int _num[3]
+        for n in range(3):
+            _num[n] = grid.thisptr.GetQtyLines(n) - (1 if cell_centers else 0)
+        cdef vector[int] dbPos
+        dbPos.resize(_num[0]*_num[1]*_num[2])
+        if not (<_CSPropDiscMaterial*>self.thisptr).GetDBPositions(grid.thisptr, dbPos.data(), cell_centers):
+            return None
+        return np.array(dbPos, dtype=np.int32).reshape(_num[2], _num[1], _num[0]).transpose()
+
+    def SetAlignedGrid(self, CSRectGrid grid):
+        """ SetAlignedGrid(grid)
+
+        Set a grid that coincides with the voxel mesh.
+
+        :param grid: CSRectGrid -- the grid
+        :returns: bool -- True if the grid is aligned
+        """
+        return (<_CSPropDiscMaterial*>self.thisptr).SetAlignedGrid(grid.thisptr)
+
+    def GetAlignedDBPos(self, pos, cell_center=True):
+        """ GetAlignedDBPos(pos, cell_center=True)
+
+        Get the database position of a cell (or grid line) index of the aligned grid.
+
+        :param pos: (3,) array of int -- cell or grid line index
+        :returns: int -- database position, -1 for background material
+        """
+        cdef unsigned int _pos[3]
+        for n in range(3):
+            _pos[n] = pos[n]
+        return (<_CSPropDiscMaterial*>self.thisptr).GetAlignedDBPos(_pos, cell_center)
+
+    def GetPyramidSize(self, level):
+        """ GetPyramidSize(level)
+
+        Get the number of coarse voxel of a pyramid level.
+
+        :param level: int -- pyramid level, 0 is the full resolution
+        :returns: (3,) ndarray -- number of voxel, None if the level was not built
+        """
+        cdef unsigned int _size[3]
+        if not (<_CSPropDiscMaterial*>self.thisptr).GetPyramidSize(level, _size):
+            return None
+        return np.array([_size[0], _size[1], _size[2]])
+
+    def GetPyramidDBPos(self, level, pos):
+        """ GetPyramidDBPos(level, pos)
+
+        Get the database position of a coarse voxel of a pyramid level.
+
+        :param level: int -- pyramid level
+        :param pos: (3,) array of int -- coarse voxel index
+        :returns: (int, bool) -- majority database position and if the covered voxel are mixed
+        """
+        cdef unsigned int _pos[3]
+        cdef bool mixed = False
+        for n in range(3):
+            _pos[n] = pos[n]
+        db_pos = (<_CSPropDiscMaterial*>self.thisptr).GetPyramidDBPos(level, _pos, mixed)
+        return db_pos, mixed
+
+    def CreateSurfaceModel(self, merge_quads=False, level=0, num_threads=0):
+        """ CreateSurfaceModel(merge_quads=False, level=0, num_threads=0)
+
+        Create the surface that separates the discrete material from the
+        background material.
+
+        :param merge_quads: bool -- merge coplanar neighboring faces into larger quads
+        :param level: int -- level of detail, coarse voxel of 2^level voxel per direction
+        :param num_threads: int -- number of threads, 0 for the number of cores
+        :returns: (N,3) array of point coordinates and (M,4) array of point indices per quad, counter-clockwise seen from the background
+        """
+        cdef vector[double] _coords
+        cdef vector[unsigned int] _quads
+        (<_CSPropDiscMaterial*>self.thisptr).CreateSurfaceModel(_coords, _quads, merge_quads, level, num_threads)
+        return np.array(_coords, dtype=np.double).reshape(-1, 3), np.array(_quads, dtype=int).reshape(-1, 4)
+
 ###############################################################################
 cdef class CSPropLumpedElement(CSProperties):
     """
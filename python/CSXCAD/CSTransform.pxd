@@ -29,8 +29,12 @@ cdef extern from "CSXCAD/CSTransform.h":
 
             double* Transform(double *inCoord, double *outCoord)
             double* InvertTransform(double *inCoord, double *outCoord)
+            void Transform(size_t num, double** inCoords, double** outCoords)
+            void InvertTransform(size_t num, double** inCoords, double** outCoords)
 
-            double* GetMatrix()
+            int GetMatrixType()
+
+            const double* GetMatrix()
 
             bool HasTransform()
 
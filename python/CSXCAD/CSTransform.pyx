@@ -56,12 +56,14 @@ cdef class CSTransform:
     def Transform(self, coord, invers=False):
         """ Transform(coord, invers)
 
-        Apply a transformation to the given coordinate.
+        Apply a transformation to the given coordinate or to a set of coordinates.
 
-        :param coord: (3,) array -- coordinate to transform
+        :param coord: (3,) array -- coordinate to transform, or (3,N) array -- N coordinates to transform
         :param invers: bool -- do an invers transformation
-        :returns: (3,) array -- transformed coordinates
+        :returns: (3,) or (3,N) array -- transformed coordinates
         """
+        if np.ndim(coord)==2:
+            return self._TransformArray(coord, invers)
         cdef double[3] d_coord
         cdef double[3] d_out
         for n in range(3):
@@ -76,13 +78,40 @@ cdef class CSTransform:
             out[n] = d_out[n]
         return out
 
+    def _TransformArray(self, coords, invers):
+        cdef double[:,::1] d_coords = np.array(coords, dtype=np.float64, order='C')
+        assert d_coords.shape[0]==3, 'Transform: coordinates must be a (3,N) array'
+        out = np.zeros((3, d_coords.shape[1]))
+        cdef double[:,::1] d_out = out
+        cdef size_t num = d_coords.shape[1]
+        if num==0:
+            return out
+        cdef double* p_coords[3]
+        cdef double* p_out[3]
+        for n in range(3):
+            p_coords[n] = &d_coords[n,0]
+            p_out[n] = &d_out[n,0]
+        if not invers:
+            self.thisptr.Transform(num, p_coords, p_out)
+        else:
+            self.thisptr.InvertTransform(num, p_coords, p_out)
+        return out
+
+    def GetMatrixType(self):
+        """
+        Get the type of the transformation matrix, used to select a cheaper transformation kernel.
+
+        :returns: int -- 0: identity, 1: translation, 2: scale (with optional translation), 3: general matrix
+        """
+        return self.thisptr.GetMatrixType()
+
     def GetMatrix(self):
         """
         Get the full 4x4 transformation matrix used for transformation.
 
         :returns: (4,4) array -- transformation matrix
         """
-        cdef double *d_mat = NULL
+        cdef const double *d_mat = NULL
         d_mat = self.thisptr.GetMatrix()
         mat = np.zeros([4,4])
         for n in range(4):
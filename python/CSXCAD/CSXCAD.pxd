@@ -53,6 +53,14 @@ cdef extern from "CSXCAD/ContinuousStructure.h":
 
             string Update()
 
+cdef extern from "CSXCAD/CSPrimKernelPack.h":
+    cdef cppclass _CSPrimKernelPack "CSPrimKernelPack":
+            _CSPrimKernelPack() except +
+            bool Compile(_ContinuousStructure* CSX, PropertyType prop_type)
+            size_t GetQtyPacked()
+            size_t GetQtyFallback()
+            void GetPropertiesByCoordPriority(const double* coords, size_t numCoords, _CSProperties** props, _CSPrimitives** prims)
+
 cdef class ContinuousStructure:
     cdef _ContinuousStructure *thisptr      # hold a C++ instance which we're wrapping
     cdef readonly ParameterSet __paraset
@@ -33,12 +33,13 @@ Examples
 >>> mesh.SmoothMeshLines('x', 2.5)  # smooth the mesh
 """
 
+import numpy as np
 cimport CSXCAD
 
 from CSProperties import CSPropMaterial, CSPropExcitation
 from CSProperties import CSPropMetal, CSPropConductingSheet
 from CSProperties import CSPropLumpedElement, CSPropProbeBox, CSPropDumpBox
-from CSPrimitives import CSPrimPoint, CSPrimBox, CSPrimCylinder, CSPrimCylindricalShell
+from CSPrimitives import CSPrimPoint, CSPrimBox, CSPrimMultiBox, CSPrimCylinder, CSPrimCylindricalShell
 from CSPrimitives import CSPrimSphere, CSPrimSphericalShell
 from CSPrimitives import CSPrimPolygon, CSPrimLinPoly, CSPrimRotPoly
 from CSPrimitives import CSPrimCurve, CSPrimWire
@@ -361,6 +362,39 @@ cdef class ContinuousStructure:
             prop.thisptr = _prop
             return prop
 
+    def GetPropertiesByCoordPriority(self, coords, prop_type=c_CSProperties.ANY):
+        """ GetPropertiesByCoordPriority(coords, prop_type=None)
+
+        Find the property of highest priority for many coordinates at once.
+        The analytic primitives are evaluated using a compiled kernel pack,
+        the structure has to be updated before.
+
+        :param coords: (N,3) array -- Coordinates in the coordinate input type
+        :returns: list of N properties, None if no property was found
+        """
+        coords = np.ascontiguousarray(coords, dtype=np.double).reshape(-1, 3)
+        cdef double[:, ::1] _coords = coords
+        cdef size_t num = coords.shape[0]
+        if num==0:
+            return []
+
+        cdef _CSPrimKernelPack pack
+        pack.Compile(self.thisptr, prop_type)
+        cdef vector[_CSProperties*] vprop
+        vprop.resize(num)
+        pack.GetPropertiesByCoordPriority(&_coords[0,0], num, vprop.data(), NULL)
+
+        cdef CSProperties prop
+        props = []
+        for n in range(num):
+            if vprop[n]==NULL:
+                props.append(None)
+                continue
+            prop = CSProperties.fromType(vprop[n].GetType(), pset=None, no_init=True)
+            prop.thisptr = vprop[n]
+            props.append(prop)
+        return props
+
     def GetAllPrimitives(self, sort=False, prop_type=c_CSProperties.ANY):
         """ GetAllPrimitives(sort, prop_type)
 
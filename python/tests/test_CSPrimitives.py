@@ -5,14 +5,72 @@ Created on Sun Dec 13 14:49:46 2015
 @author: thorsten
 """
 
+import os
+import shutil
+import tempfile
 import numpy as np
 
 from CSXCAD import ParameterObjects
 from CSXCAD import CSProperties
 from CSXCAD import CSPrimitives
+from CSXCAD import CSRectGrid
 
 import unittest
 
+def grid_intersections_brute_force(tri, lines):
+    """ Cut grid edges and faces of the given triangles (N,3,3) found by a per edge triangle intersection """
+    shape = [len(l) for l in lines]
+    stride = [1, shape[0], shape[0]*shape[1]]
+    edges = [set(), set(), set()]
+    faces = [set(), set(), set()]
+    for ny in range(3):
+        nyP, nyPP = (ny+1)%3, (ny+2)%3
+        # barycentric coordinates of every grid line in direction ny in the projected triangles
+        a = tri[:,1,[nyP,nyPP]] - tri[:,0,[nyP,nyPP]]
+        b = tri[:,2,[nyP,nyPP]] - tri[:,0,[nyP,nyPP]]
+        det = a[:,0]*b[:,1] - a[:,1]*b[:,0]
+        valid = np.abs(det)>1e-12
+        for i, p in enumerate(lines[nyP]):
+            for j, pp in enumerate(lines[nyPP]):
+                d = np.array([p, pp]) - tri[:,0,[nyP,nyPP]]
+                u = (d[:,0]*b[:,1] - d[:,1]*b[:,0])/np.where(valid, det, 1)
+                v = (a[:,0]*d[:,1] - a[:,1]*d[:,0])/np.where(valid, det, 1)
+                hit = valid & (u>=0) & (v>=0) & (u+v<=1)
+                for t in np.nonzero(hit)[0]:
+                    c = tri[t,0,ny] + u[t]*(tri[t,1,ny]-tri[t,0,ny]) + v[t]*(tri[t,2,ny]-tri[t,0,ny])
+                    for k in range(shape[ny]-1):
+                        if lines[ny][k]<=c<=lines[ny][k+1]:
+                            pos = [0, 0, 0]
+                            pos[ny], pos[nyP], pos[nyPP] = k, i, j
+                            edges[ny].add(int(np.dot(pos, stride)))
+    # a face is cut if one of its edges is cut or if the cut of the triangle with the face plane ends inside the face
+    for ny in range(3):
+        for idx in edges[ny]:
+            pos = [(idx//stride[n])%shape[n] for n in range(3)]
+            for m in [(ny+1)%3, (ny+2)%3]:
+                o = 3-ny-m
+                for c in [pos[o]-1, pos[o]]:
+                    if 0<=c<shape[o]-1:
+                        f = list(pos)
+                        f[o] = c
+                        faces[m].add(int(np.dot(f, stride)))
+    for ny in range(3):
+        nyP, nyPP = (ny+1)%3, (ny+2)%3
+        for k, plane in enumerate(lines[ny]):
+            for t in tri:
+                for e in range(3):
+                    p0, p1 = t[e], t[(e+1)%3]
+                    if (p0[ny]-plane)*(p1[ny]-plane)>0 or p0[ny]==p1[ny]:
+                        continue
+                    p = p0 + (plane-p0[ny])/(p1[ny]-p0[ny])*(p1-p0)
+                    for i in range(shape[nyP]-1):
+                        for j in range(shape[nyPP]-1):
+                            if lines[nyP][i]<=p[nyP]<=lines[nyP][i+1] and lines[nyPP][j]<=p[nyPP]<=lines[nyPP][j+1]:
+                                pos = [0, 0, 0]
+                                pos[ny], pos[nyP], pos[nyPP] = k, i, j
+                                faces[ny].add(int(np.dot(pos, stride)))
+    return [sorted(e) for e in edges], [sorted(f) for f in faces]
+
 class Test_CSPrimMethods(unittest.TestCase):
     def setUp(self):
         self.pset  = ParameterObjects.ParameterSet()
@@ -70,6 +128,33 @@ class Test_CSPrimMethods(unittest.TestCase):
         self.assertFalse(tr.HasTransform())
 
 
+    def test_multi_box(self):
+        # Test MultiBox with many boxes against a brute force test of all boxes
+        np.random.seed(3)
+        start = np.random.uniform(-10, 10, (2000,3))
+        stop  = start + np.random.uniform(-1, 1, (2000,3))
+        mbox = CSPrimitives.CSPrimMultiBox(self.pset, self.metal, start=start, stop=stop)
+        self.assertEqual(mbox.GetQtyBoxes(), 2000)
+        s, e = mbox.GetBox(17)
+        self.assertTrue( (s==start[17]).all() and (e==stop[17]).all() )
+        self.assertTrue(mbox.Update()[0])
+
+        bmin = np.minimum(start, stop)
+        bmax = np.maximum(start, stop)
+        pts = np.concatenate((np.random.uniform(-11, 11, (3000,3)), start[:500], stop[500:1000]))
+        for p in pts:
+            inside = np.any(np.all((bmin<=p) & (p<=bmax), axis=1))
+            self.assertEqual(mbox.IsInside(p), inside)
+
+    def test_multi_box_without_update(self):
+        # Test that the multi-box index is built again after a modification without Update()
+        mbox = CSPrimitives.CSPrimMultiBox(self.pset, self.metal)
+        mbox.AddBox([0, 0, 0], [1, 1, 1])
+        self.assertTrue (mbox.IsInside([0.5, 0.5, 0.5]))
+        self.assertFalse(mbox.IsInside([2.5, 2.5, 2.5]))
+        mbox.AddBox([2, 2, 2], [3, 3, 3])
+        self.assertTrue (mbox.IsInside([2.5, 2.5, 2.5]))
+
     def test_cylinder(self):
         # TEST Cylinder
         cyl = CSPrimitives.CSPrimCylinder(self.pset, self.metal)
@@ -144,6 +229,233 @@ class Test_CSPrimMethods(unittest.TestCase):
         sphere_shell.SetShellWidth(1.5)
         self.assertTrue( sphere_shell.GetShellWidth()==1.5 )
 
+    def test_inside_kernels(self):
+        # Test IsInside of the analytic primitives for Cartesian and cylindrical input, with and without transformation
+        def seg_dist(p, a, b):
+            d = b-a
+            foot = np.dot(p-a, d)/np.dot(d, d)
+            return foot, np.linalg.norm(a + foot*d - p)
+        def in_cyl(p, a, b, rad):
+            foot, dist = seg_dist(p, a, b)
+            return (0<=foot<=1) and dist<=rad
+        def in_cyl_box(p, start, stop):
+            r, a = np.hypot(p[0], p[1]), np.arctan2(p[1], p[0])
+            c = np.array([r, a, p[2]])
+            return np.all((np.minimum(start, stop)<=c) & (c<=np.maximum(start, stop)))
+
+        c  = np.array([0.2, -0.3, 0.1])
+        p0 = np.array([-1.0, 0.5, -1.2])
+        p1 = np.array([1.2, -0.4, 1.0])
+        cases = [
+            (lambda: CSPrimitives.CSPrimBox(self.pset, self.metal, start=[-1,-0.5,-1], stop=[1.5,1,0.8]),
+             lambda p: np.all((np.array([-1,-0.5,-1])<=p) & (p<=np.array([1.5,1,0.8])))),
+            (lambda: CSPrimitives.CSPrimBox(self.pset, self.metal, start=[0.5,-1,-1], stop=[2,2,1]),
+             lambda p: in_cyl_box(p, np.array([0.5,-1,-1]), np.array([2,2,1]))),
+            (lambda: CSPrimitives.CSPrimSphere(self.pset, self.metal, center=c, radius=1.3),
+             lambda p: np.linalg.norm(p-c)<=1.3),
+            (lambda: CSPrimitives.CSPrimSphericalShell(self.pset, self.metal, center=c, radius=1.3, shell_width=0.6),
+             lambda p: abs(np.linalg.norm(p-c)-1.3)<=0.3),
+            (lambda: CSPrimitives.CSPrimCylinder(self.pset, self.metal, start=p0, stop=p1, radius=0.8),
+             lambda p: in_cyl(p, p0, p1, 0.8)),
+            (lambda: CSPrimitives.CSPrimCylindricalShell(self.pset, self.metal, start=p0, stop=p1, radius=0.8, shell_width=0.4),
+             lambda p: in_cyl(p, p0, p1, 1.0) and not in_cyl(p, p0, p1, 0.6)),
+            ]
+
+        ang   = np.deg2rad(40)
+        shift = np.array([0.3, -0.2, 0.5])
+        R = np.array([[np.cos(ang), -np.sin(ang), 0], [np.sin(ang), np.cos(ang), 0], [0, 0, 1]])
+        np.random.seed(5)
+        pts = np.random.uniform(-2.5, 2.5, (500,3))
+        for n, (create, ref) in enumerate(cases):
+            for transformed in [False, True]:
+                for cyl_input in [False, True]:
+                    prim = create()
+                    if n==1:
+                        prim.SetCoordinateSystem(1)
+                    else:
+                        prim.SetCoordinateSystem(0)
+                    if cyl_input:
+                        prim.SetCoordInputType(1)
+                    if transformed:
+                        prim.AddTransform('RotateAxis', 'z', 40)
+                        prim.AddTransform('Translate', shift)
+                    self.assertTrue(prim.Update()[0])
+                    inside = 0
+                    for p in pts:
+                        if cyl_input:
+                            coord = [np.hypot(p[0], p[1]), np.arctan2(p[1], p[0]), p[2]]
+                        else:
+                            coord = p
+                        local = np.dot(R.transpose(), p-shift) if transformed else p
+                        self.assertEqual(prim.IsInside(coord), ref(local), msg='case {} {} {}'.format(n, transformed, cyl_input))
+                        inside += prim.IsInside(coord)
+                    self.assertTrue(inside>0)
+
+    def test_world_bound_box(self):
+        # The world bounding box must contain all inside points of the transformed primitive
+        def check_box(prim, pts, msg):
+            bb = prim.GetWorldBoundBox()
+            self.assertIsNotNone(bb, msg=msg)
+            for p in pts:
+                self.assertTrue(np.all((bb[0]-1e-9<=p) & (p<=bb[1]+1e-9)), msg=msg)
+                # a small box around an inside point must not be culled
+                self.assertGreaterEqual(prim.IsInsideBox([p-1e-3, p+1e-3]), 0, msg=msg)
+            far = bb[1] + 1
+            self.assertEqual(prim.IsInsideBox([far, far+1]), -1, msg=msg)
+            return bb
+
+        def sample_inside(prim, num=20000, size=3):
+            pts = np.random.uniform(-size, size, (num,3))
+            return [p for p in pts if prim.IsInside(p)]
+
+        np.random.seed(7)
+        p0 = np.array([-1.0, 0.5, -1.2])
+        p1 = np.array([1.2, -0.4, 1.0])
+        creators = [
+            lambda: CSPrimitives.CSPrimBox(self.pset, self.metal, start=[-1,-0.5,-1], stop=[1.5,1,0.8]),
+            lambda: CSPrimitives.CSPrimBox(self.pset, self.metal, start=[0.5,-1,-1], stop=[2,2,1]),
+            lambda: CSPrimitives.CSPrimSphere(self.pset, self.metal, center=[0.2,-0.3,0.1], radius=1.3),
+            lambda: CSPrimitives.CSPrimCylinder(self.pset, self.metal, start=p0, stop=p1, radius=0.8),
+            ]
+        for n, create in enumerate(creators):
+            for transformed in [False, True]:
+                prim = create()
+                prim.SetCoordinateSystem(1 if n==1 else 0)
+                if transformed:
+                    prim.AddTransform('Scale', [1.2, 0.7, 1.5])
+                    prim.AddTransform('RotateAxis', 'x', 25)
+                    prim.AddTransform('RotateAxis', 'z', 40)
+                    prim.AddTransform('Translate', [0.3, -0.2, 0.5])
+                self.assertTrue(prim.Update()[0])
+                pts = sample_inside(prim)
+                self.assertTrue(len(pts)>100)
+                check_box(prim, pts, 'case {} {}'.format(n, transformed))
+
+        # cylindrical boxes (sectors) without transformation, the box must be tight
+        for start, stop in [([0.5,-1,-1], [2,2,1]), ([0,0.3,0], [1,1.2,1]), ([1,-3,0], [2,-2,1]),
+                            ([0.2,2.5,0], [1.5,4.0,1]), ([0.5,-4,0], [1,3,1])]:
+            prim = CSPrimitives.CSPrimBox(self.pset, self.metal, start=start, stop=stop)
+            prim.SetCoordinateSystem(1)
+            self.assertTrue(prim.Update()[0])
+            r = np.random.uniform(start[0], stop[0], 20000)
+            a = np.random.uniform(start[1], stop[1], 20000)
+            z = np.random.uniform(start[2], stop[2], 20000)
+            pts = np.array([r*np.cos(a), r*np.sin(a), z]).transpose()
+            bb = check_box(prim, pts, 'sector {} {}'.format(start, stop))
+            self.assertTrue(np.all(np.abs(bb[0]-pts.min(axis=0))<0.05))
+            self.assertTrue(np.all(np.abs(bb[1]-pts.max(axis=0))<0.05))
+
+            # the box for IsInsideBox is given in the cylindrical input type
+            prim.SetCoordInputType(1)
+            for p in pts[:50]:
+                c = np.array([np.hypot(p[0], p[1]), np.arctan2(p[1], p[0]), p[2]])
+                self.assertGreaterEqual(prim.IsInsideBox([c-1e-3, c+1e-3]), 0)
+            self.assertEqual(prim.IsInsideBox([[5,-1,0], [6,1,1]]), -1)
+
+        # polyhedron, all transformed vertices must be inside the world box
+        ph = CSPrimitives.CSPrimPolyhedronReader(self.pset, self.metal)
+        ph.SetFilename('sphere.stl')
+        self.assertTrue(ph.ReadFile())
+        ph.AddTransform('Scale', [1.2, 0.7, 1.5])
+        ph.AddTransform('RotateAxis', 'z', 40)
+        ph.AddTransform('Translate', [0.3, -0.2, 0.5])
+        self.assertTrue(ph.Update()[0])
+        tr = ph.GetTransform()
+        pts = [tr.Transform(ph.GetVertex(n)) for n in range(ph.GetNumVertices())]
+        pts += sample_inside(ph, size=1.5)
+        check_box(ph, pts, 'polyhedron')
+
+    def test_group(self):
+        # Test a group against hand transformed copies of its children
+        def create_children():
+            box = CSPrimitives.CSPrimBox(self.pset, self.metal, start=[-1,-0.5,-0.2], stop=[0.5,1,0.4])
+            box.AddTransform('RotateAxis', 'x', 20)
+            sphere = CSPrimitives.CSPrimSphere(self.pset, self.metal, center=[1.2,0.3,0.1], radius=0.6)
+            return [box, sphere]
+        def add_group_transform(prim, ang, shift):
+            prim.AddTransform('RotateAxis', 'z', ang)
+            prim.AddTransform('Translate', shift)
+
+        group = CSPrimitives.CSPrimGroup(self.pset, self.metal, children=create_children())
+        self.assertEqual(group.GetType(), 15)
+        self.assertEqual(group.GetTypeName(), 'Group')
+        self.assertEqual(group.GetQtyChildren(), 2)
+        self.assertEqual(group.GetChild(1).GetTypeName(), 'Sphere')
+        self.assertIsNone(group.GetChild(2))
+        self.assertEqual(self.metal.GetQtyPrimitives(), 1)
+
+        # a second instance sharing the children with its own transformation
+        inst = group.GetCopy()
+        self.assertEqual(inst.GetTypeName(), 'Group')
+        self.assertEqual(group.GetQtyInstances(), 2)
+        self.assertEqual(inst.GetQtyChildren(), 2)
+        add_group_transform(group, 30, [0.5,-0.2,0.3])
+        add_group_transform(inst, -50, [-1,1,0])
+
+        refs = []
+        for ang, shift in [(30, [0.5,-0.2,0.3]), (-50, [-1,1,0])]:
+            children = create_children()
+            for child in children:
+                add_group_transform(child, ang, shift)
+                self.assertTrue(child.Update()[0])
+            refs.append(children)
+
+        self.assertTrue(group.Update()[0])
+        self.assertTrue(inst.Update()[0])
+        np.random.seed(2)
+        pts = np.random.uniform(-3, 3, (10000,3))
+        for prim, ref in zip([group, inst], refs):
+            inside = []
+            for p in pts:
+                self.assertEqual(prim.IsInside(p), any(r.IsInside(p) for r in ref))
+                if prim.IsInside(p):
+                    inside.append(p)
+            self.assertTrue(len(inside)>50)
+            # culling by the world box of each instance
+            bb = prim.GetWorldBoundBox()
+            for p in inside:
+                self.assertTrue(np.all((bb[0]<=p) & (p<=bb[1])))
+                self.assertGreaterEqual(prim.IsInsideBox([p-1e-3, p+1e-3]), 0)
+            self.assertFalse(prim.IsInside(bb[1]+0.1))
+            self.assertEqual(prim.IsInsideBox([bb[1]+0.1, bb[1]+1]), -1)
+
+        # a group must not contain an instance of itself
+        self.assertFalse(group.AddChild(group))
+        self.assertFalse(group.AddChild(inst))
+        self.assertFalse(group.AddChild(group.GetCopy()))
+        self.assertFalse(group.AddChild(group.GetChild(0)))
+        outer = CSPrimitives.CSPrimGroup(self.pset, self.metal)
+        self.assertTrue(outer.AddChild(group.GetCopy()))
+        self.assertFalse(group.AddChild(outer))
+        self.assertEqual(group.GetQtyChildren(), 2)
+
+        # changes of the shared children are seen by all instances after their update
+        c = np.array([0,-3,0])
+        w = [group.GetTransform().Transform(c), inst.GetTransform().Transform(c)]
+        self.assertFalse(group.IsInside(w[0]) or inst.IsInside(w[1]))
+        self.assertTrue(group.AddChild(CSPrimitives.CSPrimSphere(self.pset, self.metal, center=c, radius=0.2)))
+        self.assertEqual(inst.GetQtyChildren(), 3)
+        self.assertTrue(group.Update()[0])
+        self.assertTrue(inst.Update()[0])
+        self.assertTrue(group.IsInside(w[0]) and inst.IsInside(w[1]))
+
+        # the children are updated once per update pass, by the first instance updated a second time
+        sphere = group.GetChild(2)
+        for n, first in enumerate([group, inst, inst]):
+            shift = np.array([0,0,n+1])
+            sphere.SetCenter(c+shift)
+            self.assertTrue(first.Update()[0])
+            self.assertTrue((group if first is inst else inst).Update()[0])
+            for prim, p in zip([group, inst], w):
+                self.assertFalse(prim.IsInside(p+shift-[0,0,1]))
+                self.assertTrue(prim.IsInside(p+shift))
+
+        group.DeleteChild(2)
+        self.assertEqual(inst.GetQtyChildren(), 2)
+        self.assertTrue(group.Update()[0])
+        self.assertTrue(inst.Update()[0])
+        self.assertFalse(group.IsInside(w[0]+[0,0,3]) or inst.IsInside(w[1]+[0,0,3]))
+
     def test_polygon(self):
         # Test polygon
         poly = CSPrimitives.CSPrimPolygon(self.pset, self.metal)
@@ -164,6 +476,49 @@ class Test_CSPrimMethods(unittest.TestCase):
         poly.SetElevation(0.123)
         self.assertTrue( poly.GetElevation()==0.123 )
 
+    def test_polygon_mask(self):
+        # Test the grid mask of a polygon and lin-polygon against IsInside
+        ang = np.linspace(0, 2*np.pi, 11)[:-1]
+        rad = np.where(np.arange(10)%2, 1.0, 2.5)
+        x0  = rad*np.cos(ang)
+        x1  = rad*np.sin(ang)
+        # some grid nodes are placed on polygon edges and vertices
+        lines = [np.linspace(-3, 3, 25), np.linspace(-3, 3, 31), np.linspace(-1, 2, 13)]
+
+        poly    = CSPrimitives.CSPrimPolygon(self.pset, self.metal, points=[x0, x1], norm_dir='z', elevation=0.5)
+        linpoly = CSPrimitives.CSPrimLinPoly(self.pset, self.metal, points=[x0, x1], norm_dir='y', elevation=-0.5, length=1.0)
+        for prim in [poly, linpoly]:
+            self.assertTrue(prim.Update()[0])
+            mask = prim.GetInsideMask(lines)
+            self.assertEqual(mask.shape, (25, 31, 13))
+            self.assertTrue(mask.any())
+            for i, x in enumerate(lines[0]):
+                for j, y in enumerate(lines[1]):
+                    for k, z in enumerate(lines[2]):
+                        self.assertEqual(mask[i,j,k], prim.IsInside([x, y, z]))
+
+    def test_polygon_without_update(self):
+        # Test that polygons are evaluated again after a modification without Update()
+        poly = CSPrimitives.CSPrimPolygon(self.pset, self.metal)
+        poly.SetNormDir(2)
+        poly.SetCoords([0, 1, 1, 0], [0, 0, 1, 1])
+        self.assertTrue (poly.IsInside([0.5, 0.5, 0]))
+        self.assertFalse(poly.IsInside([1.5, 0.5, 0]))
+        poly.SetCoords([0, 2, 2, 0], [0, 0, 1, 1])
+        self.assertTrue (poly.IsInside([1.5, 0.5, 0]))
+        poly.SetElevation(1)
+        self.assertFalse(poly.IsInside([1.5, 0.5, 0]))
+        self.assertTrue (poly.IsInside([1.5, 0.5, 1]))
+
+        linpoly = CSPrimitives.CSPrimLinPoly(self.pset, self.metal)
+        linpoly.SetNormDir(2)
+        linpoly.SetCoords([0, 1, 1, 0], [0, 0, 1, 1])
+        linpoly.SetLength(1)
+        self.assertTrue (linpoly.IsInside([0.5, 0.5, 0.5]))
+        self.assertFalse(linpoly.IsInside([0.5, 0.5, 1.5]))
+        linpoly.SetLength(2)
+        self.assertTrue (linpoly.IsInside([0.5, 0.5, 1.5]))
+
     def test_lin_poly(self):
         # Test Lin-Polygon
         linpoly = CSPrimitives.CSPrimLinPoly(self.pset, self.metal)
@@ -210,6 +565,41 @@ class Test_CSPrimMethods(unittest.TestCase):
         rotpoly.SetAngle(0, 2*np.pi)
         self.assertTrue( (rotpoly.GetAngle() == np.array([0, 2*np.pi])).all() )
 
+    def test_rot_poly_inside(self):
+        # Test Rot-Polygon against a point in polygon test of its profile and the cylindrical grid mask against IsInside
+        def point_in_polygon(px, py, x, y):
+            inside = False
+            for i in range(len(x)):
+                j = i-1
+                if (y[i]>py) != (y[j]>py) and px < x[i] + (py-y[i])*(x[j]-x[i])/(y[j]-y[i]):
+                    inside = not inside
+            return inside
+
+        # profile in the z-x plane (normal direction y), rotated around the z-axis
+        z = np.array([-1.0, 1.0, 1.0, 0.0, -1.0])
+        r = np.array([ 0.5, 0.5, 2.0, 1.2,  2.0])
+        rotpoly = CSPrimitives.CSPrimRotPoly(self.pset, self.metal, points=[z, r], norm_dir='y', rot_axis='z', angle=[0, 1.5*np.pi])
+        self.assertTrue(rotpoly.Update()[0])
+
+        np.random.seed(1)
+        for p in np.random.uniform([-2.5,-2.5,-1.5], [2.5,2.5,1.5], (2000,3)):
+            a = np.arctan2(p[1], p[0]) % (2*np.pi)
+            inside = (a<=1.5*np.pi) and point_in_polygon(p[2], np.hypot(p[0], p[1]), z, r)
+            self.assertEqual(rotpoly.IsInside(p), inside)
+
+        # the profile is defined in Cartesian coordinates, the grid is cylindrical
+        rotpoly.SetCoordinateSystem(0)
+        rotpoly.SetCoordInputType(1)
+        self.assertTrue(rotpoly.Update()[0])
+        lines = [np.linspace(0, 2.5, 26), np.linspace(-np.pi, np.pi, 37), np.linspace(-1.5, 1.5, 31)]
+        mask = rotpoly.GetInsideMask(lines)
+        self.assertEqual(mask.shape, (26, 37, 31))
+        self.assertTrue(mask.any())
+        for i, r in enumerate(lines[0]):
+            for j, a in enumerate(lines[1]):
+                for k, z in enumerate(lines[2]):
+                    self.assertEqual(mask[i,j,k], rotpoly.IsInside([r, a, z]))
+
     def test_curve(self):
         # Test Curve
         x = np.array([0, 0, 1, 1]) + 1.5
@@ -259,6 +649,37 @@ class Test_CSPrimMethods(unittest.TestCase):
         self.assertTrue( ph.GetNumFaces()==1 )
         self.assertTrue( (ph.GetFace(0)==np.array([0,1,2])).all() )
 
+    def test_wire_inside(self):
+        # Test Wire with many points (helix) against the distance to all segments
+        t = np.linspace(0, 10*np.pi, 1001)
+        x = 2*np.cos(t)
+        y = 2*np.sin(t)
+        z = 0.1*t
+        wire = CSPrimitives.CSPrimWire(self.pset, self.metal, radius=0.3)
+        wire.SetPoints(x, y, z)
+        self.assertTrue(wire.Update()[0])
+
+        P0 = np.array([x[:-1], y[:-1], z[:-1]]).transpose()
+        D  = np.array([x[1:], y[1:], z[1:]]).transpose() - P0
+        np.random.seed(2)
+        for p in np.random.uniform([-2.5,-2.5,-0.5], [2.5,2.5,3.7], (2000,3)):
+            foot = np.clip(np.sum((p-P0)*D, axis=1)/np.sum(D*D, axis=1), 0, 1)
+            dist = np.min(np.linalg.norm(P0 + foot[:,None]*D - p, axis=1))
+            if abs(dist-0.3)<1e-9:
+                continue
+            self.assertEqual(wire.IsInside(p), dist<0.3)
+
+    def test_wire_without_update(self):
+        # Test that wires are evaluated again after a modification without Update()
+        wire = CSPrimitives.CSPrimWire(self.pset, self.metal, radius=0.2)
+        wire.SetPoints([0, 1], [0, 0], [0, 0])
+        self.assertTrue (wire.IsInside([0.5, 0.1, 0]))
+        self.assertFalse(wire.IsInside([1.5, 0, 0]))
+        wire.AddPoint([2, 0, 0])
+        self.assertTrue (wire.IsInside([1.5, 0, 0]))
+        wire.SetWireRadius(0.05)
+        self.assertFalse(wire.IsInside([0.5, 0.1, 0]))
+
     def test_polyhedron(self):
         ## Test CSPrimPolyhedron
         ph = CSPrimitives.CSPrimPolyhedron(self.pset, self.metal)
@@ -298,5 +719,201 @@ class Test_CSPrimMethods(unittest.TestCase):
         self.assertEqual(phr.GetNumVertices(), 50)
         self.assertEqual(phr.GetNumFaces(), 96)
 
+    def test_polyhedron_reader_formats(self):
+        ## Test the binary and ASCII STL and the PLY reader against the triangles of the binary STL file
+        data = open('sphere.stl', 'rb').read()
+        num_tri = int(np.frombuffer(data, dtype='<u4', count=1, offset=80)[0])
+        stl_tri = np.dtype([('normal', '<f4', 3), ('vertex', '<f4', (3,3)), ('attr', '<u2')])
+        tri = np.frombuffer(data, dtype=stl_tri, count=num_tri, offset=84)['vertex']
+        ref_vertices = np.unique(tri.reshape(-1,3), axis=0)
+
+        tmp_dir = tempfile.mkdtemp()
+        ascii_fn = os.path.join(tmp_dir, 'sphere_ascii.stl')
+        with open(ascii_fn, 'w') as f:
+            f.write('solid sphere\n')
+            for t in tri:
+                f.write('facet normal 0 0 0\nouter loop\n')
+                for v in t:
+                    f.write('vertex {!r} {!r} {!r}\n'.format(float(v[0]), float(v[1]), float(v[2])))
+                f.write('endloop\nendfacet\n')
+            f.write('endsolid sphere\n')
+
+        for fn in ['sphere.stl', ascii_fn, 'sphere.ply']:
+            phr = CSPrimitives.CSPrimPolyhedronReader(self.pset, self.metal, filename=fn)
+            self.assertTrue( phr.ReadFile() )
+            self.assertEqual(phr.GetNumFaces(), num_tri)
+            vertices = np.array([phr.GetVertex(n) for n in range(phr.GetNumVertices())])
+            self.assertEqual(len(vertices), len(ref_vertices))
+            self.assertTrue( (np.unique(vertices, axis=0)==ref_vertices).all() )
+        shutil.rmtree(tmp_dir)
+
+    def test_polyhedron_mesh_sharing(self):
+        ## Test the mesh sharing of copies and of readers of the same file and the copy-on-write of a shared mesh
+        data = open('sphere.stl', 'rb').read()
+        num_tri = int(np.frombuffer(data, dtype='<u4', count=1, offset=80)[0])
+        stl_tri = np.dtype([('normal', '<f4', 3), ('vertex', '<f4', (3,3)), ('attr', '<u2')])
+
+        tmp_dir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, tmp_dir)
+        fn = os.path.join(tmp_dir, 'sphere.stl')
+        link_fn = os.path.join(tmp_dir, 'sphere_link.stl')
+        with open(fn, 'wb') as f:
+            f.write(data)
+        os.symlink(fn, link_fn)
+
+        phr = CSPrimitives.CSPrimPolyhedronReader(self.pset, self.metal, filename=fn)
+        self.assertTrue( phr.ReadFile() )
+        self.assertEqual(phr.GetMeshUseCount(), 1)
+        # the same file under another name shares the mesh
+        phr_link = CSPrimitives.CSPrimPolyhedronReader(self.pset, self.metal, filename=link_fn)
+        self.assertTrue( phr_link.ReadFile() )
+        self.assertEqual(phr.GetMeshUseCount(), 2)
+        self.assertEqual(phr_link.GetNumFaces(), num_tri)
+
+        phr_copy = phr.GetCopy()
+        self.assertEqual(phr_copy.GetType(), phr.GetType())
+        self.assertEqual(phr.GetMeshUseCount(), 3)
+
+        ph = CSPrimitives.CSPrimPolyhedron(self.pset, self.metal)
+        ph.ShareMesh(phr)
+        self.assertEqual(phr.GetMeshUseCount(), 4)
+        self.assertEqual(ph.GetNumFaces(), num_tri)
+        self.assertTrue( (ph.GetVertex(0)==phr.GetVertex(0)).all() )
+
+        # modifying a shared mesh detaches a private copy
+        num_vert = phr.GetNumVertices()
+        ph.AddVertex(10, 10, 10)
+        self.assertEqual(ph.GetMeshUseCount(), 1)
+        self.assertEqual(phr.GetMeshUseCount(), 3)
+        self.assertEqual(ph.GetNumVertices(), num_vert+1)
+        self.assertEqual(ph.GetNumFaces(), num_tri)
+        self.assertEqual(phr.GetNumVertices(), num_vert)
+        self.assertEqual(phr_copy.GetNumVertices(), num_vert)
+
+        # a rewritten file of the same size must not share the old mesh
+        tri = np.frombuffer(data, dtype=stl_tri, count=num_tri, offset=84).copy()
+        tri['vertex'] *= 2
+        with open(fn, 'r+b') as f:
+            f.seek(84)
+            f.write(tri.tobytes())
+        self.assertEqual(os.path.getsize(fn), len(data))
+        phr_new = CSPrimitives.CSPrimPolyhedronReader(self.pset, self.metal, filename=fn)
+        self.assertTrue( phr_new.ReadFile() )
+        self.assertEqual(phr_new.GetMeshUseCount(), 1)
+        self.assertEqual(phr.GetMeshUseCount(), 3)
+        vertices = np.array([phr_new.GetVertex(n) for n in range(phr_new.GetNumVertices())])
+        old_vertices = np.array([phr.GetVertex(n) for n in range(phr.GetNumVertices())])
+        self.assertTrue( (np.unique(vertices, axis=0)==2*np.unique(old_vertices, axis=0)).all() )
+
+    def test_polyhedron_reader_cache(self):
+        ## Test the mesh cache: cache hit for an unchanged copy, rejection of a corrupt cache file and invalidation after a change
+        data = open('sphere.stl', 'rb').read()
+        num_tri = int(np.frombuffer(data, dtype='<u4', count=1, offset=80)[0])
+        stl_tri = np.dtype([('normal', '<f4', 3), ('vertex', '<f4', (3,3)), ('attr', '<u2')])
+
+        tmp_dir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, tmp_dir)
+        cache_dir = os.path.join(tmp_dir, 'cache')
+        os.mkdir(cache_dir)
+        CSPrimitives.CSPrimPolyhedronReader.SetCacheDirectory(cache_dir)
+        self.addCleanup(CSPrimitives.CSPrimPolyhedronReader.SetCacheDirectory, '')
+        self.assertEqual(CSPrimitives.CSPrimPolyhedronReader.GetCacheDirectory(), cache_dir)
+
+        def read(fn):
+            phr = CSPrimitives.CSPrimPolyhedronReader(self.pset, self.metal, filename=fn)
+            self.assertTrue( phr.ReadFile() )
+            self.assertEqual(phr.GetNumFaces(), num_tri)
+            return phr, np.array([phr.GetVertex(n) for n in range(phr.GetNumVertices())])
+
+        # every copy has its own inode and is read from the cache, not shared by the file identity
+        fn = os.path.join(tmp_dir, 'sphere.stl')
+        with open(fn, 'wb') as f:
+            f.write(data)
+        def copy(name):
+            copy_fn = os.path.join(tmp_dir, name)
+            shutil.copy2(fn, copy_fn)
+            return copy_fn
+
+        phr, ref_vertices = read(fn)
+        cache_files = os.listdir(cache_dir)
+        self.assertEqual(len(cache_files), 1)
+        cache_fn = os.path.join(cache_dir, cache_files[0])
+        cache_data = open(cache_fn, 'rb').read()
+
+        # cache hit, mark the first cached vertex to detect its use
+        header_size = len(cache_data) - 12*len(ref_vertices) - 12*num_tri
+        with open(cache_fn, 'r+b') as f:
+            f.seek(header_size)
+            f.write(np.array([100], '<f4').tobytes())
+        phr_hit, vertices = read(copy('sphere_hit.stl'))
+        self.assertEqual(vertices[0,0], 100)
+        self.assertTrue( (vertices[1:]==ref_vertices[1:]).all() )
+        # the cached mesh is copied on modification
+        phr_hit.AddVertex(1, 2, 3)
+        self.assertEqual(phr_hit.GetNumVertices(), len(ref_vertices)+1)
+        self.assertEqual(phr_hit.GetVertex(0)[0], 100)
+
+        # a corrupt cache file is ignored and replaced
+        with open(cache_fn, 'wb') as f:
+            f.write(cache_data[:len(cache_data)//2])
+        phr, vertices = read(copy('sphere_corrupt.stl'))
+        self.assertTrue( (vertices==ref_vertices).all() )
+        self.assertEqual(open(cache_fn, 'rb').read(), cache_data)
+
+        # a changed file of the same size and modification time is parsed again
+        st = os.stat(fn)
+        tri = np.frombuffer(data, dtype=stl_tri, count=num_tri, offset=84).copy()
+        tri['vertex'] *= 2
+        with open(fn, 'r+b') as f:
+            f.seek(84)
+            f.write(tri.tobytes())
+        os.utime(fn, ns=(st.st_atime_ns, st.st_mtime_ns))
+        phr, vertices = read(copy('sphere_changed.stl'))
+        self.assertTrue( (vertices==2*ref_vertices).all() )
+        self.assertEqual(len(os.listdir(cache_dir)), 2)
+
+    def test_polyhedron_grid_intersections(self):
+        ## Test the cut grid edges and faces of an open sheet and of a transformed closed mesh against a brute force search
+        grid = CSRectGrid.CSRectGrid()
+        lines = [np.linspace(-1.21, 1.13, 9), np.linspace(-1.17, 1.09, 8), np.linspace(-0.61, 0.73, 7)]
+        for n in range(3):
+            grid.SetLines('xyz'[n], lines[n])
+
+        # open sheet, a bumpy surface of 4x4 quads
+        sheet = CSPrimitives.CSPrimPolyhedron(self.pset, self.metal)
+        X, Y = np.meshgrid(np.linspace(-1, 1, 5), np.linspace(-0.9, 0.95, 5), indexing='ij')
+        Z = 0.3*np.sin(2*X)*np.cos(1.5*Y) + 0.05
+        for x, y, z in zip(X.ravel(), Y.ravel(), Z.ravel()):
+            sheet.AddVertex(x, y, z)
+        for i in range(4):
+            for j in range(4):
+                n = 5*i+j
+                sheet.AddFace([n, n+5, n+1])
+                sheet.AddFace([n+1, n+5, n+6])
+        self.assertTrue(sheet.Update()[0])
+
+        sphere = CSPrimitives.CSPrimPolyhedronReader(self.pset, self.metal, filename='sphere.stl')
+        self.assertTrue( sphere.ReadFile() )
+        sphere.AddTransform('RotateAxis', 'z', 30)
+        sphere.AddTransform('Translate', [0.11, -0.07, 0.05])
+        self.assertTrue(sphere.Update()[0])
+        ang = np.deg2rad(30)
+        R = np.array([[np.cos(ang), -np.sin(ang), 0], [np.sin(ang), np.cos(ang), 0], [0, 0, 1]])
+
+        for prim, transform in [(sheet, lambda p: p), (sphere, lambda p: np.dot(p, R.transpose()) + [0.11, -0.07, 0.05])]:
+            vertices = np.array([prim.GetVertex(n) for n in range(prim.GetNumVertices())], dtype=np.float64)
+            vertices = transform(vertices)
+            tri = np.array([vertices[prim.GetFace(n)] for n in range(prim.GetNumFaces())])
+            ref_edges, ref_faces = grid_intersections_brute_force(tri, lines)
+            edges, faces = prim.GetGridIntersections(grid)
+            for n in range(3):
+                self.assertTrue(len(ref_edges[n])>0)
+                self.assertEqual(list(edges[n]), ref_edges[n])
+                self.assertEqual(list(faces[n]), ref_faces[n])
+
+        # only cartesian grids are supported
+        grid.SetMeshType(1)
+        self.assertIsNone(sheet.GetGridIntersections(grid))
+
 if __name__ == '__main__':
     unittest.main()
@@ -5,10 +5,18 @@ Created on Thu Dec 10 21:47:29 2015
 @author: thorsten
 """
 
+import os
+import itertools
+import shutil
+import tempfile
 import numpy as np
+try:
+    import h5py
+except ImportError:
+    h5py = None
 
 from CSXCAD import ParameterObjects
-from CSXCAD import CSProperties, CSPrimitives
+from CSXCAD import CSProperties, CSPrimitives, CSRectGrid
 
 import unittest
 
@@ -75,6 +83,44 @@ class Test_CSPrimMethods(unittest.TestCase):
         self.assertFalse( prop.GetIsotropy(),False)
         self.assertTrue( (prop.GetMaterialProperty('epsilon')==[1.0, 2.0, 3.0]).all())
 
+    def check_weighted_values(self, prop, pts):
+        # the single and the batch lookup have to match the individual weighted getters
+        names = ['epsilon', 'mue', 'kappa', 'sigma', 'density']
+        batch = prop.GetWeightedValues(pts)
+        for name in names:
+            self.assertEqual(np.shape(batch[name]), (len(pts),3) if name!='density' else (len(pts),))
+        for i, p in enumerate(pts):
+            single = prop.GetWeightedValues(p)
+            for name in names:
+                ref = prop.GetWeightedMaterialProperty(name, p)
+                self.assertTrue(np.all(single[name]==ref), msg='{} {}'.format(name, p))
+                self.assertTrue(np.all(batch[name][i]==ref), msg='{} {}'.format(name, p))
+        return batch
+
+    def test_material_weighted_values(self):
+        prop = CSProperties.CSPropMaterial(self.pset, epsilon=[1.0, 2.0, 3.0], mue=[2.0, 3.0, 4.0],
+                                           kappa=[0.1, 0.2, 0.3], sigma=[0.4, 0.5, 0.6], density=5.0)
+        prop.SetIsotropy(False)
+        prop.SetMaterialWeight(epsilon=['0.5', '2', '3'], kappa=['2', '1', '0'], density='0.5')
+        np.random.seed(8)
+        pts = np.random.uniform(-2, 2, (50,3))
+        batch = self.check_weighted_values(prop, pts)
+        self.assertTrue(np.all(batch['epsilon']==[0.5, 4.0, 9.0]))
+        self.assertTrue(np.all(batch['mue']==[2.0, 3.0, 4.0]))
+        self.assertTrue(np.allclose(batch['kappa'], [0.2, 0.2, 0.0]))
+        self.assertTrue(np.all(batch['sigma']==[0.4, 0.5, 0.6]))
+        self.assertTrue(np.all(batch['density']==2.5))
+
+        # coordinate dependent weights per direction
+        prop.SetMaterialWeight(epsilon=['1+x*x', 'cos(y)', 'z*z'], mue=['2', 'x+y', 'exp(z)'], sigma=['y', '1', 'x*z'], density='1+x')
+        self.check_weighted_values(prop, pts)
+
+        # an isotropic material uses the first direction only
+        prop.SetIsotropy(True)
+        batch = self.check_weighted_values(prop, pts)
+        for name in ['epsilon', 'mue', 'kappa', 'sigma']:
+            self.assertTrue(np.all(batch[name]==batch[name][:,:1]))
+
     def test_lumped_elem(self):
         prop = CSProperties.CSPropLumpedElement(self.pset, R = 50, C=1e-12, caps=True, ny='x')
 
@@ -136,5 +182,396 @@ class Test_CSPrimMethods(unittest.TestCase):
         self.assertEqual( prop.GetType(), CSProperties.DUMPBOX)
         self.assertEqual( prop.GetTypeString(), 'DumpBox')
 
+    def write_disc_material(self, attrs=['epsR', 'kappa', 'mueR', 'sigma', 'density'], dtype=np.uint8, layout=None):
+        # write a discrete material file with a non-uniform y-mesh, uniform blocks and noise
+        tmp_dir = tempfile.mkdtemp()
+        self.addCleanup(shutil.rmtree, tmp_dir)
+        fn = os.path.join(tmp_dir, 'disc_material.h5')
+        if layout is None:
+            layout = dict(chunks=(8,8,8), compression='gzip')
+
+        np.random.seed(6)
+        mesh = [np.linspace(0, 4.5, 46).astype(np.float32),
+                np.concatenate(([0], np.cumsum(np.random.uniform(0.05, 0.15, 38)))).astype(np.float32),
+                np.linspace(-1, 2.3, 34).astype(np.float32)]
+        z, y, x = np.meshgrid(range(33), range(38), range(45), indexing='ij')
+        data = ((x//7 + y//5 + z//6) % 4).astype(np.uint8)
+        data[:16,:16,:16] = 2
+        noise = np.random.rand(*data.shape)<0.05
+        data[noise] = np.random.randint(0, 5, np.count_nonzero(noise))
+
+        with h5py.File(fn, 'w') as h5:
+            h5.attrs['Version'] = 2.0
+            ds = h5.create_dataset('DiscData', data=data.astype(dtype), **layout)
+            ds.attrs['DB_Size'] = np.int32(5)
+            for name in attrs:
+                ds.attrs[name] = self.disc_epsR.astype(np.float32)
+            for n, name in enumerate(['x', 'y', 'z']):
+                h5.create_dataset('mesh/'+name, data=mesh[n])
+        return fn, mesh, data
+
+    # voxel database positions for arrays of coordinates, -1 outside the voxel mesh
+    def disc_db_pos(self, mesh, data, x, y, z):
+        idx = []
+        inside = np.ones(np.shape(x), dtype=bool)
+        for n, c in enumerate(np.broadcast_arrays(x, y, z)):
+            m = mesh[n].astype(np.double)
+            i = np.searchsorted(m, c, side='right')-1
+            i[c==m[-1]] = len(m)-2
+            inside &= (c>=m[0]) & (c<=m[-1])
+            idx.append(np.clip(i, 0, len(m)-2))
+        return np.where(inside, data[idx[2], idx[1], idx[0]].astype(int), -1)
+
+    disc_epsR = np.array([1.5, 2.5, 3.5, 4.5, 5.5])
+
+    def check_disc_voxel_centers(self, prop, mesh, data):
+        # every voxel center has to return the database value of its voxel
+        centers = [0.5*(m[1:]+m[:-1]).astype(np.double) for m in mesh]
+        for k, z in enumerate(centers[2]):
+            for j, y in enumerate(centers[1]):
+                for i, x in enumerate(centers[0]):
+                    self.assertEqual(prop.GetEpsilonWeighted(0, [x, y, z]), self.disc_epsR[data[k,j,i]])
+
+    @unittest.skipUnless(h5py, 'h5py is required to write discrete material files')
+    def test_disc_material(self):
+        fn, mesh, data = self.write_disc_material()
+        prop = CSProperties.CSPropDiscMaterial(self.pset, epsilon=7.0)
+        self.assertEqual( prop.GetTypeString(), 'Discrete-Material')
+        self.assertTrue(prop.ReadHDF5(fn))
+        self.assertEqual(prop.GetDBSize(), 5)
+
+        # random coordinates inside and outside the voxel mesh, outside is the background material
+        pts = np.random.uniform([-0.5,-0.5,-1.5], [5,5,2.8], (3000,3))
+        pos = self.disc_db_pos(mesh, data, pts[:,0], pts[:,1], pts[:,2])
+        self.assertTrue((pos<0).any() and (pos>=0).any())
+        for p, db_pos in zip(pts, pos):
+            eps = 7.0 if db_pos<0 else self.disc_epsR[db_pos]
+            self.assertEqual(prop.GetEpsilonWeighted(0, p), eps)
+        self.check_disc_voxel_centers(prop, mesh, data)
+
+    @unittest.skipUnless(h5py, 'h5py is required to write discrete material files')
+    def test_disc_material_weighted_values(self):
+        # without kappa and density in the database and with index 0 as background these values come from the material
+        fn, mesh, data = self.write_disc_material(attrs=['epsR', 'mueR', 'sigma'])
+        prop = CSProperties.CSPropDiscMaterial(self.pset, epsilon=[7.0, 8.0, 9.0], mue=[2.0, 2.5, 3.0], kappa=[0.3, 0.4, 0.5], sigma=[0.1, 0.2, 0.3], density=3.0)
+        prop.SetIsotropy(False)
+        prop.SetMaterialWeight(epsilon=['2', '1', '0.5'], kappa=['1', '2', '3'], density='0.5')
+        prop.SetUseDataBaseForBackground(False)
+        self.assertTrue(prop.ReadHDF5(fn))
+
+        pts = np.random.uniform([-0.5,-0.5,-1.5], [5,5,2.8], (1000,3))
+        pos = self.disc_db_pos(mesh, data, pts[:,0], pts[:,1], pts[:,2])
+        self.assertTrue((pos<0).any() and (pos==0).any() and (pos>0).any())
+        batch = self.check_weighted_values(prop, pts)
+        for i, db_pos in enumerate(pos):
+            self.assertTrue(np.allclose(batch['kappa'][i], [0.3, 0.8, 1.5]))
+            self.assertEqual(batch['density'][i], 1.5)
+            if db_pos<=0:
+                self.assertTrue(np.all(batch['epsilon'][i]==[14.0, 8.0, 4.5]))
+                self.assertTrue(np.all(batch['mue'][i]==[2.0, 2.5, 3.0]))
+                self.assertTrue(np.allclose(batch['sigma'][i], [0.1, 0.2, 0.3]))
+            else:
+                for name in ['epsilon', 'mue', 'sigma']:
+                    self.assertTrue(np.all(batch[name][i]==self.disc_epsR[db_pos]))
+
+    @unittest.skipUnless(h5py, 'h5py is required to write discrete material files')
+    def test_disc_material_out_of_core(self):
+        fn, mesh, data = self.write_disc_material()
+        prop = CSProperties.CSPropDiscMaterial(self.pset)
+        # the smallest cache holds only a few bricks, so bricks are evicted and read again
+        prop.SetOutOfCore(True, 0)
+        self.assertTrue(prop.GetOutOfCore())
+        self.assertTrue(prop.ReadHDF5(fn))
+        self.check_disc_voxel_centers(prop, mesh, data)
+
+    @unittest.skipUnless(h5py, 'h5py is required to write discrete material files')
+    def test_disc_material_read_threads(self):
+        # the parallel chunk decompression has to give the same voxel data as a single H5Dread (one thread)
+        layouts = [dict(chunks=(8,8,8), compression='gzip'),
+                   dict(chunks=(5,16,7), compression='gzip', shuffle=True),
+                   dict(chunks=(33,38,45), compression='gzip', compression_opts=9),
+                   dict(chunks=(8,8,8)),
+                   dict()]
+        centers = [0.5*(m[1:]+m[:-1]).astype(np.double) for m in self.write_disc_material()[1]]
+        for layout in layouts:
+            for dtype in [np.uint8, np.int8, np.int16]:
+                for threads in [1, 2, 3, 8]:
+                    # a new file for every read, the voxel data of a file read before would be shared
+                    fn, mesh, data = self.write_disc_material(dtype=dtype, layout=layout)
+                    prop = CSProperties.CSPropDiscMaterial(self.pset)
+                    prop.SetReadThreads(threads)
+                    self.assertEqual(prop.GetReadThreads(), threads)
+                    self.assertTrue(prop.ReadHDF5(fn))
+                    pos = prop.GetDBPositions(centers)
+                    if threads==1:
+                        ref = pos
+                        self.assertTrue(np.all(ref==data.transpose()))
+                    else:
+                        self.assertTrue(np.all(pos==ref), msg='{} {} {}'.format(layout, dtype, threads))
+
+        # signed data is converted by HDF5, negative values are clipped to index 0
+        for threads in [1, 4]:
+            fn, mesh, data = self.write_disc_material(dtype=np.int8)
+            data = data.astype(np.int8)
+            data[::3,::2,:] = -3
+            with h5py.File(fn, 'r+') as h5:
+                h5['DiscData'][...] = data
+            prop = CSProperties.CSPropDiscMaterial(self.pset)
+            prop.SetReadThreads(threads)
+            self.assertTrue(prop.ReadHDF5(fn))
+            self.check_disc_voxel_centers(prop, mesh, np.clip(data, 0, None))
+
+    @unittest.skipUnless(h5py, 'h5py is required to write discrete material files')
+    def test_disc_material_compressed(self):
+        fn, mesh, data = self.write_disc_material()
+        prop = CSProperties.CSPropDiscMaterial(self.pset)
+        prop.SetCompressed(True)
+        self.assertTrue(prop.GetCompressed())
+        self.assertTrue(prop.ReadHDF5(fn))
+        self.check_disc_voxel_centers(prop, mesh, data)
+
+    @unittest.skipUnless(h5py, 'h5py is required to write discrete material files')
+    def test_disc_material_shared_data(self):
+        fn, mesh, data = self.write_disc_material()
+        num_shared = CSProperties.CSPropDiscMaterial.GetNumberOfSharedData()
+        ref = CSProperties.CSPropDiscMaterial(self.pset, epsilon=7.0)
+        self.assertTrue(ref.ReadHDF5(fn))
+        self.assertEqual(CSProperties.CSPropDiscMaterial.GetNumberOfSharedData(), num_shared+1)
+
+        # a different transformation, scale or background share the voxel data, but have independent lookups
+        moved = CSProperties.CSPropDiscMaterial(self.pset, epsilon=7.0)
+        moved.AddTransform('Translate', [1.0, -0.5, 2.0])
+        scaled = CSProperties.CSPropDiscMaterial(self.pset, epsilon=7.0)
+        scaled.SetScale(2.0)
+        self.assertEqual(scaled.GetScale(), 2.0)
+        no_db_bg = CSProperties.CSPropDiscMaterial(self.pset, epsilon=7.0)
+        no_db_bg.SetUseDataBaseForBackground(False)
+        users = [ref, moved, scaled, no_db_bg]
+        for prop in users[1:]:
+            self.assertTrue(prop.ReadHDF5(fn))
+            self.assertTrue(prop.SharesData(ref))
+        self.assertEqual(CSProperties.CSPropDiscMaterial.GetNumberOfSharedData(), num_shared+1)
+
+        pts = np.random.uniform([-0.5,-1.0,-1.5], [10,9,6], (2000,3))
+        local = [pts, pts-[1.0, -0.5, 2.0], pts/2.0, pts]
+        for prop, loc, db_bg in zip(users, local, [True, True, True, False]):
+            pos = self.disc_db_pos(mesh, data, loc[:,0], loc[:,1], loc[:,2])
+            self.assertTrue((pos<0).any() and (pos==0).any() and (pos>0).any())
+            for p, db_pos in zip(pts, pos):
+                eps = 7.0 if (db_pos<0 or (db_pos==0 and not db_bg)) else self.disc_epsR[db_pos]
+                self.assertEqual(prop.GetEpsilonWeighted(0, p), eps)
+
+        # different storage settings do not share the voxel data
+        compressed = CSProperties.CSPropDiscMaterial(self.pset)
+        compressed.SetCompressed(True)
+        out_of_core = CSProperties.CSPropDiscMaterial(self.pset)
+        out_of_core.SetOutOfCore(True, 1)
+        pyramid = CSProperties.CSPropDiscMaterial(self.pset)
+        pyramid.SetPyramidLevels(1)
+        others = [compressed, out_of_core, pyramid]
+        for n, prop in enumerate(others):
+            self.assertTrue(prop.ReadHDF5(fn))
+            self.assertFalse(prop.SharesData(ref))
+            for other in others[:n]:
+                self.assertFalse(prop.SharesData(other))
+            self.check_disc_voxel_centers(prop, mesh, data)
+        self.assertEqual(CSProperties.CSPropDiscMaterial.GetNumberOfSharedData(), num_shared+4)
+        compressed2 = CSProperties.CSPropDiscMaterial(self.pset)
+        compressed2.SetCompressed(True)
+        self.assertTrue(compressed2.ReadHDF5(fn))
+        self.assertTrue(compressed2.SharesData(compressed))
+
+        # rewriting the file invalidates the sharing, the previous readers keep the old voxel data
+        # (the out-of-core reader keeps the file open, so the new file replaces it)
+        new_data = (data+1) % 5
+        shutil.copy(fn, fn+'.new')
+        with h5py.File(fn+'.new', 'r+') as h5:
+            h5['DiscData'][...] = new_data
+        os.replace(fn+'.new', fn)
+        reread = CSProperties.CSPropDiscMaterial(self.pset)
+        self.assertTrue(reread.ReadHDF5(fn))
+        self.assertFalse(reread.SharesData(ref))
+        self.check_disc_voxel_centers(reread, mesh, new_data)
+        self.check_disc_voxel_centers(ref, mesh, data)
+        self.assertEqual(CSProperties.CSPropDiscMaterial.GetNumberOfSharedData(), num_shared+5)
+
+        # the registry entry of the old voxel data is removed as soon as the last user reads the new file
+        for prop in users:
+            self.assertTrue(prop.ReadHDF5(fn))
+            self.assertTrue(prop.SharesData(reread))
+        self.assertEqual(CSProperties.CSPropDiscMaterial.GetNumberOfSharedData(), num_shared+4)
+
+    @unittest.skipUnless(h5py, 'h5py is required to write discrete material files')
+    def test_disc_material_db_positions(self):
+        fn, mesh, data = self.write_disc_material()
+        prop = CSProperties.CSPropDiscMaterial(self.pset)
+        self.assertTrue(prop.ReadHDF5(fn))
+
+        # unsorted Cartesian lines
+        lines = [np.random.uniform(-0.5, 5, 23), np.random.uniform(-0.5, 5, 19), np.random.uniform(-1.5, 2.8, 17)]
+        X, Y, Z = np.meshgrid(lines[0], lines[1], lines[2], indexing='ij')
+        db_pos = prop.GetDBPositions(lines)
+        self.assertEqual(db_pos.shape, (23, 19, 17))
+        self.assertTrue((db_pos==self.disc_db_pos(mesh, data, X, Y, Z)).all())
+
+        # cylindrical lines
+        lines = [np.random.uniform(0, 5, 21), np.random.uniform(-0.5, 2, 18), np.random.uniform(-1.5, 2.8, 9)]
+        R, A, Z = np.meshgrid(lines[0], lines[1], lines[2], indexing='ij')
+        db_pos = prop.GetDBPositions(lines, 1)
+        self.assertTrue((db_pos==self.disc_db_pos(mesh, data, R*np.cos(A), R*np.sin(A), Z)).all())
+
+        # cell centers and grid points of a rectilinear grid
+        grid = CSRectGrid.CSRectGrid(CoordSystem=0)
+        grid.SetLines('x', np.sort(np.random.uniform(-0.5, 5, 31)))
+        grid.SetLines('y', np.sort(np.random.uniform(-0.5, 5, 27)))
+        grid.SetLines('z', np.sort(np.random.uniform(-1.5, 2.8, 12)))
+        lines = [grid.GetLines(n) for n in ['x', 'y', 'z']]
+        centers = [0.5*(l[1:]+l[:-1]) for l in lines]
+        X, Y, Z = np.meshgrid(centers[0], centers[1], centers[2], indexing='ij')
+        self.assertTrue((prop.GetGridDBPositions(grid)==self.disc_db_pos(mesh, data, X, Y, Z)).all())
+        X, Y, Z = np.meshgrid(lines[0], lines[1], lines[2], indexing='ij')
+        self.assertTrue((prop.GetGridDBPositions(grid, False)==self.disc_db_pos(mesh, data, X, Y, Z)).all())
+
+    @unittest.skipUnless(h5py, 'h5py is required to write discrete material files')
+    def test_disc_material_aligned_grid(self):
+        fn, mesh, data = self.write_disc_material()
+        prop = CSProperties.CSPropDiscMaterial(self.pset)
+        self.assertTrue(prop.ReadHDF5(fn))
+
+        # two grid cells per voxel plus lines outside of the voxel mesh
+        grid = CSRectGrid.CSRectGrid(CoordSystem=0)
+        for n, ny in enumerate(['x', 'y', 'z']):
+            m = mesh[n].astype(np.double)
+            grid.SetLines(ny, np.concatenate(([m[0]-0.3], m, 0.5*(m[1:]+m[:-1]), [m[-1]+0.25])))
+            grid.Sort(ny)
+        self.assertTrue(prop.SetAlignedGrid(grid))
+
+        for cell_center in [True, False]:
+            db_pos = prop.GetGridDBPositions(grid, cell_center)
+            lines = [grid.GetLines(n) for n in ['x', 'y', 'z']]
+            if cell_center:
+                lines = [0.5*(l[1:]+l[:-1]) for l in lines]
+            X, Y, Z = np.meshgrid(lines[0], lines[1], lines[2], indexing='ij')
+            self.assertTrue((db_pos==self.disc_db_pos(mesh, data, X, Y, Z)).all())
+            for pos in np.ndindex(*db_pos.shape):
+                self.assertEqual(prop.GetAlignedDBPos(pos, cell_center), db_pos[pos])
+
+        # a shifted grid is not aligned
+        grid.SetLines('y', grid.GetLines('y')+0.01)
+        self.assertFalse(prop.SetAlignedGrid(grid))
+        self.assertEqual(prop.GetAlignedDBPos([5, 5, 5]), -1)
+
+    @unittest.skipUnless(h5py, 'h5py is required to write discrete material files')
+    def test_disc_material_pyramid(self):
+        fn, mesh, data = self.write_disc_material()
+        prop = CSProperties.CSPropDiscMaterial(self.pset)
+        prop.SetPyramidLevels(3)
+        self.assertTrue(prop.ReadHDF5(fn))
+        self.assertEqual(prop.GetPyramidLevels(), 3)
+        self.assertIsNone(prop.GetPyramidSize(4))
+
+        # every coarse voxel holds the majority (lowest value on ties) of its voxel
+        for level in range(4):
+            c = 2**level
+            size = prop.GetPyramidSize(level)
+            self.assertTrue((size==(np.array(data.shape[::-1])+c-1)//c).all())
+            for pos in np.ndindex(*size):
+                block = data[pos[2]*c:(pos[2]+1)*c, pos[1]*c:(pos[1]+1)*c, pos[0]*c:(pos[0]+1)*c]
+                db_pos, mixed = prop.GetPyramidDBPos(level, pos)
+                self.assertEqual(db_pos, np.bincount(block.ravel()).argmax())
+                self.assertEqual(mixed, (block!=block.flat[0]).any())
+
+    # all voxel faces between filled and empty voxel as (direction, orientation, lower corner, upper corner), oriented to the empty voxel
+    def disc_voxel_faces(self, filled, lines):
+        faces = []
+        for n in range(3):
+            pad = [(0,0)]*3
+            pad[2-n] = (1,1)
+            diff = np.diff(np.pad(filled, pad).astype(int), axis=2-n)
+            for idx in np.argwhere(diff!=0):
+                pos = idx[::-1]
+                lo = tuple(lines[k][pos[k]] for k in range(3))
+                hi = tuple(lines[k][pos[k]+(k!=n)] for k in range(3))
+                faces.append((n, -diff[tuple(idx)], lo, hi))
+        return sorted(faces)
+
+    # faces of a surface model, see disc_voxel_faces, merged quads are split into voxel faces if lines are given
+    def disc_surface_faces(self, points, quads, lines=None):
+        self.assertEqual(len(np.unique(points, axis=0)), len(points))
+        faces = []
+        for q in quads:
+            p = points[q]
+            normal = np.cross(p[1]-p[0], p[3]-p[0])
+            n = np.argmax(np.abs(normal))
+            lo, hi = p.min(axis=0), p.max(axis=0)
+            # an axis aligned rectangle with its corners in order
+            self.assertEqual(np.count_nonzero(normal), 1)
+            self.assertTrue(np.all(p[2]-p[1]==p[3]-p[0]))
+            self.assertEqual(lo[n], hi[n])
+            if lines is None:
+                faces.append((n, np.sign(normal[n]), tuple(lo), tuple(hi)))
+                continue
+            idx = [np.arange(np.searchsorted(lines[k], lo[k]), max(np.searchsorted(lines[k], hi[k]), np.searchsorted(lines[k], lo[k])+1)) for k in range(3)]
+            for pos in itertools.product(*idx):
+                f_lo = tuple(lines[k][pos[k]] for k in range(3))
+                f_hi = tuple(lines[k][pos[k]+(k!=n)] for k in range(3))
+                faces.append((n, np.sign(normal[n]), f_lo, f_hi))
+        return sorted(faces)
+
+    # total face area per plane and orientation
+    def disc_face_areas(self, faces):
+        areas = {}
+        for n, orient, lo, hi in faces:
+            key = (n, orient, lo[n])
+            areas[key] = areas.get(key, 0) + np.prod([hi[k]-lo[k] for k in range(3) if k!=n])
+        return areas
+
+    @unittest.skipUnless(h5py, 'h5py is required to write discrete material files')
+    def test_disc_material_surface_model(self):
+        fn, mesh, data = self.write_disc_material()
+        prop = CSProperties.CSPropDiscMaterial(self.pset)
+        prop.SetPyramidLevels(2)
+        self.assertTrue(prop.ReadHDF5(fn))
+        lines = [m.astype(np.double) for m in mesh]
+
+        # the unmerged surface consists of all voxel faces between material and background (index 0)
+        points, quads = prop.CreateSurfaceModel()
+        ref = self.disc_voxel_faces(data>0, lines)
+        self.assertEqual(len(quads), len(ref))
+        self.assertEqual(self.disc_surface_faces(points, quads), ref)
+
+        # merged quads keep the area and orientation per plane and cover the same voxel faces
+        merged_points, merged_quads = prop.CreateSurfaceModel(merge_quads=True)
+        self.assertLess(len(merged_quads), len(quads)//2)
+        merged = self.disc_surface_faces(merged_points, merged_quads)
+        ref_areas = self.disc_face_areas(ref)
+        merged_areas = self.disc_face_areas(merged)
+        self.assertEqual(sorted(merged_areas.keys()), sorted(ref_areas.keys()))
+        for key, area in ref_areas.items():
+            self.assertAlmostEqual(merged_areas[key], area)
+        self.assertEqual(self.disc_surface_faces(merged_points, merged_quads, lines), ref)
+
+        # the number of threads does not change the quads
+        for merge in [False, True]:
+            ref_points, ref_quads = prop.CreateSurfaceModel(merge_quads=merge, num_threads=1)
+            ref_faces = self.disc_surface_faces(ref_points, ref_quads)
+            for threads in [0, 2, 3, 8]:
+                points, quads = prop.CreateSurfaceModel(merge_quads=merge, num_threads=threads)
+                self.assertEqual(len(quads), len(ref_quads))
+                self.assertEqual(self.disc_surface_faces(points, quads), ref_faces)
+
+        # a coarse level uses the pyramid majority of the coarse voxel
+        for level in [1, 2]:
+            size = prop.GetPyramidSize(level)
+            filled = np.zeros(size[::-1], dtype=bool)
+            for pos in np.ndindex(*size):
+                filled[pos[::-1]] = prop.GetPyramidDBPos(level, pos)[0]>0
+            coarse = [l[np.minimum(np.arange(size[n]+1)*2**level, len(l)-1)] for n, l in enumerate(lines)]
+            ref = self.disc_voxel_faces(filled, coarse)
+            points, quads = prop.CreateSurfaceModel(level=level, num_threads=2)
+            self.assertEqual(self.disc_surface_faces(points, quads), ref)
+            points, quads = prop.CreateSurfaceModel(merge_quads=True, level=level)
+            self.assertEqual(self.disc_surface_faces(points, quads, coarse), ref)
+
 if __name__ == '__main__':
     unittest.main()
\ No newline at end of file
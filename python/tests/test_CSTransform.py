@@ -77,5 +77,51 @@ class Test_CSTransform(unittest.TestCase):
         self.tr.SetMatrix(mat)
         self.assertTrue( (self.tr.GetMatrix()==mat).all() )
 
+    def test_matrix_type(self):
+        self.assertEqual( self.tr.GetMatrixType(), 0 )
+
+        self.tr.Translate([1,2,1])
+        self.assertEqual( self.tr.GetMatrixType(), 1 )
+
+        self.tr.Scale([1,2,3])
+        self.assertEqual( self.tr.GetMatrixType(), 2 )
+
+        self.tr.Reset()
+        self.tr.Scale(2)
+        self.assertEqual( self.tr.GetMatrixType(), 2 )
+
+        self.tr.RotateAxis('z', 30)
+        self.assertEqual( self.tr.GetMatrixType(), 3 )
+
+        # a rotation that cancels out is reclassified
+        self.tr.Reset()
+        self.tr.RotateAxis('z', 0)
+        self.assertEqual( self.tr.GetMatrixType(), 0 )
+
+        self.tr.SetMatrix(np.identity(4))
+        self.assertEqual( self.tr.GetMatrixType(), 0 )
+
+    def test_batch_transform(self):
+        np.random.seed(1)
+        coords = np.random.uniform(-10, 10, (3,50))
+
+        def check(tr):
+            for invers in [False, True]:
+                out = tr.Transform(coords, invers)
+                self.assertEqual(out.shape, coords.shape)
+                for n in range(coords.shape[1]):
+                    self.assertTrue( compare_coords(out[:,n], tr.Transform(coords[:,n], invers)) )
+
+        check(self.tr)
+        self.tr.Translate([1,2,1])
+        check(self.tr)
+        self.tr.Scale([1,2,3])
+        check(self.tr)
+        self.tr.RotateOrigin([1,1,1], 35)
+        check(self.tr)
+
+        self.assertTrue( compare_coords(self.tr.Transform(self.tr.Transform(coords), True), coords) )
+        self.assertEqual( self.tr.Transform(np.zeros((3,0))).shape, (3,0) )
+
 if __name__ == '__main__':
     unittest.main()
@@ -44,6 +44,69 @@ assert (exc.GetExcitation()==exc_val).all()
 
 csx.Write2XML('test_CSXCAD.xml')
 
+##### Test the kernel pack against the single coordinate priority search
+csx2 = ContinuousStructure()
+np.random.seed(4)
+for n in range(6):
+    prop = csx2.AddMetal('m{}'.format(n))
+    for k in range(10):
+        c = np.random.uniform(-5, 5, 3)
+        prio = np.random.randint(0, 4)
+        t = np.random.randint(0, 6)
+        if t==0:
+            prim = prop.AddBox(c-np.random.uniform(0, 2, 3), c+np.random.uniform(0, 2, 3), priority=prio)
+        elif t==1:
+            prim = prop.AddSphere(c, np.random.uniform(0.5, 2), priority=prio)
+        elif t==2:
+            prim = prop.AddSphericalShell(c, 1.5, 0.5, priority=prio)
+        elif t==3:
+            prim = prop.AddCylinder(c, c+np.random.uniform(-3, 3, 3), np.random.uniform(0.5, 1.5), priority=prio)
+        elif t==4:
+            prim = prop.AddCylindricalShell(c, c+np.random.uniform(-3, 3, 3), 1.0, 0.4, priority=prio)
+        else:
+            prim = prop.AddLinPoly([[0, 2, 1], [0, 0, 2]], 'z', c[2], 1.0, priority=prio)
+        if np.random.rand()<0.4:
+            prim.AddTransform('RotateAxis', 'z', np.random.uniform(0, 90))
+            prim.AddTransform('Translate', np.random.uniform(-1, 1, 3))
+assert csx2.Update()==''
+
+coords = np.random.uniform(-7, 7, (5000,3))
+props  = csx2.GetPropertiesByCoordPriority(coords)
+assert len(props)==len(coords)
+for p, prop in zip(coords, props):
+    ref = csx2.GetPropertyByCoordPriority(p)
+    if ref is None:
+        assert prop is None
+    else:
+        assert prop.GetName()==ref.GetName()
+assert any(prop is not None for prop in props)
+
+##### Test the XML round trip of group instances sharing their children
+csx3 = ContinuousStructure()
+group_metal = csx3.AddMetal('group')
+group = group_metal.AddGroup()
+group.AddChild(CSPrimitives.CSPrimBox(csx3.GetParameterSet(), group_metal, start=[-1,-1,-1], stop=[1,1,1]))
+inst = group.GetCopy()
+inst.AddTransform('Translate', [5,0,0])
+single = group_metal.AddGroup(children=[CSPrimitives.CSPrimSphere(csx3.GetParameterSet(), group_metal, center=[0,5,0], radius=1)])
+csx3.Write2XML('test_CSXCAD_group.xml')
+
+csx4 = ContinuousStructure()
+assert csx4.ReadFromXML('test_CSXCAD_group.xml')==''
+assert csx4.Update()==''
+groups = csx4.GetAllPrimitives()
+assert len(groups)==3
+assert [g.GetTypeName() for g in groups]==['Group']*3
+assert [g.GetQtyInstances() for g in groups]==[2, 2, 1]
+assert [g.GetQtyChildren() for g in groups]==[1, 1, 1]
+for g, inside in zip(groups, [[0,0,0], [5,0,0], [0,5,0]]):
+    assert g.IsInside(inside)
+    assert not g.IsInside([0,-5,0])
+# the children of the read instances are shared again
+groups[0].AddChild(CSPrimitives.CSPrimBox(csx4.GetParameterSet(), groups[0].GetProperty(), start=[0,-6,0], stop=[1,-4,1]))
+assert groups[1].GetQtyChildren()==2
+assert groups[2].GetQtyChildren()==1
+
 del metal
 
 print("all ok")
\ No newline at end of file
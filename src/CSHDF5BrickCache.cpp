@@ -0,0 +1,426 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <boost/bind/bind.hpp>
+#include <hdf5.h>
+
+#include "CSHDF5BrickCache.h"
+#include "CSHDF5Lock.h"
+
+#define NO_BRICK ((unsigned int)-1)
+
+// incremented by every Open() while holding the HDF5 lock
+static unsigned int g_BrickCacheGeneration = 0;
+
+CSHDF5BrickCache::CSHDF5BrickCache()
+{
+	m_File = -1;
+	m_Dataset = -1;
+	m_CacheSize = 64*1024*1024;
+	m_Prefetch = true;
+	m_PrefetchThread = NULL;
+	m_StopPrefetch = false;
+	for (int n=0;n<3;++n)
+	{
+		m_Size[n] = 0;
+		m_BrickSize[n] = 1;
+		m_NumBricks[n] = 0;
+	}
+	m_Head = m_Tail = -1;
+	m_QtyUsed = 0;
+	m_LastMiss = -1;
+	m_LastStride = 0;
+	m_QtyReads = 0;
+	m_ReadError = false;
+	m_Generation = 0;
+}
+
+CSHDF5BrickCache::~CSHDF5BrickCache()
+{
+	Close();
+}
+
+bool CSHDF5BrickCache::Open(std::string filename, std::string dataset)
+{
+	Close();
+
+	CSHDF5Lock hdf5Lock;
+	hid_t file = H5Fopen(filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+	if (file<0)
+	{
+		std::cerr << "CSHDF5BrickCache::Open: Error, failed to open file: \"" << filename << "\"" << std::endl;
+		return false;
+	}
+	if (H5Lexists(file, dataset.c_str(), H5P_DEFAULT)<=0)
+	{
+		std::cerr << "CSHDF5BrickCache::Open: Error, dataset: \"" << dataset << "\" not found" << std::endl;
+		H5Fclose(file);
+		return false;
+	}
+	hid_t dset = H5Dopen2(file, dataset.c_str(), H5P_DEFAULT);
+	if (dset<0)
+	{
+		std::cerr << "CSHDF5BrickCache::Open: Error, failed to open dataset: \"" << dataset << "\"" << std::endl;
+		H5Fclose(file);
+		return false;
+	}
+
+	hid_t space = H5Dget_space(dset);
+	hsize_t dims[3];
+	if ((H5Sget_simple_extent_ndims(space)!=3) || (H5Sget_simple_extent_dims(space, dims, NULL)<0))
+	{
+		std::cerr << "CSHDF5BrickCache::Open: Error, dataset: \"" << dataset << "\" is not three dimensional" << std::endl;
+		H5Sclose(space);
+		H5Dclose(dset);
+		H5Fclose(file);
+		return false;
+	}
+	H5Sclose(space);
+
+	// read whole chunks of a chunked dataset, since HDF5 always decompresses complete chunks
+	hsize_t chunk[3] = {32, 32, 32};
+	hid_t plist = H5Dget_create_plist(dset);
+	if (H5Pget_layout(plist)==H5D_CHUNKED)
+		H5Pget_chunk(plist, 3, chunk);
+	H5Pclose(plist);
+
+	size_t numBricks = 1;
+	size_t brickBytes = 1;
+	for (int n=0;n<3;++n)
+	{
+		m_Size[n] = dims[2-n];
+		m_BrickSize[n] = std::max(std::min((unsigned int)chunk[2-n], m_Size[n]), 1u);
+		m_NumBricks[n] = (m_Size[n]+m_BrickSize[n]-1)/m_BrickSize[n];
+		numBricks *= m_NumBricks[n];
+		brickBytes *= m_BrickSize[n];
+	}
+
+	// a few slots are needed to read ahead while other bricks are in use
+	size_t numSlots = std::min(std::max(m_CacheSize/brickBytes, (size_t)4), numBricks);
+	m_BrickSlot.assign(numBricks, -1);
+	m_Slots.resize(numSlots);
+	for (size_t i=0;i<numSlots;++i)
+	{
+		m_Slots[i].m_Brick = NO_BRICK;
+		m_Slots[i].m_Prev = m_Slots[i].m_Next = -1;
+		m_Slots[i].m_Ready = false;
+		m_Slots[i].m_Prefetched = false;
+	}
+	m_Head = m_Tail = -1;
+	m_QtyUsed = 0;
+	m_LastMiss = -1;
+	m_LastStride = 0;
+	m_QtyReads = 0;
+	m_ReadError = false;
+	m_Generation = ++g_BrickCacheGeneration;
+
+	m_File = file;
+	m_Dataset = dset;
+
+	if (m_Prefetch && (numBricks>1))
+	{
+		m_StopPrefetch = false;
+		m_PrefetchThread = new boost::thread(boost::bind(&CSHDF5BrickCache::PrefetchLoop, this));
+	}
+	return true;
+}
+
+void CSHDF5BrickCache::Close()
+{
+	if (m_PrefetchThread)
+	{
+		{
+			boost::mutex::scoped_lock lock(m_Mutex);
+			m_StopPrefetch = true;
+			m_PrefetchQueue.clear();
+		}
+		m_Condition.notify_all();
+		m_PrefetchThread->join();
+		delete m_PrefetchThread;
+		m_PrefetchThread = NULL;
+	}
+	if (m_File>=0)
+	{
+		CSHDF5Lock hdf5Lock;
+		if (m_Dataset>=0)
+			H5Dclose(m_Dataset);
+		H5Fclose(m_File);
+	}
+	m_Dataset = -1;
+	m_File = -1;
+	m_LocalBrick.reset();
+	m_BrickSlot.clear();
+	m_Slots.clear();
+	m_Head = m_Tail = -1;
+	m_QtyUsed = 0;
+}
+
+unsigned char CSHDF5BrickCache::GetValue(unsigned int pos)
+{
+	unsigned int x = pos%m_Size[0];
+	pos /= m_Size[0];
+	return GetValue(x, pos%m_Size[1], pos/m_Size[1]);
+}
+
+unsigned char CSHDF5BrickCache::GetValue(unsigned int x, unsigned int y, unsigned int z)
+{
+	if ((m_File<0) || (x>=m_Size[0]) || (y>=m_Size[1]) || (z>=m_Size[2]))
+		return 0;
+	unsigned int b[3] = {x/m_BrickSize[0], y/m_BrickSize[1], z/m_BrickSize[2]};
+	unsigned int brick = b[0] + b[1]*m_NumBricks[0] + b[2]*m_NumBricks[0]*m_NumBricks[1];
+
+	// fast path: the brick data is never modified once read, the local brick can be used without locking
+	LocalBrick* local = m_LocalBrick.get();
+	if ((local==NULL) || (local->m_Brick!=brick) || (local->m_Generation!=m_Generation))
+	{
+		local = GetLocalBrick(brick);
+		if (local==NULL)
+			return 0;
+	}
+	return (*local->m_Data)[(x-local->m_Start[0]) + (y-local->m_Start[1])*local->m_Count[0] + (z-local->m_Start[2])*local->m_Count[0]*local->m_Count[1]];
+}
+
+CSHDF5BrickCache::LocalBrick* CSHDF5BrickCache::GetLocalBrick(unsigned int brick)
+{
+	LocalBrick* local = m_LocalBrick.get();
+	if (local==NULL)
+	{
+		local = new LocalBrick();
+		m_LocalBrick.reset(local);
+	}
+	local->m_Brick = NO_BRICK;
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+		int slot = GetBrickSlot(brick, lock);
+		if (slot<0)
+		{
+			local->m_Data.reset();
+			return NULL;
+		}
+		local->m_Data = m_Slots[slot].m_Data;
+	}
+	local->m_Brick = brick;
+	local->m_Generation = m_Generation;
+	GetBrickExtent(brick, local->m_Start, local->m_Count);
+	return local;
+}
+
+int CSHDF5BrickCache::GetBrickSlot(unsigned int brick, boost::mutex::scoped_lock &lock)
+{
+	while (true)
+	{
+		int slot = m_BrickSlot[brick];
+		if (slot>=0)
+		{
+			Slot &s = m_Slots[slot];
+			if (s.m_Ready==false)
+			{
+				// the brick is currently read by another thread
+				m_Condition.wait(lock);
+				continue;
+			}
+			if (s.m_Prefetched)
+			{
+				// count the first access to a read ahead brick as a miss to continue the read ahead
+				s.m_Prefetched = false;
+				UpdatePrefetch(brick);
+			}
+			if (slot!=m_Head)
+			{
+				Unlink(slot);
+				LinkFront(slot);
+			}
+			return slot;
+		}
+
+		slot = AllocateSlot(brick);
+		if (slot<0)
+		{
+			m_Condition.wait(lock);
+			continue;
+		}
+		UpdatePrefetch(brick);
+
+		boost::shared_ptr<std::vector<unsigned char> > data = m_Slots[slot].m_Data;
+		lock.unlock();
+		bool ok = ReadBrick(brick, *data);
+		lock.lock();
+
+		m_Slots[slot].m_Ready = true;
+		m_Condition.notify_all();
+		if (ok==false)
+		{
+			m_BrickSlot[brick] = -1;
+			m_Slots[slot].m_Brick = NO_BRICK;
+			return -1;
+		}
+		return slot;
+	}
+}
+
+int CSHDF5BrickCache::AllocateSlot(unsigned int brick)
+{
+	int slot = -1;
+	if (m_QtyUsed<m_Slots.size())
+		slot = m_QtyUsed++;
+	else
+	{
+		// replace the least recently used brick that is not being read
+		for (int n=m_Tail;n>=0;n=m_Slots[n].m_Prev)
+			if (m_Slots[n].m_Ready)
+			{
+				slot = n;
+				break;
+			}
+		if (slot<0)
+			return -1;
+		Unlink(slot);
+		if (m_Slots[slot].m_Brick!=NO_BRICK)
+			m_BrickSlot[m_Slots[slot].m_Brick] = -1;
+	}
+	Slot &s = m_Slots[slot];
+	s.m_Brick = brick;
+	s.m_Ready = false;
+	s.m_Prefetched = false;
+	// threads may still use the data of the replaced brick
+	s.m_Data.reset(new std::vector<unsigned char>());
+	m_BrickSlot[brick] = slot;
+	LinkFront(slot);
+	return slot;
+}
+
+void CSHDF5BrickCache::Unlink(int slot)
+{
+	Slot &s = m_Slots[slot];
+	if (s.m_Prev>=0)
+		m_Slots[s.m_Prev].m_Next = s.m_Next;
+	else
+		m_Head = s.m_Next;
+	if (s.m_Next>=0)
+		m_Slots[s.m_Next].m_Prev = s.m_Prev;
+	else
+		m_Tail = s.m_Prev;
+	s.m_Prev = s.m_Next = -1;
+}
+
+void CSHDF5BrickCache::LinkFront(int slot)
+{
+	Slot &s = m_Slots[slot];
+	s.m_Prev = -1;
+	s.m_Next = m_Head;
+	if (m_Head>=0)
+		m_Slots[m_Head].m_Prev = slot;
+	m_Head = slot;
+	if (m_Tail<0)
+		m_Tail = slot;
+}
+
+void CSHDF5BrickCache::GetBrickExtent(unsigned int brick, unsigned int start[3], unsigned int count[3]) const
+{
+	unsigned int b[3];
+	b[0] = brick%m_NumBricks[0];
+	brick /= m_NumBricks[0];
+	b[1] = brick%m_NumBricks[1];
+	b[2] = brick/m_NumBricks[1];
+	for (int n=0;n<3;++n)
+	{
+		start[n] = b[n]*m_BrickSize[n];
+		count[n] = std::min(m_BrickSize[n], m_Size[n]-start[n]);
+	}
+}
+
+bool CSHDF5BrickCache::ReadBrick(unsigned int brick, std::vector<unsigned char> &data)
+{
+	unsigned int start[3], count[3];
+	GetBrickExtent(brick, start, count);
+	data.resize((size_t)count[0]*count[1]*count[2]);
+
+	CSHDF5Lock hdf5Lock;
+	hsize_t offset[3] = {start[2], start[1], start[0]};
+	hsize_t dims[3] = {count[2], count[1], count[0]};
+	hid_t fileSpace = H5Dget_space(m_Dataset);
+	hid_t memSpace = H5Screate_simple(3, dims, NULL);
+	herr_t status = H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, offset, NULL, dims, NULL);
+	if (status>=0)
+		status = H5Dread(m_Dataset, H5T_NATIVE_UINT8, memSpace, fileSpace, H5P_DEFAULT, &data[0]);
+	H5Sclose(memSpace);
+	H5Sclose(fileSpace);
+	++m_QtyReads;
+	if (status<0)
+	{
+		if (m_ReadError==false)
+			std::cerr << "CSHDF5BrickCache::ReadBrick: Error, failed to read brick " << brick << std::endl;
+		m_ReadError = true;
+		return false;
+	}
+	return true;
+}
+
+void CSHDF5BrickCache::UpdatePrefetch(unsigned int brick)
+{
+	if (m_PrefetchThread==NULL)
+		return;
+	int stride = (int)brick - m_LastMiss;
+	bool constant = (stride!=0) && (stride==m_LastStride);
+	m_LastMiss = brick;
+	m_LastStride = stride;
+	if (constant==false)
+		return;
+	long long next = (long long)brick + stride;
+	if ((next<0) || (next>=(long long)m_BrickSlot.size()) || (m_BrickSlot[next]>=0))
+		return;
+	// only the most recent requests are of interest
+	if (m_PrefetchQueue.size()>=2)
+		m_PrefetchQueue.pop_front();
+	m_PrefetchQueue.push_back((unsigned int)next);
+	m_Condition.notify_all();
+}
+
+void CSHDF5BrickCache::PrefetchLoop()
+{
+	boost::mutex::scoped_lock lock(m_Mutex);
+	while (true)
+	{
+		while ((m_StopPrefetch==false) && m_PrefetchQueue.empty())
+			m_Condition.wait(lock);
+		if (m_StopPrefetch)
+			return;
+		unsigned int brick = m_PrefetchQueue.front();
+		m_PrefetchQueue.pop_front();
+		if (m_BrickSlot[brick]>=0)
+			continue;
+		int slot = AllocateSlot(brick);
+		if (slot<0)
+			continue;
+
+		boost::shared_ptr<std::vector<unsigned char> > data = m_Slots[slot].m_Data;
+		lock.unlock();
+		bool ok = ReadBrick(brick, *data);
+		lock.lock();
+
+		m_Slots[slot].m_Ready = true;
+		m_Slots[slot].m_Prefetched = ok;
+		if (ok==false)
+		{
+			m_BrickSlot[brick] = -1;
+			m_Slots[slot].m_Brick = NO_BRICK;
+		}
+		m_Condition.notify_all();
+	}
+}
@@ -0,0 +1,153 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include "CSXCAD_Global.h"
+
+//! Out-of-core access to a 3D uint8 HDF5 dataset
+/*!
+ The dataset is read brick by brick on demand, using the chunk size of the dataset as brick size if it is chunked. The file is kept open until Close() is called.
+ A bounded number of bricks is kept in memory, the least recently used brick is replaced first.
+ If the bricks are accessed in a constant stride, e.g. during a grid ordered traversal, the next brick is read ahead by a background thread.
+ Each thread keeps a reference to the brick it accessed last, further values of this brick are read without locking.
+ All methods are thread-safe, all HDF5 calls (including the read ahead) are serialized by CSHDF5Lock.
+ */
+class CSXCAD_EXPORT CSHDF5BrickCache
+{
+public:
+	CSHDF5BrickCache();
+	~CSHDF5BrickCache();
+
+	//! Open a 3D uint8 dataset, the last (fastest varying) dataset dimension is used as x-direction. \return false on error
+	bool Open(std::string filename, std::string dataset);
+	//! Close the file and release all cached bricks
+	void Close();
+
+	bool IsOpen() const {return m_File>=0;}
+
+	//! Set the maximum memory in bytes used for cached bricks, takes effect at the next Open()
+	void SetCacheSize(size_t bytes) {m_CacheSize=bytes;}
+	size_t GetCacheSize() const {return m_CacheSize;}
+
+	//! Enable or disable reading ahead in the direction of traversal (default on), takes effect at the next Open()
+	void SetPrefetch(bool val) {m_Prefetch=val;}
+
+	//! Get the number of voxel in x-, y- and z-direction
+	const unsigned int* GetSize() const {return m_Size;}
+	//! Get the brick size in x-, y- and z-direction
+	const unsigned int* GetBrickSize() const {return m_BrickSize;}
+
+	//! Get the value at voxel position pos = x + y*size_x + z*size_x*size_y
+	unsigned char GetValue(unsigned int pos);
+	unsigned char GetValue(unsigned int x, unsigned int y, unsigned int z);
+
+	//! Get the number of bricks read from file (including read ahead bricks)
+	size_t GetQtyBrickReads() const {return m_QtyReads;}
+
+protected:
+	//! A cached brick, linked into the LRU list
+	struct Slot
+	{
+		unsigned int m_Brick;
+		int m_Prev;
+		int m_Next;
+		bool m_Ready;
+		///Set if the brick was read ahead and not yet accessed
+		bool m_Prefetched;
+		///Brick data, replaced (not modified) if the slot is reused, so that threads may keep using the old brick
+		boost::shared_ptr<std::vector<unsigned char> > m_Data;
+	};
+
+	//! The brick last accessed by a thread
+	struct LocalBrick
+	{
+		unsigned int m_Brick;
+		///Open() the brick was read in
+		unsigned int m_Generation;
+		unsigned int m_Start[3];
+		unsigned int m_Count[3];
+		boost::shared_ptr<std::vector<unsigned char> > m_Data;
+	};
+
+	//! Make the given brick the local brick of the calling thread. \return NULL on error
+	LocalBrick* GetLocalBrick(unsigned int brick);
+
+	//! Get the slot of a brick, reading it if necessary. The lock on m_Mutex is released during file access. \return -1 on error
+	int GetBrickSlot(unsigned int brick, boost::mutex::scoped_lock &lock);
+	//! Get the least recently used free or ready slot and assign it to a brick, -1 if all slots are being read
+	int AllocateSlot(unsigned int brick);
+	void Unlink(int slot);
+	void LinkFront(int slot);
+
+	//! Read a brick from file, only one brick is read at a time
+	bool ReadBrick(unsigned int brick, std::vector<unsigned char> &data);
+	//! Get the start and the number of voxel of a brick
+	void GetBrickExtent(unsigned int brick, unsigned int start[3], unsigned int count[3]) const;
+
+	//! Detect a constant stride of brick misses and queue the next brick
+	void UpdatePrefetch(unsigned int brick);
+	void PrefetchLoop();
+
+	///HDF5 identifier of the open file and dataset, -1 if closed
+	long long m_File;
+	long long m_Dataset;
+	size_t m_CacheSize;
+	bool m_Prefetch;
+
+	unsigned int m_Size[3];
+	unsigned int m_BrickSize[3];
+	unsigned int m_NumBricks[3];
+
+	///Slot of each brick, -1 if it is not cached
+	std::vector<int> m_BrickSlot;
+	std::vector<Slot> m_Slots;
+	///First (most recently used) and last slot of the LRU list
+	int m_Head;
+	int m_Tail;
+	///Number of slots in use
+	unsigned int m_QtyUsed;
+
+	int m_LastMiss;
+	int m_LastStride;
+	std::deque<unsigned int> m_PrefetchQueue;
+	bool m_StopPrefetch;
+	boost::thread* m_PrefetchThread;
+
+	size_t m_QtyReads;
+	bool m_ReadError;
+
+	///Unique number of the current Open(), invalidates the local bricks of a previously opened file
+	unsigned int m_Generation;
+	boost::thread_specific_ptr<LocalBrick> m_LocalBrick;
+
+	boost::mutex m_Mutex;
+	boost::condition_variable m_Condition;
+
+private:
+	CSHDF5BrickCache(const CSHDF5BrickCache&);
+	CSHDF5BrickCache& operator=(const CSHDF5BrickCache&);
+};
@@ -0,0 +1,281 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <string.h>
+#include <algorithm>
+#include <boost/bind/bind.hpp>
+#include <boost/thread/thread.hpp>
+#include <hdf5.h>
+#include <zlib.h>
+
+#include "CSHDF5ChunkReader.h"
+#include "CSHDF5Lock.h"
+
+// reading raw chunks and counting the allocated chunks requires HDF5 1.10.5 or newer
+#ifdef H5_VERSION_GE
+#if H5_VERSION_GE(1,10,5)
+#define CSX_HDF5_RAW_CHUNKS
+#endif
+#endif
+
+CSHDF5ChunkReader::CSHDF5ChunkReader(long long dataset)
+{
+	m_Dataset = dataset;
+	m_NumThreads = 0;
+	m_Rank = 0;
+	for (int n=0;n<3;++n)
+		m_Dims[n] = m_ChunkDims[n] = m_NumChunks[n] = 1;
+	m_Done = false;
+	m_Error = false;
+}
+
+CSHDF5ChunkReader::~CSHDF5ChunkReader()
+{
+	for (size_t i=0;i<m_Free.size();++i)
+		delete m_Free[i];
+	for (size_t i=0;i<m_Queue.size();++i)
+		delete m_Queue[i];
+}
+
+bool CSHDF5ChunkReader::Read(unsigned char* data)
+{
+	// the decompression threads do not call HDF5 and don't need this lock
+	CSHDF5Lock hdf5Lock;
+	if (CheckChunked())
+		return ReadChunked(data);
+	if (H5Dread(m_Dataset, H5T_NATIVE_UINT8, H5S_ALL, H5S_ALL, H5P_DEFAULT, data)<0)
+	{
+		std::cerr << "CSHDF5ChunkReader::Read: Error, failed to read dataset" << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool CSHDF5ChunkReader::CheckChunked()
+{
+#ifdef CSX_HDF5_RAW_CHUNKS
+	if (m_NumThreads==0)
+		m_NumThreads = boost::thread::hardware_concurrency();
+	if (m_NumThreads<=1)
+		return false;
+
+	// only unsigned 1 byte integer data can be used without type conversion
+	hid_t type = H5Dget_type(m_Dataset);
+	bool ok = (H5Tget_class(type)==H5T_INTEGER) && (H5Tget_size(type)==1) && (H5Tget_sign(type)==H5T_SGN_NONE);
+	H5Tclose(type);
+	if (ok==false)
+		return false;
+
+	hid_t space = H5Dget_space(m_Dataset);
+	int rank = H5Sget_simple_extent_ndims(space);
+	hsize_t dims[3];
+	if ((rank<1) || (rank>3) || (H5Sget_simple_extent_dims(space, dims, NULL)<0))
+		ok = false;
+	H5Sclose(space);
+	if (ok==false)
+		return false;
+
+	hid_t plist = H5Dget_create_plist(m_Dataset);
+	hsize_t chunk[3];
+	if ((H5Pget_layout(plist)!=H5D_CHUNKED) || (H5Pget_chunk(plist, rank, chunk)!=rank))
+		ok = false;
+	// for 1 byte data the shuffle filter does not change the data
+	m_Deflate.clear();
+	int numFilters = ok ? H5Pget_nfilters(plist) : 0;
+	for (int n=0;n<numFilters;++n)
+	{
+		unsigned int flags;
+		size_t numValues = 0;
+		H5Z_filter_t filter = H5Pget_filter2(plist, n, &flags, &numValues, NULL, 0, NULL, NULL);
+		if (filter==H5Z_FILTER_DEFLATE)
+			m_Deflate.push_back(n);
+		else if (filter!=H5Z_FILTER_SHUFFLE)
+			ok = false;
+	}
+	if (m_Deflate.size()>1)
+		ok = false;
+	H5Pclose(plist);
+	if (ok==false)
+		return false;
+
+	m_Rank = rank;
+	for (int n=0;n<3;++n)
+		m_Dims[n] = m_ChunkDims[n] = 1;
+	for (int n=0;n<rank;++n)
+	{
+		m_Dims[n+3-rank] = dims[n];
+		m_ChunkDims[n+3-rank] = chunk[n];
+	}
+	for (int n=0;n<3;++n)
+		m_NumChunks[n] = (m_Dims[n]+m_ChunkDims[n]-1)/m_ChunkDims[n];
+
+	// chunks that were never written are left to H5Dread to fill in
+	hsize_t numAllocated = 0;
+	space = H5Dget_space(m_Dataset);
+	if (H5Dget_num_chunks(m_Dataset, space, &numAllocated)<0)
+		numAllocated = 0;
+	H5Sclose(space);
+	return (numAllocated==m_NumChunks[0]*m_NumChunks[1]*m_NumChunks[2]);
+#else
+	return false;
+#endif
+}
+
+bool CSHDF5ChunkReader::ReadChunked(unsigned char* data)
+{
+#ifdef CSX_HDF5_RAW_CHUNKS
+	size_t numChunks = m_NumChunks[0]*m_NumChunks[1]*m_NumChunks[2];
+	m_Done = false;
+	m_Error = false;
+	// a few raw chunks per thread are kept to overlap reading and decompression
+	for (unsigned int n=0;n<2*m_NumThreads;++n)
+		m_Free.push_back(new Chunk());
+
+	boost::thread_group threads;
+	for (unsigned int n=0;n<m_NumThreads;++n)
+		threads.create_thread(boost::bind(&CSHDF5ChunkReader::DecodeLoop, this, data));
+
+	for (size_t c=0;c<numChunks;++c)
+	{
+		Chunk* chunk = NULL;
+		{
+			boost::mutex::scoped_lock lock(m_Mutex);
+			while (m_Free.empty() && (m_Error==false))
+				m_Condition.wait(lock);
+			if (m_Error)
+				break;
+			chunk = m_Free.back();
+			m_Free.pop_back();
+		}
+
+		size_t pos[3] = {c/(m_NumChunks[1]*m_NumChunks[2]), (c/m_NumChunks[2])%m_NumChunks[1], c%m_NumChunks[2]};
+		hsize_t offset[3];
+		for (int n=0;n<m_Rank;++n)
+			offset[n] = pos[n+3-m_Rank]*m_ChunkDims[n+3-m_Rank];
+		hsize_t numBytes = 0;
+		bool ok = (H5Dget_chunk_storage_size(m_Dataset, offset, &numBytes)>=0) && (numBytes>0);
+		chunk->m_Index = c;
+		chunk->m_FilterMask = 0;
+		if (ok)
+		{
+			chunk->m_Raw.resize(numBytes);
+			uint32_t filterMask = 0;
+			ok = (H5Dread_chunk(m_Dataset, H5P_DEFAULT, offset, &filterMask, &chunk->m_Raw[0])>=0);
+			chunk->m_FilterMask = filterMask;
+		}
+
+		boost::mutex::scoped_lock lock(m_Mutex);
+		if (ok==false)
+		{
+			std::cerr << "CSHDF5ChunkReader::Read: Error, failed to read chunk " << c << std::endl;
+			m_Error = true;
+			m_Free.push_back(chunk);
+			m_Condition.notify_all();
+			break;
+		}
+		m_Queue.push_back(chunk);
+		m_Condition.notify_all();
+	}
+
+	{
+		boost::mutex::scoped_lock lock(m_Mutex);
+		m_Done = true;
+		m_Condition.notify_all();
+	}
+	threads.join_all();
+	for (size_t i=0;i<m_Free.size();++i)
+		delete m_Free[i];
+	m_Free.clear();
+	return (m_Error==false);
+#else
+	(void)data;
+	return false;
+#endif
+}
+
+void CSHDF5ChunkReader::DecodeLoop(unsigned char* data)
+{
+	std::vector<unsigned char> buffer;
+	boost::mutex::scoped_lock lock(m_Mutex);
+	while (true)
+	{
+		while (m_Queue.empty() && (m_Done==false) && (m_Error==false))
+			m_Condition.wait(lock);
+		if (m_Error || m_Queue.empty())
+			return;
+		Chunk* chunk = m_Queue.front();
+		m_Queue.pop_front();
+		lock.unlock();
+
+		bool ok = DecodeChunk(chunk, data, buffer);
+
+		lock.lock();
+		if (ok==false)
+		{
+			if (m_Error==false)
+				std::cerr << "CSHDF5ChunkReader::Read: Error, failed to decompress chunk " << chunk->m_Index << std::endl;
+			m_Error = true;
+		}
+		m_Free.push_back(chunk);
+		m_Condition.notify_all();
+	}
+}
+
+bool CSHDF5ChunkReader::DecodeChunk(Chunk* chunk, unsigned char* data, std::vector<unsigned char> &buffer)
+{
+	size_t c = chunk->m_Index;
+	size_t start[3] = {c/(m_NumChunks[1]*m_NumChunks[2]), (c/m_NumChunks[2])%m_NumChunks[1], c%m_NumChunks[2]};
+	size_t count[3];
+	for (int n=0;n<3;++n)
+	{
+		start[n] *= m_ChunkDims[n];
+		count[n] = std::min(m_ChunkDims[n], m_Dims[n]-start[n]);
+	}
+	size_t chunkSize = m_ChunkDims[0]*m_ChunkDims[1]*m_ChunkDims[2];
+	unsigned char* target = data + (start[0]*m_Dims[1] + start[1])*m_Dims[2] + start[2];
+
+	// a chunk that covers complete, not truncated planes is decompressed directly into the target
+	bool direct = (m_ChunkDims[1]==m_Dims[1]) && (m_ChunkDims[2]==m_Dims[2]) && (count[0]==m_ChunkDims[0]);
+
+	const unsigned char* src = &chunk->m_Raw[0];
+	size_t srcSize = chunk->m_Raw.size();
+	// shuffle is a no-op for 1 byte data, only deflate has to be reverted if it was applied
+	if ((m_Deflate.size()>0) && ((chunk->m_FilterMask & (1u<<m_Deflate[0]))==0))
+	{
+		unsigned char* dest = target;
+		if (direct==false)
+		{
+			buffer.resize(chunkSize);
+			dest = &buffer[0];
+		}
+		uLongf destSize = chunkSize;
+		if ((uncompress(dest, &destSize, src, srcSize)!=Z_OK) || (destSize!=chunkSize))
+			return false;
+		if (direct)
+			return true;
+		src = dest;
+		srcSize = chunkSize;
+	}
+
+	if (srcSize!=chunkSize)
+		return false;
+	for (size_t i=0;i<count[0];++i)
+		for (size_t j=0;j<count[1];++j)
+			memcpy(target + (i*m_Dims[1]+j)*m_Dims[2], src + (i*m_ChunkDims[1]+j)*m_ChunkDims[2], count[2]);
+	return true;
+}
@@ -0,0 +1,83 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <stddef.h>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include "CSXCAD_Global.h"
+
+//! Read a complete uint8 HDF5 dataset of rank 1 to 3, decompressing the chunks in parallel
+/*!
+ The raw chunks of a deflate (and shuffle) compressed dataset are read by the calling thread and decompressed by a group of worker threads directly into the target buffer.
+ Datasets that are not chunked, not completely written, use other filters or need a type conversion (all but unsigned 1 byte integer) are read by a single H5Dread into the target buffer.
+ All HDF5 calls are made by the calling thread only, while holding the CSHDF5Lock.
+ */
+class CSXCAD_EXPORT CSHDF5ChunkReader
+{
+public:
+	//! Create a reader for an open dataset, the dataset is not closed by the reader
+	CSHDF5ChunkReader(long long dataset);
+	~CSHDF5ChunkReader();
+
+	//! Set the number of decompression threads, 0 to use the number of cores (default)
+	void SetNumberOfThreads(unsigned int val) {m_NumThreads=val;}
+
+	//! Read the complete dataset into data, which has to hold all dataset elements. \return false on error
+	bool Read(unsigned char* data);
+
+protected:
+	//! A raw chunk read from file
+	struct Chunk
+	{
+		unsigned int m_Index;
+		unsigned int m_FilterMask;
+		std::vector<unsigned char> m_Raw;
+	};
+
+	//! Check the dataset for parallel chunk decompression and setup the chunk layout
+	bool CheckChunked();
+	bool ReadChunked(unsigned char* data);
+	void DecodeLoop(unsigned char* data);
+	bool DecodeChunk(Chunk* chunk, unsigned char* data, std::vector<unsigned char> &buffer);
+
+	long long m_Dataset;
+	unsigned int m_NumThreads;
+
+	int m_Rank;
+	///Dataset and chunk size, padded to rank 3 with the first dimension being the slowest varying
+	size_t m_Dims[3];
+	size_t m_ChunkDims[3];
+	size_t m_NumChunks[3];
+	///Position of the deflate filter in the filter pipeline, if any
+	std::vector<int> m_Deflate;
+
+	std::deque<Chunk*> m_Queue;
+	std::vector<Chunk*> m_Free;
+	bool m_Done;
+	bool m_Error;
+	boost::mutex m_Mutex;
+	boost::condition_variable m_Condition;
+
+private:
+	CSHDF5ChunkReader(const CSHDF5ChunkReader&);
+	CSHDF5ChunkReader& operator=(const CSHDF5ChunkReader&);
+};
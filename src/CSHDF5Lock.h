@@ -0,0 +1,41 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <boost/thread/recursive_mutex.hpp>
+
+#include "CSXCAD_Global.h"
+
+//! Lock on the process-wide mutex serializing all HDF5 calls of CSXCAD
+/*!
+ HDF5 is usually not built thread-safe, so every HDF5 call has to be made while holding this lock, including calls from background threads.
+ The lock is recursive and may be taken again by a thread already holding it.
+ */
+class CSXCAD_EXPORT CSHDF5Lock
+{
+public:
+	CSHDF5Lock() : m_Lock(GetMutex()) {}
+
+protected:
+	static boost::recursive_mutex& GetMutex();
+	boost::recursive_mutex::scoped_lock m_Lock;
+
+private:
+	CSHDF5Lock(const CSHDF5Lock&);
+	CSHDF5Lock& operator=(const CSHDF5Lock&);
+};
@@ -0,0 +1,106 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <iostream>
+
+#if !defined(WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "CSMappedFile.h"
+
+CSMappedFile::CSMappedFile()
+{
+	m_Data = NULL;
+	m_Size = 0;
+	m_Mapped = false;
+}
+
+CSMappedFile::~CSMappedFile()
+{
+	Close();
+}
+
+bool CSMappedFile::Open(std::string filename)
+{
+	Close();
+#if !defined(WIN32)
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd<0)
+		return false;
+	struct stat st;
+	if ((fstat(fd, &st)!=0) || (st.st_size<=0))
+	{
+		close(fd);
+		return false;
+	}
+	void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data==MAP_FAILED)
+		return false;
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+	m_Data = (const char*)data;
+	m_Size = st.st_size;
+	m_Mapped = true;
+	return true;
+#else
+	FILE* file = fopen(filename.c_str(), "rb");
+	if (file==NULL)
+		return false;
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (size<=0)
+	{
+		fclose(file);
+		return false;
+	}
+	char* data = new char[size];
+	if (fread(data, 1, size, file)!=(size_t)size)
+	{
+		delete[] data;
+		fclose(file);
+		return false;
+	}
+	fclose(file);
+	m_Data = data;
+	m_Size = size;
+	m_Mapped = false;
+	return true;
+#endif
+}
+
+void CSMappedFile::Close()
+{
+	if (m_Data==NULL)
+		return;
+#if !defined(WIN32)
+	if (m_Mapped)
+		munmap((void*)m_Data, m_Size);
+	else
+		delete[] m_Data;
+#else
+	delete[] m_Data;
+#endif
+	m_Data = NULL;
+	m_Size = 0;
+	m_Mapped = false;
+}
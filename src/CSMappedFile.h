@@ -0,0 +1,55 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <string>
+#include <stddef.h>
+
+#include "CSXCAD_Global.h"
+
+//! Read-only memory mapped file
+/*!
+ Maps a complete file read-only into memory. On platforms without mmap support the file content is read into a buffer instead.
+ */
+class CSXCAD_EXPORT CSMappedFile
+{
+public:
+	CSMappedFile();
+	~CSMappedFile();
+
+	//! Map the given file, any previously mapped file is closed. \return true on success
+	bool Open(std::string filename);
+	//! Unmap and close the current file
+	void Close();
+
+	bool IsOpen() const {return m_Data!=NULL;}
+
+	//! Get the mapped file content, NULL if no file is open
+	const char* GetData() const {return m_Data;}
+	//! Get the size of the mapped file in bytes
+	size_t GetSize() const {return m_Size;}
+
+protected:
+	const char* m_Data;
+	size_t m_Size;
+	bool m_Mapped;
+
+private:
+	CSMappedFile(const CSMappedFile&);
+	CSMappedFile& operator=(const CSMappedFile&);
+};
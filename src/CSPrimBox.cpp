@@ -84,22 +84,86 @@ bool CSPrimBox::GetBoundBox(double dBoundBox[6], bool PreserveOrientation)
 	return true;
 }
 
+bool CSPrimBox::GetWorldBoundBox(double dBoundBox[6])
+{
+	if (m_Evaluated==false)
+		return false;
+	CoordinateSystem cs = m_PrimCoordSystem;
+	if (cs==UNDEFINED_CS)
+		cs = m_MeshType;
+	const double* start = m_Coords[0].GetCoords(m_PrimCoordSystem);
+	const double* stop  = m_Coords[1].GetCoords(m_PrimCoordSystem);
+	double box[6];
+	for (int n=0;n<3;++n)
+	{
+		box[2*n]   = std::min(start[n],stop[n]);
+		box[2*n+1] = std::max(start[n],stop[n]);
+	}
+	if (cs==CYLINDRICAL)
+		CylindricalToCartesianBox(box, box);
+	TransformBoundBox(box, dBoundBox);
+	return true;
+}
+
 bool CSPrimBox::IsInside(const double* Coord, double /*tol*/)
 {
 	if (Coord==NULL) return false;
+	if (m_InsideKernel==NULL)
+		SelectInsideKernel();
+	return m_InsideKernel(this,Coord);
+}
 
-	const double* start = m_Coords[0].GetCoords(m_PrimCoordSystem);
-	const double* stop  = m_Coords[1].GetCoords(m_PrimCoordSystem);
+template <CoordinateSystem MeshType, CoordinateSystem BoxType, bool Transformed> bool CSPrimBox::IsInsideKernel(const CSPrimitives* prim, const double* Coord)
+{
+	const CSPrimBox* box = static_cast<const CSPrimBox*>(prim);
+	const double* start = box->m_Coords[0].GetCoords(box->m_PrimCoordSystem);
+	const double* stop  = box->m_Coords[1].GetCoords(box->m_PrimCoordSystem);
 	double pos[3] = {Coord[0],Coord[1],Coord[2]};
 
-	TransformCoords(pos, true, m_MeshType);
 	//transform incoming coordinates into the coorindate system of the primitive
-	TransformCoordSystem(pos,pos,m_MeshType,m_PrimCoordSystem);
+	if (Transformed)
+	{
+		TransformToCartesian<MeshType>(pos,pos);
+		box->m_Transform->InvertTransform(pos,pos);
+		if (BoxType==CYLINDRICAL)
+			TransformCoordSystem(pos,pos,CARTESIAN,CYLINDRICAL);
+	}
+	else if (MeshType!=BoxType)
+	{
+		if (BoxType==CARTESIAN)
+			TransformToCartesian<MeshType>(pos,pos);
+		else
+			TransformCoordSystem(pos,pos,MeshType,BoxType);
+	}
+
+	if (BoxType==CYLINDRICAL)
+		return CoordInRange(pos, start, stop, CYLINDRICAL);
+	for (int n=0;n<3;++n)
+		if ((pos[n]<std::min(start[n],stop[n])) || (pos[n]>std::max(start[n],stop[n])))
+			return false;
+	return true;
+}
 
-	if (m_PrimCoordSystem!=UNDEFINED_CS)
-		return CoordInRange(pos, start, stop, m_PrimCoordSystem);
+void CSPrimBox::SelectInsideKernel()
+{
+	CoordinateSystem boxType = m_PrimCoordSystem;
+	if (boxType==UNDEFINED_CS)
+		boxType = m_MeshType;
+	bool transformed = (m_Transform!=NULL);
+	if (m_MeshType==CYLINDRICAL)
+	{
+		if (boxType==CYLINDRICAL)
+			m_InsideKernel = transformed ? &IsInsideKernel<CYLINDRICAL,CYLINDRICAL,true> : &IsInsideKernel<CYLINDRICAL,CYLINDRICAL,false>;
+		else
+			m_InsideKernel = transformed ? &IsInsideKernel<CYLINDRICAL,CARTESIAN,true> : &IsInsideKernel<CYLINDRICAL,CARTESIAN,false>;
+	}
 	else
-		return CoordInRange(pos, start, stop, m_MeshType);
+	{
+		if (boxType==CYLINDRICAL)
+			m_InsideKernel = transformed ? &IsInsideKernel<CARTESIAN,CYLINDRICAL,true> : &IsInsideKernel<CARTESIAN,CYLINDRICAL,false>;
+		else
+			m_InsideKernel = transformed ? &IsInsideKernel<CARTESIAN,CARTESIAN,true> : &IsInsideKernel<CARTESIAN,CARTESIAN,false>;
+	}
 }
 
 
@@ -116,6 +180,8 @@ bool CSPrimBox::Update(std::string *ErrStr)
 	m_Coords[1].SetCoordinateSystem(m_PrimCoordSystem, m_MeshType);
 	//update local bounding box
 	m_BoundBoxValid = GetBoundBox(m_BoundBox);
+	SelectInsideKernel();
+	m_Evaluated = bOK;
 	return bOK;
 }
 
@@ -44,6 +44,7 @@ public:
 	ParameterCoord* GetStopCoord() {return &m_Coords[1];}
 
 	virtual bool GetBoundBox(double dBoundBox[6], bool PreserveOrientation=false);
+	virtual bool GetWorldBoundBox(double dBoundBox[6]);
 	virtual bool IsInside(const double* Coord, double tol=0);
 
 	virtual bool Update(std::string *ErrStr=NULL);
@@ -53,6 +54,10 @@ public:
 	virtual void ShowPrimitiveStatus(std::ostream& stream);
 
 protected:
+	//! Select the specialized inside kernel for the current mesh type, box coordinate system and transformation
+	void SelectInsideKernel();
+	template <CoordinateSystem MeshType, CoordinateSystem BoxType, bool Transformed> static bool IsInsideKernel(const CSPrimitives* prim, const double* Coord);
+
 	//start and stop coords defining the box
 	ParameterCoord m_Coords[2];
 };
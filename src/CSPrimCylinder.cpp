@@ -111,33 +111,88 @@ bool CSPrimCylinder::GetBoundBox(double dBoundBox[6], bool PreserveOrientation)
 	return accurate;
 }
 
+void CSPrimCylinder::GetCylinderWorldBoundBox(double radius, double dBoundBox[6]) const
+{
+	const double* start=m_AxisCoords[0].GetCartesianCoords();
+	const double* stop =m_AxisCoords[1].GetCartesianCoords();
+	double dir[3] = {stop[0]-start[0],stop[1]-start[1],stop[2]-start[2]};
+	double len = sqrt(pow(dir[0],2)+pow(dir[1],2)+pow(dir[2],2));
+	if (len>0)
+		for (int n=0;n<3;++n)
+			dir[n]/=len;
+
+	double unit[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1};
+	const double* matrix = unit;
+	double w_start[3] = {start[0],start[1],start[2]};
+	double w_stop[3]  = {stop[0],stop[1],stop[2]};
+	if (HasWorldTransform())
+	{
+		matrix = m_Transform->GetMatrix();
+		m_Transform->Transform(start, w_start);
+		m_Transform->Transform(stop, w_stop);
+	}
+	// the circular cross-section is mapped onto an ellipse, its extent in direction n is radius*sqrt(|row_n|^2 - (row_n*dir)^2)
+	for (int n=0;n<3;++n)
+	{
+		const double* row = &matrix[4*n];
+		double row2 = pow(row[0],2)+pow(row[1],2)+pow(row[2],2);
+		double proj = row[0]*dir[0]+row[1]*dir[1]+row[2]*dir[2];
+		double ext = radius*sqrt(std::max(row2-proj*proj, 0.0));
+		dBoundBox[2*n]   = std::min(w_start[n],w_stop[n])-ext;
+		dBoundBox[2*n+1] = std::max(w_start[n],w_stop[n])+ext;
+	}
+}
+
+bool CSPrimCylinder::GetWorldBoundBox(double dBoundBox[6])
+{
+	if (m_Evaluated==false)
+		return false;
+	GetCylinderWorldBoundBox(psRadius.GetValue(), dBoundBox);
+	return true;
+}
+
 bool CSPrimCylinder::IsInside(const double* Coord, double /*tol*/)
 {
 	if (Coord==NULL) return false;
+	if (m_InsideKernel==NULL)
+		SelectInsideKernel();
+	return m_InsideKernel(this,Coord);
+}
 
-	const double* start=m_AxisCoords[0].GetCartesianCoords();
-	const double* stop =m_AxisCoords[1].GetCartesianCoords();
+template <CoordinateSystem MeshType, bool Transformed> bool CSPrimCylinder::IsInsideKernel(const CSPrimitives* prim, const double* Coord)
+{
+	const CSPrimCylinder* cyl = static_cast<const CSPrimCylinder*>(prim);
+	const double* start=cyl->m_AxisCoords[0].GetCartesianCoords();
+	const double* stop =cyl->m_AxisCoords[1].GetCartesianCoords();
 	double pos[3];
 	//transform incoming coordinates into cartesian coords
-	TransformCoordSystem(Coord,pos,m_MeshType,CARTESIAN);
-	if (m_Transform)
-		m_Transform->InvertTransform(pos,pos);
+	TransformToCartesian<MeshType>(Coord,pos);
+	if (Transformed)
+		cyl->m_Transform->InvertTransform(pos,pos);
 
 	for (int n=0;n<3;++n)
-		if (pos[n]<m_BoundBox[2*n] || pos[n]>m_BoundBox[2*n+1])
+		if (pos[n]<cyl->m_BoundBox[2*n] || pos[n]>cyl->m_BoundBox[2*n+1])
 			return false;
 
 	double foot,dist;
-	Point_Line_Distance(pos,start,stop,foot,dist);
+	Point_Line_Distance(pos,start,stop,foot,dist,CARTESIAN);
 
 	if ((foot<0) || (foot>1)) //the foot point is not on the axis
 		return false;
-	if (dist>psRadius.GetValue())
+	if (dist>cyl->psRadius.GetValue())
 		return false;
 
 	return true;
 }
 
+void CSPrimCylinder::SelectInsideKernel()
+{
+	if (m_MeshType==CYLINDRICAL)
+		m_InsideKernel = m_Transform ? &IsInsideKernel<CYLINDRICAL,true> : &IsInsideKernel<CYLINDRICAL,false>;
+	else
+		m_InsideKernel = m_Transform ? &IsInsideKernel<CARTESIAN,true> : &IsInsideKernel<CARTESIAN,false>;
+}
+
 bool CSPrimCylinder::Update(std::string *ErrStr)
 {
 	int EC=0;
@@ -166,6 +221,9 @@ bool CSPrimCylinder::Update(std::string *ErrStr)
 	//update local bounding box
 	m_BoundBoxValid = GetBoundBox(m_BoundBox);
 
+	SelectInsideKernel();
+
+	m_Evaluated = bOK;
 	return bOK;
 }
 
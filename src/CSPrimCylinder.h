@@ -50,6 +50,7 @@ public:
 	ParameterScalar* GetRadiusPS() {return &psRadius;}
 
 	virtual bool GetBoundBox(double dBoundBox[6], bool PreserveOrientation=false);
+	virtual bool GetWorldBoundBox(double dBoundBox[6]);
 	virtual bool IsInside(const double* Coord, double tol=0);
 
 	virtual bool Update(std::string *ErrStr=NULL);
@@ -59,6 +60,13 @@ public:
 	virtual void ShowPrimitiveStatus(std::ostream& stream);
 
 protected:
+	//! Select the specialized inside kernel for the current mesh type and transformation
+	virtual void SelectInsideKernel();
+	template <CoordinateSystem MeshType, bool Transformed> static bool IsInsideKernel(const CSPrimitives* prim, const double* Coord);
+
+	//! Calculate the exact cartesian bounding box of the (transformed) cylinder with the given radius
+	void GetCylinderWorldBoundBox(double radius, double dBoundBox[6]) const;
+
 	ParameterCoord m_AxisCoords[2];
 	ParameterScalar psRadius;
 };
@@ -104,32 +104,56 @@ bool CSPrimCylindricalShell::GetBoundBox(double dBoundBox[6], bool PreserveOrien
 	return accurate;
 }
 
+bool CSPrimCylindricalShell::GetWorldBoundBox(double dBoundBox[6])
+{
+	if (m_Evaluated==false)
+		return false;
+	GetCylinderWorldBoundBox(psRadius.GetValue()+psShellWidth.GetValue()/2.0, dBoundBox);
+	return true;
+}
+
 bool CSPrimCylindricalShell::IsInside(const double* Coord, double /*tol*/)
 {
 	if (Coord==NULL) return false;
-	const double* start=m_AxisCoords[0].GetCartesianCoords();
-	const double* stop =m_AxisCoords[1].GetCartesianCoords();
+	if (m_InsideKernel==NULL)
+		SelectInsideKernel();
+	return m_InsideKernel(this,Coord);
+}
+
+template <CoordinateSystem MeshType, bool Transformed> bool CSPrimCylindricalShell::IsInsideKernel(const CSPrimitives* prim, const double* Coord)
+{
+	const CSPrimCylindricalShell* shell = static_cast<const CSPrimCylindricalShell*>(prim);
+	const double* start=shell->m_AxisCoords[0].GetCartesianCoords();
+	const double* stop =shell->m_AxisCoords[1].GetCartesianCoords();
 	double pos[3];
 	//transform incoming coordinates into cartesian coords
-	TransformCoordSystem(Coord,pos,m_MeshType,CARTESIAN);
-	if (m_Transform)
-		m_Transform->InvertTransform(pos,pos);
+	TransformToCartesian<MeshType>(Coord,pos);
+	if (Transformed)
+		shell->m_Transform->InvertTransform(pos,pos);
 
 	for (int n=0;n<3;++n)
-		if (pos[n]<m_BoundBox[2*n] || pos[n]>m_BoundBox[2*n+1])
+		if (pos[n]<shell->m_BoundBox[2*n] || pos[n]>shell->m_BoundBox[2*n+1])
 			return false;
 
 	double foot,dist;
-	Point_Line_Distance(pos,start,stop,foot,dist);
+	Point_Line_Distance(pos,start,stop,foot,dist,CARTESIAN);
 
 	if ((foot<0) || (foot>1)) //the foot point is not on the axis
 		return false;
-	if (fabs(dist-psRadius.GetValue())>psShellWidth.GetValue()/2.0)
+	if (fabs(dist-shell->psRadius.GetValue())>shell->psShellWidth.GetValue()/2.0)
 		return false;
 
 	return true;
 }
 
+void CSPrimCylindricalShell::SelectInsideKernel()
+{
+	if (m_MeshType==CYLINDRICAL)
+		m_InsideKernel = m_Transform ? &IsInsideKernel<CYLINDRICAL,true> : &IsInsideKernel<CYLINDRICAL,false>;
+	else
+		m_InsideKernel = m_Transform ? &IsInsideKernel<CARTESIAN,true> : &IsInsideKernel<CARTESIAN,false>;
+}
+
 bool CSPrimCylindricalShell::Update(std::string *ErrStr)
 {
 	int EC=0;
@@ -149,6 +173,7 @@ bool CSPrimCylindricalShell::Update(std::string *ErrStr)
 	//update local bounding box
 	m_BoundBoxValid = GetBoundBox(m_BoundBox);
 
+	m_Evaluated = bOK;
 	return bOK;
 }
 
@@ -42,6 +42,7 @@ public:
 	ParameterScalar* GetShellWidthPS() {return &psShellWidth;}
 
 	virtual bool GetBoundBox(double dBoundBox[6], bool PreserveOrientation=false);
+	virtual bool GetWorldBoundBox(double dBoundBox[6]);
 	virtual bool IsInside(const double* Coord, double tol=0);
 
 	virtual bool Update(std::string *ErrStr=NULL);
@@ -51,6 +52,9 @@ public:
 	virtual void ShowPrimitiveStatus(std::ostream& stream);
 
 protected:
+	virtual void SelectInsideKernel();
+	template <CoordinateSystem MeshType, bool Transformed> static bool IsInsideKernel(const CSPrimitives* prim, const double* Coord);
+
 	ParameterScalar psShellWidth;
 };
 
@@ -0,0 +1,355 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sstream>
+#include <iostream>
+#include <limits>
+#include <algorithm>
+#include <math.h>
+#include <map>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include "tinyxml.h"
+
+#include "CSPrimGroup.h"
+#include "CSProperties.h"
+#include "CSTransform.h"
+#include "CSUseful.h"
+#include "ContinuousStructure.h"
+
+// pad a bounding box to stay conservative against round-off
+static void PadBoundBox(double box[6])
+{
+	for (int n=0;n<3;++n)
+	{
+		double pad = 1e-9*(fabs(box[2*n])+fabs(box[2*n+1])+1.0);
+		box[2*n]   -= pad;
+		box[2*n+1] += pad;
+	}
+}
+
+// shared children read in the current XML pass by their ID
+typedef std::map<unsigned int, boost::weak_ptr<void> > ChildSetRegistry;
+static ChildSetRegistry g_XMLChildSets;
+static unsigned int g_XMLPass = 1;
+static unsigned int g_XMLNextID = 1;
+static boost::mutex g_XMLMutex;
+
+void CSPrimGroup::NewXMLPass()
+{
+	boost::mutex::scoped_lock lock(g_XMLMutex);
+	++g_XMLPass;
+	g_XMLNextID = 1;
+	g_XMLChildSets.clear();
+}
+
+CSPrimGroup::ChildSet::ChildSet()
+{
+	m_UpdateOK = false;
+	m_XMLPass = 0;
+	m_XMLID = 0;
+}
+
+CSPrimGroup::ChildSet::~ChildSet()
+{
+	for (size_t i=0;i<m_Prims.size();++i)
+		delete m_Prims.at(i);
+	m_Prims.clear();
+}
+
+CSPrimGroup::CSPrimGroup(unsigned int ID, ParameterSet* paraSet, CSProperties* prop) : CSPrimitives(ID,paraSet,prop), m_Children(new ChildSet())
+{
+	Type=GROUP;
+	PrimTypeName = std::string("Group");
+	m_WorldBoxValid = false;
+}
+
+CSPrimGroup::CSPrimGroup(CSPrimGroup* group, CSProperties *prop) : CSPrimitives(group,prop), m_Children(group->m_Children)
+{
+	Type=GROUP;
+	PrimTypeName = std::string("Group");
+	m_WorldBoxValid = false;
+	// the first update of the new instance has to update the children
+	m_Children->m_Updated.clear();
+}
+
+CSPrimGroup::CSPrimGroup(ParameterSet* paraSet, CSProperties* prop) : CSPrimitives(paraSet,prop), m_Children(new ChildSet())
+{
+	Type=GROUP;
+	PrimTypeName = std::string("Group");
+	m_WorldBoxValid = false;
+}
+
+CSPrimGroup::~CSPrimGroup()
+{
+	m_Children->m_Updated.erase(this);
+}
+
+bool CSPrimGroup::AddChild(CSPrimitives* prim)
+{
+	if ((prim==NULL) || (prim==this))
+		return false;
+	std::vector<CSPrimitives*> &prims = m_Children->m_Prims;
+	if (std::find(prims.begin(), prims.end(), prim)!=prims.end())
+	{
+		std::cerr << "CSPrimGroup::AddChild: Error, primitive is already a child of this group" << std::endl;
+		return false;
+	}
+	// a group instance sharing the children of this group would contain itself
+	if (prim->ToGroup() && prim->ToGroup()->UsesChildSet(m_Children.get()))
+	{
+		std::cerr << "CSPrimGroup::AddChild: Error, a group can not contain an instance of itself" << std::endl;
+		return false;
+	}
+	prim->SetProperty(NULL);
+	prim->SetCoordInputType(CARTESIAN, false);
+	prims.push_back(prim);
+	// the bounding box of the new child is unknown until the next Update()
+	m_Children->m_ChildBox.resize(6*prims.size(), 0.0);
+	m_Children->m_ChildBoxValid.resize(prims.size(), 0);
+	m_Children->m_Updated.clear();
+	return true;
+}
+
+void CSPrimGroup::DeleteChild(size_t index)
+{
+	std::vector<CSPrimitives*> &prims = m_Children->m_Prims;
+	if (index>=prims.size())
+		return;
+	delete prims.at(index);
+	prims.erase(prims.begin()+index);
+	m_Children->m_ChildBox.erase(m_Children->m_ChildBox.begin()+6*index, m_Children->m_ChildBox.begin()+6*index+6);
+	m_Children->m_ChildBoxValid.erase(m_Children->m_ChildBoxValid.begin()+index);
+	m_Children->m_Updated.clear();
+}
+
+bool CSPrimGroup::UsesChildSet(const ChildSet* children)
+{
+	if (m_Children.get()==children)
+		return true;
+	for (size_t i=0;i<m_Children->m_Prims.size();++i)
+	{
+		CSPrimGroup* group = m_Children->m_Prims.at(i)->ToGroup();
+		if (group && group->UsesChildSet(children))
+			return true;
+	}
+	return false;
+}
+
+bool CSPrimGroup::GetBoundBox(double dBoundBox[6], bool PreserveOrientation)
+{
+	UNUSED(PreserveOrientation); //has no orientation or preserved anyways
+	m_BoundBox_CoordSys = CARTESIAN;
+	m_Dimension = 0;
+	const ChildSet* children = m_Children.get();
+	size_t num = children->m_Prims.size();
+	bool valid = (num>0);
+	for (int n=0;n<3;++n)
+	{
+		dBoundBox[2*n] = std::numeric_limits<double>::max();
+		dBoundBox[2*n+1] = -std::numeric_limits<double>::max();
+	}
+	for (size_t i=0;i<num;++i)
+	{
+		m_Dimension = std::max(m_Dimension, children->m_Prims.at(i)->GetDimension());
+		if ((valid==false) || (children->m_ChildBoxValid.at(i)==0))
+		{
+			valid = false;
+			continue;
+		}
+		for (int n=0;n<3;++n)
+		{
+			dBoundBox[2*n] = std::min(dBoundBox[2*n], children->m_ChildBox.at(6*i+2*n));
+			dBoundBox[2*n+1] = std::max(dBoundBox[2*n+1], children->m_ChildBox.at(6*i+2*n+1));
+		}
+	}
+	if (valid==false)
+		for (int n=0;n<6;++n)
+			dBoundBox[n] = 0;
+	return valid;
+}
+
+bool CSPrimGroup::IsInside(const double* Coord, double tol)
+{
+	if (Coord==NULL) return false;
+	const ChildSet* children = m_Children.get();
+	size_t num = children->m_Prims.size();
+	if (num==0)
+		return false;
+
+	double pos[3];
+	TransformCoordSystem(Coord, pos, m_MeshType, CARTESIAN);
+	if (m_WorldBoxValid)
+		for (int n=0;n<3;++n)
+			if ((pos[n]<m_WorldBox[2*n]-tol) || (pos[n]>m_WorldBox[2*n+1]+tol))
+				return false;
+
+	// transform once into the group coordinate system shared by all children
+	if (m_Transform)
+		m_Transform->InvertTransform(pos, pos);
+
+	for (size_t i=0;i<num;++i)
+	{
+		if (children->m_ChildBoxValid[i])
+		{
+			const double* box = &children->m_ChildBox[6*i];
+			if ((pos[0]<box[0]-tol) || (pos[0]>box[1]+tol) || (pos[1]<box[2]-tol) || (pos[1]>box[3]+tol) || (pos[2]<box[4]-tol) || (pos[2]>box[5]+tol))
+				continue;
+		}
+		if (children->m_Prims[i]->IsInside(pos, tol))
+			return true;
+	}
+	return false;
+}
+
+bool CSPrimGroup::UpdateChildren(std::string *ErrStr)
+{
+	bool bOK=true;
+	ChildSet* children = m_Children.get();
+	size_t num = children->m_Prims.size();
+	children->m_ChildBox.assign(6*num, 0.0);
+	children->m_ChildBoxValid.assign(num, 0);
+	for (size_t i=0;i<num;++i)
+	{
+		CSPrimitives* child = children->m_Prims.at(i);
+		child->SetCoordInputType(CARTESIAN, false);
+		if (child->Update(ErrStr)==false)
+		{
+			bOK=false;
+			if (ErrStr!=NULL)
+			{
+				std::stringstream stream;
+				stream << std::endl << "Error in Group (ID: " << uiID << "): invalid child primitive #" << i << std::endl;
+				ErrStr->append(stream.str());
+			}
+		}
+		double* box = &children->m_ChildBox[6*i];
+		if (child->GetWorldBoundBox(box))
+		{
+			PadBoundBox(box);
+			children->m_ChildBoxValid[i] = 1;
+		}
+	}
+	return bOK;
+}
+
+bool CSPrimGroup::Update(std::string *ErrStr)
+{
+	// the shared children are updated once per update pass of all instances
+	ChildSet* children = m_Children.get();
+	if (children->m_Updated.empty() || (children->m_Updated.count(this)>0))
+	{
+		children->m_Updated.clear();
+		children->m_UpdateOK = UpdateChildren(ErrStr);
+	}
+	children->m_Updated.insert(this);
+	bool bOK = children->m_UpdateOK;
+
+	//update local bounding box
+	m_BoundBoxValid = GetBoundBox(m_BoundBox);
+
+	//the bounding box including the transformation of this instance is used to cull coordinates in IsInside
+	m_WorldBoxValid = m_BoundBoxValid && GetWorldBoundBox(m_WorldBox);
+	if (m_WorldBoxValid)
+		PadBoundBox(m_WorldBox);
+	return bOK;
+}
+
+bool CSPrimGroup::Write2XML(TiXmlElement &elem, bool parameterised)
+{
+	CSPrimitives::Write2XML(elem,parameterised);
+
+	TiXmlElement Children("Children");
+	// shared children are written once per XML pass, all other instances only reference them
+	bool shared = (m_Children.use_count()>1);
+	if (shared)
+	{
+		boost::mutex::scoped_lock lock(g_XMLMutex);
+		if (m_Children->m_XMLPass==g_XMLPass)
+		{
+			Children.SetAttribute("ID", m_Children->m_XMLID);
+			elem.InsertEndChild(Children);
+			return true;
+		}
+		m_Children->m_XMLPass = g_XMLPass;
+		m_Children->m_XMLID = g_XMLNextID++;
+		Children.SetAttribute("ID", m_Children->m_XMLID);
+	}
+	for (size_t i=0;i<m_Children->m_Prims.size();++i)
+	{
+		CSPrimitives* child = m_Children->m_Prims.at(i);
+		TiXmlElement ChildElem(child->GetTypeName().c_str());
+		child->Write2XML(ChildElem,parameterised);
+		Children.InsertEndChild(ChildElem);
+	}
+	elem.InsertEndChild(Children);
+	return true;
+}
+
+bool CSPrimGroup::ReadFromXML(TiXmlNode &root)
+{
+	if (CSPrimitives::ReadFromXML(root)==false) return false;
+
+	m_Children->m_Updated.erase(this);
+	m_Children.reset(new ChildSet());
+	TiXmlElement* Children = root.FirstChildElement("Children");
+	if (Children==NULL)
+		return true;
+
+	// use the children of a previous instance with the same ID in this XML pass, else read a new set
+	int id;
+	bool shared = (Children->QueryIntAttribute("ID",&id)==TIXML_SUCCESS);
+	if (shared)
+	{
+		boost::mutex::scoped_lock lock(g_XMLMutex);
+		ChildSetRegistry::iterator it = g_XMLChildSets.find(id);
+		boost::shared_ptr<ChildSet> children;
+		if (it!=g_XMLChildSets.end())
+			children = boost::static_pointer_cast<ChildSet>(it->second.lock());
+		if (children)
+		{
+			m_Children = children;
+			m_Children->m_Updated.clear();
+			return true;
+		}
+		g_XMLChildSets[id] = m_Children;
+	}
+	TiXmlElement* ChildNode = Children->FirstChildElement();
+	while (ChildNode!=NULL)
+	{
+		CSPrimitives* child = ContinuousStructure::CreatePrimitive(ChildNode->Value(), clParaSet, NULL);
+		if (child==NULL)
+		{
+			std::cerr << "CSPrimGroup::ReadFromXML: Error, child primitive with type: " << ChildNode->Value() << " is unknown" << std::endl;
+			return false;
+		}
+		if (child->ReadFromXML(*ChildNode)==false)
+		{
+			delete child;
+			return false;
+		}
+		AddChild(child);
+		ChildNode = ChildNode->NextSiblingElement();
+	}
+	return true;
+}
+
+void CSPrimGroup::ShowPrimitiveStatus(std::ostream& stream)
+{
+	CSPrimitives::ShowPrimitiveStatus(stream);
+	stream << "  Children: " << GetQtyChildren() << " Instances: " << GetQtyInstances() << std::endl;
+}
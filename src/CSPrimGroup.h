@@ -0,0 +1,97 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include <set>
+#include <boost/shared_ptr.hpp>
+
+#include "CSPrimitives.h"
+
+//! Group Primitive (instance of a set of child primitives)
+/*!
+ This primitive is defined by a set of child primitives placed by the transformation of the group. The children are defined in the cartesian coordinate system of the group.
+ Copies of a group (see GetCopy) are instances sharing the same children, each instance may have its own transformation and property. Adding or removing a child will affect all instances, Update() has to be called afterwards.
+ The shared children are updated only by the first instance of an update pass, an instance that is updated a second time starts a new pass.
+ In a XML file the children of shared instances are written only once with an ID, all other instances reference this ID (see NewXMLPass).
+ A coordinate is first tested against the bounding box of the whole group, then transformed once into the group system and tested against the bounding box of each child and finally against the child itself.
+ */
+class CSXCAD_EXPORT CSPrimGroup : public CSPrimitives
+{
+public:
+	CSPrimGroup(ParameterSet* paraSet, CSProperties* prop);
+	CSPrimGroup(CSPrimGroup* group, CSProperties *prop=NULL);
+	CSPrimGroup(unsigned int ID, ParameterSet* paraSet, CSProperties* prop);
+	virtual ~CSPrimGroup();
+
+	//! Create a new instance of this group sharing all children
+	virtual CSPrimitives* GetCopy(CSProperties *prop=NULL) {return new CSPrimGroup(this,prop);}
+
+	//! Add a child primitive to this group, the group takes ownership. The child is removed from its property, if any. \return false if prim is NULL, already a child or a group containing the children of this group
+	bool AddChild(CSPrimitives* prim);
+	//! Remove and delete a child primitive
+	void DeleteChild(size_t index);
+
+	size_t GetQtyChildren() const {return m_Children->m_Prims.size();}
+	CSPrimitives* GetChild(size_t index) const {if (index<m_Children->m_Prims.size()) return m_Children->m_Prims.at(index); else return NULL;}
+
+	//! Get the number of group instances sharing the children of this group (including this group)
+	long GetQtyInstances() const {return m_Children.use_count();}
+
+	//! Get the bounding box of all children in the group coordinate system (the transformation of this group is not included)
+	virtual bool GetBoundBox(double dBoundBox[6], bool PreserveOrientation=false);
+	virtual bool IsInside(const double* Coord, double tol=0);
+
+	virtual bool Update(std::string *ErrStr=NULL);
+	virtual bool Write2XML(TiXmlElement &elem, bool parameterised=true);
+	virtual bool ReadFromXML(TiXmlNode &root);
+
+	virtual void ShowPrimitiveStatus(std::ostream& stream);
+
+	//! Start a new XML document, all shared children are written (and read) again in full once
+	static void NewXMLPass();
+
+protected:
+	//! Child primitives shared by all instances of a group
+	struct ChildSet
+	{
+		ChildSet();
+		~ChildSet();
+		std::vector<CSPrimitives*> m_Prims;
+		///Conservative bounding box of each child in the group coordinate system, updated by Update()
+		std::vector<double> m_ChildBox;
+		///Flag for each child if its bounding box is known
+		std::vector<unsigned char> m_ChildBoxValid;
+		///Instances updated since the children were updated and the result of the children update
+		std::set<const CSPrimGroup*> m_Updated;
+		bool m_UpdateOK;
+		///XML pass in which the children were last written and their ID in this pass
+		unsigned int m_XMLPass;
+		unsigned int m_XMLID;
+	};
+	//! Update all shared children and their bounding boxes
+	bool UpdateChildren(std::string *ErrStr);
+	//! Check if the given children are used by this group or any of its child groups
+	bool UsesChildSet(const ChildSet* children);
+
+	boost::shared_ptr<ChildSet> m_Children;
+
+	///Conservative world bounding box of this instance, updated by Update()
+	bool m_WorldBoxValid;
+	double m_WorldBox[6];
+};
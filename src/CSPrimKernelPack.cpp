@@ -0,0 +1,481 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+#include "CSPrimKernelPack.h"
+#include "ContinuousStructure.h"
+#include "CSPrimBox.h"
+#include "CSPrimSphere.h"
+#include "CSPrimSphericalShell.h"
+#include "CSPrimCylinder.h"
+#include "CSPrimCylindricalShell.h"
+#include "CSTransform.h"
+
+namespace
+{
+struct KeyCompare
+{
+	KeyCompare(const std::vector<long long>& keys) : m_Keys(keys) {}
+	bool operator()(unsigned int a, unsigned int b) const {return m_Keys[a]>m_Keys[b];}
+	const std::vector<long long>& m_Keys;
+};
+
+template <typename T> void PermuteVector(std::vector<T>& vec, const std::vector<unsigned int>& order, unsigned int stride=1)
+{
+	if (vec.empty())
+		return;
+	std::vector<T> sorted(vec.size());
+	for (size_t i=0;i<order.size();++i)
+		for (unsigned int k=0;k<stride;++k)
+			sorted[i*stride+k] = vec[order[i]*stride+k];
+	vec.swap(sorted);
+}
+
+// The kernels below reproduce the IsInside methods of the respective primitives for cartesian coordinates.
+// They are written branch-free to allow the compiler to vectorize them.
+
+void BoxKernel(unsigned int num, const double* x, const double* y, const double* z, const double* p, unsigned char* inside)
+{
+	for (unsigned int j=0;j<num;++j)
+		inside[j] = (x[j]>=p[0]) & (x[j]<=p[3]) & (y[j]>=p[1]) & (y[j]<=p[4]) & (z[j]>=p[2]) & (z[j]<=p[5]);
+}
+
+void SphereKernel(unsigned int num, const double* x, const double* y, const double* z, const double* p, unsigned char* inside)
+{
+	for (unsigned int j=0;j<num;++j)
+	{
+		double dx=x[j]-p[0], dy=y[j]-p[1], dz=z[j]-p[2];
+		inside[j] = sqrt(dx*dx+dy*dy+dz*dz)<p[3];
+	}
+}
+
+void SphericalShellKernel(unsigned int num, const double* x, const double* y, const double* z, const double* p, unsigned char* inside)
+{
+	for (unsigned int j=0;j<num;++j)
+	{
+		double dx=x[j]-p[0], dy=y[j]-p[1], dz=z[j]-p[2];
+		inside[j] = fabs(sqrt(dx*dx+dy*dy+dz*dz)-p[3])<p[4];
+	}
+}
+
+// common part of the cylinder kernels, returns the inside flag for the bounding box and axis range and the distance to the axis
+inline unsigned char CylinderAxis(double x, double y, double z, const double* p, double &dist)
+{
+	unsigned char in = (x>=p[8]) & (x<=p[9]) & (y>=p[10]) & (y<=p[11]) & (z>=p[12]) & (z<=p[13]);
+	double foot = (x-p[0])*p[3] + (y-p[1])*p[4] + (z-p[2])*p[5];
+	foot /= p[6];
+	double dx = x-(p[0]+foot*p[3]);
+	double dy = y-(p[1]+foot*p[4]);
+	double dz = z-(p[2]+foot*p[5]);
+	dist = sqrt(dx*dx+dy*dy+dz*dz);
+	return in & (foot>=0) & (foot<=1);
+}
+
+void CylinderKernel(unsigned int num, const double* x, const double* y, const double* z, const double* p, unsigned char* inside)
+{
+	double dist;
+	for (unsigned int j=0;j<num;++j)
+		inside[j] = CylinderAxis(x[j],y[j],z[j],p,dist) & (dist<=p[7]);
+}
+
+void CylindricalShellKernel(unsigned int num, const double* x, const double* y, const double* z, const double* p, unsigned char* inside)
+{
+	double dist;
+	for (unsigned int j=0;j<num;++j)
+		inside[j] = CylinderAxis(x[j],y[j],z[j],p,dist) & (fabs(dist-p[7])<=p[14]);
+}
+}
+
+CSPrimKernelPack::CSPrimKernelPack()
+{
+	m_MeshType = CARTESIAN;
+}
+
+CSPrimKernelPack::~CSPrimKernelPack()
+{
+}
+
+void CSPrimKernelPack::Clear()
+{
+	for (int kt=0;kt<KERNEL_COUNT;++kt)
+		m_Tables[kt] = KernelTable();
+	m_Prims.clear();
+	m_Props.clear();
+	m_Fallback.clear();
+	m_FallbackKey.clear();
+}
+
+size_t CSPrimKernelPack::GetQtyPacked() const
+{
+	size_t num=0;
+	for (int kt=0;kt<KERNEL_COUNT;++kt)
+		num += m_Tables[kt].m_Key.size();
+	return num;
+}
+
+long long CSPrimKernelPack::CreateKey(int priority, unsigned int rank)
+{
+	return (long long)priority*4294967296LL + (4294967295LL - rank);
+}
+
+bool CSPrimKernelPack::Compile(ContinuousStructure* CSX, CSProperties::PropertyType type)
+{
+	Clear();
+	if (CSX==NULL)
+	{
+		std::cerr << "CSPrimKernelPack::Compile: Error, no structure given" << std::endl;
+		return false;
+	}
+	m_MeshType = CSX->GetCoordInputType();
+
+	// the rank reproduces the order of properties and primitives used by ContinuousStructure::GetPropertyByCoordPriority for equal priorities
+	unsigned int rank = 0;
+	for (size_t p=0;p<CSX->GetQtyProperties();++p)
+	{
+		CSProperties* prop = CSX->GetProperty(p);
+		if ((type!=CSProperties::ANY) && ((prop->GetType() & type)==0))
+			continue;
+		for (size_t n=0;n<prop->GetQtyPrimitives();++n)
+		{
+			CSPrimitives* prim = prop->GetPrimitive(n);
+			unsigned int index = m_Prims.size();
+			long long key = CreateKey(prim->GetPriority(), rank++);
+			m_Prims.push_back(prim);
+			m_Props.push_back(prop);
+			if (PackPrimitive(prim, index, key)==false)
+			{
+				m_Fallback.push_back(index);
+				m_FallbackKey.push_back(key);
+			}
+		}
+	}
+	SortTables();
+	return true;
+}
+
+bool CSPrimKernelPack::PackPrimitive(CSPrimitives* prim, unsigned int index, long long key)
+{
+	if (prim->GetCoordInputType()!=m_MeshType)
+		return false;
+	const CSTransform* transform = prim->GetTransformPtr();
+
+	double param[16];
+	double box[6];
+	switch (prim->GetType())
+	{
+	case CSPrimitives::BOX:
+	{
+		CoordinateSystem cs = prim->GetCoordinateSystem();
+		if (cs==UNDEFINED_CS)
+			cs = m_MeshType;
+		if (cs!=CARTESIAN)
+			return false;
+		// a transformed box is tested in the mesh coordinate system, only equivalent for a cartesian mesh
+		if (transform && (m_MeshType!=CARTESIAN))
+			return false;
+		CSPrimBox* prim_box = prim->ToBox();
+		const double* start = prim_box->GetStartCoord()->GetCoords(prim->GetCoordinateSystem());
+		const double* stop  = prim_box->GetStopCoord()->GetCoords(prim->GetCoordinateSystem());
+		for (int n=0;n<3;++n)
+		{
+			param[n]   = std::min(start[n],stop[n]);
+			param[n+3] = std::max(start[n],stop[n]);
+			box[2*n]   = param[n];
+			box[2*n+1] = param[n+3];
+		}
+		AddToTable(KERNEL_BOX, param, 6, box, prim, index, key);
+		return true;
+	}
+	case CSPrimitives::SPHERE:
+	case CSPrimitives::SPHERICALSHELL:
+	{
+		CSPrimSphere* sphere = (CSPrimSphere*)prim;
+		const double* center = sphere->GetCenter()->GetCartesianCoords();
+		for (int n=0;n<3;++n)
+			param[n] = center[n];
+		param[3] = sphere->GetRadius();
+		double ext = param[3];
+		KernelType kt = KERNEL_SPHERE;
+		if (prim->GetType()==CSPrimitives::SPHERICALSHELL)
+		{
+			param[4] = prim->ToSphericalShell()->GetShellWidth()/2.0;
+			ext += param[4];
+			kt = KERNEL_SPHERICALSHELL;
+		}
+		for (int n=0;n<3;++n)
+		{
+			box[2*n]   = center[n]-ext;
+			box[2*n+1] = center[n]+ext;
+		}
+		AddToTable(kt, param, kt==KERNEL_SPHERE ? 4 : 5, box, prim, index, key);
+		return true;
+	}
+	case CSPrimitives::CYLINDER:
+	case CSPrimitives::CYLINDRICALSHELL:
+	{
+		CSPrimCylinder* cylinder = (CSPrimCylinder*)prim;
+		const double* start = cylinder->GetAxisStartCoord()->GetCartesianCoords();
+		const double* stop  = cylinder->GetAxisStopCoord()->GetCartesianCoords();
+		// the (possibly inaccurate) bounding box is part of the cylinder inside test
+		prim->GetBoundBox(box);
+		for (int n=0;n<3;++n)
+		{
+			param[n]   = start[n];
+			param[n+3] = stop[n]-start[n];
+		}
+		param[6] = param[3]*param[3] + param[4]*param[4] + param[5]*param[5];
+		param[7] = cylinder->GetRadius();
+		for (int n=0;n<6;++n)
+			param[8+n] = box[n];
+		KernelType kt = KERNEL_CYLINDER;
+		if (prim->GetType()==CSPrimitives::CYLINDRICALSHELL)
+		{
+			param[14] = prim->ToCylindricalShell()->GetShellWidth()/2.0;
+			kt = KERNEL_CYLINDRICALSHELL;
+		}
+		AddToTable(kt, param, kt==KERNEL_CYLINDER ? 14 : 15, box, prim, index, key);
+		return true;
+	}
+	default:
+		return false;
+	}
+	return false;
+}
+
+void CSPrimKernelPack::AddToTable(KernelType kt, const double* param, unsigned int numParam, const double localBox[6], CSPrimitives* prim, unsigned int index, long long key)
+{
+	KernelTable& table = m_Tables[kt];
+	for (unsigned int k=0;k<numParam;++k)
+		table.m_Param[k].push_back(param[k]);
+
+	const CSTransform* transform = prim->GetTransformPtr();
+	const double* inv = NULL;
+	bool transformed = false;
+	if (transform)
+	{
+		// the primitive applies its inverse matrix even if no transformation was added, skip it only if it is the identity
+		inv = transform->GetInverseMatrix();
+		transformed = (transform->GetMatrixType()!=CSTransform::IDENTITY_MATRIX);
+	}
+	for (int m=0;m<3;++m)
+		for (int n=0;n<4;++n)
+			table.m_InvMatrix.push_back(transformed ? inv[4*m+n] : (m==n ? 1.0 : 0.0));
+	table.m_Transformed.push_back(transformed);
+
+	double box[6];
+	if (prim->GetWorldBoundBox(box)==false)
+	{
+		// transform all corners of the local box into the world
+		for (int n=0;n<3;++n)
+		{
+			box[2*n]   = std::numeric_limits<double>::max();
+			box[2*n+1] = -std::numeric_limits<double>::max();
+		}
+		double corner[3], world[3];
+		for (int c=0;c<8;++c)
+		{
+			for (int n=0;n<3;++n)
+				corner[n] = localBox[2*n+((c>>n)&1)];
+			if (transformed)
+				transform->Transform(corner, world);
+			else
+				for (int n=0;n<3;++n)
+					world[n] = corner[n];
+			for (int n=0;n<3;++n)
+			{
+				box[2*n]   = std::min(box[2*n],   world[n]);
+				box[2*n+1] = std::max(box[2*n+1], world[n]);
+			}
+		}
+	}
+	// pad the box to stay conservative against round-off
+	for (int n=0;n<3;++n)
+	{
+		double pad = 1e-9*(fabs(box[2*n])+fabs(box[2*n+1])+1.0);
+		box[2*n]   -= pad;
+		box[2*n+1] += pad;
+	}
+	for (int n=0;n<6;++n)
+		table.m_BoundBox[n].push_back(box[n]);
+	table.m_Key.push_back(key);
+	table.m_Index.push_back(index);
+}
+
+void CSPrimKernelPack::SortTables()
+{
+	for (int kt=0;kt<KERNEL_COUNT;++kt)
+	{
+		KernelTable& table = m_Tables[kt];
+		std::vector<unsigned int> order(table.m_Key.size());
+		for (size_t i=0;i<order.size();++i)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), KeyCompare(table.m_Key));
+		for (int k=0;k<16;++k)
+			PermuteVector(table.m_Param[k], order);
+		PermuteVector(table.m_InvMatrix, order, 12);
+		PermuteVector(table.m_Transformed, order);
+		for (int n=0;n<6;++n)
+			PermuteVector(table.m_BoundBox[n], order);
+		PermuteVector(table.m_Key, order);
+		PermuteVector(table.m_Index, order);
+	}
+
+	std::vector<unsigned int> order(m_Fallback.size());
+	for (size_t i=0;i<order.size();++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), KeyCompare(m_FallbackKey));
+	PermuteVector(m_Fallback, order);
+	PermuteVector(m_FallbackKey, order);
+}
+
+void CSPrimKernelPack::EvaluateTable(KernelType kt, unsigned int num, const double* const pos[3], const double blockBox[6], long long* bestKey, unsigned int* winner) const
+{
+	const KernelTable& table = m_Tables[kt];
+	double local[3][BlockSize];
+	unsigned char inside[BlockSize];
+	double param[16];
+
+	long long minKey = bestKey[0];
+	for (unsigned int j=1;j<num;++j)
+		minKey = std::min(minKey, bestKey[j]);
+
+	for (size_t i=0;i<table.m_Key.size();++i)
+	{
+		const long long key = table.m_Key[i];
+		// the table is sorted, no remaining primitive can win any coordinate of this block
+		if (key<=minKey)
+			return;
+
+		bool outside = false;
+		for (int n=0;n<3;++n)
+			outside |= (blockBox[2*n+1]<table.m_BoundBox[2*n][i]) || (blockBox[2*n]>table.m_BoundBox[2*n+1][i]);
+		if (outside)
+			continue;
+
+		const double* x = pos[0];
+		const double* y = pos[1];
+		const double* z = pos[2];
+		if (table.m_Transformed[i])
+		{
+			const double* M = &table.m_InvMatrix[12*i];
+			for (unsigned int j=0;j<num;++j)
+			{
+				local[0][j] = M[0]*x[j] + M[1]*y[j] + M[2]*z[j]  + M[3];
+				local[1][j] = M[4]*x[j] + M[5]*y[j] + M[6]*z[j]  + M[7];
+				local[2][j] = M[8]*x[j] + M[9]*y[j] + M[10]*z[j] + M[11];
+			}
+			x = local[0];
+			y = local[1];
+			z = local[2];
+		}
+
+		for (int k=0;k<16;++k)
+			if (table.m_Param[k].size())
+				param[k] = table.m_Param[k][i];
+
+		switch (kt)
+		{
+		case KERNEL_BOX:
+			BoxKernel(num, x, y, z, param, inside);
+			break;
+		case KERNEL_SPHERE:
+			SphereKernel(num, x, y, z, param, inside);
+			break;
+		case KERNEL_SPHERICALSHELL:
+			SphericalShellKernel(num, x, y, z, param, inside);
+			break;
+		case KERNEL_CYLINDER:
+			CylinderKernel(num, x, y, z, param, inside);
+			break;
+		case KERNEL_CYLINDRICALSHELL:
+			CylindricalShellKernel(num, x, y, z, param, inside);
+			break;
+		default:
+			return;
+		}
+
+		// priority resolution, a primitive wins if it is hit and has a larger key
+		const unsigned int index = table.m_Index[i];
+		minKey = std::numeric_limits<long long>::max();
+		for (unsigned int j=0;j<num;++j)
+		{
+			const bool take = inside[j] & (key>bestKey[j]);
+			bestKey[j] = take ? key : bestKey[j];
+			winner[j]  = take ? index : winner[j];
+			minKey = std::min(minKey, bestKey[j]);
+		}
+	}
+}
+
+void CSPrimKernelPack::GetPropertiesByCoordPriority(const double* coords, size_t numCoords, CSProperties** props, CSPrimitives** prims) const
+{
+	const unsigned int noHit = (unsigned int)-1;
+	double pos[3][BlockSize];
+	const double* const posPtr[3] = {pos[0], pos[1], pos[2]};
+	long long bestKey[BlockSize];
+	unsigned int winner[BlockSize];
+	double cart[3];
+	double blockBox[6];
+
+	for (size_t start=0;start<numCoords;start+=BlockSize)
+	{
+		unsigned int num = (unsigned int)std::min<size_t>(BlockSize, numCoords-start);
+		for (int n=0;n<3;++n)
+		{
+			blockBox[2*n]   = std::numeric_limits<double>::max();
+			blockBox[2*n+1] = -std::numeric_limits<double>::max();
+		}
+		for (unsigned int j=0;j<num;++j)
+		{
+			TransformCoordSystem(&coords[3*(start+j)], cart, m_MeshType, CARTESIAN);
+			for (int n=0;n<3;++n)
+			{
+				pos[n][j] = cart[n];
+				blockBox[2*n]   = std::min(blockBox[2*n],   cart[n]);
+				blockBox[2*n+1] = std::max(blockBox[2*n+1], cart[n]);
+			}
+			bestKey[j] = std::numeric_limits<long long>::min();
+			winner[j] = noHit;
+		}
+
+		for (int kt=0;kt<KERNEL_COUNT;++kt)
+			EvaluateTable((KernelType)kt, num, posPtr, blockBox, bestKey, winner);
+
+		for (unsigned int j=0;j<num;++j)
+		{
+			// the fallback list is sorted, the first hit with a larger key wins
+			for (size_t f=0;f<m_Fallback.size();++f)
+			{
+				if (m_FallbackKey[f]<=bestKey[j])
+					break;
+				if (m_Prims[m_Fallback[f]]->IsInside(&coords[3*(start+j)]))
+				{
+					bestKey[j] = m_FallbackKey[f];
+					winner[j] = m_Fallback[f];
+					break;
+				}
+			}
+			props[start+j] = winner[j]==noHit ? NULL : m_Props[winner[j]];
+			if (prims)
+				prims[start+j] = winner[j]==noHit ? NULL : m_Prims[winner[j]];
+		}
+	}
+}
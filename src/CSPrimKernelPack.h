@@ -0,0 +1,112 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "CSXCAD_Global.h"
+#include "CSProperties.h"
+
+class ContinuousStructure;
+class CSPrimitives;
+
+//! Compiled structure-of-arrays representation of the analytic primitives of a structure
+/*!
+ All boxes, spheres, cylinders and spherical/cylindrical shells of a structure are gathered into type-grouped tables of evaluated coordinates, radii, inverse transformation matrices and priorities.
+ Blocks of coordinates are tested against these tables in tight loops without virtual calls. All other primitives are tested using their IsInside method.
+ The result is the same as calling ContinuousStructure::GetPropertyByCoordPriority for each coordinate.
+ The pack has to be compiled again after the structure or any of its parameter was changed.
+ */
+class CSXCAD_EXPORT CSPrimKernelPack
+{
+public:
+	CSPrimKernelPack();
+	virtual ~CSPrimKernelPack();
+
+	//! Gather all primitives of the given property type from an updated structure. \return false if CSX is NULL
+	bool Compile(ContinuousStructure* CSX, CSProperties::PropertyType type=CSProperties::ANY);
+	//! Remove all primitives from this pack
+	void Clear();
+
+	//! Get the number of primitives evaluated by the analytic kernels
+	size_t GetQtyPacked() const;
+	//! Get the number of primitives evaluated by their IsInside method
+	size_t GetQtyFallback() const {return m_Fallback.size();}
+
+	//! Find the property of highest priority for numCoords coordinates
+	/*!
+	 \param coords Coordinates (x1,y1,z1,x2,y2,z2,...) in the coordinate input type of the compiled structure
+	 \param numCoords Number of coordinates
+	 \param props Array of numCoords found properties, set to NULL if no property was found
+	 \param prims Optional array of numCoords found primitives, set to NULL if no primitive was found
+	 */
+	void GetPropertiesByCoordPriority(const double* coords, size_t numCoords, CSProperties** props, CSPrimitives** prims=NULL) const;
+
+	///Number of coordinates tested at once
+	static const unsigned int BlockSize = 16;
+
+protected:
+	enum KernelType
+	{
+		KERNEL_BOX, KERNEL_SPHERE, KERNEL_SPHERICALSHELL, KERNEL_CYLINDER, KERNEL_CYLINDRICALSHELL, KERNEL_COUNT
+	};
+
+	//! Structure-of-arrays table of all primitives of one kernel type, sorted by descending priority key
+	struct KernelTable
+	{
+		///Evaluated cartesian parameter of all primitives, the meaning depends on the kernel type (see Compile)
+		std::vector<double> m_Param[16];
+		///Inverse transformation matrix (first 3 rows) for each primitive
+		std::vector<double> m_InvMatrix;
+		///Flag for each primitive if m_InvMatrix has to be applied
+		std::vector<unsigned char> m_Transformed;
+		///Conservative world bounding box (min/max per direction) used to skip a block of coordinates
+		std::vector<double> m_BoundBox[6];
+		///Priority key, see CreateKey
+		std::vector<long long> m_Key;
+		///Index into m_Prims
+		std::vector<unsigned int> m_Index;
+	};
+
+	//! Add a primitive to its kernel table. \return false if the primitive is not supported by any kernel
+	bool PackPrimitive(CSPrimitives* prim, unsigned int index, long long key);
+	//! Add a primitive to a kernel table, param is expected to hold the kernel parameter. The local box is only used if the primitive has no world bounding box.
+	void AddToTable(KernelType kt, const double* param, unsigned int numParam, const double localBox[6], CSPrimitives* prim, unsigned int index, long long key);
+	//! Sort all tables by descending priority key
+	void SortTables();
+
+	//! Evaluate a block of at most BlockSize cartesian coordinates against one table, updating best key and winner index
+	void EvaluateTable(KernelType kt, unsigned int num, const double* const pos[3], const double blockBox[6], long long* bestKey, unsigned int* winner) const;
+
+	//! Create a priority key. A larger key wins, equal priorities are resolved by the order of properties and primitives in the structure.
+	static long long CreateKey(int priority, unsigned int rank);
+
+	CoordinateSystem m_MeshType;
+	KernelTable m_Tables[KERNEL_COUNT];
+
+	///All compiled primitives and their property, referenced by index
+	std::vector<CSPrimitives*> m_Prims;
+	std::vector<CSProperties*> m_Props;
+	///Primitives not covered by a kernel (index into m_Prims) sorted by descending priority key
+	std::vector<unsigned int> m_Fallback;
+	std::vector<long long> m_FallbackKey;
+
+private:
+	CSPrimKernelPack(const CSPrimKernelPack&);
+	CSPrimKernelPack& operator=(const CSPrimKernelPack&);
+};
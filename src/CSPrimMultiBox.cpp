@@ -18,6 +18,7 @@
 #include <sstream>
 #include <iostream>
 #include <limits>
+#include <algorithm>
 #include "tinyxml.h"
 #include "stdint.h"
 
@@ -29,6 +30,9 @@ CSPrimMultiBox::CSPrimMultiBox(unsigned int ID, ParameterSet* paraSet, CSPropert
 {
 	Type=MULTIBOX;
 	PrimTypeName = std::string("Multi Box");
+	m_SweepDir = 0;
+	m_TreeLeafs = 0;
+	m_IndexValid = false;
 }
 
 CSPrimMultiBox::CSPrimMultiBox(CSPrimMultiBox* multiBox, CSProperties *prop) : CSPrimitives(multiBox, prop)
@@ -37,12 +41,24 @@ CSPrimMultiBox::CSPrimMultiBox(CSPrimMultiBox* multiBox, CSProperties *prop) : C
 	for (size_t i=0;i<multiBox->vCoords.size();++i)
 		vCoords.push_back(new ParameterScalar(multiBox->vCoords.at(i)));
 	PrimTypeName = std::string("Multi Box");
+	for (int n=0;n<3;++n)
+	{
+		m_BoxMin[n] = multiBox->m_BoxMin[n];
+		m_BoxMax[n] = multiBox->m_BoxMax[n];
+	}
+	m_SweepDir = multiBox->m_SweepDir;
+	m_BlockTree = multiBox->m_BlockTree;
+	m_TreeLeafs = multiBox->m_TreeLeafs;
+	m_IndexValid = multiBox->m_IndexValid;
 }
 
 CSPrimMultiBox::CSPrimMultiBox(ParameterSet* paraSet, CSProperties* prop) : CSPrimitives(paraSet,prop)
 {
 	Type=MULTIBOX;
 	PrimTypeName = std::string("Multi Box");
+	m_SweepDir = 0;
+	m_TreeLeafs = 0;
+	m_IndexValid = false;
 }
 
 CSPrimMultiBox::~CSPrimMultiBox()
@@ -55,22 +71,26 @@ void CSPrimMultiBox::SetCoord(int index, double val)
 {
 	if ((index>=0) && (index<(int)vCoords.size()))
 		vCoords.at(index)->SetValue(val);
+	m_IndexValid = false;
 }
 
 void CSPrimMultiBox::SetCoord(int index, const char* val)
 {
 	if ((index>=0) && (index<(int)vCoords.size()))
 		vCoords.at(index)->SetValue(val);
+	m_IndexValid = false;
 }
 
 void CSPrimMultiBox::AddCoord(double val)
 {
 	vCoords.push_back(new ParameterScalar(clParaSet,val));
+	m_IndexValid = false;
 }
 
 void CSPrimMultiBox::AddCoord(const char* val)
 {
 	vCoords.push_back(new ParameterScalar(clParaSet,val));
+	m_IndexValid = false;
 }
 
 void CSPrimMultiBox::AddBox(int initBox)
@@ -83,6 +103,7 @@ void CSPrimMultiBox::AddBox(int initBox)
 	}
 	else for (unsigned int i=0;i<6;++i)
 		vCoords.push_back(new ParameterScalar(vCoords.at(6*initBox+i)));
+	m_IndexValid = false;
 }
 
 void CSPrimMultiBox::DeleteBox(size_t box)
@@ -92,6 +113,7 @@ void CSPrimMultiBox::DeleteBox(size_t box)
 	std::vector<ParameterScalar*>::iterator end=vCoords.begin()+(box*6+6);
 
 	vCoords.erase(start,end);
+	m_IndexValid = false;
 }
 
 
@@ -124,6 +146,7 @@ void CSPrimMultiBox::ClearOverlap()
 	if (vCoords.size()%6==0) return;  //no work to be done
 
 	vCoords.resize(vCoords.size()-vCoords.size()%6);
+	m_IndexValid = false;
 }
 
 bool CSPrimMultiBox::GetBoundBox(double dBoundBox[6], bool PreserveOrientation)
@@ -174,38 +197,134 @@ bool CSPrimMultiBox::GetBoundBox(double dBoundBox[6], bool PreserveOrientation)
 	return false;
 }
 
+// test a point against a block of boxes, written branch-free for auto-vectorization
+static inline bool IsInsideBlock(const double* coords, const double* const min[3], const double* const max[3], unsigned int block, unsigned int size)
+{
+	unsigned int offset = block*size;
+	const double* min0 = min[0]+offset; const double* max0 = max[0]+offset;
+	const double* min1 = min[1]+offset; const double* max1 = max[1]+offset;
+	const double* min2 = min[2]+offset; const double* max2 = max[2]+offset;
+	int hit = 0;
+	for (unsigned int l=0;l<size;++l)
+		hit |= (min0[l]<=coords[0]) & (coords[0]<=max0[l]) & (min1[l]<=coords[1]) & (coords[1]<=max1[l]) & (min2[l]<=coords[2]) & (coords[2]<=max2[l]);
+	return hit!=0;
+}
+
 bool CSPrimMultiBox::IsInside(const double* Coord, double /*tol*/)
 {
 	if (Coord==NULL) return false;
-	bool in=false;
-	double UpVal,DownVal;
+	if (m_IndexValid==false)
+		BuildIndex();
+	if (m_TreeLeafs==0) return false;
 	double coords[3]={Coord[0],Coord[1],Coord[2]};
 	TransformCoords(coords, true, m_MeshType);
-	//fprintf(stderr,"here\n");
-	for (unsigned int i=0;i<vCoords.size()/6;++i)
+
+	// only blocks starting below the coordinate can contain it
+	const std::vector<double> &sweepMin = m_BoxMin[m_SweepDir];
+	unsigned int numBoxes = std::upper_bound(sweepMin.begin(), sweepMin.end(), coords[m_SweepDir]) - sweepMin.begin();
+	unsigned int numBlocks = (numBoxes+BlockSize-1)/BlockSize;
+	if (numBlocks==0)
+		return false;
+
+	const double* min[3] = {&m_BoxMin[0][0], &m_BoxMin[1][0], &m_BoxMin[2][0]};
+	const double* max[3] = {&m_BoxMax[0][0], &m_BoxMax[1][0], &m_BoxMax[2][0]};
+
+	// descend into all subtrees with boxes reaching up to the coordinate
+	unsigned int stack[64];
+	int top = 0;
+	stack[top++] = 1;
+	while (top>0)
 	{
-		in=true;
-		for (unsigned int n=0;n<3;++n)
+		unsigned int node = stack[--top];
+		if (m_BlockTree[node]<coords[m_SweepDir])
+			continue;
+		// first block below this node
+		unsigned int level = 0;
+		while ((node<<level)<m_TreeLeafs)
+			++level;
+		unsigned int first = (node<<level)-m_TreeLeafs;
+		if (first>=numBlocks)
+			continue;
+		if (node>=m_TreeLeafs)
 		{
-			//fprintf(stderr,"%e %e %e \n",vCoords.at(6*i+2*n)->GetValue(),vCoords.at(6*i+2*n+1)->GetValue());
-			UpVal=vCoords.at(6*i+2*n+1)->GetValue();
-			DownVal=vCoords.at(6*i+2*n)->GetValue();
-			if (DownVal<UpVal)
-			{
-				if (DownVal>coords[n]) {in=false;break;}
-				if (UpVal<coords[n]) {in=false;break;}
-			}
-			else
-			{
-				if (DownVal<coords[n]) {in=false;break;}
-				if (UpVal>coords[n]) {in=false;break;}
-			}
+			if (IsInsideBlock(coords, min, max, first, BlockSize))
+				return true;
+			continue;
 		}
-		if (in==true) {	return true;}
+		stack[top++] = 2*node+1;
+		stack[top++] = 2*node;
 	}
 	return false;
 }
 
+void CSPrimMultiBox::BuildIndex()
+{
+	unsigned int numBoxes = vCoords.size()/6;
+	for (int n=0;n<3;++n)
+	{
+		m_BoxMin[n].clear();
+		m_BoxMax[n].clear();
+	}
+	m_BlockTree.clear();
+	m_TreeLeafs = 0;
+	m_SweepDir = 0;
+	m_IndexValid = true;
+	if (numBoxes==0)
+		return;
+
+	std::vector<double> box(6*numBoxes);
+	double extent[3] = {0,0,0};
+	for (unsigned int i=0;i<numBoxes;++i)
+		for (int n=0;n<3;++n)
+		{
+			double a = vCoords.at(6*i+2*n)->GetValue();
+			double b = vCoords.at(6*i+2*n+1)->GetValue();
+			box[6*i+2*n] = std::min(a,b);
+			box[6*i+2*n+1] = std::max(a,b);
+			extent[n] += box[6*i+2*n+1]-box[6*i+2*n];
+		}
+
+	// sweep along the direction in which the boxes are smallest compared to the total size
+	double bestRatio = -1;
+	for (int n=0;n<3;++n)
+	{
+		double ratio = (m_BoundBox[2*n+1]-m_BoundBox[2*n])/(extent[n]/numBoxes + std::numeric_limits<double>::min());
+		if (ratio>bestRatio)
+		{
+			bestRatio = ratio;
+			m_SweepDir = n;
+		}
+	}
+
+	std::vector<std::pair<double,unsigned int> > order(numBoxes);
+	for (unsigned int i=0;i<numBoxes;++i)
+		order[i] = std::make_pair(box[6*i+2*m_SweepDir], i);
+	std::sort(order.begin(), order.end());
+
+	// the padding boxes are empty and sorted to the end
+	unsigned int numBlocks = (numBoxes+BlockSize-1)/BlockSize;
+	for (int n=0;n<3;++n)
+	{
+		m_BoxMin[n].assign(numBlocks*BlockSize, std::numeric_limits<double>::max());
+		m_BoxMax[n].assign(numBlocks*BlockSize, -std::numeric_limits<double>::max());
+		for (unsigned int i=0;i<numBoxes;++i)
+		{
+			m_BoxMin[n][i] = box[6*order[i].second+2*n];
+			m_BoxMax[n][i] = box[6*order[i].second+2*n+1];
+		}
+	}
+
+	m_TreeLeafs = 1;
+	while (m_TreeLeafs<numBlocks)
+		m_TreeLeafs*=2;
+	m_BlockTree.assign(2*m_TreeLeafs, -std::numeric_limits<double>::max());
+	for (unsigned int b=0;b<numBlocks;++b)
+		for (unsigned int l=0;l<BlockSize;++l)
+			m_BlockTree[m_TreeLeafs+b] = std::max(m_BlockTree[m_TreeLeafs+b], m_BoxMax[m_SweepDir][b*BlockSize+l]);
+	for (unsigned int node=m_TreeLeafs-1;node>0;--node)
+		m_BlockTree[node] = std::max(m_BlockTree[2*node], m_BlockTree[2*node+1]);
+}
+
 unsigned int CSPrimMultiBox::GetQtyBoxes() {return (unsigned int) vCoords.size()/6;}
 
 bool CSPrimMultiBox::Update(std::string *ErrStr)
@@ -227,6 +346,9 @@ bool CSPrimMultiBox::Update(std::string *ErrStr)
 	}
 	//update local bounding box
 	m_BoundBoxValid = GetBoundBox(m_BoundBox);
+
+	//evaluate all boxes once and build the index used by IsInside()
+	BuildIndex();
 	return bOK;
 }
 
@@ -50,6 +50,7 @@ public:
 	void ClearOverlap();
 
 	virtual bool GetBoundBox(double dBoundBox[6], bool PreserveOrientation=false);
+	//! Check if the given point is inside any box, the index is built again after a modification without Update()
 	virtual bool IsInside(const double* Coord, double tol=0);
 
 	unsigned int GetQtyBoxes();
@@ -60,5 +61,25 @@ public:
 
 protected:
 	std::vector<ParameterScalar*> vCoords;
+
+	//! Build the box index from the evaluated coordinates, done by Update() or on demand after a modification
+	/*!
+	 Parameterised values are not evaluated again, this requires an Update().
+	 */
+	void BuildIndex();
+	///The box index is up to date, reset by any modification of the boxes
+	bool m_IndexValid;
+
+	///Number of boxes tested at once, the box arrays are padded to a multiple of this size
+	static const unsigned int BlockSize = 8;
+	///Evaluated and ordered (min<=max) boxes, sorted by their lower coordinate in m_SweepDir, set by Update()
+	std::vector<double> m_BoxMin[3];
+	std::vector<double> m_BoxMax[3];
+	///Direction the boxes are sorted in
+	int m_SweepDir;
+	///Implicit binary tree over all blocks of boxes, storing the max upper coordinate in m_SweepDir of all boxes below a node
+	std::vector<double> m_BlockTree;
+	///Number of tree leafs (power of 2)
+	unsigned int m_TreeLeafs;
 };
 
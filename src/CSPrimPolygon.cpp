@@ -18,6 +18,7 @@
 #include <sstream>
 #include <iostream>
 #include <limits>
+#include <algorithm>
 #include "tinyxml.h"
 #include "stdint.h"
 
@@ -31,6 +32,9 @@ CSPrimPolygon::CSPrimPolygon(unsigned int ID, ParameterSet* paraSet, CSPropertie
 	m_NormDir = 0;
 	Elevation.SetParameterSet(paraSet);
 	PrimTypeName = std::string("Polygon");
+	m_SlabOrigin = 0;
+	m_SlabInvDelta = 0;
+	m_CoordsValid = false;
 }
 
 CSPrimPolygon::CSPrimPolygon(CSPrimPolygon* primPolygon, CSProperties *prop) : CSPrimitives(primPolygon,prop)
@@ -39,6 +43,13 @@ CSPrimPolygon::CSPrimPolygon(CSPrimPolygon* primPolygon, CSProperties *prop) : C
 	m_NormDir = primPolygon->m_NormDir;
 	Elevation.Copy(&primPolygon->Elevation);
 	PrimTypeName = std::string("Polygon");
+	vCoords = primPolygon->vCoords;
+	m_Coords = primPolygon->m_Coords;
+	m_SlabOrigin = primPolygon->m_SlabOrigin;
+	m_SlabInvDelta = primPolygon->m_SlabInvDelta;
+	m_SlabStart = primPolygon->m_SlabStart;
+	m_SlabEdges = primPolygon->m_SlabEdges;
+	m_CoordsValid = primPolygon->m_CoordsValid;
 }
 
 CSPrimPolygon::CSPrimPolygon(ParameterSet* paraSet, CSProperties* prop) : CSPrimitives(paraSet,prop)
@@ -47,6 +58,9 @@ CSPrimPolygon::CSPrimPolygon(ParameterSet* paraSet, CSProperties* prop) : CSPrim
 	m_NormDir = 0;
 	Elevation.SetParameterSet(paraSet);
 	PrimTypeName = std::string("Polygon");
+	m_SlabOrigin = 0;
+	m_SlabInvDelta = 0;
+	m_CoordsValid = false;
 }
 
 CSPrimPolygon::~CSPrimPolygon()
@@ -58,21 +72,25 @@ CSPrimPolygon* CSPrimPolygon::GetCopy(CSProperties *prop) {return new CSPrimPoly
 void CSPrimPolygon::SetCoord(int index, double val)
 {
 	if ((index>=0) && (index<(int)vCoords.size())) vCoords.at(index).SetValue(val);
+	m_CoordsValid = false;
 }
 
 void CSPrimPolygon::SetCoord(int index, const std::string val)
 {
 	if ((index>=0) && (index<(int)vCoords.size())) vCoords.at(index).SetValue(val);
+	m_CoordsValid = false;
 }
 
 void CSPrimPolygon::AddCoord(double val)
 {
 	vCoords.push_back(ParameterScalar(clParaSet,val));
+	m_CoordsValid = false;
 }
 
 void CSPrimPolygon::AddCoord(const std::string val)
 {
 	vCoords.push_back(ParameterScalar(clParaSet,val));
+	m_CoordsValid = false;
 }
 
 void CSPrimPolygon::RemoveCoords(int /*index*/)
@@ -103,7 +121,11 @@ double* CSPrimPolygon::GetAllCoords(size_t &Qty, double* array)
 	return array;
 }
 
-void CSPrimPolygon::SetNormDir(int dir) {if ((dir>=0) && (dir<3)) m_NormDir=dir;}
+void CSPrimPolygon::SetNormDir(int dir)
+{
+	if ((dir>=0) && (dir<3)) m_NormDir=dir;
+	m_CoordsValid = false;
+}
 
 bool CSPrimPolygon::GetBoundBox(double dBoundBox[6], bool PreserveOrientation)
 {
@@ -145,7 +167,9 @@ bool CSPrimPolygon::GetBoundBox(double dBoundBox[6], bool PreserveOrientation)
 bool CSPrimPolygon::IsInside(const double* inCoord, double /*tol*/)
 {
 	if (inCoord==NULL) return false;
-	if (vCoords.size()<2) return false;
+	if (m_CoordsValid==false)
+		EvaluateCoords();
+	if (m_Coords.size()<2) return false;
 
 	double Coord[3];
 	//transform incoming coordinates into cartesian coords
@@ -156,26 +180,29 @@ bool CSPrimPolygon::IsInside(const double* inCoord, double /*tol*/)
 	for (unsigned int n=0;n<3;++n)
 		if ((m_BoundBox[2*n]>Coord[n]) || (m_BoundBox[2*n+1]<Coord[n])) return false;
 
-	double x=0,y=0;
 	int nP = (m_NormDir+1)%3;
 	int nPP = (m_NormDir+2)%3;
-	x = Coord[nP];
-	y = Coord[nPP];
+	return IsInsidePlane(Coord[nP], Coord[nPP]);
+}
 
-	int wn = 0;
+bool CSPrimPolygon::IsInsidePlane(double x, double y) const
+{
+	if (m_Coords.size()<2) return false;
 
-	size_t np = vCoords.size()/2;
-	double x1 = vCoords[2*np-2].GetValue();
-	double y1 = vCoords[2*np-1].GetValue();
-	double x2 = vCoords[0].GetValue();
-	double y2 = vCoords[1].GetValue();
-	bool startover = y1 >= y ? true : false;
-	bool endover;
+	int wn = 0;
 
-	for (size_t i=0;i<np;++i)
+	// only edges with a y-range touching the y-slab of this coordinate can contribute
+	size_t np = m_Coords.size()/2;
+	const double* coords = &m_Coords[0];
+	unsigned int slab = GetEdgeSlab(y);
+	for (unsigned int e=m_SlabStart[slab];e<m_SlabStart[slab+1];++e)
 	{
-		x2 = vCoords[2*i].GetValue();
-		y2 = vCoords[2*i+1].GetValue();
+		size_t i = m_SlabEdges[e];
+		size_t i1 = (i>0) ? i-1 : np-1;
+		double x1 = coords[2*i1];
+		double y1 = coords[2*i1+1];
+		double x2 = coords[2*i];
+		double y2 = coords[2*i+1];
 
 		//check if coord is on a cartesian edge exactly
 		if ((x2==x1) && (x1==x) && ( ((y<y1) && (y>y2)) || ((y>y1) && (y<y2)) ))
@@ -183,7 +210,8 @@ bool CSPrimPolygon::IsInside(const double* inCoord, double /*tol*/)
 		if ((y2==y1) && (y1==y) && ( ((x<x1) && (x>x2)) || ((x>x1) && (x<x2)) ))
 			return true;
 
-		endover = y2 >= y ? true : false;
+		bool startover = y1 >= y ? true : false;
+		bool endover = y2 >= y ? true : false;
 		if (startover != endover)
 		{
 			if ((y2 - y)*(x2 - x1) <= (y2 - y1)*(x2 - x))
@@ -195,9 +223,6 @@ bool CSPrimPolygon::IsInside(const double* inCoord, double /*tol*/)
 				if (!endover) wn --;
 			}
 		}
-		startover = endover;
-		y1 = y2;
-		x1 = x2;
 	}
 	// return true if polygon is inside the polygon
 	if (wn != 0)
@@ -206,6 +231,167 @@ bool CSPrimPolygon::IsInside(const double* inCoord, double /*tol*/)
 	return false;
 }
 
+void CSPrimPolygon::GetPlaneMask(const double* lines1, unsigned int numLines1, const double* lines2, unsigned int numLines2, std::vector<unsigned char> &mask)
+{
+	if (m_CoordsValid==false)
+		EvaluateCoords();
+	mask.assign((size_t)numLines1*numLines2, 0);
+	if ((m_Coords.size()<2) || (numLines1==0))
+		return;
+
+	size_t np = m_Coords.size()/2;
+	const double* coords = &m_Coords[0];
+	const double* lines1_end = lines1+numLines1;
+	// winding number changes along the current line
+	std::vector<int> wn(numLines1+1);
+	for (unsigned int j=0;j<numLines2;++j)
+	{
+		double y = lines2[j];
+		unsigned char* row = &mask[(size_t)j*numLines1];
+		std::fill(wn.begin(), wn.end(), 0);
+		unsigned int slab = GetEdgeSlab(y);
+		for (unsigned int e=m_SlabStart[slab];e<m_SlabStart[slab+1];++e)
+		{
+			size_t i = m_SlabEdges[e];
+			size_t i1 = (i>0) ? i-1 : np-1;
+			double x1 = coords[2*i1];
+			double y1 = coords[2*i1+1];
+			double x2 = coords[2*i];
+			double y2 = coords[2*i+1];
+
+			//nodes on a cartesian edge exactly
+			if ((x2==x1) && ( ((y<y1) && (y>y2)) || ((y>y1) && (y<y2)) ))
+			{
+				for (const double* l=std::lower_bound(lines1, lines1_end, x1);(l<lines1_end) && (*l==x1);++l)
+					row[l-lines1] = 1;
+			}
+			if ((y2==y1) && (y1==y))
+			{
+				const double* l = std::upper_bound(lines1, lines1_end, std::min(x1,x2));
+				for (;(l<lines1_end) && (*l<std::max(x1,x2));++l)
+					row[l-lines1] = 1;
+			}
+
+			bool startover = y1 >= y ? true : false;
+			bool endover = y2 >= y ? true : false;
+			if (startover == endover)
+				continue;
+			// the winding test of IsInside is monotone along the line, find the first node where its result changes
+			// an upward edge adds 1 to all nodes before, a downward edge subtracts 1 from all nodes before
+			unsigned int lo = 0, hi = numLines1;
+			while (lo<hi)
+			{
+				unsigned int mid = (lo+hi)/2;
+				bool left = (y2 - y)*(x2 - x1) <= (y2 - y1)*(x2 - lines1[mid]);
+				if (left == endover)
+					lo = mid+1;
+				else
+					hi = mid;
+			}
+			wn[0] += endover ? 1 : -1;
+			wn[lo] -= endover ? 1 : -1;
+		}
+		int sum = 0;
+		for (unsigned int i=0;i<numLines1;++i)
+		{
+			sum += wn[i];
+			if (sum!=0)
+				row[i] = 1;
+		}
+	}
+}
+
+bool CSPrimPolygon::GetInsideMask(const double* const lines[3], const unsigned int numLines[3], std::vector<unsigned char> &mask)
+{
+	if ((m_Transform && m_Transform->HasTransform()) || (m_MeshType!=CARTESIAN))
+		return false;
+	if (m_CoordsValid==false)
+		EvaluateCoords();
+	if (m_Coords.size()<2)
+		return false;
+
+	int nP = (m_NormDir+1)%3;
+	int nPP = (m_NormDir+2)%3;
+	std::vector<unsigned char> plane;
+	GetPlaneMask(lines[nP], numLines[nP], lines[nPP], numLines[nPP], plane);
+
+	mask.assign((size_t)numLines[0]*numLines[1]*numLines[2], 0);
+	size_t stride[3] = {1, numLines[0], (size_t)numLines[0]*numLines[1]};
+	for (unsigned int k=0;k<numLines[m_NormDir];++k)
+	{
+		double z = lines[m_NormDir][k];
+		if ((z<m_BoundBox[2*m_NormDir]) || (z>m_BoundBox[2*m_NormDir+1]))
+			continue;
+		for (unsigned int j=0;j<numLines[nPP];++j)
+		{
+			const unsigned char* row = &plane[(size_t)j*numLines[nP]];
+			unsigned char* out = &mask[k*stride[m_NormDir] + j*stride[nPP]];
+			for (unsigned int i=0;i<numLines[nP];++i)
+				out[i*stride[nP]] = row[i];
+		}
+	}
+	return true;
+}
+
+unsigned int CSPrimPolygon::GetEdgeSlab(double y) const
+{
+	double pos = (y-m_SlabOrigin)*m_SlabInvDelta;
+	unsigned int numSlabs = m_SlabStart.size()-1;
+	if (pos<=0)
+		return 0;
+	if (pos>=numSlabs)
+		return numSlabs-1;
+	return (unsigned int)pos;
+}
+
+void CSPrimPolygon::BuildEdgeIndex()
+{
+	m_SlabStart.clear();
+	m_SlabEdges.clear();
+	size_t np = m_Coords.size()/2;
+	m_SlabOrigin = 0;
+	m_SlabInvDelta = 0;
+	if (np==0)
+		return;
+
+	double ymin = m_Coords[1], ymax = m_Coords[1];
+	for (size_t i=1;i<np;++i)
+	{
+		ymin = std::min(ymin, m_Coords[2*i+1]);
+		ymax = std::max(ymax, m_Coords[2*i+1]);
+	}
+
+	// about 4 edges per slab, small polygons use a single slab
+	unsigned int numSlabs = std::max<size_t>(1, std::min<size_t>(np/4, 65536));
+	m_SlabOrigin = ymin;
+	if (ymax>ymin)
+		m_SlabInvDelta = numSlabs/(ymax-ymin);
+	else
+		numSlabs = 1;
+
+	// count the edges per slab, then fill the slabs (edge i is from vertex i-1 to vertex i)
+	std::vector<unsigned int> first(np), last(np);
+	m_SlabStart.assign(numSlabs+1, 0);
+	std::vector<unsigned int> count(numSlabs, 0);
+	for (size_t i=0;i<np;++i)
+	{
+		size_t i1 = (i>0) ? i-1 : np-1;
+		double y1 = m_Coords[2*i1+1];
+		double y2 = m_Coords[2*i+1];
+		first[i] = GetEdgeSlab(std::min(y1,y2));
+		last[i] = GetEdgeSlab(std::max(y1,y2));
+		for (unsigned int s=first[i];s<=last[i];++s)
+			++count[s];
+	}
+	for (unsigned int s=0;s<numSlabs;++s)
+		m_SlabStart[s+1] = m_SlabStart[s] + count[s];
+	m_SlabEdges.resize(m_SlabStart[numSlabs]);
+	for (unsigned int s=0;s<numSlabs;++s)
+		count[s] = m_SlabStart[s];
+	for (size_t i=0;i<np;++i)
+		for (unsigned int s=first[i];s<=last[i];++s)
+			m_SlabEdges[count[s]++] = i;
+}
 
 bool CSPrimPolygon::Update(std::string *ErrStr)
 {
@@ -216,7 +402,7 @@ bool CSPrimPolygon::Update(std::string *ErrStr)
 		std::cerr << "CSPrimPolygon::Update: Warning: CSPrimPolygon can not be defined in non Cartesian coordinate systems! Result may be unexpected..." << std::endl;
 		ErrStr->append("Warning: CSPrimPolygon can not be defined in non Cartesian coordinate systems! Result may be unexpected...\n");
 	}
-	for (size_t i=1;i<vCoords.size();++i)
+	for (size_t i=0;i<vCoords.size();++i)
 	{
 		EC=vCoords[i].Evaluate();
 		if (EC!=ParameterScalar::PS_NO_ERROR) bOK=false;
@@ -241,10 +427,21 @@ bool CSPrimPolygon::Update(std::string *ErrStr)
 		PSErrorCode2Msg(EC,ErrStr);
 	}
 
+	EvaluateCoords();
+	return bOK;
+}
+
+void CSPrimPolygon::EvaluateCoords()
+{
+	//evaluate all vertices once and build the edge index used by IsInside()
+	m_Coords.resize(vCoords.size()/2*2);
+	for (size_t i=0;i<m_Coords.size();++i)
+		m_Coords[i] = vCoords[i].GetValue();
+	BuildEdgeIndex();
+
 	//update local bounding box used to speedup IsInside()
 	m_BoundBoxValid = GetBoundBox(m_BoundBox);
-
-	return bOK;
+	m_CoordsValid = true;
 }
 
 bool CSPrimPolygon::Write2XML(TiXmlElement &elem, bool parameterised)
@@ -41,7 +41,7 @@ public:
 	void AddCoord(const std::string val);
 
 	void RemoveCoords(int index);
-	void ClearCoords() {vCoords.clear();}
+	void ClearCoords() {vCoords.clear(); m_CoordsValid=false;}
 
 	double GetCoord(int index);
 	ParameterScalar* GetCoordPS(int index);
@@ -53,15 +53,33 @@ public:
 
 	int GetNormDir() {return m_NormDir;}
 
-	void SetElevation(double val) {Elevation.SetValue(val);}
-	void SetElevation(const char* val) {Elevation.SetValue(val);}
+	void SetElevation(double val) {Elevation.SetValue(val); m_CoordsValid=false;}
+	void SetElevation(const char* val) {Elevation.SetValue(val); m_CoordsValid=false;}
 
 	double GetElevation() {return Elevation.GetValue();}
 	ParameterScalar* GetElevationPS() {return &Elevation;}
 
 	virtual bool GetBoundBox(double dBoundBox[6], bool PreserveOrientation=false);
+	//! Check if the given point is inside the polygon, the vertices are evaluated again after a modification without Update()
 	virtual bool IsInside(const double* Coord, double tol=0);
 
+	//! Rasterize the polygon in its plane using a scanline algorithm
+	/*!
+	 The result is identical to IsInside for all nodes of the given lines, but much faster for large numbers of nodes.
+	 \param lines1 Sorted lines in the first in-plane direction ((NormDir+1)%3).
+	 \param lines2 Sorted lines in the second in-plane direction ((NormDir+2)%3).
+	 \param mask Resulting mask, mask[i+j*numLines1] is set to 1 if the node (lines1[i], lines2[j]) is inside.
+	 */
+	void GetPlaneMask(const double* lines1, unsigned int numLines1, const double* lines2, unsigned int numLines2, std::vector<unsigned char> &mask);
+	//! Rasterize the primitive onto all nodes of a grid
+	/*!
+	 The in-plane mask is only computed once and reused for all lines in normal direction within the primitive.
+	 \param lines Sorted grid lines of all three directions, given in the mesh coordinate system (see SetCoordInputType).
+	 \param mask Resulting mask, mask[i+j*numLines[0]+k*numLines[0]*numLines[1]] is set to 1 if the node is inside.
+	 \return false if not supported for this primitive (e.g. with a transformation or non-cartesian mesh), use IsInside instead.
+	 */
+	virtual bool GetInsideMask(const double* const lines[3], const unsigned int numLines[3], std::vector<unsigned char> &mask);
+
 	virtual bool Update(std::string *ErrStr=NULL);
 	virtual bool Write2XML(TiXmlElement &elem, bool parameterised=true);
 	virtual bool ReadFromXML(TiXmlNode &root);
@@ -73,5 +91,29 @@ protected:
 	int m_NormDir;
 	///The polygon plane elevation in direction of the normal vector
 	ParameterScalar Elevation;
+
+	///Evaluated polygon vertices x1,y1,x2,y2 ... xn,yn, set by Update()
+	std::vector<double> m_Coords;
+	///The evaluated vertices, the edge index and the bounding box are up to date, reset by any modification of the vertices, the elevation or the normal direction
+	bool m_CoordsValid;
+	//! Evaluate the vertices and rebuild the edge index and the bounding box, done by Update() or on demand after a modification
+	/*!
+	 Parameterised values are not evaluated again, this requires an Update().
+	 */
+	void EvaluateCoords();
+
+	//! Winding number test of a point given in the polygon plane coordinates, requires evaluated vertices (see EvaluateCoords)
+	bool IsInsidePlane(double x, double y) const;
+
+	//! Build the y-slab edge index from the evaluated vertices
+	void BuildEdgeIndex();
+	//! Get the y-slab for the given y value
+	unsigned int GetEdgeSlab(double y) const;
+	///Lower y value and inverse height of the y-slabs
+	double m_SlabOrigin, m_SlabInvDelta;
+	///Start of the edges of each y-slab in m_SlabEdges, number of slabs + 1 entries
+	std::vector<unsigned int> m_SlabStart;
+	///Edges (given by their end vertex) whose y-range touches a y-slab, sorted by slab
+	std::vector<unsigned int> m_SlabEdges;
 };
 
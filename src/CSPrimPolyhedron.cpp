@@ -18,28 +18,44 @@
 #include <sstream>
 #include <iostream>
 #include <limits>
+#include <cmath>
+#include <algorithm>
+#include <map>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 #include "tinyxml.h"
 #include "stdint.h"
 
 #include "CSPrimPolyhedron.h"
 #include "CSPrimPolyhedron_p.h"
+#include "CSMappedFile.h"
 #include "CSProperties.h"
 #include "CSUseful.h"
-
+#include "CSRectGrid.h"
 void Polyhedron_Builder::operator()(HalfedgeDS &hds)
 {
 	// Postcondition: `hds' is a valid polyhedral surface.
 	CGAL::Polyhedron_incremental_builder_3<HalfedgeDS> B( hds, true);
-	B.begin_surface( m_polyhedron->m_Vertices.size(), m_polyhedron->m_Faces.size());
+	unsigned int numVertices = m_mesh->GetNumVertices();
+	unsigned int numFaces = m_mesh->GetNumFaces();
+	B.begin_surface( numVertices, numFaces);
 	typedef HalfedgeDS::Vertex   Vertex;
 	typedef Vertex::Point Point;
-	for (size_t n=0;n<m_polyhedron->m_Vertices.size();++n)
-		B.add_vertex( Point( m_polyhedron->m_Vertices.at(n).coord[0], m_polyhedron->m_Vertices.at(n).coord[1], m_polyhedron->m_Vertices.at(n).coord[2]));
-
-	for (size_t f=0;f<m_polyhedron->m_Faces.size();++f)
+	const float* coords = m_mesh->m_Vertices.data();
+	for (unsigned int n=0;n<numVertices;++n)
+		B.add_vertex( Point( coords[3*n], coords[3*n+1], coords[3*n+2]));
+
+	m_mesh->m_FaceValid.assign(numFaces, false);
+	std::vector<int> help;
+	unsigned int numVertex;
+	for (unsigned int f=0;f<numFaces;++f)
 	{
-		m_polyhedron->m_Faces.at(f).valid=false;
-		int *first = m_polyhedron->m_Faces.at(f).vertices, *beyond = first+m_polyhedron->m_Faces.at(f).numVertex;
+		const int *first = m_mesh->GetFace(f, numVertex), *beyond = first+numVertex;
+		if (first==NULL)
+		{
+			++m_mesh->m_InvalidFaces;
+			continue;
+		}
 		if (B.test_facet(first, beyond))
 		{
 			B.add_facet(first, beyond);
@@ -48,16 +64,15 @@ void Polyhedron_Builder::operator()(HalfedgeDS &hds)
 				std::cerr << "Polyhedron_Builder::operator(): Error in polyhedron construction" << std::endl;
 				break;
 			}
-			m_polyhedron->m_Faces.at(f).valid=true;
+			m_mesh->m_FaceValid[f]=true;
 		}
 		else
 		{
 			std::cerr << "Polyhedron_Builder::operator(): Face " << f << ": Trying reverse order... ";
-			int* help = new int [m_polyhedron->m_Faces.at(f).numVertex];
-			for (unsigned int n=0;n<m_polyhedron->m_Faces.at(f).numVertex;++n)
-				help[n]=m_polyhedron->m_Faces.at(f).vertices[m_polyhedron->m_Faces.at(f).numVertex-1-n];
-			first = help;
-			beyond = first+m_polyhedron->m_Faces.at(f).numVertex;
+			help.assign(first, beyond);
+			std::reverse(help.begin(), help.end());
+			first = &help[0];
+			beyond = first+numVertex;
 			if (B.test_facet(first, beyond))
 			{
 				B.add_facet(first, beyond);
@@ -67,155 +82,316 @@ void Polyhedron_Builder::operator()(HalfedgeDS &hds)
 					break;
 				}
 				std::cerr << "success" << std::endl;
-				m_polyhedron->m_Faces.at(f).valid=true;
+				m_mesh->m_FaceValid[f]=true;
 			}
 			else
 			{
 				std::cerr << "failed" << std::endl;
-				++m_polyhedron->m_InvalidFaces;
+				++m_mesh->m_InvalidFaces;
 			}
-			delete[] help; help = NULL;
 		}
 	}
 	B.end_surface();
 }
 
+/*********************CSPolyhedronMesh********************************************************************/
+const int* CSPolyhedronMesh::GetFace(unsigned int n, unsigned int &numVertices) const
+{
+	numVertices = 0;
+	if (n>=GetNumFaces())
+		return NULL;
+	if (m_FaceOffsets.empty())
+	{
+		numVertices = 3;
+		return &m_FaceIndices[3*n];
+	}
+	numVertices = m_FaceOffsets[n+1]-m_FaceOffsets[n];
+	if (numVertices==0)
+		return NULL;
+	return &m_FaceIndices[m_FaceOffsets[n]];
+}
+
+void CSPolyhedronMesh::CreateFaceOffsets()
+{
+	if (!m_FaceOffsets.empty())
+		return;
+	unsigned int numFaces = m_FaceIndices.size()/3;
+	std::vector<unsigned int> &offsets = m_FaceOffsets.Modify();
+	offsets.resize(numFaces+1);
+	for (unsigned int n=0;n<=numFaces;++n)
+		offsets[n]=3*n;
+}
+
+// registry of shared meshes, meshes are released as soon as no primitive uses them anymore
+typedef std::map<std::string, boost::weak_ptr<CSPolyhedronMesh> > MeshRegistry;
+static MeshRegistry g_MeshRegistry;
+static boost::mutex g_MeshRegistryMutex;
+
 /*********************CSPrimPolyhedron********************************************************************/
 CSPrimPolyhedron::CSPrimPolyhedron(unsigned int ID, ParameterSet* paraSet, CSProperties* prop) : CSPrimitives(ID,paraSet,prop), d_ptr(new CSPrimPolyhedronPrivate)
 {
 	Type = POLYHEDRON;
 	PrimTypeName = "Polyhedron";
-	d_ptr->m_PolyhedronTree = NULL;
-	m_InvalidFaces = 0;
+	d_ptr->m_Mesh.reset(new CSPolyhedronMesh);
+	m_WorldBoxValid = false;
 }
 
 CSPrimPolyhedron::CSPrimPolyhedron(CSPrimPolyhedron* primPolyhedron, CSProperties *prop) : CSPrimitives(primPolyhedron,prop), d_ptr(new CSPrimPolyhedronPrivate)
 {
 	Type = POLYHEDRON;
 	PrimTypeName = "Polyhedron";
-	d_ptr->m_PolyhedronTree = NULL;
-	m_InvalidFaces = 0;
 
-	//copy all vertices
-	for (size_t n=0;n<primPolyhedron->m_Vertices.size();++n)
-		AddVertex(primPolyhedron->m_Vertices.at(n).coord);
-	//copy all faces
-	for (size_t n=0;n<primPolyhedron->m_Faces.size();++n)
-		AddFace(primPolyhedron->m_Faces.at(n).numVertex,primPolyhedron->m_Faces.at(n).vertices);
+	//share vertices, faces and tree, the copy is an instance of the given polyhedron
+	d_ptr->m_Mesh = primPolyhedron->d_ptr->m_Mesh;
+	m_WorldBoxValid = false;
 }
 
 CSPrimPolyhedron::CSPrimPolyhedron(ParameterSet* paraSet, CSProperties* prop) : CSPrimitives(paraSet,prop), d_ptr(new CSPrimPolyhedronPrivate)
 {
 	Type = POLYHEDRON;
 	PrimTypeName = "Polyhedron";
-	d_ptr->m_PolyhedronTree = NULL;
-	m_InvalidFaces = 0;
+	d_ptr->m_Mesh.reset(new CSPolyhedronMesh);
+	m_WorldBoxValid = false;
 }
 
 CSPrimPolyhedron::~CSPrimPolyhedron()
 {
-	Reset();
 	delete d_ptr;
 }
 
 void CSPrimPolyhedron::Reset()
 {
-	m_Vertices.clear();
-	for (size_t n=0;n<m_Faces.size();++n)
+	d_ptr->m_Mesh.reset(new CSPolyhedronMesh);
+	m_WorldBoxValid = false;
+}
+
+void CSPrimPolyhedron::DetachMesh()
+{
+	m_WorldBoxValid = false;
+	CSPolyhedronMesh* mesh = d_ptr->m_Mesh.get();
+	if ((d_ptr->m_Mesh.use_count()>1) || mesh->m_Registered)
 	{
-		delete[] m_Faces.at(n).vertices;
-		m_Faces.at(n).vertices=NULL;
+		CSPolyhedronMesh* copy = new CSPolyhedronMesh;
+		copy->m_Vertices = mesh->m_Vertices;
+		copy->m_FaceIndices = mesh->m_FaceIndices;
+		copy->m_FaceOffsets = mesh->m_FaceOffsets;
+		copy->m_MappedFile = mesh->m_MappedFile;
+		d_ptr->m_Mesh.reset(copy);
+		return;
 	}
-	m_Faces.clear();
-	d_ptr->m_Polyhedron.clear();
-	d_ptr->m_PolyhedronTree = NULL;
-	m_InvalidFaces = 0;
+	if (mesh->m_TreeValid==false)
+		return;
+	delete mesh->m_PolyhedronTree;
+	mesh->m_PolyhedronTree = NULL;
+	mesh->m_Polyhedron.clear();
+	mesh->m_FaceValid.clear();
+	mesh->m_InvalidFaces = 0;
+	mesh->m_TreeValid = false;
+}
+
+void CSPrimPolyhedron::ShareMesh(CSPrimPolyhedron* primPolyhedron)
+{
+	if ((primPolyhedron==NULL) || (primPolyhedron==this))
+		return;
+	d_ptr->m_Mesh = primPolyhedron->d_ptr->m_Mesh;
+	m_BoundBoxValid = false;
+	m_WorldBoxValid = false;
+}
+
+unsigned int CSPrimPolyhedron::GetMeshUseCount() const
+{
+	return d_ptr->m_Mesh.use_count();
+}
+
+bool CSPrimPolyhedron::ShareMeshByKey(const std::string &key)
+{
+	boost::mutex::scoped_lock lock(g_MeshRegistryMutex);
+	MeshRegistry::iterator it = g_MeshRegistry.find(key);
+	if (it==g_MeshRegistry.end())
+		return false;
+	boost::shared_ptr<CSPolyhedronMesh> mesh = it->second.lock();
+	if (!mesh)
+	{
+		g_MeshRegistry.erase(it);
+		return false;
+	}
+	d_ptr->m_Mesh = mesh;
+	m_BoundBoxValid = false;
+	m_WorldBoxValid = false;
+	return true;
+}
+
+void CSPrimPolyhedron::RegisterMesh(const std::string &key)
+{
+	boost::mutex::scoped_lock lock(g_MeshRegistryMutex);
+	d_ptr->m_Mesh->m_Registered = true;
+	g_MeshRegistry[key] = d_ptr->m_Mesh;
+}
+
+void CSPrimPolyhedron::SetMappedMesh(CSMappedFile* file, unsigned int numVertices, const float* coords, unsigned int numFaces, unsigned int numIndices, const int* indices, const unsigned int* offsets)
+{
+	CSPolyhedronMesh* mesh = new CSPolyhedronMesh;
+	mesh->m_MappedFile.reset(file);
+	mesh->m_Vertices.SetExternal(coords, 3*(size_t)numVertices);
+	mesh->m_FaceIndices.SetExternal(indices, numIndices);
+	if (offsets)
+		mesh->m_FaceOffsets.SetExternal(offsets, (size_t)numFaces+1);
+	d_ptr->m_Mesh.reset(mesh);
+	m_WorldBoxValid = false;
 }
 
 void CSPrimPolyhedron::AddVertex(float px, float py, float pz)
 {
-	vertex nv;
-	nv.coord[0]=px;nv.coord[1]=py;nv.coord[2]=pz;
-	m_Vertices.push_back(nv);
+	DetachMesh();
+	std::vector<float> &vertices = d_ptr->m_Mesh->m_Vertices.Modify();
+	vertices.push_back(px);
+	vertices.push_back(py);
+	vertices.push_back(pz);
 }
 
-float* CSPrimPolyhedron::GetVertex(unsigned int n)
+void CSPrimPolyhedron::AddVertices(unsigned int numVertices, const float* coords)
 {
-	if (n<m_Vertices.size())
-		return m_Vertices.at(n).coord;
+	DetachMesh();
+	std::vector<float> &vertices = d_ptr->m_Mesh->m_Vertices.Modify();
+	vertices.insert(vertices.end(), coords, coords+3*numVertices);
+}
+
+void CSPrimPolyhedron::AddVertices(unsigned int numVertices, const double* coords)
+{
+	DetachMesh();
+	std::vector<float> &vertices = d_ptr->m_Mesh->m_Vertices.Modify();
+	vertices.insert(vertices.end(), coords, coords+3*numVertices);
+}
+
+unsigned int CSPrimPolyhedron::GetNumVertices() const
+{
+	return d_ptr->m_Mesh->GetNumVertices();
+}
+
+const float* CSPrimPolyhedron::GetVertex(unsigned int n) const
+{
+	if (n<GetNumVertices())
+		return &d_ptr->m_Mesh->m_Vertices[3*n];
 	return NULL;
 }
 
 void CSPrimPolyhedron::AddFace(face f)
 {
-	m_Faces.push_back(f);
+	AddFace(f.numVertex, f.vertices);
+	delete[] f.vertices;
 }
 
 void CSPrimPolyhedron::AddFace(int numVertex, int* vertices)
 {
-	face f;
-	f.numVertex=numVertex;
-	f.vertices=new int[numVertex];
-	for (int n=0;n<numVertex;++n)
-		f.vertices[n]=vertices[n];
-	m_Faces.push_back(f);
+	DetachMesh();
+	CSPolyhedronMesh* mesh = d_ptr->m_Mesh.get();
+	std::vector<int> &indices = mesh->m_FaceIndices.Modify();
+	if ((numVertex!=3) || !mesh->m_FaceOffsets.empty())
+	{
+		mesh->CreateFaceOffsets();
+		mesh->m_FaceOffsets.Modify().push_back(indices.size()+numVertex);
+	}
+	indices.insert(indices.end(), vertices, vertices+numVertex);
 }
 
 void CSPrimPolyhedron::AddFace(std::vector<int> vertices)
 {
-	face f;
-	f.numVertex=vertices.size();
-	if (f.numVertex>3)
+	if (vertices.size()>3)
 		std::cerr << __func__ << ": Warning, faces other than triangles are currently not supported for discretization, expect false results!!!" << std::endl;
-	f.vertices=new int[f.numVertex];
-	for (unsigned int n=0;n<f.numVertex;++n)
-		f.vertices[n]=vertices.at(n);
-	m_Faces.push_back(f);
+	AddFace(vertices.size(), vertices.empty() ? NULL : &vertices[0]);
 }
 
-bool CSPrimPolyhedron::BuildTree()
+void CSPrimPolyhedron::AddFaces(unsigned int numFaces, const int* vertices, const unsigned int* offsets)
 {
-	Polyhedron_Builder builder(this);
-	d_ptr->m_Polyhedron.delegate(builder);
+	if (numFaces==0)
+		return;
+	DetachMesh();
+	CSPolyhedronMesh* mesh = d_ptr->m_Mesh.get();
+	std::vector<int> &indices = mesh->m_FaceIndices.Modify();
+	if (offsets==NULL)
+	{
+		if (!mesh->m_FaceOffsets.empty())
+		{
+			std::vector<unsigned int> &faceOffsets = mesh->m_FaceOffsets.Modify();
+			for (unsigned int n=1;n<=numFaces;++n)
+				faceOffsets.push_back(indices.size()+3*n);
+		}
+		indices.insert(indices.end(), vertices, vertices+3*numFaces);
+		return;
+	}
 
-	if (d_ptr->m_Polyhedron.is_closed())
-		m_Dimension = 3;
-	else
+	bool allTriangles = mesh->m_FaceOffsets.empty();
+	for (unsigned int n=0;(n<numFaces) && allTriangles;++n)
+		allTriangles = (offsets[n+1]-offsets[n]==3);
+	if (!allTriangles)
 	{
-		m_Dimension = 2;
+		mesh->CreateFaceOffsets();
+		std::vector<unsigned int> &faceOffsets = mesh->m_FaceOffsets.Modify();
+		unsigned int start = indices.size()-offsets[0];
+		for (unsigned int n=1;n<=numFaces;++n)
+			faceOffsets.push_back(start+offsets[n]);
+	}
+	indices.insert(indices.end(), vertices+offsets[0], vertices+offsets[numFaces]);
+}
+
+bool CSPrimPolyhedron::BuildTree()
+{
+	CSPolyhedronMesh* mesh = d_ptr->m_Mesh.get();
+	if (mesh->m_TreeValid==false)
+	{
+		Polyhedron_Builder builder(mesh);
+		mesh->m_Polyhedron.delegate(builder);
+		mesh->m_Closed = mesh->m_Polyhedron.is_closed();
 
 		//if structure is not closed due to invalud faces, mark it as 3D
-		if (m_InvalidFaces>0)
-		{
-			m_Dimension = 3;
+		if (!mesh->m_Closed && (mesh->m_InvalidFaces>0))
 			std::cerr << "CSPrimPolyhedron::BuildTree: Warning, found polyhedron has invalud faces and is not a closed surface, setting to 3D solid anyway!" << std::endl;
-		}
-	}
 
-	//build tree
-	delete d_ptr->m_PolyhedronTree;
+		//build tree
+		delete mesh->m_PolyhedronTree;
 #if CGAL_VERSION_NR >= CGAL_VERSION_NUMBER(4,6,0)
-    d_ptr->m_PolyhedronTree = new CGAL::AABB_tree< Traits >(faces(d_ptr->m_Polyhedron).first,faces(d_ptr->m_Polyhedron).second,d_ptr->m_Polyhedron);
+		mesh->m_PolyhedronTree = new CGAL::AABB_tree< Traits >(faces(mesh->m_Polyhedron).first,faces(mesh->m_Polyhedron).second,mesh->m_Polyhedron);
 #else
-    d_ptr->m_PolyhedronTree = new CGAL::AABB_tree< Traits >(d_ptr->m_Polyhedron.facets_begin(),d_ptr->m_Polyhedron.facets_end());
+		mesh->m_PolyhedronTree = new CGAL::AABB_tree< Traits >(mesh->m_Polyhedron.facets_begin(),mesh->m_Polyhedron.facets_end());
 #endif
 
+		//update mesh bounding box
+		GetBoundBox(mesh->m_BoundBox);
+		double p[3] = {mesh->m_BoundBox[1]*(1.0+(double)rand()/RAND_MAX),mesh->m_BoundBox[3]*(1.0+(double)rand()/RAND_MAX),mesh->m_BoundBox[5]*(1.0+(double)rand()/RAND_MAX)};
+		mesh->m_RandPt = Point(p[0],p[1],p[2]);
+		mesh->m_TreeValid = true;
+	}
+
+	if (mesh->m_Closed || (mesh->m_InvalidFaces>0))
+		m_Dimension = 3;
+	else
+		m_Dimension = 2;
+
 	//update local bounding box
-	GetBoundBox(m_BoundBox);
-	double p[3] = {m_BoundBox[1]*(1.0+(double)rand()/RAND_MAX),m_BoundBox[3]*(1.0+(double)rand()/RAND_MAX),m_BoundBox[5]*(1.0+(double)rand()/RAND_MAX)};
-	d_ptr->m_RandPt = Point(p[0],p[1],p[2]);
+	for (int n=0;n<6;++n)
+		m_BoundBox[n] = mesh->m_BoundBox[n];
 	return true;
 }
 
-int* CSPrimPolyhedron::GetFace(unsigned int n, unsigned int &numVertices)
+unsigned int CSPrimPolyhedron::GetNumFaces() const
 {
-	numVertices = 0;
-	if (n<m_Faces.size())
-	{
-		numVertices = m_Faces.at(n).numVertex;
-		return m_Faces.at(n).vertices;
-	}
-	return NULL;
+	return d_ptr->m_Mesh->GetNumFaces();
+}
+
+const int* CSPrimPolyhedron::GetFace(unsigned int n, unsigned int &numVertices) const
+{
+	return d_ptr->m_Mesh->GetFace(n, numVertices);
+}
+
+bool CSPrimPolyhedron::GetFaceValid(unsigned int n) const
+{
+	const std::vector<bool> &valid = d_ptr->m_Mesh->m_FaceValid;
+	return (n<valid.size()) && valid[n];
+}
+
+bool CSPrimPolyhedron::IsTriangleMesh() const
+{
+	return d_ptr->m_Mesh->m_FaceOffsets.empty();
 }
 
 bool CSPrimPolyhedron::GetBoundBox(double dBoundBox[6], bool PreserveOrientation)
@@ -223,21 +399,73 @@ bool CSPrimPolyhedron::GetBoundBox(double dBoundBox[6], bool PreserveOrientation
 	UNUSED(PreserveOrientation); //has no orientation or preserved anyways
 	m_BoundBox_CoordSys=CARTESIAN;
 
-	if (m_Vertices.size()==0)
+	const CSPolyhedronMesh* mesh = d_ptr->m_Mesh.get();
+	if (mesh->m_TreeValid)
+	{
+		for (int n=0;n<6;++n)
+			dBoundBox[n] = mesh->m_BoundBox[n];
 		return true;
+	}
 
-	dBoundBox[0]=dBoundBox[1]=m_Vertices.at(0).coord[0];
-	dBoundBox[2]=dBoundBox[3]=m_Vertices.at(0).coord[1];
-	dBoundBox[4]=dBoundBox[5]=m_Vertices.at(0).coord[2];
+	const CSMeshArray<float> &vertices = mesh->m_Vertices;
+	if (vertices.size()==0)
+		return true;
 
-	for (size_t n=0;n<m_Vertices.size();++n)
+	for (int d=0;d<3;++d)
+		dBoundBox[2*d]=dBoundBox[2*d+1]=vertices[d];
+
+	for (size_t n=0;n<vertices.size();n+=3)
 	{
-		dBoundBox[0]=std::min(dBoundBox[0],(double)m_Vertices.at(n).coord[0]);
-		dBoundBox[2]=std::min(dBoundBox[2],(double)m_Vertices.at(n).coord[1]);
-		dBoundBox[4]=std::min(dBoundBox[4],(double)m_Vertices.at(n).coord[2]);
-		dBoundBox[1]=std::max(dBoundBox[1],(double)m_Vertices.at(n).coord[0]);
-		dBoundBox[3]=std::max(dBoundBox[3],(double)m_Vertices.at(n).coord[1]);
-		dBoundBox[5]=std::max(dBoundBox[5],(double)m_Vertices.at(n).coord[2]);
+		for (int d=0;d<3;++d)
+		{
+			dBoundBox[2*d]=std::min(dBoundBox[2*d],(double)vertices[n+d]);
+			dBoundBox[2*d+1]=std::max(dBoundBox[2*d+1],(double)vertices[n+d]);
+		}
+	}
+	return true;
+}
+
+bool CSPrimPolyhedron::GetWorldBoundBox(double dBoundBox[6])
+{
+	if (m_WorldBoxValid==false)
+		m_WorldBoxValid = CalcWorldBoundBox(m_WorldBox);
+	if (m_WorldBoxValid==false)
+		return false;
+	for (int n=0;n<6;++n)
+		dBoundBox[n] = m_WorldBox[n];
+	return true;
+}
+
+bool CSPrimPolyhedron::CalcWorldBoundBox(double dBoundBox[6]) const
+{
+	const CSPolyhedronMesh* mesh = d_ptr->m_Mesh.get();
+	unsigned int numVertices = mesh->GetNumVertices();
+	if (numVertices==0)
+		return false;
+	for (int n=0;n<3;++n)
+	{
+		dBoundBox[2*n]   = std::numeric_limits<double>::max();
+		dBoundBox[2*n+1] = -std::numeric_limits<double>::max();
+	}
+	// transform all vertices chunk-wise, the bounding box of the transformed vertices is exact
+	const unsigned int chunk = 256;
+	double coords[3][chunk];
+	double* const coordPtr[3] = {coords[0], coords[1], coords[2]};
+	bool transformed = HasWorldTransform();
+	for (unsigned int start=0;start<numVertices;start+=chunk)
+	{
+		unsigned int num = std::min(chunk, numVertices-start);
+		const float* vertex = &mesh->m_Vertices[3*start];
+		for (unsigned int i=0;i<num;++i)
+			for (int n=0;n<3;++n)
+				coords[n][i] = vertex[3*i+n];
+		if (transformed)
+			m_Transform->Transform(num, coordPtr, coordPtr);
+		for (int n=0;n<3;++n)
+		{
+			dBoundBox[2*n]   = std::min(dBoundBox[2*n],   *std::min_element(coords[n], coords[n]+num));
+			dBoundBox[2*n+1] = std::max(dBoundBox[2*n+1], *std::max_element(coords[n], coords[n]+num));
+		}
 	}
 	return true;
 }
@@ -247,21 +475,26 @@ bool CSPrimPolyhedron::IsInside(const double* Coord, double /*tol*/)
 	if (m_Dimension<3)
 		return false;
 
+	const CSPolyhedronMesh* mesh = d_ptr->m_Mesh.get();
+	if (mesh->m_PolyhedronTree==NULL)
+		return false;
+
 	double pos[3];
 	//transform incoming coordinates into cartesian coords
 	TransformCoordSystem(Coord,pos,m_MeshType,CARTESIAN);
+	//apply the transformation of this instance, the shared mesh is always untransformed
 	if (m_Transform)
 		m_Transform->InvertTransform(pos,pos);
 
 	for (unsigned int n=0;n<3;++n)
 	{
-		if ((m_BoundBox[2*n]>pos[n]) || (m_BoundBox[2*n+1]<pos[n])) return false;
+		if ((mesh->m_BoundBox[2*n]>pos[n]) || (mesh->m_BoundBox[2*n+1]<pos[n])) return false;
 	}
 
 	Point p(pos[0], pos[1], pos[2]);
-	Segment segment_query(p,d_ptr->m_RandPt);
+	Segment segment_query(p,mesh->m_RandPt);
 	// return true for an odd number of intersections
-	if ((d_ptr->m_PolyhedronTree->number_of_intersected_primitives(segment_query)%2)==1)
+	if ((mesh->m_PolyhedronTree->number_of_intersected_primitives(segment_query)%2)==1)
 		return true;
 	return false;
 }
@@ -272,25 +505,187 @@ bool CSPrimPolyhedron::Update(std::string *ErrStr)
 	BuildTree();
 	//update local bounding box
 	m_BoundBoxValid = GetBoundBox(m_BoundBox);
+	// the transformation may have changed, the world box is calculated once per update
+	m_WorldBoxValid = CalcWorldBoundBox(m_WorldBox);
 	return CSPrimitives::Update(ErrStr);
 }
 
+// separating axis test of a triangle (already moved relative to the box center) and an axis aligned box with the given half sizes
+static bool TriangleBoxSeparated(const double v[3][3], const double axis[3], const double half[3])
+{
+	double p0 = v[0][0]*axis[0] + v[0][1]*axis[1] + v[0][2]*axis[2];
+	double p1 = v[1][0]*axis[0] + v[1][1]*axis[1] + v[1][2]*axis[2];
+	double p2 = v[2][0]*axis[0] + v[2][1]*axis[1] + v[2][2]*axis[2];
+	double r = half[0]*fabs(axis[0]) + half[1]*fabs(axis[1]) + half[2]*fabs(axis[2]);
+	return (std::min(p0,std::min(p1,p2))>r) || (std::max(p0,std::max(p1,p2))<-r);
+}
+
+// triangle/box overlap test (Akenine-Moeller), the box may be flat (grid face) or a line (grid edge)
+static bool TriangleBoxOverlap(const double tri[3][3], const double boxMin[3], const double boxMax[3])
+{
+	double center[3], half[3], v[3][3], e[3][3];
+	for (int n=0;n<3;++n)
+	{
+		center[n] = 0.5*(boxMin[n]+boxMax[n]);
+		half[n] = 0.5*(boxMax[n]-boxMin[n]);
+	}
+	for (int i=0;i<3;++i)
+		for (int n=0;n<3;++n)
+			v[i][n] = tri[i][n]-center[n];
+	for (int i=0;i<3;++i)
+		for (int n=0;n<3;++n)
+			e[i][n] = v[(i+1)%3][n]-v[i][n];
+
+	// the box axes are skipped, the caller only tests boxes overlapping the triangle bounding box
+	// triangle normal
+	double axis[3];
+	axis[0] = e[0][1]*e[1][2]-e[0][2]*e[1][1];
+	axis[1] = e[0][2]*e[1][0]-e[0][0]*e[1][2];
+	axis[2] = e[0][0]*e[1][1]-e[0][1]*e[1][0];
+	if (TriangleBoxSeparated(v, axis, half))
+		return false;
+	// cross products of the box axes and triangle edges
+	for (int b=0;b<3;++b)
+		for (int i=0;i<3;++i)
+		{
+			axis[b] = 0;
+			axis[(b+1)%3] = -e[i][(b+2)%3];
+			axis[(b+2)%3] = e[i][(b+1)%3];
+			if (TriangleBoxSeparated(v, axis, half))
+				return false;
+		}
+	return true;
+}
+
+bool CSPrimPolyhedron::GetGridIntersections(CSRectGrid* grid, std::vector<size_t> edges[3], std::vector<size_t> faces[3])
+{
+	for (int n=0;n<3;++n)
+	{
+		edges[n].clear();
+		faces[n].clear();
+	}
+	if (grid==NULL)
+		return false;
+	if (grid->GetMeshType()!=CARTESIAN)
+	{
+		std::cerr << "CSPrimPolyhedron::GetGridIntersections: Error, only cartesian grids are supported" << std::endl;
+		return false;
+	}
+
+	std::vector<double> lines[3];
+	size_t stride[3] = {1,0,0};
+	for (int n=0;n<3;++n)
+	{
+		unsigned int qty = 0;
+		double* array = grid->GetLines(n, NULL, qty, true);
+		lines[n].assign(array, array+qty);
+		delete[] array;
+		if (qty==0)
+			return true;
+	}
+	stride[1] = lines[0].size();
+	stride[2] = lines[0].size()*lines[1].size();
+
+	CSPolyhedronMesh* mesh = d_ptr->m_Mesh.get();
+	unsigned int numFaces = mesh->GetNumFaces();
+	unsigned int numVertex;
+	double tri[3][3], triMin[3], triMax[3];
+	double boxMin[3], boxMax[3];
+	unsigned int nodeStart[3], nodeStop[3], cellStart[3], cellStop[3];
+	unsigned int pos[3];
+	for (unsigned int f=0;f<numFaces;++f)
+	{
+		const int* face = mesh->GetFace(f, numVertex);
+		// polygonal faces are split into a triangle fan
+		for (unsigned int t=1;t+1<numVertex;++t)
+		{
+			int idx[3] = {face[0], face[t], face[t+1]};
+			for (int i=0;i<3;++i)
+			{
+				const float* coord = &mesh->m_Vertices[3*idx[i]];
+				for (int n=0;n<3;++n)
+					tri[i][n] = coord[n];
+				if (m_Transform)
+					m_Transform->Transform(tri[i],tri[i]);
+			}
+			bool outside = false;
+			for (int n=0;n<3;++n)
+			{
+				triMin[n] = std::min(tri[0][n],std::min(tri[1][n],tri[2][n]));
+				triMax[n] = std::max(tri[0][n],std::max(tri[1][n],tri[2][n]));
+				// grid nodes inside the triangle bounding box
+				nodeStart[n] = std::lower_bound(lines[n].begin(), lines[n].end(), triMin[n]) - lines[n].begin();
+				nodeStop[n] = std::upper_bound(lines[n].begin(), lines[n].end(), triMax[n]) - lines[n].begin();
+				// grid cells overlapping the triangle bounding box
+				cellStart[n] = nodeStart[n]>0 ? nodeStart[n]-1 : 0;
+				cellStop[n] = std::min(nodeStop[n], (unsigned int)lines[n].size()-1);
+				if ((triMax[n]<lines[n].front()) || (triMin[n]>lines[n].back()))
+					outside = true;
+			}
+			if (outside)
+				continue;
+
+			for (int ny=0;ny<3;++ny)
+			{
+				int nyP = (ny+1)%3;
+				int nyPP = (ny+2)%3;
+				// edges in direction ny
+				for (pos[nyP]=nodeStart[nyP];pos[nyP]<nodeStop[nyP];++pos[nyP])
+					for (pos[nyPP]=nodeStart[nyPP];pos[nyPP]<nodeStop[nyPP];++pos[nyPP])
+						for (pos[ny]=cellStart[ny];pos[ny]<cellStop[ny];++pos[ny])
+						{
+							for (int n=0;n<3;++n)
+								boxMin[n] = boxMax[n] = lines[n][pos[n]];
+							boxMax[ny] = lines[ny][pos[ny]+1];
+							if (TriangleBoxOverlap(tri, boxMin, boxMax))
+								edges[ny].push_back(pos[0]*stride[0] + pos[1]*stride[1] + pos[2]*stride[2]);
+						}
+				// faces with normal direction ny
+				for (pos[ny]=nodeStart[ny];pos[ny]<nodeStop[ny];++pos[ny])
+					for (pos[nyP]=cellStart[nyP];pos[nyP]<cellStop[nyP];++pos[nyP])
+						for (pos[nyPP]=cellStart[nyPP];pos[nyPP]<cellStop[nyPP];++pos[nyPP])
+						{
+							for (int n=0;n<3;++n)
+							{
+								boxMin[n] = lines[n][pos[n]];
+								boxMax[n] = (n==ny) ? boxMin[n] : lines[n][pos[n]+1];
+							}
+							if (TriangleBoxOverlap(tri, boxMin, boxMax))
+								faces[ny].push_back(pos[0]*stride[0] + pos[1]*stride[1] + pos[2]*stride[2]);
+						}
+			}
+		}
+	}
+
+	// remove duplicates found by neighboring triangles
+	for (int n=0;n<3;++n)
+	{
+		std::sort(edges[n].begin(), edges[n].end());
+		edges[n].erase(std::unique(edges[n].begin(), edges[n].end()), edges[n].end());
+		std::sort(faces[n].begin(), faces[n].end());
+		faces[n].erase(std::unique(faces[n].begin(), faces[n].end()), faces[n].end());
+	}
+	return true;
+}
+
 bool CSPrimPolyhedron::Write2XML(TiXmlElement &elem, bool parameterised)
 {
 	if (CSPrimitives::Write2XML(elem,parameterised)==false)
 		return false;
 
-	for (size_t n=0;n<m_Vertices.size();++n)
+	for (unsigned int n=0;n<GetNumVertices();++n)
 	{
 		TiXmlElement vertex("Vertex");
-		TiXmlText text(CombineArray2String(m_Vertices.at(n).coord,3,','));
+		TiXmlText text(CombineArray2String(GetVertex(n),3,','));
 		vertex.InsertEndChild(text);
 		elem.InsertEndChild(vertex);
 	}
-	for (size_t n=0;n<m_Faces.size();++n)
+	unsigned int numVertex;
+	for (unsigned int n=0;n<GetNumFaces();++n)
 	{
+		const int* vertices = GetFace(n, numVertex);
 		TiXmlElement face("Face");
-		TiXmlText text(CombineArray2String(m_Faces.at(n).vertices,m_Faces.at(n).numVertex,','));
+		TiXmlText text(CombineArray2String(vertices,numVertex,','));
 		face.InsertEndChild(text);
 		elem.InsertEndChild(face);
 	}
@@ -353,7 +748,8 @@ bool CSPrimPolyhedron::ReadFromXML(TiXmlNode &root)
 void CSPrimPolyhedron::ShowPrimitiveStatus(std::ostream& stream)
 {
 	CSPrimitives::ShowPrimitiveStatus(stream);
-	stream << " Number of Vertices: " << m_Vertices.size() << std::endl;
-	stream << " Number of Faces: " << m_Faces.size() << std::endl;
-	stream << " Number of invalid Faces: " << m_InvalidFaces << std::endl;
+	stream << " Number of Vertices: " << GetNumVertices() << std::endl;
+	stream << " Number of Faces: " << GetNumFaces() << std::endl;
+	stream << " Number of invalid Faces: " << d_ptr->m_Mesh->m_InvalidFaces << std::endl;
+	stream << " Number of mesh instances: " << GetMeshUseCount() << std::endl;
 }
@@ -20,10 +20,15 @@
 #include "CSPrimitives.h"
 
 struct CSPrimPolyhedronPrivate;
+class CSRectGrid;
+class CSMappedFile;
 
 //! Polyhedron Primitive
 /*!
  This is a polyhedron primitive. A 3D solid object, defined by vertices and faces
+
+ Copies of a polyhedron (see GetCopy and ShareMesh) are instances, they share the (then immutable) vertices, faces and search tree
+ and only keep their own properties and transformation. Modifying the mesh of an instance creates a private copy of the mesh first.
  */
 class CSXCAD_EXPORT CSPrimPolyhedron : public CSPrimitives
 {
@@ -50,34 +55,82 @@ public:
 	virtual void AddVertex(float p[3]) {AddVertex(p[0],p[1],p[2]);}
 	virtual void AddVertex(double p[3]) {AddVertex(p[0],p[1],p[2]);}
 	virtual void AddVertex(float px, float py, float pz);
+	//! Add multiple vertices at once, coords contains 3 values per vertex
+	virtual void AddVertices(unsigned int numVertices, const float* coords);
+	virtual void AddVertices(unsigned int numVertices, const double* coords);
 
-	virtual unsigned int GetNumVertices() const {return m_Vertices.size();}
-	virtual float* GetVertex(unsigned int n);
+	virtual unsigned int GetNumVertices() const;
+	//! Get the coordinates of vertex n, the vertices may be shared with other instances and must not be modified
+	virtual const float* GetVertex(unsigned int n) const;
 
+	//! Add a face, this takes the ownership of f.vertices (allocated with new[]), which is deleted after the vertex indices are copied
 	virtual void AddFace(face f);
 	virtual void AddFace(int numVertex, int* vertices);
 	virtual void AddFace(std::vector<int> vertices);
+	//! Add multiple faces at once
+	/*!
+	 \param numFaces Number of faces to add.
+	 \param vertices Vertex indices of all faces.
+	 \param offsets Start index of every face in vertices plus the end index of the last face (numFaces+1 values), use NULL if all faces are triangles.
+	 */
+	virtual void AddFaces(unsigned int numFaces, const int* vertices, const unsigned int* offsets=NULL);
 
 	virtual bool BuildTree();
 
-	virtual unsigned int GetNumFaces() const {return m_Faces.size();}
-	virtual int* GetFace(unsigned int n, unsigned int &numVertices);
-	virtual bool GetFaceValid(unsigned int n) const {return m_Faces.at(n).valid;}
+	virtual unsigned int GetNumFaces() const;
+	//! Get the vertex indices of the given face, the returned array is owned by this primitive and may be shared with other instances
+	virtual const int* GetFace(unsigned int n, unsigned int &numVertices) const;
+	virtual bool GetFaceValid(unsigned int n) const;
+	//! Check if all faces of this polyhedron are triangles
+	bool IsTriangleMesh() const;
+
+	//! Use the mesh and search tree of the given polyhedron, this primitive keeps its own properties and transformation
+	virtual void ShareMesh(CSPrimPolyhedron* primPolyhedron);
+	//! Get the number of primitives using the mesh of this polyhedron (including this one)
+	unsigned int GetMeshUseCount() const;
 
 	virtual CSPrimPolyhedron* GetCopy(CSProperties *prop=NULL) {return new CSPrimPolyhedron(this,prop);}
 
 	virtual bool GetBoundBox(double dBoundBox[6], bool PreserveOrientation=false);
+	virtual bool GetWorldBoundBox(double dBoundBox[6]);
 	virtual bool IsInside(const double* Coord, double tol=0);
 
 	virtual bool Update(std::string *ErrStr=NULL);
 	virtual bool Write2XML(TiXmlElement &elem, bool parameterised=true);
 	virtual bool ReadFromXML(TiXmlNode &root);
 
+	//! Find all grid edges and grid faces cut by the surface of this polyhedron
+	/*!
+	 This is mainly intended for open surfaces (e.g. sheets imported from STL files), which are not found by IsInside.
+	 Only cartesian grids are supported. An edge or face touching the surface counts as cut.
+	 \param grid The grid to test against.
+	 \param edges Cut edges in direction n, stored as the linear index (i + j*Nx + k*Nx*Ny) of the lower edge node. The result is sorted.
+	 \param faces Cut faces with normal direction n, stored as the linear index of the lowest face node. The result is sorted.
+	 \return false if the grid is not supported.
+	 */
+	virtual bool GetGridIntersections(CSRectGrid* grid, std::vector<size_t> edges[3], std::vector<size_t> faces[3]);
+
 	virtual void ShowPrimitiveStatus(std::ostream& stream);
 
 protected:
-	unsigned int m_InvalidFaces;
-	std::vector<vertex> m_Vertices;
-	std::vector<face> m_Faces;
+	//! Prepare the mesh for modification, a shared mesh is copied and the search tree is invalidated
+	void DetachMesh();
+	//! Calculate the bounding box of all transformed vertices
+	bool CalcWorldBoundBox(double dBoundBox[6]) const;
+
+	//! Use the mesh registered with the given key, \return false if no such mesh exists
+	bool ShareMeshByKey(const std::string &key);
+	//! Register the current mesh with the given key for sharing, the mesh becomes immutable
+	void RegisterMesh(const std::string &key);
+	//! Replace the mesh by vertex and face arrays of a mapped file, the arrays are used in place and copied only on modification
+	/*!
+	 This takes the ownership of the mapped file, all arrays have to point into its data.
+	 \param offsets Face offsets as in AddFaces (numFaces+1 values), NULL if all faces are triangles.
+	 */
+	void SetMappedMesh(CSMappedFile* file, unsigned int numVertices, const float* coords, unsigned int numFaces, unsigned int numIndices, const int* indices, const unsigned int* offsets);
 	CSPrimPolyhedronPrivate *d_ptr; //!< pointer to private data structure, to hide the CGAL dependency from applications
+
+	///World bounding box of the transformed vertices, updated by Update() or on first use
+	bool m_WorldBoxValid;
+	double m_WorldBox[6];
 };
@@ -26,7 +26,21 @@
 #include <vtkPolyData.h>
 #include <vtkCellArray.h>
 
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <iomanip>
+#include <sys/stat.h>
+#if !defined(WIN32)
+#include <unistd.h>
+#else
+#include <process.h>
+#endif
+#include <boost/thread.hpp>
+#include <boost/bind/bind.hpp>
+
 #include "CSPrimPolyhedronReader.h"
+#include "CSMappedFile.h"
 #include "CSProperties.h"
 #include "CSUseful.h"
 
@@ -116,7 +130,773 @@ bool CSPrimPolyhedronReader::ReadFromXML(TiXmlNode &root)
 	return BuildTree();
 }
 
+// hash of a single vertex coordinate, -0.0 and +0.0 are treated as equal
+static inline uint32_t VertexHash(const float* p, uint32_t key[3])
+{
+	uint32_t h = 2166136261u;
+	for (int n=0;n<3;++n)
+	{
+		float v = (p[n]==0) ? 0.0f : p[n];
+		memcpy(&key[n], &v, sizeof(float));
+		h = (h ^ key[n]) * 16777619u;
+		h ^= h >> 15;
+	}
+	return h;
+}
+
+//! Parallel vertex welding of a triangle soup
+/*!
+ The corners are distributed by their hash over all threads, each thread owns a private open addressing hash table for its share.
+ For each corner the index of its first occurrence is stored, which is later (serially) converted into the final vertex index.
+ This ensures a vertex order independent of the number of threads used.
+ */
+class VertexWelder
+{
+public:
+	VertexWelder(const float* corners, size_t numCorners) : m_Corners(corners), m_NumCorners(numCorners)
+	{
+		m_Hash.resize(numCorners);
+		m_Index.resize(numCorners);
+	}
+
+	void CalcHash(unsigned int thread, unsigned int numThreads)
+	{
+		uint32_t key[3];
+		size_t chunk = m_NumCorners/numThreads+1;
+		size_t stop = std::min(m_NumCorners, chunk*(thread+1));
+		for (size_t c=chunk*thread;c<stop;++c)
+			m_Hash[c] = VertexHash(m_Corners+3*c, key);
+	}
+
+	//! Sort all corners by the thread owning them, keeping the original order within each thread
+	void Partition(unsigned int numThreads)
+	{
+		m_Order.resize(m_NumCorners);
+		m_PartStart.assign(numThreads+1, 0);
+		for (size_t c=0;c<m_NumCorners;++c)
+			++m_PartStart[m_Hash[c]%numThreads+1];
+		for (unsigned int n=0;n<numThreads;++n)
+			m_PartStart[n+1] += m_PartStart[n];
+		std::vector<size_t> fill(m_PartStart.begin(), m_PartStart.end()-1);
+		for (size_t c=0;c<m_NumCorners;++c)
+			m_Order[fill[m_Hash[c]%numThreads]++] = (uint32_t)c;
+	}
+
+	void Weld(unsigned int thread, unsigned int numThreads)
+	{
+		size_t count = m_PartStart[thread+1]-m_PartStart[thread];
+		size_t capacity = 16;
+		while (capacity<2*count)
+			capacity*=2;
+		size_t mask = capacity-1;
+		std::vector<uint32_t> table(capacity, (uint32_t)-1);
+		uint32_t key[3], other[3];
+		for (size_t i=m_PartStart[thread];i<m_PartStart[thread+1];++i)
+		{
+			uint32_t c = m_Order[i];
+			VertexHash(m_Corners+3*c, key);
+			size_t slot = (m_Hash[c]/numThreads) & mask;
+			while (true)
+			{
+				if (table[slot]==(uint32_t)-1)
+				{
+					table[slot] = c;
+					m_Index[c] = c;
+					break;
+				}
+				VertexHash(m_Corners+3*table[slot], other);
+				if ((key[0]==other[0]) && (key[1]==other[1]) && (key[2]==other[2]))
+				{
+					m_Index[c] = table[slot];
+					break;
+				}
+				slot = (slot+1) & mask;
+			}
+		}
+	}
+
+	//! Convert first occurrence indices into consecutive vertex indices, \return number of unique vertices
+	uint32_t Finish()
+	{
+		uint32_t numVertices = 0;
+		for (size_t c=0;c<m_NumCorners;++c)
+		{
+			uint32_t first = m_Index[c];
+			if (first==c)
+				m_Index[c] = numVertices++;
+			else
+				m_Index[c] = m_Index[first];
+		}
+		return numVertices;
+	}
+
+	const float* m_Corners;
+	size_t m_NumCorners;
+	std::vector<uint32_t> m_Hash;
+	std::vector<uint32_t> m_Index;
+	std::vector<uint32_t> m_Order;
+	std::vector<size_t> m_PartStart;
+};
+
+void CSPrimPolyhedronReader::AddTriangleSoup(const float* corners, size_t numTriangles)
+{
+	size_t numCorners = 3*numTriangles;
+	if (numCorners==0)
+		return;
+	VertexWelder welder(corners, numCorners);
+
+	unsigned int numThreads = boost::thread::hardware_concurrency();
+	if ((numThreads<=1) || (numCorners<100000))
+	{
+		welder.CalcHash(0,1);
+		welder.Partition(1);
+		welder.Weld(0,1);
+	}
+	else
+	{
+		boost::thread_group threads;
+		for (unsigned int n=0;n<numThreads;++n)
+			threads.create_thread(boost::bind(&VertexWelder::CalcHash, &welder, n, numThreads));
+		threads.join_all();
+		welder.Partition(numThreads);
+		for (unsigned int n=0;n<numThreads;++n)
+			threads.create_thread(boost::bind(&VertexWelder::Weld, &welder, n, numThreads));
+		threads.join_all();
+	}
+	uint32_t numVertices = welder.Finish();
+
+	std::vector<float> coords(3*(size_t)numVertices);
+	for (size_t c=0;c<numCorners;++c)
+		for (int n=0;n<3;++n)
+			coords[3*welder.m_Index[c]+n] = corners[3*c+n];
+
+	int offset = GetNumVertices();
+	AddVertices(numVertices, &coords[0]);
+
+	std::vector<int> tris;
+	tris.reserve(numCorners);
+	int* tri;
+	for (size_t t=0;t<numTriangles;++t)
+	{
+		tris.resize(tris.size()+3);
+		tri = &tris[tris.size()-3];
+		for (int n=0;n<3;++n)
+			tri[n] = offset + welder.m_Index[3*t+n];
+		// skip degenerated triangles
+		if ((tri[0]==tri[1]) || (tri[0]==tri[2]) || (tri[1]==tri[2]))
+			tris.resize(tris.size()-3);
+	}
+	if (!tris.empty())
+		AddFaces(tris.size()/3, &tris[0]);
+}
+
+// read the next whitespace separated token, \return false at the end of the data
+static bool NextToken(const char* &pos, const char* end, const char* &token, size_t &len)
+{
+	while ((pos<end) && ((*pos==' ') || (*pos=='\t') || (*pos=='\r') || (*pos=='\n')))
+		++pos;
+	if (pos>=end)
+		return false;
+	token = pos;
+	while ((pos<end) && (*pos!=' ') && (*pos!='\t') && (*pos!='\r') && (*pos!='\n'))
+		++pos;
+	len = pos-token;
+	return true;
+}
+
+static bool TokenEquals(const char* token, size_t len, const char* str)
+{
+	return (strlen(str)==len) && (strncmp(token, str, len)==0);
+}
+
+bool CSPrimPolyhedronReader::ReadSTL(const char* data, size_t size)
+{
+	uint32_t numTri = 0;
+	if (size>=84)
+		memcpy(&numTri, data+80, 4);
+	bool binary = (size>=84) && (size==84+50*(size_t)numTri);
+	if ((binary==false) && ((size<5) || (strncmp(data, "solid", 5)!=0)))
+		binary = (size>=84) && (size>=84+50*(size_t)numTri);
+
+	std::vector<float> corners;
+	if (binary)
+	{
+		corners.resize(9*(size_t)numTri);
+		const char* record = data+84;
+		for (size_t t=0;t<numTri;++t, record+=50)
+			memcpy(&corners[9*t], record+12, 9*sizeof(float)); // skip the normal vector
+	}
+	else
+	{
+		const char* pos = data;
+		const char* end = data+size;
+		const char* token;
+		size_t len;
+		char number[64];
+		while (NextToken(pos, end, token, len))
+		{
+			if (TokenEquals(token, len, "vertex")==false)
+				continue;
+			for (int n=0;n<3;++n)
+			{
+				if ((NextToken(pos, end, token, len)==false) || (len>=sizeof(number)))
+				{
+					std::cerr << "CSPrimPolyhedronReader::ReadSTL: Error, invalid vertex in ASCII STL file" << std::endl;
+					return false;
+				}
+				memcpy(number, token, len);
+				number[len] = 0;
+				corners.push_back(strtof(number, NULL));
+			}
+		}
+		if (corners.size()%9!=0)
+		{
+			std::cerr << "CSPrimPolyhedronReader::ReadSTL: Error, ASCII STL file contains incomplete triangles" << std::endl;
+			return false;
+		}
+		numTri = corners.size()/9;
+	}
+
+	if (numTri==0)
+	{
+		std::cerr << "CSPrimPolyhedronReader::ReadSTL: file invalid or empty, skipping ..." << std::endl;
+		return false;
+	}
+	AddTriangleSoup(&corners[0], numTri);
+	return true;
+}
+
+namespace
+{
+	enum PLYType {PLY_INVALID, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64};
+
+	struct PLYProperty
+	{
+		std::string name;
+		PLYType type;
+		bool isList;
+		PLYType countType;
+	};
+
+	struct PLYElement
+	{
+		std::string name;
+		size_t count;
+		std::vector<PLYProperty> props;
+	};
+
+	PLYType PLYTypeByName(std::string name)
+	{
+		if ((name=="char") || (name=="int8")) return PLY_INT8;
+		if ((name=="uchar") || (name=="uint8")) return PLY_UINT8;
+		if ((name=="short") || (name=="int16")) return PLY_INT16;
+		if ((name=="ushort") || (name=="uint16")) return PLY_UINT16;
+		if ((name=="int") || (name=="int32")) return PLY_INT32;
+		if ((name=="uint") || (name=="uint32")) return PLY_UINT32;
+		if ((name=="float") || (name=="float32")) return PLY_FLOAT32;
+		if ((name=="double") || (name=="float64")) return PLY_FLOAT64;
+		return PLY_INVALID;
+	}
+
+	size_t PLYTypeSize(PLYType type)
+	{
+		switch (type)
+		{
+		case PLY_INT8: case PLY_UINT8: return 1;
+		case PLY_INT16: case PLY_UINT16: return 2;
+		case PLY_INT32: case PLY_UINT32: case PLY_FLOAT32: return 4;
+		case PLY_FLOAT64: return 8;
+		default: return 0;
+		}
+	}
+
+	double PLYValue(const char* p, PLYType type, bool swap)
+	{
+		unsigned char buf[8];
+		size_t size = PLYTypeSize(type);
+		for (size_t n=0;n<size;++n)
+			buf[n] = swap ? p[size-1-n] : p[n];
+		switch (type)
+		{
+		case PLY_INT8: {int8_t v; memcpy(&v,buf,1); return v;}
+		case PLY_UINT8: {uint8_t v; memcpy(&v,buf,1); return v;}
+		case PLY_INT16: {int16_t v; memcpy(&v,buf,2); return v;}
+		case PLY_UINT16: {uint16_t v; memcpy(&v,buf,2); return v;}
+		case PLY_INT32: {int32_t v; memcpy(&v,buf,4); return v;}
+		case PLY_UINT32: {uint32_t v; memcpy(&v,buf,4); return v;}
+		case PLY_FLOAT32: {float v; memcpy(&v,buf,4); return v;}
+		case PLY_FLOAT64: {double v; memcpy(&v,buf,8); return v;}
+		default: return 0;
+		}
+	}
+}
+
+bool CSPrimPolyhedronReader::ReadPLY(const char* data, size_t size)
+{
+	const char* end = data+size;
+	const char* pos = data;
+
+	// parse the ASCII header
+	std::vector<PLYElement> elements;
+	bool swap = false;
+	bool header_done = false;
+	std::string line;
+	while ((pos<end) && !header_done)
+	{
+		const char* eol = (const char*)memchr(pos, '\n', end-pos);
+		if (eol==NULL)
+			return false;
+		line.assign(pos, eol-pos);
+		pos = eol+1;
+		if ((line.size()>0) && (line[line.size()-1]=='\r'))
+			line.erase(line.size()-1);
+
+		std::istringstream ss(line);
+		std::string keyword;
+		ss >> keyword;
+		if ((keyword=="ply") || (keyword=="comment") || (keyword=="obj_info") || keyword.empty())
+			continue;
+		if (keyword=="format")
+		{
+			std::string format;
+			ss >> format;
+			uint16_t test = 1;
+			bool little_host = (*(char*)&test)==1;
+			if (format=="binary_little_endian")
+				swap = !little_host;
+			else if (format=="binary_big_endian")
+				swap = little_host;
+			else
+				return false; // ASCII format is handled by vtk
+		}
+		else if (keyword=="element")
+		{
+			PLYElement elem;
+			ss >> elem.name >> elem.count;
+			if (ss.fail())
+				return false;
+			elements.push_back(elem);
+		}
+		else if (keyword=="property")
+		{
+			if (elements.size()==0)
+				return false;
+			PLYProperty prop;
+			std::string type;
+			ss >> type;
+			prop.isList = (type=="list");
+			prop.countType = PLY_INVALID;
+			if (prop.isList)
+			{
+				std::string count_type;
+				ss >> count_type >> type;
+				prop.countType = PLYTypeByName(count_type);
+				if (prop.countType==PLY_INVALID)
+					return false;
+			}
+			prop.type = PLYTypeByName(type);
+			ss >> prop.name;
+			if ((prop.type==PLY_INVALID) || ss.fail())
+				return false;
+			elements.back().props.push_back(prop);
+		}
+		else if (keyword=="end_header")
+			header_done = true;
+		else
+			return false;
+	}
+	if (!header_done)
+		return false;
+
+	std::vector<float> vertices;
+	std::vector<unsigned int> face_offsets;
+	std::vector<int> face_indices;
+	bool has_vertices = false;
+	bool has_faces = false;
+
+	for (size_t e=0;e<elements.size();++e)
+	{
+		const PLYElement &elem = elements.at(e);
+		bool is_vertex = (elem.name=="vertex");
+		bool is_face = (elem.name=="face");
+
+		int coord_prop[3] = {-1,-1,-1};
+		int index_prop = -1;
+		for (size_t p=0;p<elem.props.size();++p)
+		{
+			const PLYProperty &prop = elem.props.at(p);
+			if (is_vertex && !prop.isList)
+			{
+				if (prop.name=="x") coord_prop[0]=p;
+				if (prop.name=="y") coord_prop[1]=p;
+				if (prop.name=="z") coord_prop[2]=p;
+			}
+			if (is_face && prop.isList && ((prop.name=="vertex_indices") || (prop.name=="vertex_index")))
+				index_prop = p;
+		}
+		if (is_vertex)
+		{
+			if ((coord_prop[0]<0) || (coord_prop[1]<0) || (coord_prop[2]<0))
+				return false;
+			vertices.resize(3*elem.count);
+			has_vertices = true;
+		}
+		if (is_face)
+		{
+			if (index_prop<0)
+				return false;
+			face_offsets.reserve(elem.count+1);
+			face_offsets.push_back(0);
+			face_indices.reserve(3*elem.count);
+			has_faces = true;
+		}
+
+		for (size_t i=0;i<elem.count;++i)
+		{
+			for (size_t p=0;p<elem.props.size();++p)
+			{
+				const PLYProperty &prop = elem.props.at(p);
+				if (prop.isList)
+				{
+					size_t count_size = PLYTypeSize(prop.countType);
+					if (pos+count_size>end)
+						return false;
+					double count = PLYValue(pos, prop.countType, swap);
+					pos += count_size;
+					size_t item_size = PLYTypeSize(prop.type);
+					if ((count<0) || (pos+(size_t)count*item_size>end))
+						return false;
+					if ((int)p==index_prop)
+					{
+						for (size_t n=0;n<(size_t)count;++n)
+							face_indices.push_back((int)PLYValue(pos+n*item_size, prop.type, swap));
+						face_offsets.push_back(face_indices.size());
+					}
+					pos += (size_t)count*item_size;
+				}
+				else
+				{
+					size_t item_size = PLYTypeSize(prop.type);
+					if (pos+item_size>end)
+						return false;
+					for (int n=0;n<3;++n)
+						if ((int)p==coord_prop[n])
+							vertices[3*i+n] = PLYValue(pos, prop.type, swap);
+					pos += item_size;
+				}
+			}
+		}
+	}
+
+	if (!has_vertices || !has_faces || (vertices.size()==0) || (face_offsets.size()<=1))
+	{
+		std::cerr << "CSPrimPolyhedronReader::ReadPLY: file invalid or empty, skipping ..." << std::endl;
+		return false;
+	}
+	for (size_t n=0;n<face_indices.size();++n)
+		if ((face_indices[n]<0) || (face_indices[n]>=(int)(vertices.size()/3)))
+		{
+			std::cerr << "CSPrimPolyhedronReader::ReadPLY: Error, invalid vertex index found, skipping ..." << std::endl;
+			return false;
+		}
+
+	int offset = GetNumVertices();
+	for (size_t n=0;n<face_indices.size();++n)
+		face_indices[n] += offset;
+	AddVertices(vertices.size()/3, &vertices[0]);
+	AddFaces(face_offsets.size()-1, face_indices.empty() ? NULL : &face_indices[0], &face_offsets[0]);
+	return true;
+}
+
+// 64bit FNV-1a hash of the given data
+static uint64_t FNVHash(const char* data, size_t size, uint64_t hash=14695981039346656037ULL)
+{
+	for (size_t n=0;n<size;++n)
+	{
+		hash ^= (unsigned char)data[n];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// hash of evenly spaced blocks of the file content (the complete content of small files),
+// together with the file size and modification time this identifies the file without reading all of it
+static uint64_t SampledContentHash(const char* data, size_t size)
+{
+	const size_t blockSize = 4096;
+	const size_t numBlocks = 64;
+	if (size<=blockSize*numBlocks)
+		return FNVHash(data, size);
+	uint64_t hash = 14695981039346656037ULL;
+	for (size_t n=0;n<numBlocks;++n)
+		hash = FNVHash(data + n*(size-blockSize)/(numBlocks-1), blockSize, hash);
+	return hash;
+}
+
+// mesh cache file layout, all values in native byte order:
+// header, 3*numVertices float coordinates, numIndices int vertex indices, numFaces+1 uint32 face offsets (only if not all faces are triangles)
+#define MESH_CACHE_VERSION 2
+struct MeshCacheHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	uint64_t fileSize;
+	int64_t fileMTime;
+	uint64_t fileHash;
+	uint32_t numVertices;
+	uint32_t numFaces;
+	uint32_t numIndices;
+	uint32_t hasOffsets;
+};
+
+static const char g_MeshCacheMagic[8] = {'C','S','X','M','E','S','H','\0'};
+
+// key identifying a mesh file and its modification state, empty if the file can't be accessed
+static std::string MeshFileKey(const std::string &filename, int filetype)
+{
+	std::string fileKey = GetFileIdentity(filename);
+	if (fileKey.empty())
+		return std::string();
+	std::stringstream key;
+	key << "PolyhedronReader:" << filetype << ":" << fileKey;
+	return key.str();
+}
+
 bool CSPrimPolyhedronReader::ReadFile()
+{
+	if ((m_filetype!=STL_FILE) && (m_filetype!=PLY_FILE))
+	{
+		std::cerr << "CSPrimPolyhedronReader::ReadFile: unknown filetype, skipping..." << std::endl;
+		return false;
+	}
+
+	// an unchanged file that is already loaded by another reader is shared instead of being read again
+	std::string key;
+	if ((GetNumVertices()==0) && (GetNumFaces()==0))
+		key = MeshFileKey(m_filename, m_filetype);
+	if (!key.empty() && ShareMeshByKey(key))
+		return true;
+
+	if (ParseFile()==false)
+		return false;
+	if (!key.empty())
+		RegisterMesh(key);
+	return true;
+}
+
+bool CSPrimPolyhedronReader::ParseFile()
+{
+	CSMappedFile file;
+	if (file.Open(m_filename)==false)
+	{
+		std::cerr << "CSPrimPolyhedronReader::ParseFile: Error, can't open file \"" << m_filename << "\", skipping ..." << std::endl;
+		return false;
+	}
+
+	// the cache stores complete meshes only, it is keyed by the size, modification time and a sampled hash of the file
+	std::string cacheFile;
+	long long fileMTime = 0;
+	uint64_t fileHash = 0;
+	std::string cacheDir = GetCacheDirectory();
+	if (!cacheDir.empty() && (GetNumVertices()==0) && (GetNumFaces()==0))
+	{
+		fileMTime = GetFileModificationTime(m_filename);
+		fileHash = SampledContentHash(file.GetData(), file.GetSize());
+		uint64_t key = FNVHash((const char*)&fileMTime, sizeof(fileMTime), fileHash);
+		std::stringstream name;
+		name << cacheDir << "/" << std::hex << std::setfill('0') << std::setw(16) << key << "_" << std::dec << file.GetSize() << "." << m_filetype << ".csxmesh";
+		cacheFile = name.str();
+		if (ReadCache(cacheFile, file.GetSize(), fileMTime, fileHash))
+			return true;
+	}
+
+	bool ok;
+	if (m_filetype==STL_FILE)
+		ok = ReadSTL(file.GetData(), file.GetSize());
+	else
+		ok = ReadPLY(file.GetData(), file.GetSize());
+
+	// unsupported format (e.g. ASCII PLY) or parser error, try vtk instead
+	if (!ok)
+		ok = ReadFileVTK();
+
+	if (ok && !cacheFile.empty())
+		WriteCache(cacheFile, file.GetSize(), fileMTime, fileHash);
+	return ok;
+}
+
+static std::string g_CacheDirectory;
+static bool g_CacheDirectorySet = false;
+
+void CSPrimPolyhedronReader::SetCacheDirectory(std::string dir)
+{
+	g_CacheDirectory = dir;
+	g_CacheDirectorySet = true;
+}
+
+std::string CSPrimPolyhedronReader::GetCacheDirectory()
+{
+	if (g_CacheDirectorySet)
+		return g_CacheDirectory;
+	const char* env = getenv("CSXCAD_POLYHEDRON_CACHE");
+	if (env==NULL)
+		return std::string();
+	return std::string(env);
+}
+
+// check the header and the array layout of a mapped cache file, the mapped arrays are returned
+static bool CheckMeshCache(const CSMappedFile &file, MeshCacheHeader &header, const float* &coords, const int* &indices, const unsigned int* &offsets)
+{
+	if (file.GetSize()<sizeof(MeshCacheHeader))
+		return false;
+	memcpy(&header, file.GetData(), sizeof(header));
+	if ((memcmp(header.magic, g_MeshCacheMagic, 8)!=0) || (header.version!=MESH_CACHE_VERSION) || (header.byteOrder!=0x01020304))
+		return false;
+
+	size_t expected = sizeof(header) + 3*sizeof(float)*(size_t)header.numVertices + sizeof(int)*(size_t)header.numIndices;
+	if (header.hasOffsets)
+		expected += sizeof(uint32_t)*((size_t)header.numFaces+1);
+	else if (header.numIndices!=3*header.numFaces)
+		return false;
+	if ((file.GetSize()!=expected) || (header.numVertices==0) || (header.numFaces==0))
+		return false;
+
+	const char* pos = file.GetData() + sizeof(header);
+	coords = (const float*)pos;
+	pos += 3*sizeof(float)*(size_t)header.numVertices;
+	indices = (const int*)pos;
+	pos += sizeof(int)*(size_t)header.numIndices;
+	offsets = NULL;
+	if (header.hasOffsets)
+	{
+		offsets = (const unsigned int*)pos;
+		if ((offsets[0]!=0) || (offsets[header.numFaces]!=header.numIndices))
+			return false;
+		for (uint32_t n=0;n<header.numFaces;++n)
+			if (offsets[n]>offsets[n+1])
+				return false;
+	}
+	for (uint32_t n=0;n<header.numIndices;++n)
+		if ((indices[n]<0) || ((uint32_t)indices[n]>=header.numVertices))
+			return false;
+	return true;
+}
+
+bool CSPrimPolyhedronReader::ReadCache(std::string cacheFile, unsigned long long fileSize, long long fileMTime, unsigned long long fileHash)
+{
+	CSMappedFile* file = new CSMappedFile();
+	if (file->Open(cacheFile)==false)
+	{
+		delete file;
+		return false;
+	}
+
+	MeshCacheHeader header;
+	const float* coords;
+	const int* indices;
+	const unsigned int* offsets;
+	if (CheckMeshCache(*file, header, coords, indices, offsets)==false)
+	{
+		std::cerr << "CSPrimPolyhedronReader::ReadCache: Warning, ignoring invalid cache file \"" << cacheFile << "\"" << std::endl;
+		delete file;
+		return false;
+	}
+	if ((header.fileSize!=fileSize) || (header.fileMTime!=fileMTime) || (header.fileHash!=fileHash))
+	{
+		delete file;
+		return false;
+	}
+
+	// the mesh uses the mapped arrays in place
+	SetMappedMesh(file, header.numVertices, coords, header.numFaces, header.numIndices, indices, offsets);
+	return true;
+}
+
+bool CSPrimPolyhedronReader::WriteCache(std::string cacheFile, unsigned long long fileSize, long long fileMTime, unsigned long long fileHash)
+{
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, g_MeshCacheMagic, 8);
+	header.version = MESH_CACHE_VERSION;
+	header.byteOrder = 0x01020304;
+	header.fileSize = fileSize;
+	header.fileMTime = fileMTime;
+	header.fileHash = fileHash;
+	header.numVertices = GetNumVertices();
+	header.numFaces = GetNumFaces();
+	header.hasOffsets = !IsTriangleMesh();
+	if ((header.numVertices==0) || (header.numFaces==0))
+		return false;
+
+	std::vector<unsigned int> offsets;
+	if (header.hasOffsets)
+		offsets.reserve(header.numFaces+1);
+	offsets.push_back(0);
+	unsigned int numVertex;
+	for (unsigned int n=0;n<header.numFaces;++n)
+	{
+		GetFace(n, numVertex);
+		header.numIndices += numVertex;
+		if (header.hasOffsets)
+			offsets.push_back(header.numIndices);
+	}
+	// all face indices are stored consecutively, starting with the first face
+	unsigned int n=0;
+	const int* indices = NULL;
+	while ((indices==NULL) && (n<header.numFaces))
+		indices = GetFace(n++, numVertex);
+
+	// write to a unique temporary file first, concurrent readers must never see a partial cache file
+	std::string tmpName = cacheFile + ".tmpXXXXXX";
+	FILE* file = NULL;
+#if !defined(WIN32)
+	int fd = mkstemp(&tmpName[0]);
+	if (fd>=0)
+	{
+		// mkstemp creates the file for the owner only, the cache is readable like a file created by fopen
+		fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+		file = fdopen(fd, "wb");
+		if (file==NULL)
+		{
+			close(fd);
+			remove(tmpName.c_str());
+		}
+	}
+#else
+	static boost::mutex counterMutex;
+	static unsigned int counter = 0;
+	{
+		boost::mutex::scoped_lock lock(counterMutex);
+		std::stringstream name;
+		name << cacheFile << ".tmp" << _getpid() << "_" << counter++;
+		tmpName = name.str();
+	}
+	file = fopen(tmpName.c_str(), "wb");
+#endif
+	if (file==NULL)
+	{
+		std::cerr << "CSPrimPolyhedronReader::WriteCache: Warning, can't write cache file \"" << cacheFile << "\"" << std::endl;
+		return false;
+	}
+	bool ok = (fwrite(&header, sizeof(header), 1, file)==1);
+	ok &= (fwrite(GetVertex(0), 3*sizeof(float), header.numVertices, file)==header.numVertices);
+	if (header.numIndices>0)
+		ok &= (fwrite(indices, sizeof(int), header.numIndices, file)==header.numIndices);
+	if (header.hasOffsets)
+		ok &= (fwrite(&offsets[0], sizeof(unsigned int), offsets.size(), file)==offsets.size());
+	ok &= (fclose(file)==0);
+	if (ok)
+		ok = (rename(tmpName.c_str(), cacheFile.c_str())==0);
+	if (!ok)
+	{
+		remove(tmpName.c_str());
+		std::cerr << "CSPrimPolyhedronReader::WriteCache: Warning, can't write cache file \"" << cacheFile << "\"" << std::endl;
+	}
+	return ok;
+}
+
+bool CSPrimPolyhedronReader::ReadFileVTK()
 {
 	vtkPolyData *polydata = NULL;
 	switch (m_filetype)
@@ -141,7 +921,7 @@ bool CSPrimPolyhedronReader::ReadFile()
 	case UNKNOWN:
 	default:
 	{
-		std::cerr << "CSPrimPolyhedronReader::ReadFile: unknown filetype, skipping..." << std::endl;
+		std::cerr << "CSPrimPolyhedronReader::ReadFileVTK: unknown filetype, skipping..." << std::endl;
 		return false;
 		break;
 	}
@@ -149,13 +929,13 @@ bool CSPrimPolyhedronReader::ReadFile()
 	//polydata->Update(); // not availabe for vtk 6.x, now done only on reader?
 	if ((polydata->GetNumberOfPoints()==0) || (polydata->GetNumberOfCells()==0))
 	{
-		std::cerr << "CSPrimPolyhedronReader::ReadFile: file invalid or empty, skipping ..." << std::endl;
+		std::cerr << "CSPrimPolyhedronReader::ReadFileVTK: file invalid or empty, skipping ..." << std::endl;
 		return false;
 	}
 	vtkCellArray *verts = polydata->GetPolys();
 	if (verts->GetNumberOfCells()==0)
 	{
-		std::cerr << "CSPrimPolyhedronReader::ReadFile: file invalid or empty, skipping ..." << std::endl;
+		std::cerr << "CSPrimPolyhedronReader::ReadFileVTK: file invalid or empty, skipping ..." << std::endl;
 		return false;
 	}
 
@@ -164,14 +944,14 @@ bool CSPrimPolyhedronReader::ReadFile()
 
 	vtkIdType numP;
 	const vtkIdType *vertices = nullptr;
+	std::vector<int> face_indices;
+	std::vector<unsigned int> face_offsets(1,0);
+	face_offsets.reserve(verts->GetNumberOfCells()+1);
 	while (verts->GetNextCell(numP, vertices))
 	{
-		face f;
-		f.numVertex=numP;
-		f.vertices = new int[f.numVertex];
-		for (unsigned int np=0;np<f.numVertex;++np)
-			f.vertices[np]=vertices[np];
-		AddFace(f);
+		face_indices.insert(face_indices.end(), vertices, vertices+numP);
+		face_offsets.push_back(face_indices.size());
 	}
+	AddFaces(face_offsets.size()-1, face_indices.empty() ? NULL : &face_indices[0], &face_offsets[0]);
 	return true;
 }
@@ -47,9 +47,37 @@ public:
 	virtual bool Write2XML(TiXmlElement &elem, bool parameterised=true);
 	virtual bool ReadFromXML(TiXmlNode &root);
 
+	//! Read the file. If the same unchanged file was already read by another reader, its mesh and search tree are shared.
 	virtual bool ReadFile();
 
+	//! Set a directory to cache parsed meshes in, an empty string disables the cache
+	/*!
+	 Parsed meshes are stored keyed by the size, the modification time and a hash of evenly spaced blocks of the file
+	 and are loaded (and used in place) instead of parsing the unchanged file again.
+	 If not set, the directory given by the environment variable CSXCAD_POLYHEDRON_CACHE is used.
+	 */
+	static void SetCacheDirectory(std::string dir);
+	static std::string GetCacheDirectory();
+
 protected:
 	std::string m_filename;
 	FileType m_filetype;
+
+	//! Parse the file. Binary/ASCII STL and binary PLY files are parsed directly, other formats are read using vtk.
+	bool ParseFile();
+
+	//! Parse a binary or ASCII STL file from memory, identical vertices are merged
+	bool ReadSTL(const char* data, size_t size);
+	//! Parse a binary PLY file from memory
+	bool ReadPLY(const char* data, size_t size);
+	//! Read the file using the vtk STL/PLY reader
+	bool ReadFileVTK();
+
+	//! Load the mesh from the given cache file, the source file size, modification time and sampled hash must match
+	bool ReadCache(std::string cacheFile, unsigned long long fileSize, long long fileMTime, unsigned long long fileHash);
+	//! Store the current mesh in the given cache file
+	bool WriteCache(std::string cacheFile, unsigned long long fileSize, long long fileMTime, unsigned long long fileHash);
+
+	//! Merge identical corners of the given triangles (9 floats per triangle) and add the resulting vertices and faces
+	void AddTriangleSoup(const float* corners, size_t numTriangles);
 };
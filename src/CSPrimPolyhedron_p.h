@@ -1,6 +1,9 @@
 #ifndef CSPRIMPOLYHEDRON_P_H
 #define CSPRIMPOLYHEDRON_P_H
 
+#include <vector>
+#include <boost/shared_ptr.hpp>
+
 #include <CGAL/Simple_cartesian.h>
 #include <CGAL/Polyhedron_incremental_builder_3.h>
 #include <CGAL/Polyhedron_3.h>
@@ -17,14 +20,49 @@ typedef CGAL::Simple_cartesian<double>     Kernel;
 typedef CGAL::Polyhedron_3<Kernel>         Polyhedron;
 typedef Polyhedron::HalfedgeDS             HalfedgeDS;
 
+struct CSPolyhedronMesh;
+class CSMappedFile;
+
+//! Mesh data array, either owned or using external (e.g. memory mapped) data in place
+template <typename T>
+class CSMeshArray
+{
+public:
+	CSMeshArray() : m_External(NULL), m_ExternalSize(0) {}
+
+	size_t size() const {return m_External ? m_ExternalSize : m_Data.size();}
+	bool empty() const {return size()==0;}
+	const T* data() const {return m_External ? m_External : (m_Data.empty() ? NULL : &m_Data[0]);}
+	const T& operator[](size_t n) const {return data()[n];}
+
+	//! Use the given external data, it must stay valid as long as it is used by this array
+	void SetExternal(const T* data, size_t size) {m_Data.clear(); m_External=data; m_ExternalSize=size;}
+	//! Get the owned data for modification, external data is copied first
+	std::vector<T>& Modify()
+	{
+		if (m_External)
+		{
+			m_Data.assign(m_External, m_External+m_ExternalSize);
+			m_External = NULL;
+			m_ExternalSize = 0;
+		}
+		return m_Data;
+	}
+
+protected:
+	std::vector<T> m_Data;
+	const T* m_External;
+	size_t m_ExternalSize;
+};
+
 class Polyhedron_Builder : public CGAL::Modifier_base<HalfedgeDS>
 {
 public:
-	Polyhedron_Builder(CSPrimPolyhedron* polyhedron) {m_polyhedron=polyhedron;}
+	Polyhedron_Builder(CSPolyhedronMesh* mesh) {m_mesh=mesh;}
 	void operator()(HalfedgeDS &hds);
 
 protected:
-	CSPrimPolyhedron* m_polyhedron;
+	CSPolyhedronMesh* m_mesh;
 };
 
 typedef Kernel::Point_3                                             Point;
@@ -37,11 +75,50 @@ typedef CGAL::AABB_traits<Kernel, Primitive>                        Traits;
 typedef CGAL::Simple_cartesian<double>::Ray_3                       Ray;
 typedef Kernel::Segment_3                                           Segment;
 
-struct CSPrimPolyhedronPrivate
+//! Vertices, faces and search tree of a polyhedron, shared by all instances of the same mesh
+/*!
+ A mesh that is used by more than one primitive (or was registered for sharing) is immutable.
+ */
+struct CSPolyhedronMesh
 {
+	CSPolyhedronMesh() : m_InvalidFaces(0), m_PolyhedronTree(NULL), m_TreeValid(false), m_Closed(false), m_Registered(false)
+	{
+		for (int n=0;n<6;++n)
+			m_BoundBox[n]=0;
+	}
+	~CSPolyhedronMesh() {delete m_PolyhedronTree;}
+
+	unsigned int GetNumVertices() const {return m_Vertices.size()/3;}
+	unsigned int GetNumFaces() const {return m_FaceOffsets.empty() ? m_FaceIndices.size()/3 : m_FaceOffsets.size()-1;}
+	const int* GetFace(unsigned int n, unsigned int &numVertices) const;
+
+	//! switch from the triangle-only layout to the general face layout
+	void CreateFaceOffsets();
+
+	//! vertex coordinates, 3 values per vertex
+	CSMeshArray<float> m_Vertices;
+	//! vertex indices of all faces, 3 per face as long as all faces are triangles
+	CSMeshArray<int> m_FaceIndices;
+	//! start index of each face in m_FaceIndices plus the final end index, empty as long as all faces are triangles
+	CSMeshArray<unsigned int> m_FaceOffsets;
+	//! mapped file the arrays may point into
+	boost::shared_ptr<CSMappedFile> m_MappedFile;
+	//! face is part of the built polyhedron, set by the builder
+	std::vector<bool> m_FaceValid;
+	unsigned int m_InvalidFaces;
+
 	Polyhedron m_Polyhedron;
 	Point m_RandPt;
 	CGAL::AABB_tree<Traits> *m_PolyhedronTree;
+	bool m_TreeValid;
+	bool m_Closed;
+	bool m_Registered;
+	double m_BoundBox[6];
+};
+
+struct CSPrimPolyhedronPrivate
+{
+	boost::shared_ptr<CSPolyhedronMesh> m_Mesh;
 };
 
 
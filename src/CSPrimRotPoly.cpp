@@ -22,6 +22,7 @@
 #include "stdint.h"
 #define _USE_MATH_DEFINES
 #include <math.h>
+#include <algorithm>
 
 #include "CSPrimRotPoly.h"
 #include "CSProperties.h"
@@ -57,53 +58,138 @@ bool CSPrimRotPoly::IsInside(const double* inCoord, double /*tol*/)
 	if (inCoord==NULL) return false;
 
 	double Coord[3];
-	//transform incoming coordinates into cartesian coords
-	TransformCoordSystem(inCoord,Coord,m_MeshType,CARTESIAN);
-	if (m_Transform && Type==ROTPOLY)
-		TransformCoords(Coord,true, CARTESIAN);
-
-	double origin[3]={0,0,0};
-	double dir[3]={0,0,0};
-	dir[m_RotAxisDir] = 1;
-	double foot;
-	double dist;
-	Point_Line_Distance(Coord, origin, dir, foot, dist);
+	double alpha, dist;
+	if ((m_MeshType==CYLINDRICAL) && (m_RotAxisDir==2) && (inCoord[0]>=0) && !(m_Transform && m_Transform->HasTransform()))
+	{
+		// the rotation axis is the mesh axis, radius and angle are used directly (as in GetInsideMask) to avoid rounding errors
+		dist = inCoord[0];
+		alpha = (dist==0) ? atan2(0.0,0.0) : atan2(sin(inCoord[1]),cos(inCoord[1]));
+		Coord[2] = inCoord[2];
+	}
+	else
+	{
+		//transform incoming coordinates into cartesian coords
+		TransformCoordSystem(inCoord,Coord,m_MeshType,CARTESIAN);
+		if (m_Transform && Type==ROTPOLY)
+			TransformCoords(Coord,true, CARTESIAN);
+
+		int raP = (m_RotAxisDir+1)%3;
+		int raPP = (m_RotAxisDir+2)%3;
+		alpha = atan2(Coord[raPP],Coord[raP]);
+		// distance to the rotation axis
+		dist = sqrt(Coord[raP]*Coord[raP] + Coord[raPP]*Coord[raPP]);
+	}
+
+	int sides = GetAngleSides(alpha);
+	if (sides==0)
+		return false;
+
+	// position in the profile plane: distance to the rotation axis and position along the axis
+	double profile[3];
+	profile[m_NormDir] = 0;
+	profile[3-m_NormDir-m_RotAxisDir] = dist;
+	profile[m_RotAxisDir] = Coord[m_RotAxisDir];
+	int nP = (m_NormDir+1)%3;
+	int nPP = (m_NormDir+2)%3;
+
+	if ((sides & 1) && IsInsidePlane(profile[nP],profile[nPP]))
+		return true;
+
+	profile[3-m_NormDir-m_RotAxisDir] = -dist;
+	if ((sides & 2) && IsInsidePlane(profile[nP],profile[nPP]))
+		return true;
+	return false;
+}
 
+int CSPrimRotPoly::GetAngleSides(double alpha) const
+{
+	int sides = 0;
 	int raP = (m_RotAxisDir+1)%3;
-	int raPP = (m_RotAxisDir+2)%3;
-	double alpha = atan2(Coord[raPP],Coord[raP]);
 	if (raP == m_NormDir)
 		alpha=alpha-M_PI/2;
 	if (alpha<0)
 		alpha+=2*M_PI;
 
-	origin[0] = dist;origin[1] = dist;origin[2] = dist;
-	origin[m_NormDir] = 0;
-	origin[m_RotAxisDir] = foot;
-
 	if (alpha<m_StartStopAng[0])
 		alpha+=2*M_PI;
+	if (alpha<m_StartStopAng[1])
+		sides |= 1;
 
-	if ((CSPrimPolygon::IsInside(origin)) && (alpha<m_StartStopAng[1]))
-		return true;
-
-	dist*=-1;
 	alpha=alpha+M_PI;
 	if (alpha>2*M_PI)
 		alpha-=2*M_PI;
-
 	if (alpha<m_StartStopAng[0])
 		alpha+=2*M_PI;
+	if (alpha<=m_StartStopAng[1])
+		sides |= 2;
+	return sides;
+}
 
-	if (alpha>m_StartStopAng[1])
+bool CSPrimRotPoly::GetInsideMask(const double* const lines[3], const unsigned int numLines[3], std::vector<unsigned char> &mask)
+{
+	if ((m_Transform && m_Transform->HasTransform()) || (m_MeshType!=CYLINDRICAL) || (m_RotAxisDir!=2))
+		return false;
+	if (m_Coords.size()<2)
 		return false;
 
-	origin[0] = dist;origin[1] = dist;origin[2] = dist;
-	origin[m_NormDir] = 0;
-	origin[m_RotAxisDir] = foot;
-	return CSPrimPolygon::IsInside(origin);
-}
+	// all radii (both signs) as sorted lines for the profile plane
+	std::vector<double> radius;
+	radius.reserve(2*numLines[0]);
+	for (unsigned int i=0;i<numLines[0];++i)
+	{
+		radius.push_back(lines[0][i]);
+		radius.push_back(-lines[0][i]);
+	}
+	std::sort(radius.begin(), radius.end());
+	radius.erase(std::unique(radius.begin(), radius.end()), radius.end());
+	std::vector<unsigned int> posIdx(numLines[0]), negIdx(numLines[0]);
+	for (unsigned int i=0;i<numLines[0];++i)
+	{
+		posIdx[i] = std::lower_bound(radius.begin(), radius.end(), lines[0][i]) - radius.begin();
+		negIdx[i] = std::lower_bound(radius.begin(), radius.end(), -lines[0][i]) - radius.begin();
+	}
+
+	// profile membership of all (radius,z) nodes
+	int radDir = 3-m_NormDir-m_RotAxisDir;
+	std::vector<unsigned char> profile;
+	size_t strideRad, strideZ;
+	if (radDir==(m_NormDir+1)%3)
+	{
+		GetPlaneMask(&radius[0], radius.size(), lines[2], numLines[2], profile);
+		strideRad = 1;
+		strideZ = radius.size();
+	}
+	else
+	{
+		GetPlaneMask(lines[2], numLines[2], &radius[0], radius.size(), profile);
+		strideRad = numLines[2];
+		strideZ = 1;
+	}
 
+	// angular range of all alpha lines
+	std::vector<int> sides(numLines[1]);
+	for (unsigned int j=0;j<numLines[1];++j)
+		sides[j] = GetAngleSides(atan2(sin(lines[1][j]),cos(lines[1][j])));
+	int sidesAxis = GetAngleSides(atan2(0.0,0.0));
+
+	mask.assign((size_t)numLines[0]*numLines[1]*numLines[2], 0);
+	size_t stride[3] = {1, numLines[0], (size_t)numLines[0]*numLines[1]};
+	for (unsigned int k=0;k<numLines[2];++k)
+		for (unsigned int i=0;i<numLines[0];++i)
+		{
+			bool pos = profile[posIdx[i]*strideRad + k*strideZ];
+			bool neg = profile[negIdx[i]*strideRad + k*strideZ];
+			if (!pos && !neg)
+				continue;
+			for (unsigned int j=0;j<numLines[1];++j)
+			{
+				int s = (lines[0][i]==0) ? sidesAxis : sides[j];
+				if (((s & 1) && pos) || ((s & 2) && neg))
+					mask[i*stride[0] + j*stride[1] + k*stride[2]] = 1;
+			}
+		}
+	return true;
+}
 
 bool CSPrimRotPoly::Update(std::string *ErrStr)
 {
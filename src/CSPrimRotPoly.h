@@ -46,12 +46,20 @@ public:
 	ParameterScalar* GetAnglePS(int index) {if ((index>=0) && (index<2)) return &StartStopAngle[index]; else return NULL;}
 
 	virtual bool IsInside(const double* Coord, double tol=0);
+	//! Rasterize onto a cylindrical grid with the rotation axis in z-direction, see CSPrimPolygon::GetInsideMask
+	/*!
+	 The profile is evaluated only once per (rho,z) node and reused for all alpha lines.
+	 */
+	virtual bool GetInsideMask(const double* const lines[3], const unsigned int numLines[3], std::vector<unsigned char> &mask);
 
 	virtual bool Update(std::string *ErrStr=NULL);
 	virtual bool Write2XML(TiXmlElement &elem, bool parameterised=true);
 	virtual bool ReadFromXML(TiXmlNode &root);
 
 protected:
+	//! Check which half-plane of the profile (1: positive radius, 2: negative radius) is inside the angular range for the given angle
+	int GetAngleSides(double alpha) const;
+
 	//start-stop angle
 	ParameterScalar StartStopAngle[2];
 	//sorted and pre evaluated angles
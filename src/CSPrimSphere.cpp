@@ -99,18 +99,64 @@ bool CSPrimSphere::GetBoundBox(double dBoundBox[6], bool PreserveOrientation)
 	return true;
 }
 
+void CSPrimSphere::GetSphereWorldBoundBox(double radius, double dBoundBox[6]) const
+{
+	const double* center = m_Center.GetCartesianCoords();
+	if (HasWorldTransform()==false)
+	{
+		for (int n=0;n<3;++n)
+		{
+			dBoundBox[2*n]   = center[n]-radius;
+			dBoundBox[2*n+1] = center[n]+radius;
+		}
+		return;
+	}
+	// the transformed sphere is an ellipsoid, its extent in each direction is given by the norm of the matrix row
+	double w_center[3];
+	m_Transform->Transform(center, w_center);
+	const double* matrix = m_Transform->GetMatrix();
+	for (int n=0;n<3;++n)
+	{
+		double ext = radius*sqrt(pow(matrix[4*n],2)+pow(matrix[4*n+1],2)+pow(matrix[4*n+2],2));
+		dBoundBox[2*n]   = w_center[n]-ext;
+		dBoundBox[2*n+1] = w_center[n]+ext;
+	}
+}
+
+bool CSPrimSphere::GetWorldBoundBox(double dBoundBox[6])
+{
+	if (m_Evaluated==false)
+		return false;
+	GetSphereWorldBoundBox(psRadius.GetValue(), dBoundBox);
+	return true;
+}
+
 bool CSPrimSphere::IsInside(const double* Coord, double /*tol*/)
 {
 	if (Coord==NULL) return false;
+	if (m_InsideKernel==NULL)
+		SelectInsideKernel();
+	return m_InsideKernel(this,Coord);
+}
+
+template <CoordinateSystem MeshType, bool Transformed> bool CSPrimSphere::IsInsideKernel(const CSPrimitives* prim, const double* Coord)
+{
+	const CSPrimSphere* sphere = static_cast<const CSPrimSphere*>(prim);
 	double out[3];
-	const double* center = m_Center.GetCartesianCoords();
-	TransformCoordSystem(Coord,out,m_MeshType,CARTESIAN);
-	if (m_Transform)
-		m_Transform->InvertTransform(out,out);
+	const double* center = sphere->m_Center.GetCartesianCoords();
+	TransformToCartesian<MeshType>(Coord,out);
+	if (Transformed)
+		sphere->m_Transform->InvertTransform(out,out);
 	double dist=sqrt(pow(out[0]-center[0],2)+pow(out[1]-center[1],2)+pow(out[2]-center[2],2));
-	if (dist<psRadius.GetValue())
-		return true;
-	return false;
+	return (dist<sphere->psRadius.GetValue());
+}
+
+void CSPrimSphere::SelectInsideKernel()
+{
+	if (m_MeshType==CYLINDRICAL)
+		m_InsideKernel = m_Transform ? &IsInsideKernel<CYLINDRICAL,true> : &IsInsideKernel<CYLINDRICAL,false>;
+	else
+		m_InsideKernel = m_Transform ? &IsInsideKernel<CARTESIAN,true> : &IsInsideKernel<CARTESIAN,false>;
 }
 
 bool CSPrimSphere::Update(std::string *ErrStr)
@@ -139,6 +185,9 @@ bool CSPrimSphere::Update(std::string *ErrStr)
 	//update local bounding box
 	m_BoundBoxValid = GetBoundBox(m_BoundBox);
 
+	SelectInsideKernel();
+
+	m_Evaluated = bOK;
 	return bOK;
 }
 
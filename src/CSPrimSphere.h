@@ -57,6 +57,7 @@ public:
 	ParameterScalar* GetRadiusPS() {return &psRadius;}
 
 	virtual bool GetBoundBox(double dBoundBox[6], bool PreserveOrientation=false);
+	virtual bool GetWorldBoundBox(double dBoundBox[6]);
 	virtual bool IsInside(const double* Coord, double tol=0);
 
 	virtual bool Update(std::string *ErrStr=NULL);
@@ -66,6 +67,13 @@ public:
 	virtual void ShowPrimitiveStatus(std::ostream& stream);
 
 protected:
+	//! Select the specialized inside kernel for the current mesh type and transformation
+	virtual void SelectInsideKernel();
+	template <CoordinateSystem MeshType, bool Transformed> static bool IsInsideKernel(const CSPrimitives* prim, const double* Coord);
+
+	//! Calculate the exact cartesian bounding box of the (transformed) sphere with the given radius
+	void GetSphereWorldBoundBox(double radius, double dBoundBox[6]) const;
+
 	ParameterCoord m_Center;
 	ParameterScalar psRadius;
 };
@@ -72,18 +72,40 @@ bool CSPrimSphericalShell::GetBoundBox(double dBoundBox[6], bool PreserveOrienta
 	return true;
 }
 
+bool CSPrimSphericalShell::GetWorldBoundBox(double dBoundBox[6])
+{
+	if (m_Evaluated==false)
+		return false;
+	GetSphereWorldBoundBox(psRadius.GetValue()+psShellWidth.GetValue()/2.0, dBoundBox);
+	return true;
+}
+
 bool CSPrimSphericalShell::IsInside(const double* Coord, double /*tol*/)
 {
 	if (Coord==NULL) return false;
+	if (m_InsideKernel==NULL)
+		SelectInsideKernel();
+	return m_InsideKernel(this,Coord);
+}
+
+template <CoordinateSystem MeshType, bool Transformed> bool CSPrimSphericalShell::IsInsideKernel(const CSPrimitives* prim, const double* Coord)
+{
+	const CSPrimSphericalShell* shell = static_cast<const CSPrimSphericalShell*>(prim);
 	double out[3];
-	const double* center = m_Center.GetCartesianCoords();
-	TransformCoordSystem(Coord,out,m_MeshType,CARTESIAN);
-	if (m_Transform)
-		m_Transform->InvertTransform(out,out);
+	const double* center = shell->m_Center.GetCartesianCoords();
+	TransformToCartesian<MeshType>(Coord,out);
+	if (Transformed)
+		shell->m_Transform->InvertTransform(out,out);
 	double dist=sqrt(pow(out[0]-center[0],2)+pow(out[1]-center[1],2)+pow(out[2]-center[2],2));
-	if (fabs(dist-psRadius.GetValue())< psShellWidth.GetValue()/2.0)
-		return true;
-	return false;
+	return (fabs(dist-shell->psRadius.GetValue())< shell->psShellWidth.GetValue()/2.0);
+}
+
+void CSPrimSphericalShell::SelectInsideKernel()
+{
+	if (m_MeshType==CYLINDRICAL)
+		m_InsideKernel = m_Transform ? &IsInsideKernel<CYLINDRICAL,true> : &IsInsideKernel<CYLINDRICAL,false>;
+	else
+		m_InsideKernel = m_Transform ? &IsInsideKernel<CARTESIAN,true> : &IsInsideKernel<CARTESIAN,false>;
 }
 
 bool CSPrimSphericalShell::Update(std::string *ErrStr)
@@ -105,6 +127,7 @@ bool CSPrimSphericalShell::Update(std::string *ErrStr)
 	//update local bounding box
 	m_BoundBoxValid = GetBoundBox(m_BoundBox);
 
+	m_Evaluated = bOK;
 	return bOK;
 }
 
@@ -18,6 +18,8 @@
 #include <sstream>
 #include <iostream>
 #include <limits>
+#include <algorithm>
+#include <math.h>
 #include "tinyxml.h"
 #include "stdint.h"
 
@@ -30,6 +32,8 @@ CSPrimWire::CSPrimWire(unsigned int ID, ParameterSet* paraSet, CSProperties* pro
 	Type=WIRE;
 	PrimTypeName = std::string("Wire");
 	wireRadius.SetParameterSet(paraSet);
+	m_WireRad = 0;
+	m_PointsValid = false;
 }
 
 CSPrimWire::CSPrimWire(CSPrimWire* primCurve, CSProperties *prop) : CSPrimCurve(primCurve,prop)
@@ -37,6 +41,11 @@ CSPrimWire::CSPrimWire(CSPrimWire* primCurve, CSProperties *prop) : CSPrimCurve(
 	Type=WIRE;
 	PrimTypeName = std::string("Wire");
 	wireRadius.Copy(&primCurve->wireRadius);
+	m_WirePoints = primCurve->m_WirePoints;
+	m_WireRad = primCurve->m_WireRad;
+	m_BVHNodes = primCurve->m_BVHNodes;
+	m_BVHSegments = primCurve->m_BVHSegments;
+	m_PointsValid = primCurve->m_PointsValid;
 }
 
 CSPrimWire::CSPrimWire(ParameterSet* paraSet, CSProperties* prop) : CSPrimCurve(paraSet,prop)
@@ -44,6 +53,8 @@ CSPrimWire::CSPrimWire(ParameterSet* paraSet, CSProperties* prop) : CSPrimCurve(
 	Type=WIRE;
 	PrimTypeName = std::string("Wire");
 	wireRadius.SetParameterSet(paraSet);
+	m_WireRad = 0;
+	m_PointsValid = false;
 }
 
 
@@ -51,6 +62,30 @@ CSPrimWire::~CSPrimWire()
 {
 }
 
+size_t CSPrimWire::AddPoint(double coords[])
+{
+	m_PointsValid = false;
+	return CSPrimCurve::AddPoint(coords);
+}
+
+void CSPrimWire::SetCoord(size_t point_index, int nu, double val)
+{
+	m_PointsValid = false;
+	CSPrimCurve::SetCoord(point_index, nu, val);
+}
+
+void CSPrimWire::SetCoord(size_t point_index, int nu, std::string val)
+{
+	m_PointsValid = false;
+	CSPrimCurve::SetCoord(point_index, nu, val);
+}
+
+void CSPrimWire::ClearPoints()
+{
+	m_PointsValid = false;
+	CSPrimCurve::ClearPoints();
+}
+
 
 bool CSPrimWire::GetBoundBox(double dBoundBox[6], bool PreserveOrientation)
 {
@@ -70,9 +105,9 @@ bool CSPrimWire::GetBoundBox(double dBoundBox[6], bool PreserveOrientation)
 bool CSPrimWire::IsInside(const double* Coord, double /*tol*/)
 {
 	if (Coord==NULL) return false;
-	double rad = wireRadius.GetValue();
-	const double* p0;
-	const double* p1;
+	if (m_PointsValid==false)
+		EvaluatePoints();
+	if (m_BVHNodes.empty()) return false;
 	double pos[3];
 	//transform incoming coordinates into cartesian coords
 	TransformCoordSystem(Coord,pos,m_MeshType,CARTESIAN);
@@ -84,29 +119,293 @@ bool CSPrimWire::IsInside(const double* Coord, double /*tol*/)
 		if ((m_BoundBox[2*n]>pos[n]) || (m_BoundBox[2*n+1]<pos[n])) return false;
 	}
 
-	double foot,dist,distPP;
-	for (size_t i=0;i<GetNumberOfPoints();++i)
+	// traverse all nodes containing the point
+	unsigned int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top>0)
 	{
-		p0 = points.at(i)->GetCartesianCoords();
+		const BVHNode &node = m_BVHNodes[stack[--top]];
+		if ((node.bbox[0]>pos[0]) || (node.bbox[1]<pos[0]) || (node.bbox[2]>pos[1]) || (node.bbox[3]<pos[1]) || (node.bbox[4]>pos[2]) || (node.bbox[5]<pos[2]))
+			continue;
+		if (node.count>0)
+		{
+			for (unsigned int i=node.index;i<node.index+node.count;++i)
+				if (IsInsideSegment(pos, m_BVHSegments[i]))
+					return true;
+			continue;
+		}
+		stack[top++] = node.index;
+		stack[top++] = &node - &m_BVHNodes[0] + 1;
+	}
+	return false;
+}
+
+bool CSPrimWire::IsInsideSegment(const double* pos, unsigned int n) const
+{
+	double rad2 = m_WireRad*m_WireRad;
+	const double* p0 = &m_WirePoints[3*n];
+	double d0[3] = {pos[0]-p0[0], pos[1]-p0[1], pos[2]-p0[2]};
+	double dist2 = d0[0]*d0[0] + d0[1]*d0[1] + d0[2]*d0[2];
+	if (dist2<rad2)
+		return true;
+	if (3*(n+1)>=m_WirePoints.size())
+		return false;
+
+	const double* p1 = &m_WirePoints[3*n+3];
+	double d1[3] = {pos[0]-p1[0], pos[1]-p1[1], pos[2]-p1[2]};
+	if (d1[0]*d1[0] + d1[1]*d1[1] + d1[2]*d1[2]<rad2)
+		return true;
 
-		dist = sqrt(pow(pos[0]-p0[0],2)+pow(pos[1]-p0[1],2)+pow(pos[2]-p0[2],2));
-		if (dist<rad)
-			return true;
+	double dir[3] = {p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2]};
+	double LL = dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2];
+	if (LL==0)
+		return false;
+	double foot = (d0[0]*dir[0] + d0[1]*dir[1] + d0[2]*dir[2])/LL;
+	if ((foot<=0) || (foot>=1))
+		return false;
+	double perp2 = dist2 - foot*foot*LL;
+	return (perp2<rad2);
+}
 
-		if (i<GetNumberOfPoints()-1)
+// append the open interval (t0,t1) to a list of start/stop pairs, the list is sorted and merged later
+static inline void AddInterval(std::vector<double> &intervals, double t0, double t1)
+{
+	if (t0<t1)
+	{
+		intervals.push_back(t0);
+		intervals.push_back(t1);
+	}
+}
+
+// interval where a*t^2+b*t+c<0, returns false if empty (a>=0 required)
+static bool QuadraticInterval(double a, double b, double c, double &t0, double &t1)
+{
+	if (a<=0)
+	{
+		// line parallel to the capsule axis, constant distance
+		if (b!=0)
+			return false;
+		if (c>=0)
+			return false;
+		t0 = -std::numeric_limits<double>::infinity();
+		t1 = std::numeric_limits<double>::infinity();
+		return true;
+	}
+	double disc = b*b - 4*a*c;
+	if (disc<=0)
+		return false;
+	disc = sqrt(disc);
+	t0 = (-b-disc)/(2*a);
+	t1 = (-b+disc)/(2*a);
+	return true;
+}
+
+void CSPrimWire::AddSegmentIntervals(const double origin[3], const double dir[3], unsigned int n, std::vector<double> &intervals) const
+{
+	double rad2 = m_WireRad*m_WireRad;
+	double DD = dir[0]*dir[0] + dir[1]*dir[1] + dir[2]*dir[2];
+	double t0, t1;
+	unsigned int numPoints = m_WirePoints.size()/3;
+	for (unsigned int p=n;(p<=n+1) && (p<numPoints);++p)
+	{
+		// sphere around the segment end points
+		const double* c = &m_WirePoints[3*p];
+		double w[3] = {origin[0]-c[0], origin[1]-c[1], origin[2]-c[2]};
+		double b = 2*(w[0]*dir[0] + w[1]*dir[1] + w[2]*dir[2]);
+		double cc = w[0]*w[0] + w[1]*w[1] + w[2]*w[2] - rad2;
+		if (QuadraticInterval(DD, b, cc, t0, t1))
+			AddInterval(intervals, t0, t1);
+	}
+	if (n+1>=numPoints)
+		return;
+
+	// cylinder between both end points
+	const double* p0 = &m_WirePoints[3*n];
+	const double* p1 = &m_WirePoints[3*n+3];
+	double u[3] = {p1[0]-p0[0], p1[1]-p0[1], p1[2]-p0[2]};
+	double LL = u[0]*u[0] + u[1]*u[1] + u[2]*u[2];
+	if (LL==0)
+		return;
+	double w0[3] = {origin[0]-p0[0], origin[1]-p0[1], origin[2]-p0[2]};
+	double Du = dir[0]*u[0] + dir[1]*u[1] + dir[2]*u[2];
+	double w0u = w0[0]*u[0] + w0[1]*u[1] + w0[2]*u[2];
+	double w0D = w0[0]*dir[0] + w0[1]*dir[1] + w0[2]*dir[2];
+	double w0w0 = w0[0]*w0[0] + w0[1]*w0[1] + w0[2]*w0[2];
+	if (!QuadraticInterval(DD - Du*Du/LL, 2*(w0D - w0u*Du/LL), w0w0 - w0u*w0u/LL - rad2, t0, t1))
+		return;
+
+	// restrict to 0<foot<1 with foot(t) = (w0u + t*Du)/LL
+	double f0 = w0u/LL, f1 = Du/LL;
+	if (f1==0)
+	{
+		if ((f0<=0) || (f0>=1))
+			return;
+	}
+	else
+	{
+		double s0 = -f0/f1, s1 = (1-f0)/f1;
+		t0 = std::max(t0, std::min(s0,s1));
+		t1 = std::min(t1, std::max(s0,s1));
+	}
+	AddInterval(intervals, t0, t1);
+}
+
+bool CSPrimWire::GetLineIntervals(int ny, const double coord[3], std::vector<double> &intervals)
+{
+	intervals.clear();
+	if ((ny<0) || (ny>2) || (m_MeshType!=CARTESIAN))
+		return false;
+	if (m_PointsValid==false)
+		EvaluatePoints();
+	if (m_BVHNodes.empty())
+		return true;
+
+	// the line in the (untransformed) wire coordinate system: origin + t*dir, with t being the coordinate in direction ny
+	double origin[3] = {coord[0],coord[1],coord[2]};
+	origin[ny] = 0;
+	double dir[3] = {0,0,0};
+	dir[ny] = 1;
+	if (m_Transform)
+	{
+		double end[3] = {origin[0],origin[1],origin[2]};
+		end[ny] = 1;
+		m_Transform->InvertTransform(origin,origin);
+		m_Transform->InvertTransform(end,end);
+		for (int n=0;n<3;++n)
+			dir[n] = end[n]-origin[n];
+	}
+
+	std::vector<double> found;
+	unsigned int stack[64];
+	int top = 0;
+	stack[top++] = 0;
+	while (top>0)
+	{
+		const BVHNode &node = m_BVHNodes[stack[--top]];
+		// slab test of the line and the node box
+		double tmin = -std::numeric_limits<double>::infinity();
+		double tmax = std::numeric_limits<double>::infinity();
+		for (int n=0;(n<3) && (tmin<=tmax);++n)
 		{
-			p1 = points.at(i+1)->GetCartesianCoords();
-			distPP = sqrt(pow(p1[0]-p0[0],2)+pow(p1[1]-p0[1],2)+pow(p1[2]-p0[2],2))+rad;
-			if (dist<distPP)
+			if (dir[n]==0)
 			{
-				Point_Line_Distance(pos ,p0 ,p1 ,foot ,dist);
-				if ((foot>0) && (foot<1) && (dist<rad))
-					return true;
+				if ((origin[n]<node.bbox[2*n]) || (origin[n]>node.bbox[2*n+1]))
+					tmax = -tmin;
+				continue;
 			}
+			double s0 = (node.bbox[2*n]-origin[n])/dir[n];
+			double s1 = (node.bbox[2*n+1]-origin[n])/dir[n];
+			tmin = std::max(tmin, std::min(s0,s1));
+			tmax = std::min(tmax, std::max(s0,s1));
+		}
+		if (tmin>tmax)
+			continue;
+		if (node.count>0)
+		{
+			for (unsigned int i=node.index;i<node.index+node.count;++i)
+				AddSegmentIntervals(origin, dir, m_BVHSegments[i], found);
+			continue;
 		}
+		stack[top++] = node.index;
+		stack[top++] = &node - &m_BVHNodes[0] + 1;
 	}
 
-	return false;
+	// sort by interval start and merge overlapping intervals
+	std::vector<std::pair<double,double> > sorted(found.size()/2);
+	for (size_t i=0;i<sorted.size();++i)
+		sorted[i] = std::make_pair(found[2*i], found[2*i+1]);
+	std::sort(sorted.begin(), sorted.end());
+	for (size_t i=0;i<sorted.size();++i)
+	{
+		if (!intervals.empty() && (sorted[i].first<intervals.back()))
+			intervals.back() = std::max(intervals.back(), sorted[i].second);
+		else
+		{
+			intervals.push_back(sorted[i].first);
+			intervals.push_back(sorted[i].second);
+		}
+	}
+	return true;
+}
+
+void CSPrimWire::BuildBVH()
+{
+	m_BVHNodes.clear();
+	m_BVHSegments.clear();
+	unsigned int numPoints = m_WirePoints.size()/3;
+	if (numPoints==0)
+		return;
+	unsigned int numSegments = (numPoints>1) ? numPoints-1 : 1;
+	m_BVHSegments.resize(numSegments);
+	std::vector<double> centers(3*numSegments);
+	for (unsigned int i=0;i<numSegments;++i)
+	{
+		m_BVHSegments[i] = i;
+		unsigned int i1 = std::min(i+1, numPoints-1);
+		for (int n=0;n<3;++n)
+			centers[3*i+n] = 0.5*(m_WirePoints[3*i+n]+m_WirePoints[3*i1+n]);
+	}
+	m_BVHNodes.reserve(2*numSegments);
+	BuildBVHNode(0, numSegments, centers);
+}
+
+// compare segments by their center in a given direction
+struct WireSegmentLess
+{
+	WireSegmentLess(const std::vector<double> &centers, int dir) : m_centers(centers), m_dir(dir) {}
+	bool operator()(unsigned int a, unsigned int b) const {return m_centers[3*a+m_dir]<m_centers[3*b+m_dir];}
+	const std::vector<double> &m_centers;
+	int m_dir;
+};
+
+unsigned int CSPrimWire::BuildBVHNode(unsigned int first, unsigned int count, std::vector<double> &centers)
+{
+	unsigned int idx = m_BVHNodes.size();
+	m_BVHNodes.push_back(BVHNode());
+	double bbox[6];
+	double cmin[3], cmax[3];
+	unsigned int numPoints = m_WirePoints.size()/3;
+	for (int n=0;n<3;++n)
+	{
+		bbox[2*n] = cmin[n] = std::numeric_limits<double>::max();
+		bbox[2*n+1] = cmax[n] = -std::numeric_limits<double>::max();
+	}
+	for (unsigned int i=first;i<first+count;++i)
+	{
+		unsigned int seg = m_BVHSegments[i];
+		unsigned int seg1 = std::min(seg+1, numPoints-1);
+		for (int n=0;n<3;++n)
+		{
+			bbox[2*n] = std::min(bbox[2*n], std::min(m_WirePoints[3*seg+n], m_WirePoints[3*seg1+n]) - m_WireRad);
+			bbox[2*n+1] = std::max(bbox[2*n+1], std::max(m_WirePoints[3*seg+n], m_WirePoints[3*seg1+n]) + m_WireRad);
+			cmin[n] = std::min(cmin[n], centers[3*seg+n]);
+			cmax[n] = std::max(cmax[n], centers[3*seg+n]);
+		}
+	}
+	for (int n=0;n<6;++n)
+		m_BVHNodes[idx].bbox[n] = bbox[n];
+
+	if (count<=4)
+	{
+		m_BVHNodes[idx].index = first;
+		m_BVHNodes[idx].count = count;
+		return idx;
+	}
+
+	// median split along the largest extent of the segment centers
+	int dir = 0;
+	for (int n=1;n<3;++n)
+		if (cmax[n]-cmin[n] > cmax[dir]-cmin[dir])
+			dir = n;
+	unsigned int half = count/2;
+	std::nth_element(m_BVHSegments.begin()+first, m_BVHSegments.begin()+first+half, m_BVHSegments.begin()+first+count, WireSegmentLess(centers, dir));
+
+	m_BVHNodes[idx].count = 0;
+	BuildBVHNode(first, half, centers);
+	unsigned int right = BuildBVHNode(first+half, count-half, centers);
+	m_BVHNodes[idx].index = right;
+	return idx;
 }
 
 bool CSPrimWire::Update(std::string *ErrStr)
@@ -125,9 +424,26 @@ bool CSPrimWire::Update(std::string *ErrStr)
 		ErrStr->append(stream.str());
 		PSErrorCode2Msg(EC,ErrStr);
 	}
+	EvaluatePoints();
+	return bOK;
+}
+
+void CSPrimWire::EvaluatePoints()
+{
+	//evaluate all points once and build the segment hierarchy used by IsInside()
+	m_WireRad = wireRadius.GetValue();
+	m_WirePoints.resize(3*GetNumberOfPoints());
+	for (size_t i=0;i<GetNumberOfPoints();++i)
+	{
+		const double* p = points.at(i)->GetCartesianCoords();
+		for (int n=0;n<3;++n)
+			m_WirePoints[3*i+n] = p[n];
+	}
+	BuildBVH();
+
 	//update local bounding box used to speedup IsInside()
 	m_BoundBoxValid = GetBoundBox(m_BoundBox);
-	return bOK;
+	m_PointsValid = true;
 }
 
 bool CSPrimWire::Write2XML(TiXmlElement &elem, bool parameterised)
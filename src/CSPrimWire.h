@@ -35,19 +35,67 @@ public:
 
 	virtual CSPrimitives* GetCopy(CSProperties *prop=NULL) {return new CSPrimWire(this,prop);}
 
-	void SetWireRadius(double val) {wireRadius.SetValue(val);}
-	void SetWireRadius(const char* val) {wireRadius.SetValue(val);}
+	void SetWireRadius(double val) {wireRadius.SetValue(val); m_PointsValid=false;}
+	void SetWireRadius(const char* val) {wireRadius.SetValue(val); m_PointsValid=false;}
 
 	double GetWireRadius() {return wireRadius.GetValue();}
 	ParameterScalar* GetWireRadiusPS() {return &wireRadius;}
 
+	virtual size_t AddPoint(double coords[]);
+	virtual void SetCoord(size_t point_index, int nu, double val);
+	virtual void SetCoord(size_t point_index, int nu, std::string val);
+	virtual void ClearPoints();
+
 	virtual bool GetBoundBox(double dBoundBox[6], bool PreserveOrientation=false);
+	//! Check if the given point is inside the wire, the points are evaluated again after a modification without Update()
 	virtual bool IsInside(const double* Coord, double tol=0);
 
+	//! Find all intervals along a cartesian grid line that are inside the wire
+	/*!
+	 \param ny Direction of the line.
+	 \param coord A point on the line, coord[ny] is ignored.
+	 \param intervals Found intervals as start/stop pairs of the coordinate in direction ny, sorted and non-overlapping.
+	 \return false if not supported (non-cartesian mesh), use IsInside instead.
+	 */
+	virtual bool GetLineIntervals(int ny, const double coord[3], std::vector<double> &intervals);
+
 	virtual bool Update(std::string *ErrStr=NULL);
 	virtual bool Write2XML(TiXmlElement &elem, bool parameterised=true);
 	virtual bool ReadFromXML(TiXmlNode &root);
 
 protected:
 	ParameterScalar wireRadius;
+
+	//! Node of the bounding volume hierarchy over the wire segments (capsules)
+	struct BVHNode
+	{
+		double bbox[6];
+		//! leaf: first entry in m_BVHSegments, inner node: index of the second child (the first child follows directly)
+		unsigned int index;
+		//! number of segments of a leaf, 0 for inner nodes
+		unsigned int count;
+	};
+
+	//! Evaluate the points and the radius and rebuild the segment hierarchy and the bounding box, done by Update() or on demand after a modification
+	/*!
+	 Parameterised values are not evaluated again, this requires an Update().
+	 */
+	void EvaluatePoints();
+	//! Build the segment hierarchy from the evaluated points
+	void BuildBVH();
+	unsigned int BuildBVHNode(unsigned int first, unsigned int count, std::vector<double> &centers);
+	//! Check if the point is inside the capsule of segment n
+	bool IsInsideSegment(const double* pos, unsigned int n) const;
+	//! Add the intervals of the line origin+t*dir inside the capsule of segment n
+	void AddSegmentIntervals(const double origin[3], const double dir[3], unsigned int n, std::vector<double> &intervals) const;
+
+	///The evaluated points, the segment hierarchy and the bounding box are up to date, reset by any modification of the points or the radius
+	bool m_PointsValid;
+	///Evaluated cartesian wire points, 3 values per point, set by Update()
+	std::vector<double> m_WirePoints;
+	///Evaluated wire radius
+	double m_WireRad;
+	std::vector<BVHNode> m_BVHNodes;
+	///Segment n connects point n and n+1, a single point is a segment of zero length
+	std::vector<unsigned int> m_BVHSegments;
 };
@@ -18,6 +18,7 @@
 #include <sstream>
 #include <iostream>
 #include <limits>
+#include <algorithm>
 #include "tinyxml.h"
 #include "stdint.h"
 
@@ -35,10 +36,17 @@ int g_PrimUniqueIDCounter=0;
 
 void Point_Line_Distance(const double P[], const double start[], const double stop[], double &foot, double &dist, CoordinateSystem c_system)
 {
-	double l_P[3],l_start[3],l_stop[3];
-	TransformCoordSystem(P,l_P,c_system,CARTESIAN);
-	TransformCoordSystem(start,l_start,c_system,CARTESIAN);
-	TransformCoordSystem(stop,l_stop,c_system,CARTESIAN);
+	double P_buf[3],start_buf[3],stop_buf[3];
+	const double* l_P = P;
+	const double* l_start = start;
+	const double* l_stop = stop;
+	// only cylindrical coordinates need a conversion, all others are copied by TransformCoordSystem
+	if (c_system==CYLINDRICAL)
+	{
+		l_P = TransformCoordSystem(P,P_buf,c_system,CARTESIAN);
+		l_start = TransformCoordSystem(start,start_buf,c_system,CARTESIAN);
+		l_stop = TransformCoordSystem(stop,stop_buf,c_system,CARTESIAN);
+	}
 
 	double dir[] = {l_stop[0]-l_start[0],l_stop[1]-l_start[1],l_stop[2]-l_start[2]};
 
@@ -74,6 +82,56 @@ bool CSXCAD_EXPORT CoordInRange(const double* coord, const double* start, const
 	return true;
 }
 
+void CylindricalToCartesianBox(const double cylBox[6], double cartBox[6])
+{
+	double r_min = std::min(cylBox[0],cylBox[1]);
+	double r_max = std::max(cylBox[0],cylBox[1]);
+	double a_min = std::min(cylBox[2],cylBox[3]);
+	double a_max = std::max(cylBox[2],cylBox[3]);
+	double z_min = std::min(cylBox[4],cylBox[5]);
+	double z_max = std::max(cylBox[4],cylBox[5]);
+	r_min = std::max(r_min,0.0);
+	r_max = std::max(r_max,0.0);
+	cartBox[4] = z_min;
+	cartBox[5] = z_max;
+	if (a_max-a_min>=2*PI)
+	{
+		cartBox[0] = cartBox[2] = -r_max;
+		cartBox[1] = cartBox[3] = r_max;
+		return;
+	}
+	// extreme values are found at the corners of the sector or at the outer radius for all multiples of pi/2 inside the angle range
+	double x[4] = {r_min*cos(a_min), r_max*cos(a_min), r_min*cos(a_max), r_max*cos(a_max)};
+	double y[4] = {r_min*sin(a_min), r_max*sin(a_min), r_min*sin(a_max), r_max*sin(a_max)};
+	cartBox[0] = cartBox[2] = std::numeric_limits<double>::max();
+	cartBox[1] = cartBox[3] = -std::numeric_limits<double>::max();
+	for (int n=0;n<4;++n)
+	{
+		cartBox[0] = std::min(cartBox[0],x[n]);
+		cartBox[1] = std::max(cartBox[1],x[n]);
+		cartBox[2] = std::min(cartBox[2],y[n]);
+		cartBox[3] = std::max(cartBox[3],y[n]);
+	}
+	for (int k=(int)ceil(a_min/(PI/2));k*(PI/2)<=a_max;++k)
+	{
+		switch (((k%4)+4)%4)
+		{
+		case 0:
+			cartBox[1] = r_max;
+			break;
+		case 1:
+			cartBox[3] = r_max;
+			break;
+		case 2:
+			cartBox[0] = -r_max;
+			break;
+		case 3:
+			cartBox[2] = -r_max;
+			break;
+		}
+	}
+}
+
 /*********************CSPrimitives********************************************************************/
 CSPrimitives::CSPrimitives(unsigned int ID, ParameterSet* paraSet, CSProperties* prop)
 {
@@ -110,6 +168,7 @@ void CSPrimitives::Init()
 	clProperty=NULL;
 	clParaSet=NULL;
 	m_Transform=NULL;
+	m_InsideKernel=NULL;
 	uiID=g_PrimUniqueIDCounter++;
 	iPriority=0;
 	PrimTypeName = std::string("Base Type");
@@ -121,12 +180,16 @@ void CSPrimitives::Init()
 	for (int n=0;n<6;++n)
 		m_BoundBox[n]=0;
 	m_BoundBoxValid = false;
+	m_Evaluated = false;
 }
 
 CSTransform* CSPrimitives::GetTransform()
 {
 	if (m_Transform==NULL)
+	{
 		m_Transform = new CSTransform(clParaSet);
+		m_InsideKernel = NULL;
+	}
 	return m_Transform;
 }
 
@@ -147,15 +210,75 @@ CSPrimitives::~CSPrimitives()
 	m_Transform=NULL;
 }
 
-int CSPrimitives::IsInsideBox(const double *boundbox)
+bool CSPrimitives::HasWorldTransform() const
+{
+	return (m_Transform!=NULL) && (m_Transform->GetMatrixType()!=CSTransform::IDENTITY_MATRIX);
+}
+
+void CSPrimitives::TransformBoundBox(const double localBox[6], double worldBox[6]) const
+{
+	if (HasWorldTransform()==false)
+	{
+		for (int n=0;n<6;++n)
+			worldBox[n] = localBox[n];
+		return;
+	}
+	// transform all eight corners at once
+	double corner[3][8];
+	for (int c=0;c<8;++c)
+		for (int n=0;n<3;++n)
+			corner[n][c] = localBox[2*n+((c>>n)&1)];
+	double* const coords[3] = {corner[0], corner[1], corner[2]};
+	m_Transform->Transform(8, coords, coords);
+	for (int n=0;n<3;++n)
+	{
+		worldBox[2*n]   = *std::min_element(corner[n], corner[n]+8);
+		worldBox[2*n+1] = *std::max_element(corner[n], corner[n]+8);
+	}
+}
+
+bool CSPrimitives::GetWorldBoundBox(double dBoundBox[6])
 {
 	if (m_BoundBoxValid==false)
-		return 0;  // unable to decide with an invalid bounding box
-	if ((this->GetBoundBoxCoordSystem()!=UNDEFINED_CS) && (this->GetBoundBoxCoordSystem()!=this->GetCoordInputType()))
-		return 0;  // unable to decide if coordinate system do not match
-	if (m_Transform!=NULL)
-		if (m_Transform->HasTransform())
-			return 0;  // unable to decide if a transformation is used
+		return false;
+	double box[6];
+	for (int n=0;n<3;++n)
+	{
+		box[2*n]   = std::min(m_BoundBox[2*n],m_BoundBox[2*n+1]);
+		box[2*n+1] = std::max(m_BoundBox[2*n],m_BoundBox[2*n+1]);
+	}
+	CoordinateSystem cs = GetBoundBoxCoordSystem();
+	if (cs==UNDEFINED_CS)
+		cs = m_MeshType;
+	if (cs==CYLINDRICAL)
+		CylindricalToCartesianBox(box, box);
+	TransformBoundBox(box, dBoundBox);
+	return true;
+}
+
+int CSPrimitives::IsInsideBox(const double *boundbox)
+{
+	CoordinateSystem bb_cs = this->GetBoundBoxCoordSystem();
+	if ((m_BoundBoxValid==false) || HasWorldTransform() || ((bb_cs!=UNDEFINED_CS) && (bb_cs!=this->GetCoordInputType())))
+	{
+		// compare conservative cartesian boxes if the local bounding box can not be used directly
+		double primBox[6];
+		if (GetWorldBoundBox(primBox)==false)
+			return 0;  // unable to decide without a bounding box
+		double box[6];
+		if (this->GetCoordInputType()==CYLINDRICAL)
+			CylindricalToCartesianBox(boundbox, box);
+		else
+			for (int n=0;n<3;++n)
+			{
+				box[2*n]   = std::min(boundbox[2*n],boundbox[2*n+1]);
+				box[2*n+1] = std::max(boundbox[2*n],boundbox[2*n+1]);
+			}
+		for (int n=0;n<3;++n)
+			if ((box[2*n+1]<primBox[2*n]) || (box[2*n]>primBox[2*n+1]))
+				return -1;
+		return 1;
+	}
 
 	for (int i=0;i<3;++i)
 	{
@@ -194,6 +317,7 @@ bool CSPrimitives::ReadFromXML(TiXmlNode &root)
 
 	delete m_Transform;
 	m_Transform = CSTransform::New(elem, clParaSet);
+	m_InsideKernel = NULL;
 
 	return true;
 }
@@ -25,6 +25,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <string>
 
 #include "ParameterObjects.h"
@@ -46,6 +47,7 @@ class CSPrimPolyhedron;
 class CSPrimCurve;
 	class CSPrimWire;
 class CSPrimUserDefined;
+class CSPrimGroup;
 
 class CSProperties; //include VisualProperties
 
@@ -62,6 +64,27 @@ void CSXCAD_EXPORT Point_Line_Distance(const double P[], const double start[], c
 
 bool CSXCAD_EXPORT CoordInRange(const double* p, const double* start, const double* stop, CoordinateSystem cs_in);
 
+//! Calculate the cartesian bounding box of a cylindrical box (rho, alpha and z range), in- and output may be identical
+void CSXCAD_EXPORT CylindricalToCartesianBox(const double cylBox[6], double cartBox[6]);
+
+//! Compile time specialized version of TransformCoordSystem into cartesian coordinates (in and out may be identical)
+template <CoordinateSystem CS_In> inline void TransformToCartesian(const double* in, double* out)
+{
+	if (CS_In==CYLINDRICAL)
+	{
+		double rho = in[0];
+		double alpha = in[1];
+		out[0] = rho * cos(alpha);
+		out[1] = rho * sin(alpha);
+	}
+	else
+	{
+		out[0] = in[0];
+		out[1] = in[1];
+	}
+	out[2] = in[2];
+}
+
 //! Abstract base class for different geometrical primitives.
 /*!
  This is an abstract base class for different geometrical primitives like boxes, spheres, cylinders etc.
@@ -78,7 +101,7 @@ public:
 	enum PrimitiveType
 	{
 		POINT,BOX,MULTIBOX,SPHERE,SPHERICALSHELL,CYLINDER,CYLINDRICALSHELL,POLYGON,LINPOLY,ROTPOLY,POLYHEDRON,CURVE,WIRE,USERDEFINED,
-		POLYHEDRONREADER
+		POLYHEDRONREADER,GROUP
 	};
 
 	//! Set or change the property for this primitive.
@@ -110,7 +133,10 @@ public:
 	//! Check if given Coordinate (in the given mesh type) is inside the Primitive.
 	virtual bool IsInside(const double* Coord, double tol=0) {UNUSED(Coord);UNUSED(tol);return false;}
 
-	//! Check if the primitive is inside a given box (box must be specified in the bounding box coordinate system)
+	//! Get a conservative cartesian bounding box of this primitive including its transformation. \return false if no bounding box is known
+	virtual bool GetWorldBoundBox(double dBoundBox[6]);
+
+	//! Check if the primitive is inside a given box (box must be specified in the coordinate input type)
 	//! @return -1 if not, +1 if it is, 0 if unknown
 	virtual int IsInsideBox(const double*  boundbox);
 
@@ -159,6 +185,8 @@ public:
 	CSPrimWire* ToWire() { return ( this && Type == WIRE ) ? (CSPrimWire*) this : 0; } /// Cast Primitive to a more defined type. Will return null if not of the requested type.
 	//! Get the corresponing UserDefined-Primitive or NULL in case of different type.
 	CSPrimUserDefined* ToUserDefined() { return ( this && Type == USERDEFINED ) ? (CSPrimUserDefined*) this : 0; } /// Cast Primitive to a more defined type. Will return null if not of the requested type.
+	//! Get the corresponing Group-Primitive or NULL in case of different type.
+	CSPrimGroup* ToGroup() { return ( this && Type == GROUP ) ? (CSPrimGroup*) this : 0; } /// Cast Primitive to a more defined type. Will return null if not of the requested type.
 	//! Get the corresponing Point-Primitive or 0 in case of different type.
 	CSPrimPoint* ToPoint() { return ( this && Type == POINT ) ? (CSPrimPoint*) this : 0; } //!< Cast Primitive to a more defined type. Will return 0 if not of the requested type.
 
@@ -168,17 +196,19 @@ public:
 	bool operator!=(CSPrimitives& vgl) { return iPriority!=vgl.GetPriority();}
 
 	//! Define the input type for the weighting coordinate system 0=cartesian, 1=cylindrical, 2=spherical
-	void SetCoordInputType(CoordinateSystem type, bool doUpdate=true) {m_MeshType=type; if (doUpdate) Update();}
+	void SetCoordInputType(CoordinateSystem type, bool doUpdate=true) {m_MeshType=type; m_InsideKernel=NULL; if (doUpdate) Update();}
 	//! Get the input type for the weighting coordinate system 0=cartesian, 1=cylindrical, 2=spherical
 	CoordinateSystem GetCoordInputType() const {return m_MeshType;}
 
 	//! Define the coordinate system this primitive is defined in (may be different to the input mesh type) \sa SetCoordInputType
-	void SetCoordinateSystem(CoordinateSystem cs) {m_PrimCoordSystem=cs;}
+	void SetCoordinateSystem(CoordinateSystem cs) {m_PrimCoordSystem=cs; m_InsideKernel=NULL;}
 	//! Read the coordinate system for this primitive (may be different to the input mesh type) \sa GetCoordInputType
 	CoordinateSystem GetCoordinateSystem() const {return m_PrimCoordSystem;}
 
 	//! Get the CSTransform if it exists already or create a new one
 	CSTransform* GetTransform();
+	//! Get the CSTransform of this primitive, NULL if it has none. In contrast to GetTransform() no new transformation is created.
+	const CSTransform* GetTransformPtr() const {return m_Transform;}
 
 	//! Show status of this primitve
 	virtual void ShowPrimitiveStatus(std::ostream& stream);
@@ -191,6 +221,16 @@ protected:
 	//! Apply (invers) transformation to the given coordinate in the given coordinate system
 	void TransformCoords(double* Coord, bool invers, CoordinateSystem cs_in) const;
 
+	//! Check for a transformation other than the identity
+	bool HasWorldTransform() const;
+	//! Calculate the bounding box of a transformed local cartesian box
+	void TransformBoundBox(const double localBox[6], double worldBox[6]) const;
+
+	//! Inside test specialized at compile time for a mesh type, primitive coordinate system and transformation
+	typedef bool (*InsideKernel)(const CSPrimitives* prim, const double* Coord);
+	///Inside kernel selected by the derived primitive, reset to NULL if the mesh type, coordinate system or transformation changes
+	InsideKernel m_InsideKernel;
+
 	unsigned int uiID;
 	int iPriority;
 	CoordinateSystem m_PrimCoordSystem;
@@ -206,6 +246,8 @@ protected:
 	bool m_BoundBoxValid;
 	double m_BoundBox[6];
 	CoordinateSystem m_BoundBox_CoordSys;
+	//set by Update() of primitives with an analytic world bounding box, if all parameters could be evaluated
+	bool m_Evaluated;
 
 	int m_Dimension;
 };
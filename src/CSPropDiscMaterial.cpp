@@ -15,6 +15,17 @@
 *	along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+#include <sstream>
+#include <map>
+#include <math.h>
+#include <string.h>
+#include <boost/weak_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind/bind.hpp>
+#include <boost/unordered_map.hpp>
+
 #include "tinyxml.h"
 #include <hdf5.h>
 #include <hdf5_hl.h>
@@ -24,7 +35,64 @@
 #include "vtkPoints.h"
 
 #include "ParameterCoord.h"
+#include "CSRectGrid.h"
 #include "CSPropDiscMaterial.h"
+#include "CSHDF5BrickCache.h"
+#include "CSHDF5ChunkReader.h"
+#include "CSHDF5Lock.h"
+#include "CSVoxelBrickVolume.h"
+#include "CSVoxelPyramid.h"
+
+//! Voxel data of a discrete material file, shared by all properties reading the same file
+struct CSDiscMaterialData
+{
+	CSDiscMaterialData()
+	{
+		m_DB_size = 0;
+		for (int n=0;n<3;++n)
+		{
+			m_Size[n] = 0;
+			m_mesh[n] = NULL;
+		}
+		m_Disc_Ind = NULL;
+		m_BrickCache = NULL;
+		m_BrickVolume = NULL;
+		m_Pyramid = NULL;
+		m_Disc_epsR = m_Disc_kappa = m_Disc_mueR = m_Disc_sigma = m_Disc_Density = NULL;
+	}
+	~CSDiscMaterialData()
+	{
+		for (int n=0;n<3;++n)
+			delete[] m_mesh[n];
+		delete[] m_Disc_Ind;
+		delete m_BrickCache;
+		delete m_BrickVolume;
+		delete m_Pyramid;
+		delete[] m_Disc_epsR;
+		delete[] m_Disc_kappa;
+		delete[] m_Disc_mueR;
+		delete[] m_Disc_sigma;
+		delete[] m_Disc_Density;
+	}
+
+	unsigned int m_Size[3];
+	unsigned int m_DB_size;
+	float *m_mesh[3];
+	uint8* m_Disc_Ind;
+	CSHDF5BrickCache* m_BrickCache;
+	CSVoxelBrickVolume* m_BrickVolume;
+	CSVoxelPyramid* m_Pyramid;
+	float *m_Disc_epsR;
+	float *m_Disc_kappa;
+	float *m_Disc_mueR;
+	float *m_Disc_sigma;
+	float *m_Disc_Density;
+};
+
+// registry of shared voxel data, the data is released as soon as no property uses it anymore
+typedef std::map<std::string, boost::weak_ptr<CSDiscMaterialData> > DiscDataRegistry;
+static DiscDataRegistry g_DiscDataRegistry;
+static boost::mutex g_DiscDataRegistryMutex;
 
 CSPropDiscMaterial::CSPropDiscMaterial(ParameterSet* paraSet) : CSPropMaterial(paraSet)
 {
@@ -46,28 +114,19 @@ CSPropDiscMaterial::CSPropDiscMaterial(unsigned int ID, ParameterSet* paraSet) :
 
 CSPropDiscMaterial::~CSPropDiscMaterial()
 {
-	for (int n=0;n<3;++n)
-	{
-		delete[] m_mesh[n];
-		m_mesh[n]=NULL;
-	}
-	delete[] m_Disc_Ind;
-	m_Disc_Ind=NULL;
-	delete[] m_Disc_epsR;
-	m_Disc_epsR=NULL;
-	delete[] m_Disc_kappa;
-	m_Disc_kappa=NULL;
-	delete[] m_Disc_mueR;
-	m_Disc_mueR=NULL;
-	delete[] m_Disc_sigma;
-	m_Disc_sigma=NULL;
-	delete[] m_Disc_Density;
-	m_Disc_Density=NULL;
+	ReleaseData();
 
 	delete m_Transform;
 	m_Transform=NULL;
 }
 
+CSTransform* CSPropDiscMaterial::GetTransform()
+{
+	if (m_Transform==NULL)
+		m_Transform = new CSTransform(clParaSet);
+	return m_Transform;
+}
+
 unsigned int CSPropDiscMaterial::GetWeightingPos(const double* inCoords)
 {
 	double coords[3];
@@ -76,39 +135,376 @@ unsigned int CSPropDiscMaterial::GetWeightingPos(const double* inCoords)
 		m_Transform->InvertTransform(coords,coords);
 	for (int n=0;n<3;++n)
 		coords[n]/=m_Scale;
+	return GetLocalWeightingPos(coords);
+}
+
+unsigned int CSPropDiscMaterial::GetLocalWeightingPos(const double* coords, unsigned int* hint) const
+{
 	unsigned int pos[3];
 	if (!(m_mesh[0] && m_mesh[1] && m_mesh[2]))
 		return -1;
 	for (int n=0;n<3;++n)
 	{
-		if (coords[n]<m_mesh[n][0])
-			return -1;
-		if (coords[n]>m_mesh[n][m_Size[n]-1])
+		if (hint)
+			pos[n] = hint[n] = GetMeshIndex(n, coords[n], hint[n]);
+		else
+			pos[n] = GetMeshIndex(n, coords[n]);
+		if (pos[n]==(unsigned int)-1)
 			return -1;
-		pos[n]=0;
-		for (unsigned int i=1;i<m_Size[n];++i)
+	}
+	return pos[0] + pos[1]*(m_Size[0]-1) + pos[2]*(m_Size[0]-1)*(m_Size[1]-1);
+}
+
+void CSPropDiscMaterial::UpdateMeshIndex()
+{
+	for (int n=0;n<3;++n)
+	{
+		m_MeshUniform[n] = false;
+		m_MeshInvDelta[n] = 0;
+		if ((m_mesh[n]==NULL) || (m_Size[n]<2))
+			continue;
+		const float* mesh = m_mesh[n];
+		unsigned int numCells = m_Size[n]-1;
+		double delta = ((double)mesh[numCells]-(double)mesh[0])/numCells;
+		if (delta<=0)
+			continue;
+		// the float mesh lines are never exactly uniform, small deviations are corrected in GetMeshIndex
+		bool uniform = true;
+		for (unsigned int i=1;(i<numCells) && uniform;++i)
+			if (fabs((double)mesh[i]-(double)mesh[0]-i*delta)>1e-3*delta)
+				uniform = false;
+		m_MeshUniform[n] = uniform;
+		if (uniform)
+			m_MeshInvDelta[n] = 1.0/delta;
+	}
+}
+
+unsigned int CSPropDiscMaterial::GetMeshIndex(int ny, double coord) const
+{
+	const float* mesh = m_mesh[ny];
+	unsigned int numCells = m_Size[ny]-1;
+	if ((coord<mesh[0]) || (coord>mesh[numCells]))
+		return -1;
+	if (m_MeshUniform[ny])
+	{
+		unsigned int pos = std::min((unsigned int)((coord-mesh[0])*m_MeshInvDelta[ny]), numCells-1);
+		while ((pos>0) && (coord<mesh[pos]))
+			--pos;
+		while ((pos+1<numCells) && (coord>=mesh[pos+1]))
+			++pos;
+		return pos;
+	}
+	// first mesh line above coord, a coordinate on the last mesh line belongs to the last voxel
+	return (std::upper_bound(mesh, mesh+numCells, coord) - mesh) - 1;
+}
+
+unsigned int CSPropDiscMaterial::GetMeshIndex(int ny, double coord, unsigned int hint) const
+{
+	const float* mesh = m_mesh[ny];
+	unsigned int numCells = m_Size[ny]-1;
+	if ((hint>=numCells) || (coord<mesh[hint]) || (coord>mesh[numCells]))
+		return GetMeshIndex(ny, coord);
+	// walk a few voxels up from the previous index, jump directly for larger distances
+	for (unsigned int n=0;n<8;++n)
+	{
+		if ((hint+1==numCells) || (coord<mesh[hint+1]))
+			return hint;
+		++hint;
+	}
+	return GetMeshIndex(ny, coord);
+}
+
+bool CSPropDiscMaterial::MapGridLines(int ny, const double* lines, unsigned int numLines, unsigned int* index) const
+{
+	if (coordInputType!=CARTESIAN)
+		return false;
+	return MapLines(ny, lines, numLines, index);
+}
+
+bool CSPropDiscMaterial::MapLines(int ny, const double* lines, unsigned int numLines, unsigned int* index) const
+{
+	if ((ny<0) || (ny>2))
+		return false;
+	double scale = 1;
+	double shift = 0;
+	if (m_Transform)
+	{
+		if (m_Transform->GetMatrixType()==CSTransform::GENERAL_MATRIX)
+			return false;
+		// the same calculation as InvertTransform for a diagonal matrix
+		const double* inv = m_Transform->GetInverseMatrix();
+		scale = inv[5*ny];
+		shift = inv[4*ny+3];
+	}
+	if (m_mesh[ny]==NULL)
+	{
+		for (unsigned int i=0;i<numLines;++i)
+			index[i] = -1;
+		return true;
+	}
+	unsigned int hint = -1;
+	for (unsigned int i=0;i<numLines;++i)
+	{
+		double coord = (scale*lines[i] + shift)/m_Scale;
+		index[i] = GetMeshIndex(ny, coord, hint);
+		if (index[i]!=(unsigned int)-1)
+			hint = index[i];
+	}
+	return true;
+}
+
+bool CSPropDiscMaterial::GetDBPositions(const double* const lines[3], const unsigned int numLines[3], CoordinateSystem cs, int* dbPos)
+{
+	if (HasVoxelData()==false)
+		return false;
+	size_t numX = numLines[0];
+	size_t numXY = numX*numLines[1];
+
+	// gather through per direction index maps
+	std::vector<unsigned int> index[3];
+	bool separable = (cs==CARTESIAN);
+	for (int n=0;(n<3) && separable;++n)
+	{
+		index[n].resize(numLines[n]+1);
+		separable = MapLines(n, lines[n], numLines[n], &index[n][0]);
+	}
+	if (separable)
+	{
+		GatherDBPositions(index, numLines, dbPos);
+		return true;
+	}
+
+	// transform every point, one line in x (or r) direction at a time
+	std::vector<double> local[3];
+	for (int n=0;n<3;++n)
+		local[n].resize(numLines[0]+1);
+	double* const localPtr[3] = {&local[0][0], &local[1][0], &local[2][0]};
+	unsigned int hint[3] = {(unsigned int)-1, (unsigned int)-1, (unsigned int)-1};
+	for (unsigned int k=0;k<numLines[2];++k)
+		for (unsigned int j=0;j<numLines[1];++j)
+		{
+			for (unsigned int i=0;i<numLines[0];++i)
+			{
+				double coords[3] = {lines[0][i], lines[1][j], lines[2][k]};
+				TransformCoordSystem(coords, coords, cs, CARTESIAN);
+				for (int n=0;n<3;++n)
+					local[n][i] = coords[n];
+			}
+			if (m_Transform)
+				m_Transform->InvertTransform(numLines[0], localPtr, localPtr);
+			int* out = &dbPos[k*numXY + j*numX];
+			for (unsigned int i=0;i<numLines[0];++i)
+			{
+				double coords[3] = {local[0][i]/m_Scale, local[1][i]/m_Scale, local[2][i]/m_Scale};
+				out[i] = GetVoxelDBPos(GetLocalWeightingPos(coords, hint));
+			}
+		}
+	return true;
+}
+
+void CSPropDiscMaterial::GatherDBPositions(const std::vector<unsigned int>* index, const unsigned int numLines[3], int* dbPos) const
+{
+	size_t numX = numLines[0];
+	size_t numXY = numX*numLines[1];
+	unsigned int strideY = m_Size[0]-1;
+	unsigned int strideZ = (m_Size[0]-1)*(m_Size[1]-1);
+	for (unsigned int k=0;k<numLines[2];++k)
+		for (unsigned int j=0;j<numLines[1];++j)
 		{
-			if (coords[n]<m_mesh[n][i])
+			int* out = &dbPos[k*numXY + j*numX];
+			if ((index[1][j]==(unsigned int)-1) || (index[2][k]==(unsigned int)-1))
 			{
-				pos[n]=i-1;
-				break;
+				for (unsigned int i=0;i<numLines[0];++i)
+					out[i] = -1;
+				continue;
 			}
+			unsigned int offset = index[1][j]*strideY + index[2][k]*strideZ;
+			for (unsigned int i=0;i<numLines[0];++i)
+				out[i] = (index[0][i]==(unsigned int)-1) ? -1 : GetVoxelDBPos(index[0][i] + offset);
+		}
+}
+
+bool CSPropDiscMaterial::GetDBPositions(CSRectGrid* grid, int* dbPos, bool cellCenters)
+{
+	if (grid==NULL)
+		return false;
+	if ((grid==m_AlignedGrid) && HasVoxelData())
+	{
+		// integer index maps of the aligned grid
+		std::vector<unsigned int> index[3];
+		unsigned int numLines[3];
+		bool aligned = true;
+		for (int n=0;n<3;++n)
+		{
+			numLines[n] = grid->GetQtyLines(n);
+			aligned &= (numLines[n]==m_AlignedNumLines[n]);
+			if (cellCenters && (numLines[n]>0))
+				--numLines[n];
+			index[n].resize(numLines[n]);
+			for (unsigned int i=0;i<numLines[n];++i)
+				index[n][i] = GetAlignedIndex(n, i, cellCenters);
+		}
+		if (aligned)
+		{
+			GatherDBPositions(index, numLines, dbPos);
+			return true;
 		}
 	}
-	return pos[0] + pos[1]*(m_Size[0]-1) + pos[2]*(m_Size[0]-1)*(m_Size[1]-1);
+	double* lines[3] = {NULL, NULL, NULL};
+	unsigned int numLines[3];
+	for (int n=0;n<3;++n)
+	{
+		lines[n] = grid->GetLines(n, lines[n], numLines[n], true);
+		if (cellCenters && (numLines[n]>0))
+		{
+			for (unsigned int i=0;i+1<numLines[n];++i)
+				lines[n][i] = 0.5*(lines[n][i]+lines[n][i+1]);
+			--numLines[n];
+		}
+	}
+	bool ok = GetDBPositions(lines, numLines, grid->GetMeshType(), dbPos);
+	for (int n=0;n<3;++n)
+		delete[] lines[n];
+	return ok;
+}
+
+bool CSPropDiscMaterial::SetAlignedGrid(CSRectGrid* grid)
+{
+	m_AlignedGrid = NULL;
+	if ((grid==NULL) || (HasVoxelData()==false) || (grid->GetMeshType()!=CARTESIAN))
+		return false;
+	double scale[3] = {1,1,1};
+	double shift[3] = {0,0,0};
+	if (m_Transform)
+	{
+		if (m_Transform->GetMatrixType()==CSTransform::GENERAL_MATRIX)
+			return false;
+		// the same calculation as InvertTransform for a diagonal matrix
+		const double* inv = m_Transform->GetInverseMatrix();
+		for (int n=0;n<3;++n)
+		{
+			scale[n] = inv[5*n];
+			shift[n] = inv[4*n+3];
+		}
+	}
+	for (int n=0;n<3;++n)
+	{
+		if (scale[n]<=0)
+			return false;
+		unsigned int numLines = 0;
+		double* lines = grid->GetLines(n, NULL, numLines, true);
+		for (unsigned int i=0;i<numLines;++i)
+			lines[i] = (scale[n]*lines[i] + shift[n])/m_Scale;
+		bool ok = AlignLines(n, lines, numLines);
+		delete[] lines;
+		if (ok==false)
+			return false;
+		m_AlignedNumLines[n] = numLines;
+	}
+	m_AlignedGrid = grid;
+	return true;
+}
+
+bool CSPropDiscMaterial::AlignLines(int ny, const double* lines, unsigned int numLines)
+{
+	const float* mesh = m_mesh[ny];
+	unsigned int numCells = m_Size[ny]-1;
+	if ((mesh==NULL) || (numLines<2))
+		return false;
+	// the voxel mesh is stored as float, mesh lines are matched with a tolerance relative to the smallest voxel
+	double minDelta = (double)mesh[1]-(double)mesh[0];
+	for (unsigned int m=1;m<numCells;++m)
+		minDelta = std::min(minDelta, (double)mesh[m+1]-(double)mesh[m]);
+	double tol = 1e-4*minDelta;
+
+	// first grid line on a voxel mesh line
+	unsigned int g0 = 0;
+	while ((g0<numLines) && (lines[g0]<mesh[0]-tol))
+		++g0;
+	if (g0>=numLines)
+		return false;
+	unsigned int m0 = std::lower_bound(mesh, mesh+numCells+1, lines[g0]-tol) - mesh;
+	if ((m0>=numCells) || (fabs(lines[g0]-mesh[m0])>tol))
+		return false;
+	// number of grid cells per voxel, all following grid lines are inside voxel m0 if none is on the next mesh line
+	unsigned int g1 = g0+1;
+	while ((g1<numLines) && (lines[g1]<mesh[m0+1]-tol))
+		++g1;
+	unsigned int ratio = g1-g0;
+	int offset = (int)g0 - (int)(m0*ratio);
+
+	// verify the integer mapping against the voxel search for all grid lines and cell centers
+	for (unsigned int g=0;g<numLines;++g)
+	{
+		int d = (int)g - offset;
+		if ((d>=0) && (d%ratio==0) && ((unsigned int)d/ratio<=numCells))
+		{
+			if (fabs(lines[g]-mesh[d/ratio])>tol)
+				return false;
+		}
+		else if (GetAlignedIndex(ny, g, offset, ratio, false)!=GetMeshIndex(ny, lines[g]))
+			return false;
+		if ((g+1<numLines) && (GetAlignedIndex(ny, g, offset, ratio, true)!=GetMeshIndex(ny, 0.5*(lines[g]+lines[g+1]))))
+			return false;
+	}
+	m_AlignedOffset[ny] = offset;
+	m_AlignedRatio[ny] = ratio;
+	return true;
+}
+
+unsigned int CSPropDiscMaterial::GetAlignedIndex(int ny, unsigned int pos, int offset, unsigned int ratio, bool cellCenter) const
+{
+	int d = (int)pos - offset;
+	if (d<0)
+		return -1;
+	unsigned int m = d/ratio;
+	unsigned int numCells = m_Size[ny]-1;
+	if (m<numCells)
+		return m;
+	// a grid line on the last mesh line belongs to the last voxel
+	if ((cellCenter==false) && (m==numCells) && (d%ratio==0))
+		return numCells-1;
+	return -1;
+}
+
+int CSPropDiscMaterial::GetAlignedDBPos(const unsigned int pos[3], bool cellCenter) const
+{
+	if ((m_AlignedGrid==NULL) || (HasVoxelData()==false))
+		return -1;
+	unsigned int index[3];
+	for (int n=0;n<3;++n)
+	{
+		index[n] = GetAlignedIndex(n, pos[n], cellCenter);
+		if (index[n]==(unsigned int)-1)
+			return -1;
+	}
+	return GetVoxelDBPos(index[0] + index[1]*(m_Size[0]-1) + index[2]*(m_Size[0]-1)*(m_Size[1]-1));
 }
 
 int CSPropDiscMaterial::GetDBPos(const double* coords)
 {
-	if (m_Disc_Ind==NULL)
+	if (HasVoxelData()==false)
 		return -1;
-	unsigned int pos = GetWeightingPos(coords);
-	if (pos==(unsigned int)-1)
+	return GetVoxelDBPos(GetWeightingPos(coords));
+}
+
+uint8 CSPropDiscMaterial::GetVoxelIndex(unsigned int pos) const
+{
+	if (m_Disc_Ind)
+		return m_Disc_Ind[pos];
+	if (m_BrickVolume)
+		return m_BrickVolume->GetValue(pos);
+	return m_BrickCache->GetValue(pos);
+}
+
+int CSPropDiscMaterial::GetVoxelDBPos(unsigned int pos) const
+{
+	if ((HasVoxelData()==false) || (pos==(unsigned int)-1))
 		return -1;
+	int db_pos = (int)GetVoxelIndex(pos);
 	// material with index 0 is assumed to be background material
-	if ((m_DB_Background==false) && (m_Disc_Ind[pos]==0))
+	if ((m_DB_Background==false) && (db_pos==0))
 			return -1;
-	int db_pos = (int)m_Disc_Ind[pos];
 	if (db_pos>=(int)m_DB_size)
 	{
 		//sanity check, this should not happen!!!
@@ -168,6 +564,65 @@ double CSPropDiscMaterial::GetDensityWeighted(const double* inCoords)
 	return m_Disc_Density[pos];
 }
 
+void CSPropDiscMaterial::SetWeightedValues(const double* inCoords, int pos, WeightedValues &values)
+{
+	// the background material is only evaluated if any value is not found in the database
+	if ((pos<0) || !(m_Disc_epsR && m_Disc_kappa && m_Disc_mueR && m_Disc_sigma && m_Disc_Density))
+		CSPropMaterial::GetWeightedValues(inCoords, values);
+	if (pos<0)
+		return;
+	for (int n=0;n<3;++n)
+	{
+		if (m_Disc_epsR)
+			values.Epsilon[n] = m_Disc_epsR[pos];
+		if (m_Disc_kappa)
+			values.Kappa[n] = m_Disc_kappa[pos];
+		if (m_Disc_mueR)
+			values.Mue[n] = m_Disc_mueR[pos];
+		if (m_Disc_sigma)
+			values.Sigma[n] = m_Disc_sigma[pos];
+	}
+	if (m_Disc_Density)
+		values.Density = m_Disc_Density[pos];
+}
+
+void CSPropDiscMaterial::GetWeightedValues(const double* inCoords, WeightedValues &values)
+{
+	SetWeightedValues(inCoords, GetDBPos(inCoords), values);
+}
+
+void CSPropDiscMaterial::GetWeightedValues(const double* inCoords, unsigned int numCoords, WeightedValues* values)
+{
+	// transform blocks of coordinates at once, neighboring coordinates are found by a short search from the previous voxel
+	const unsigned int blockSize = 256;
+	double local[3][blockSize];
+	double* const localPtr[3] = {local[0], local[1], local[2]};
+	unsigned int hint[3] = {(unsigned int)-1, (unsigned int)-1, (unsigned int)-1};
+	for (unsigned int start=0;start<numCoords;start+=blockSize)
+	{
+		unsigned int num = std::min(blockSize, numCoords-start);
+		for (unsigned int i=0;i<num;++i)
+		{
+			double coords[3];
+			TransformCoordSystem(&inCoords[3*(start+i)], coords, coordInputType, CARTESIAN);
+			for (int n=0;n<3;++n)
+				local[n][i] = coords[n];
+		}
+		if (m_Transform)
+			m_Transform->InvertTransform(num, localPtr, localPtr);
+		for (unsigned int i=0;i<num;++i)
+		{
+			int pos = -1;
+			if (HasVoxelData())
+			{
+				double coords[3] = {local[0][i]/m_Scale, local[1][i]/m_Scale, local[2][i]/m_Scale};
+				pos = GetVoxelDBPos(GetLocalWeightingPos(coords, hint));
+			}
+			SetWeightedValues(&inCoords[3*(start+i)], pos, values[start+i]);
+		}
+	}
+}
+
 void CSPropDiscMaterial::Init()
 {
 	m_Filename.clear();
@@ -179,6 +634,15 @@ void CSPropDiscMaterial::Init()
 	for (int n=0;n<3;++n)
 		m_mesh[n]=NULL;
 	m_Disc_Ind=NULL;
+	m_BrickCache=NULL;
+	m_OutOfCore=false;
+	m_CacheSize=64;
+	m_BrickVolume=NULL;
+	m_Compressed=false;
+	m_ReadThreads=0;
+	m_Pyramid=NULL;
+	m_PyramidLevels=0;
+	m_AlignedGrid=NULL;
 	m_Disc_epsR=NULL;
 	m_Disc_kappa=NULL;
 	m_Disc_mueR=NULL;
@@ -188,6 +652,12 @@ void CSPropDiscMaterial::Init()
 	m_Scale=1;
 	m_Transform=NULL;
 
+	for (int n=0;n<3;++n)
+	{
+		m_MeshUniform[n] = false;
+		m_MeshInvDelta[n] = 0;
+	}
+
 	CSPropMaterial::Init();
 }
 
@@ -202,6 +672,15 @@ bool CSPropDiscMaterial::Write2XML(TiXmlNode& root, bool parameterised, bool spa
 	filename.SetAttribute("File",m_Filename.c_str());
 	filename.SetAttribute("UseDBBackground",m_DB_Background);
 	filename.SetAttribute("Scale",m_Scale);
+	if (m_OutOfCore)
+	{
+		filename.SetAttribute("OutOfCore",1);
+		filename.SetAttribute("CacheSize",m_CacheSize);
+	}
+	if (m_Compressed)
+		filename.SetAttribute("Compressed",1);
+	if (m_PyramidLevels>0)
+		filename.SetAttribute("PyramidLevels",m_PyramidLevels);
 
 	if (m_Transform)
 		m_Transform->Write2XML(prop);
@@ -232,6 +711,15 @@ bool CSPropDiscMaterial::ReadFromXML(TiXmlNode &root)
 	if (prop->QueryDoubleAttribute("Scale",&m_Scale)!=TIXML_SUCCESS)
 		m_Scale=1;
 
+	if (prop->QueryIntAttribute("OutOfCore",&help)==TIXML_SUCCESS)
+		m_OutOfCore = (help!=0);
+	if (prop->QueryIntAttribute("CacheSize",&help)==TIXML_SUCCESS)
+		m_CacheSize = std::max(help,1);
+	if (prop->QueryIntAttribute("Compressed",&help)==TIXML_SUCCESS)
+		m_Compressed = (help!=0);
+	if (prop->QueryIntAttribute("PyramidLevels",&help)==TIXML_SUCCESS)
+		m_PyramidLevels = std::max(help,0);
+
 	if (c_filename==NULL)
 		return true;
 
@@ -243,28 +731,18 @@ bool CSPropDiscMaterial::ReadFromXML(TiXmlNode &root)
 	return true;
 }
 
-void *CSPropDiscMaterial::ReadDataSet(std::string filename, std::string d_name, int type_id, int &rank, unsigned int &size, bool debug)
+void *CSPropDiscMaterial::ReadDataSet(long long file_id, std::string d_name, long long type_id, int &rank, unsigned int &size, bool debug)
 {
 	herr_t status;
 	H5T_class_t class_id;
 	size_t type_size;
 	rank = -1;
-
-	// open hdf5 file
-	hid_t file_id = H5Fopen( filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT );
-	if (file_id < 0)
-	{
-		if (debug)
-			std::cerr << __func__ << ": Failed to open file, skipping..." << std::endl;
-		H5Fclose(file_id);
-		return NULL;
-	}
+	CSHDF5Lock hdf5Lock;
 
 	if (H5Lexists(file_id, d_name.c_str(), H5P_DEFAULT)<=0)
 	{
 		if (debug)
 			std::cerr << __func__ << ": Warning, dataset: \"" << d_name << "\" not found... skipping" << std::endl;
-		H5Fclose(file_id);
 		return NULL;
 	}
 
@@ -273,7 +751,6 @@ void *CSPropDiscMaterial::ReadDataSet(std::string filename, std::string d_name,
 	{
 		if (debug)
 			std::cerr << __func__ << ": Warning, failed to read dimension for dataset: \"" << d_name << "\" skipping..." << std::endl;
-		H5Fclose(file_id);
 		return NULL;
 	}
 
@@ -283,7 +760,7 @@ void *CSPropDiscMaterial::ReadDataSet(std::string filename, std::string d_name,
 	{
 		if (debug)
 			std::cerr << __func__ << ": Warning, failed to read dataset info: \"" << d_name << "\" skipping..." << std::endl;
-		H5Fclose(file_id);
+		delete[] dims;
 		return NULL;
 	}
 
@@ -302,7 +779,6 @@ void *CSPropDiscMaterial::ReadDataSet(std::string filename, std::string d_name,
 	else
 	{
 		std::cerr << __func__ << ": Error, unknown data type" << std::endl;
-		H5Fclose(file_id);
 		return NULL;
 	}
 
@@ -317,11 +793,9 @@ void *CSPropDiscMaterial::ReadDataSet(std::string filename, std::string d_name,
 			delete[] (int*)data;
 		else if (type_id==H5T_NATIVE_UINT8)
 			delete[] (uint8*)data;
-		H5Fclose(file_id);
 		return NULL;
 	}
 
-	H5Fclose(file_id);
 	return data;
 }
 
@@ -329,14 +803,160 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 {
 	cout << __func__ << ": Reading \"" << filename << "\"" << std::endl;
 
-	// open hdf5 file
-	hid_t file_id = H5Fopen( filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT );
-	if (file_id < 0)
+	ReleaseData();
+	std::string key = GetDataKey(filename);
+	if (AttachData(key))
 	{
-		std::cerr << __func__ << ": Error, failed to open file, abort..." << std::endl;
+		cout << __func__ << ": Using voxel data shared with other properties" << std::endl;
+		return true;
+	}
+
+	bool ok;
+	{
+		CSHDF5Lock hdf5Lock;
+		// open hdf5 file, all data is read using this file handle
+		hid_t file_id = H5Fopen( filename.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT );
+		if (file_id < 0)
+		{
+			std::cerr << __func__ << ": Error, failed to open file, abort..." << std::endl;
+			return false;
+		}
+
+		ok = ReadHDF5(file_id, filename);
+		H5Fclose(file_id);
+	}
+	if (ok && (m_PyramidLevels>0))
+		BuildPyramid();
+	// a partially read file is owned but not shared
+	StoreData(ok ? key : std::string());
+	return ok;
+}
+
+std::string CSPropDiscMaterial::GetDataKey(std::string filename) const
+{
+	std::string fileKey = GetFileIdentity(filename);
+	if (fileKey.empty())
+		return std::string();
+	std::stringstream key;
+	key << fileKey << "|";
+	if (m_OutOfCore)
+		key << "OutOfCore:" << m_CacheSize;
+	else if (m_Compressed)
+		key << "Compressed";
+	else
+		key << "Dense";
+	if (m_PyramidLevels>0)
+		key << "|Pyramid:" << std::min(m_PyramidLevels, CSVoxelPyramid::MaxLevels);
+	return key.str();
+}
+
+void CSPropDiscMaterial::ReleaseData()
+{
+	if (m_Data)
+	{
+		m_Data.reset();
+		// remove the registry entries of all voxel data that is no longer used
+		boost::mutex::scoped_lock lock(g_DiscDataRegistryMutex);
+		DiscDataRegistry::iterator it = g_DiscDataRegistry.begin();
+		while (it!=g_DiscDataRegistry.end())
+		{
+			if (it->second.expired())
+				g_DiscDataRegistry.erase(it++);
+			else
+				++it;
+		}
+	}
+	m_AlignedGrid = NULL;
+	m_DB_size = 0;
+	for (int n=0;n<3;++n)
+	{
+		m_Size[n] = 0;
+		m_mesh[n] = NULL;
+	}
+	m_Disc_Ind = NULL;
+	m_BrickCache = NULL;
+	m_BrickVolume = NULL;
+	m_Pyramid = NULL;
+	m_Disc_epsR = NULL;
+	m_Disc_kappa = NULL;
+	m_Disc_mueR = NULL;
+	m_Disc_sigma = NULL;
+	m_Disc_Density = NULL;
+}
+
+void CSPropDiscMaterial::StoreData(const std::string &key)
+{
+	CSDiscMaterialData* data = new CSDiscMaterialData();
+	data->m_DB_size = m_DB_size;
+	for (int n=0;n<3;++n)
+	{
+		data->m_Size[n] = m_Size[n];
+		data->m_mesh[n] = m_mesh[n];
+	}
+	data->m_Disc_Ind = m_Disc_Ind;
+	data->m_BrickCache = m_BrickCache;
+	data->m_BrickVolume = m_BrickVolume;
+	data->m_Pyramid = m_Pyramid;
+	data->m_Disc_epsR = m_Disc_epsR;
+	data->m_Disc_kappa = m_Disc_kappa;
+	data->m_Disc_mueR = m_Disc_mueR;
+	data->m_Disc_sigma = m_Disc_sigma;
+	data->m_Disc_Density = m_Disc_Density;
+	m_Data.reset(data);
+
+	if (key.empty())
+		return;
+	boost::mutex::scoped_lock lock(g_DiscDataRegistryMutex);
+	g_DiscDataRegistry[key] = m_Data;
+}
+
+unsigned int CSPropDiscMaterial::GetNumberOfSharedData()
+{
+	boost::mutex::scoped_lock lock(g_DiscDataRegistryMutex);
+	return g_DiscDataRegistry.size();
+}
+
+bool CSPropDiscMaterial::AttachData(const std::string &key)
+{
+	if (key.empty())
 		return false;
+	boost::shared_ptr<CSDiscMaterialData> data;
+	{
+		boost::mutex::scoped_lock lock(g_DiscDataRegistryMutex);
+		DiscDataRegistry::iterator it = g_DiscDataRegistry.find(key);
+		if (it==g_DiscDataRegistry.end())
+			return false;
+		data = it->second.lock();
+		if (!data)
+		{
+			g_DiscDataRegistry.erase(it);
+			return false;
+		}
+	}
+
+	m_Data = data;
+	m_DB_size = data->m_DB_size;
+	for (int n=0;n<3;++n)
+	{
+		m_Size[n] = data->m_Size[n];
+		m_mesh[n] = data->m_mesh[n];
 	}
+	m_Disc_Ind = data->m_Disc_Ind;
+	m_BrickCache = data->m_BrickCache;
+	m_BrickVolume = data->m_BrickVolume;
+	m_Pyramid = data->m_Pyramid;
+	m_Disc_epsR = data->m_Disc_epsR;
+	m_Disc_kappa = data->m_Disc_kappa;
+	m_Disc_mueR = data->m_Disc_mueR;
+	m_Disc_sigma = data->m_Disc_sigma;
+	m_Disc_Density = data->m_Disc_Density;
+	UpdateMeshIndex();
+	return true;
+}
 
+bool CSPropDiscMaterial::ReadHDF5(long long file_id, std::string filename)
+{
+	CSHDF5Lock hdf5Lock;
 	double ver;
 	herr_t status = H5LTget_attribute_double(file_id, "/", "Version", &ver);
 	if (status < 0)
@@ -345,7 +965,6 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 	if (ver<2.0)
 	{
 		std::cerr << __func__ << ": Error, older file versions are no longer supported, abort..." << std::endl;
-		H5Fclose(file_id);
 		return false;
 	}
 
@@ -354,7 +973,6 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 	if (status<0)
 	{
 		std::cerr << __func__ << ": Error, can't read database size, abort..." << std::endl;
-		H5Fclose(file_id);
 		return false;
 	}
 
@@ -362,7 +980,6 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 	if (H5Lexists(file_id, "/DiscData", H5P_DEFAULT)<=0)
 	{
 		std::cerr << __func__ << ": Error, can't read database, abort..." << std::endl;
-		H5Fclose(file_id);
 		return false;
 	}
 
@@ -370,8 +987,7 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 	if (dataset<0)
 	{
 		std::cerr << __func__ << ": Error, can't open database" << std::endl;
-		H5Fclose(file_id);
-		return 0;
+		return false;
 	}
 
 	// read database
@@ -386,7 +1002,6 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 		m_Disc_epsR=NULL;
 	}
 
-	delete[] m_Disc_kappa;
 	if (H5LTfind_attribute(dataset, "kappa")==1)
 	{
 		m_Disc_kappa = new float[db_size];
@@ -398,7 +1013,6 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 		m_Disc_kappa=NULL;
 	}
 
-	delete[] m_Disc_mueR;
 	if (H5LTfind_attribute(dataset, "mueR")==1)
 	{
 		m_Disc_mueR = new float[db_size];
@@ -410,7 +1024,6 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 		m_Disc_mueR=NULL;
 	}
 
-	delete[] m_Disc_sigma;
 	if (H5LTfind_attribute(dataset, "sigma")==1)
 	{
 		m_Disc_sigma = new float[db_size];
@@ -422,7 +1035,6 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 		m_Disc_sigma=NULL;
 	}
 
-	delete[] m_Disc_Density;
 	if (H5LTfind_attribute(dataset, "density")==1)
 	{
 		m_Disc_Density = new float[db_size];
@@ -434,8 +1046,6 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 		m_Disc_Density=NULL;
 	}
 
-	H5Fclose(file_id);
-
 	// read mesh
 	unsigned int size;
 	int rank;
@@ -443,23 +1053,62 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 	std::string names[] = {"/mesh/x","/mesh/y","/mesh/z"};
 	for (int n=0; n<3; ++n)
 	{
-		m_mesh[n] = (float*)ReadDataSet(filename, names[n], H5T_NATIVE_FLOAT, rank, size);
+		m_mesh[n] = (float*)ReadDataSet(file_id, names[n], H5T_NATIVE_FLOAT, rank, size);
 		if ((m_mesh[n]==NULL) || (rank!=1) || (size<=1))
 		{
 			std::cerr << __func__ << ": Error, failed to read or invalid mesh, abort..." << std::endl;
-			H5Fclose(file_id);
+			H5Dclose(dataset);
 			return false;
 		}
 		m_Size[n]=size;
 		numCells*=(m_Size[n]-1);
 	}
+	UpdateMeshIndex();
 
-	delete[] m_Disc_Ind;
-	m_Disc_Ind = (uint8*)ReadDataSet(filename, "/DiscData", H5T_NATIVE_UINT8, rank, size, true);
+	bool ok;
+	if (m_OutOfCore)
+	{
+		// keep the file open and read the voxel data on demand
+		m_BrickCache = new CSHDF5BrickCache();
+		m_BrickCache->SetCacheSize((size_t)m_CacheSize*1024*1024);
+		const unsigned int* volSize = m_BrickCache->GetSize();
+		ok = m_BrickCache->Open(filename, "/DiscData") && ((size_t)volSize[0]*volSize[1]*volSize[2]==numCells);
+		if (ok==false)
+		{
+			std::cerr << __func__ << ": Error, can't open database indizies or size is invalid, abort..." << std::endl;
+			delete m_BrickCache;
+			m_BrickCache = NULL;
+		}
+	}
+	else if (m_Compressed)
+		ok = ReadCompressedIndex(dataset, numCells);
+	else
+		ok = ReadIndex(dataset, numCells);
+	H5Dclose(dataset);
+	return ok;
+}
 
-	if ((m_Disc_Ind==NULL) || (rank!=3) || (size!=numCells))
+bool CSPropDiscMaterial::ReadIndex(long long dataset, unsigned int numCells)
+{
+	CSHDF5Lock hdf5Lock;
+	hid_t fileSpace = H5Dget_space(dataset);
+	hssize_t numPoints = (fileSpace<0) ? -1 : H5Sget_simple_extent_npoints(fileSpace);
+	int rank = (fileSpace<0) ? -1 : H5Sget_simple_extent_ndims(fileSpace);
+	if (fileSpace>=0)
+		H5Sclose(fileSpace);
+	if ((rank!=3) || (numPoints!=(hssize_t)numCells))
 	{
 		std::cerr << __func__ << ": Error, can't read database indizies or size/rank is invalid, abort..." << std::endl;
+		return false;
+	}
+
+	// chunks are decompressed in parallel directly into the voxel array
+	m_Disc_Ind = new uint8[numCells];
+	CSHDF5ChunkReader reader(dataset);
+	reader.SetNumberOfThreads(m_ReadThreads);
+	if (reader.Read(m_Disc_Ind)==false)
+	{
+		std::cerr << __func__ << ": Error, failed to read database indizies, abort..." << std::endl;
 		delete[] m_Disc_Ind;
 		m_Disc_Ind = NULL;
 		return false;
@@ -467,12 +1116,139 @@ bool CSPropDiscMaterial::ReadHDF5( std::string filename )
 	return true;
 }
 
+bool CSPropDiscMaterial::ReadCompressedIndex(long long dataset, unsigned int numCells)
+{
+	CSHDF5Lock hdf5Lock;
+	hid_t fileSpace = H5Dget_space(dataset);
+	hsize_t dims[3] = {0,0,0};
+	if ((fileSpace<0) || (H5Sget_simple_extent_ndims(fileSpace)!=3) || (H5Sget_simple_extent_dims(fileSpace, dims, NULL)<0) || (dims[0]*dims[1]*dims[2]!=numCells))
+	{
+		std::cerr << __func__ << ": Error, can't read database indizies or size/rank is invalid, abort..." << std::endl;
+		if (fileSpace>=0)
+			H5Sclose(fileSpace);
+		return false;
+	}
+
+	// the last dataset dimension is the x-direction
+	unsigned int size[3] = {(unsigned int)dims[2], (unsigned int)dims[1], (unsigned int)dims[0]};
+	m_BrickVolume = new CSVoxelBrickVolume();
+	m_BrickVolume->Create(size);
+	std::vector<unsigned char> slab((size_t)size[0]*size[1]*CSVoxelBrickVolume::BrickSize);
+	bool ok = true;
+	for (unsigned int s=0;(s<m_BrickVolume->GetQtySlabs()) && ok;++s)
+	{
+		hsize_t offset[3] = {(hsize_t)s*CSVoxelBrickVolume::BrickSize, 0, 0};
+		hsize_t count[3] = {std::min((hsize_t)CSVoxelBrickVolume::BrickSize, dims[0]-offset[0]), dims[1], dims[2]};
+		hid_t memSpace = H5Screate_simple(3, count, NULL);
+		ok = (H5Sselect_hyperslab(fileSpace, H5S_SELECT_SET, offset, NULL, count, NULL)>=0);
+		if (ok)
+			ok = (H5Dread(dataset, H5T_NATIVE_UINT8, memSpace, fileSpace, H5P_DEFAULT, &slab[0])>=0);
+		H5Sclose(memSpace);
+		if (ok)
+			m_BrickVolume->SetSlab(s, &slab[0]);
+	}
+	H5Sclose(fileSpace);
+
+	if (ok==false)
+	{
+		std::cerr << __func__ << ": Error, failed to read database indizies, abort..." << std::endl;
+		delete m_BrickVolume;
+		m_BrickVolume = NULL;
+	}
+	return ok;
+}
+
+void CSPropDiscMaterial::BuildPyramid()
+{
+	unsigned int size[3] = {m_Size[0]-1, m_Size[1]-1, m_Size[2]-1};
+	m_Pyramid = new CSVoxelPyramid();
+	m_Pyramid->Create(size, m_PyramidLevels);
+	const unsigned int blockSize = m_Pyramid->GetBlockSize();
+	std::vector<uint8> voxel((size_t)blockSize*blockSize*blockSize, 0);
+	const unsigned int* numBlocks = m_Pyramid->GetSize(m_Pyramid->GetQtyLevels());
+	unsigned int block[3];
+	for (block[2]=0;block[2]<numBlocks[2];++block[2])
+		for (block[1]=0;block[1]<numBlocks[1];++block[1])
+			for (block[0]=0;block[0]<numBlocks[0];++block[0])
+			{
+				unsigned int start[3];
+				unsigned int num[3];
+				for (int n=0;n<3;++n)
+				{
+					start[n] = block[n]*blockSize;
+					num[n] = std::min(blockSize, size[n]-start[n]);
+				}
+				for (unsigned int z=0;z<num[2];++z)
+					for (unsigned int y=0;y<num[1];++y)
+					{
+						unsigned int pos = start[0] + (start[1]+y)*size[0] + (start[2]+z)*size[0]*size[1];
+						uint8* line = &voxel[(y + z*blockSize)*blockSize];
+						if (m_Disc_Ind)
+							memcpy(line, m_Disc_Ind+pos, num[0]);
+						else
+							for (unsigned int x=0;x<num[0];++x)
+								line[x] = GetVoxelIndex(pos+x);
+					}
+				m_Pyramid->SetBlock(block, &voxel[0]);
+			}
+}
+
+bool CSPropDiscMaterial::GetPyramidSize(unsigned int level, unsigned int size[3]) const
+{
+	if (HasVoxelData()==false)
+		return false;
+	if (level==0)
+	{
+		for (int n=0;n<3;++n)
+			size[n] = m_Size[n]-1;
+		return true;
+	}
+	if ((m_Pyramid==NULL) || (level>m_Pyramid->GetQtyLevels()))
+		return false;
+	for (int n=0;n<3;++n)
+		size[n] = m_Pyramid->GetSize(level)[n];
+	return true;
+}
+
+int CSPropDiscMaterial::GetPyramidDBPos(unsigned int level, const unsigned int pos[3], bool &mixed) const
+{
+	mixed = false;
+	unsigned int size[3];
+	if (GetPyramidSize(level, size)==false)
+		return -1;
+	for (int n=0;n<3;++n)
+		if (pos[n]>=size[n])
+			return -1;
+	if (level==0)
+		return GetVoxelDBPos(pos[0] + pos[1]*size[0] + pos[2]*size[0]*size[1]);
+
+	int db_pos = (int)m_Pyramid->GetValue(level, pos[0], pos[1], pos[2], mixed);
+	if (((m_DB_Background==false) && (db_pos==0)) || (db_pos>=(int)m_DB_size))
+		return -1;
+	return db_pos;
+}
+
 void CSPropDiscMaterial::ShowPropertyStatus(std::ostream& stream)
 {
 	CSProperties::ShowPropertyStatus(stream);
 	stream << " --- Discrete Material Properties --- " << std::endl;
 	stream << "  Data-Base Size:\t: " << m_DB_size << std::endl;
 	stream << "  Number of Voxels:\t: " << m_Size[0] << "x" << m_Size[1] << "x" << m_Size[2] << std::endl;
+	if (m_Data.use_count()>1)
+		stream << "  Shared Voxel Data:\t: used by " << m_Data.use_count() << " properties" << std::endl;
+	if (m_BrickCache)
+		stream << "  Out-of-Core Cache:\t: " << m_CacheSize << " MB, " << m_BrickCache->GetQtyBrickReads() << " bricks read" << std::endl;
+	if (m_BrickVolume)
+		stream << "  Compressed Voxels:\t: " << m_BrickVolume->GetMemoryUsage() << " bytes, " << m_BrickVolume->GetQtyUniformBricks() << " uniform bricks" << std::endl;
+	if (m_Pyramid)
+	{
+		stream << "  Pyramid Levels:\t: " << m_Pyramid->GetQtyLevels() << ", " << m_Pyramid->GetMemoryUsage() << " bytes" << std::endl;
+		for (unsigned int l=1;l<=m_Pyramid->GetQtyLevels();++l)
+		{
+			const unsigned int* size = m_Pyramid->GetSize(l);
+			stream << "   Level " << l << ":\t\t: " << size[0] << "x" << size[1] << "x" << size[2] << ", " << m_Pyramid->GetQtyMixed(l) << " mixed voxels" << std::endl;
+		}
+	}
 	stream << " Background Material Properties: " << std::endl;
 	stream << "  Isotropy\t: " << bIsotropy << std::endl;
 	stream << "  Epsilon_R\t: " << Epsilon[0].GetValueString() << ", "  << Epsilon[1].GetValueString() << ", "  << Epsilon[2].GetValueString()  << std::endl;
@@ -484,132 +1260,216 @@ void CSPropDiscMaterial::ShowPropertyStatus(std::ostream& stream)
 
 vtkPolyData* CSPropDiscMaterial::CreatePolyDataModel() const
 {
-	vtkPolyData* polydata = vtkPolyData::New();
-	vtkCellArray *poly = vtkCellArray::New();
-	vtkPoints *points = vtkPoints::New();
+	return CreatePolyDataModel(false);
+}
 
+unsigned int CSPropDiscMaterial::GetCoarseLine(int ny, unsigned int level, unsigned int line) const
+{
+	return std::min(line<<level, m_Size[ny]-1);
+}
 
-	int* pointIdx[2];
-	pointIdx[0] = new int[m_Size[0]*m_Size[1]];
-	pointIdx[1] = new int[m_Size[0]*m_Size[1]];
-	// init point idx
-	for (unsigned int n=0;n<m_Size[0]*m_Size[1];++n)
+bool CSPropDiscMaterial::IsCoarseVoxelFilled(unsigned int level, const unsigned int numVoxel[3], const int pos[3]) const
+{
+	for (int n=0;n<3;++n)
+		if ((pos[n]<0) || (pos[n]>=(int)numVoxel[n]))
+			return false;
+	if ((level>0) && m_Pyramid && (level<=m_Pyramid->GetQtyLevels()))
 	{
-		pointIdx[0][n]=-1;
-		pointIdx[1][n]=-1;
+		bool mixed;
+		return m_Pyramid->GetValue(level, pos[0], pos[1], pos[2], mixed)>0;
 	}
+	unsigned int fine[3];
+	for (int n=0;n<3;++n)
+	{
+		// the center voxel of a coarse voxel is used as representative
+		fine[n] = std::min((pos[n]<<level) + ((1u<<level)>>1), m_Size[n]-2);
+	}
+	return GetVoxelIndex(fine[0] + fine[1]*(m_Size[0]-1) + fine[2]*(m_Size[0]-1)*(m_Size[1]-1))>0;
+}
 
-	unsigned int mat_idx, mat_idx_down;
-	unsigned int mesh_idx=0;
-	bool bd, bu;
-	int nP, nPP;
-	unsigned int pos[3],rpos[3];
-	for (pos[2]=0;pos[2]<m_Size[2]-1;++pos[2])
-	{ // each xy-plane
-		for (unsigned int n=0;n<m_Size[0]*m_Size[1];++n)
+void CSPropDiscMaterial::CreateSurfaceSlabs(unsigned int level, bool mergeQuads, unsigned int first, unsigned int step, std::vector<SurfaceSlab>* slabs) const
+{
+	unsigned int numVoxel[3];
+	for (int n=0;n<3;++n)
+		numVoxel[n] = ((m_Size[n]-1) + (1u<<level) - 1)>>level;
+	unsigned long long numNodesXY = (unsigned long long)(numVoxel[0]+1)*(numVoxel[1]+1);
+	std::vector<signed char> mask;
+
+	for (unsigned int s=first;s<slabs->size();s+=step)
+	{
+		SurfaceSlab &slab = slabs->at(s);
+		boost::unordered_map<unsigned long long, unsigned int> pointIdx;
+		for (int n=0;n<3;++n)
 		{
-			pointIdx[0][n]=pointIdx[1][n];
-			pointIdx[1][n]=-1;
-		}
-		for (pos[0]=0;pos[0]<m_Size[0]-1;++pos[0])
-			for (pos[1]=0;pos[1]<m_Size[1]-1;++pos[1])
+			int nP = (n+1)%3;
+			int nPP = (n+2)%3;
+			// in-plane range of this slab, faces in z-direction at the last mesh line belong to the last slab
+			unsigned int lo[3] = {0, 0, slab.m_Start};
+			unsigned int hi[3] = {numVoxel[0], numVoxel[1], slab.m_Stop};
+			unsigned int lineStart = (n==2) ? slab.m_Start : 0;
+			unsigned int lineStop = (n==2) ? slab.m_Stop : numVoxel[n]+1;
+			if ((n==2) && (slab.m_Stop==numVoxel[2]))
+				++lineStop;
+			unsigned int numU = hi[nP]-lo[nP];
+			unsigned int numV = hi[nPP]-lo[nPP];
+			mask.resize((size_t)numU*numV);
+			for (unsigned int f=lineStart;f<lineStop;++f)
 			{
-				mat_idx = pos[0] + pos[1]*(m_Size[0]-1) + pos[2]*(m_Size[0]-1)*(m_Size[1]-1);
-				for (int n=0;n<3;++n)
-				{
-					// reset relative pos
-					rpos[0]=pos[0];
-					rpos[1]=pos[1];
-					rpos[2]=pos[2];
-					bd = false;
-					bu = false;
-					if (pos[n]==0)
+				// orientation of all faces in this plane, 1 for surface up, -1 for surface down
+				int pos[3];
+				pos[n] = f;
+				for (unsigned int v=0;v<numV;++v)
+					for (unsigned int u=0;u<numU;++u)
 					{
-						if (m_Disc_Ind[mat_idx]>0)
-							bd=true;
+						pos[nP] = lo[nP]+u;
+						pos[nPP] = lo[nPP]+v;
+						bool above = IsCoarseVoxelFilled(level, numVoxel, pos);
+						--pos[n];
+						bool below = IsCoarseVoxelFilled(level, numVoxel, pos);
+						++pos[n];
+						mask[u+v*numU] = (above==below) ? 0 : (below ? 1 : -1);
 					}
-					else if (pos[n]==m_Size[n]-2)
-					{
-						if (m_Disc_Ind[mat_idx]>0)
-							bu=true;
-					}
-					else
+
+				for (unsigned int v=0;v<numV;++v)
+					for (unsigned int u=0;u<numU;++u)
 					{
-						rpos[n] = pos[n]-1; // set relative pos
-						mat_idx_down  = rpos[0] + rpos[1]*(m_Size[0]-1) + rpos[2]*(m_Size[0]-1)*(m_Size[1]-1);
-						rpos[n] = pos[n]; // reset relative pos
-						if ((m_Disc_Ind[mat_idx]>0) && (m_Disc_Ind[mat_idx_down]==0))
-							bd=true;
-						else if (m_Disc_Ind[mat_idx]==0 && (m_Disc_Ind[mat_idx_down]>0))
-							bu=true;
+						signed char orient = mask[u+v*numU];
+						if (orient==0)
+							continue;
+						// grow a rectangle of equal orientation, first in u then in v direction
+						unsigned int u1 = u+1;
+						unsigned int v1 = v+1;
+						if (mergeQuads)
+						{
+							while ((u1<numU) && (mask[u1+v*numU]==orient))
+								++u1;
+							bool grow = true;
+							while (grow && (v1<numV))
+							{
+								for (unsigned int i=u;(i<u1) && grow;++i)
+									grow = (mask[i+v1*numU]==orient);
+								if (grow)
+									++v1;
+							}
+						}
+						for (unsigned int j=v;j<v1;++j)
+							for (unsigned int i=u;i<u1;++i)
+								mask[i+j*numU] = 0;
+
+						unsigned int corner[4][3];
+						for (int c=0;c<4;++c)
+						{
+							corner[c][n] = f;
+							corner[c][nP] = lo[nP] + u;
+							corner[c][nPP] = lo[nPP] + v;
+						}
+						// same point order as for a single voxel face: p, p+nP, p+nP+nPP, p+nPP for surface up, reversed for down
+						int c1 = (orient>0) ? 1 : 3;
+						int c3 = (orient>0) ? 3 : 1;
+						corner[c1][nP] = lo[nP] + u1;
+						corner[2][nP] = lo[nP] + u1;
+						corner[2][nPP] = lo[nPP] + v1;
+						corner[c3][nPP] = lo[nPP] + v1;
+						for (int c=0;c<4;++c)
+						{
+							unsigned long long node = corner[c][0] + (unsigned long long)corner[c][1]*(numVoxel[0]+1) + corner[c][2]*numNodesXY;
+							boost::unordered_map<unsigned long long, unsigned int>::iterator it = pointIdx.find(node);
+							if (it==pointIdx.end())
+							{
+								it = pointIdx.insert(std::make_pair(node, (unsigned int)slab.m_Nodes.size())).first;
+								slab.m_Nodes.push_back(node);
+							}
+							slab.m_Quads.push_back(it->second);
+						}
 					}
+			}
+		}
+	}
+}
 
-					rpos[0]=pos[0];
-					rpos[1]=pos[1];
-					rpos[2]=0;
+void CSPropDiscMaterial::CreateSurfaceModel(std::vector<double> &coords, std::vector<unsigned int> &quads, bool mergeQuads, unsigned int level, unsigned int numThreads) const
+{
+	coords.clear();
+	quads.clear();
+	if (HasVoxelData()==false)
+		return;
 
-					if (bu) // draw poly for surface up
-					{
-						nP = (n+1)%3;
-						nPP = (n+2)%3;
-						poly->InsertNextCell(4);
-
-						mesh_idx = rpos[0] + rpos[1]*m_Size[0];
-						if (pointIdx[rpos[2]][mesh_idx]<0)
-							pointIdx[rpos[2]][mesh_idx] = (int)points->InsertNextPoint(m_mesh[0][rpos[0]],m_mesh[1][rpos[1]],m_mesh[2][pos[2]+rpos[2]]);
-						poly->InsertCellPoint(pointIdx[rpos[2]][mesh_idx]);
-
-						++rpos[nP];
-						mesh_idx = rpos[0] + rpos[1]*m_Size[0];
-						if (pointIdx[rpos[2]][mesh_idx]<0)
-							pointIdx[rpos[2]][mesh_idx] = (int)points->InsertNextPoint(m_mesh[0][rpos[0]],m_mesh[1][rpos[1]],m_mesh[2][pos[2]+rpos[2]]);
-						poly->InsertCellPoint(pointIdx[rpos[2]][mesh_idx]);
-
-						++rpos[nPP];
-						mesh_idx = rpos[0] + rpos[1]*m_Size[0];
-						if (pointIdx[rpos[2]][mesh_idx]<0)
-							pointIdx[rpos[2]][mesh_idx] = (int)points->InsertNextPoint(m_mesh[0][rpos[0]],m_mesh[1][rpos[1]],m_mesh[2][pos[2]+rpos[2]]);
-						poly->InsertCellPoint(pointIdx[rpos[2]][mesh_idx]);
-
-						--rpos[nP];
-						mesh_idx = rpos[0] + rpos[1]*m_Size[0];
-						if (pointIdx[rpos[2]][mesh_idx]<0)
-							pointIdx[rpos[2]][mesh_idx] = (int)points->InsertNextPoint(m_mesh[0][rpos[0]],m_mesh[1][rpos[1]],m_mesh[2][pos[2]+rpos[2]]);
-						poly->InsertCellPoint(pointIdx[rpos[2]][mesh_idx]);
-					}
-					else if (bd) // draw poly for surface down
-					{
-						nP = (n+1)%3;
-						nPP = (n+2)%3;
-						poly->InsertNextCell(4);
-						mesh_idx = rpos[0] + rpos[1]*m_Size[0];
-						if (pointIdx[rpos[2]][mesh_idx]<0)
-							pointIdx[rpos[2]][mesh_idx] = (int)points->InsertNextPoint(m_mesh[0][rpos[0]],m_mesh[1][rpos[1]],m_mesh[2][pos[2]+rpos[2]]);
-						poly->InsertCellPoint(pointIdx[rpos[2]][mesh_idx]);
-
-						++rpos[nPP];
-						mesh_idx = rpos[0] + rpos[1]*m_Size[0];
-						if (pointIdx[rpos[2]][mesh_idx]<0)
-							pointIdx[rpos[2]][mesh_idx] = (int)points->InsertNextPoint(m_mesh[0][rpos[0]],m_mesh[1][rpos[1]],m_mesh[2][pos[2]+rpos[2]]);
-						poly->InsertCellPoint(pointIdx[rpos[2]][mesh_idx]);
-
-						++rpos[nP];
-						mesh_idx = rpos[0] + rpos[1]*m_Size[0];
-						if (pointIdx[rpos[2]][mesh_idx]<0)
-							pointIdx[rpos[2]][mesh_idx] = (int)points->InsertNextPoint(m_mesh[0][rpos[0]],m_mesh[1][rpos[1]],m_mesh[2][pos[2]+rpos[2]]);
-						poly->InsertCellPoint(pointIdx[rpos[2]][mesh_idx]);
-
-						--rpos[nPP];
-						mesh_idx = rpos[0] + rpos[1]*m_Size[0];
-						if (pointIdx[rpos[2]][mesh_idx]<0)
-							pointIdx[rpos[2]][mesh_idx] = (int)points->InsertNextPoint(m_mesh[0][rpos[0]],m_mesh[1][rpos[1]],m_mesh[2][pos[2]+rpos[2]]);
-						poly->InsertCellPoint(pointIdx[rpos[2]][mesh_idx]);
-					}
-				}
+	unsigned int numVoxel[3];
+	for (int n=0;n<3;++n)
+		numVoxel[n] = ((m_Size[n]-1) + (1u<<level) - 1)>>level;
+	unsigned long long numNodesXY = (unsigned long long)(numVoxel[0]+1)*(numVoxel[1]+1);
+
+	// extract the surface of z-slabs in parallel, the slabs depend on the volume only, so every number of threads gives the same quads
+	unsigned int numSlabs = std::max(1u, std::min(numVoxel[2]/MinSlabLayers, (unsigned int)MaxSlabs));
+	if (numThreads==0)
+		numThreads = boost::thread::hardware_concurrency();
+	numThreads = std::max(1u, std::min(numThreads, numSlabs));
+	std::vector<SurfaceSlab> slabs(numSlabs);
+	for (unsigned int s=0;s<numSlabs;++s)
+	{
+		slabs[s].m_Start = (unsigned int)((unsigned long long)numVoxel[2]*s/numSlabs);
+		slabs[s].m_Stop = (unsigned int)((unsigned long long)numVoxel[2]*(s+1)/numSlabs);
+	}
+	if (numThreads==1)
+		CreateSurfaceSlabs(level, mergeQuads, 0, 1, &slabs);
+	else
+	{
+		boost::thread_group threads;
+		for (unsigned int t=0;t<numThreads;++t)
+			threads.create_thread(boost::bind(&CSPropDiscMaterial::CreateSurfaceSlabs, this, level, mergeQuads, t, numThreads, &slabs));
+		threads.join_all();
+	}
+
+	// merge all slabs, points on the boundary plane of two slabs are shared
+	boost::unordered_map<unsigned long long, unsigned int> boundary, nextBoundary;
+	std::vector<unsigned int> pointIdx;
+	for (unsigned int s=0;s<numSlabs;++s)
+	{
+		const SurfaceSlab &slab = slabs[s];
+		pointIdx.resize(slab.m_Nodes.size());
+		nextBoundary.clear();
+		for (size_t i=0;i<slab.m_Nodes.size();++i)
+		{
+			unsigned long long node = slab.m_Nodes[i];
+			unsigned int z = (unsigned int)(node/numNodesXY);
+			boost::unordered_map<unsigned long long, unsigned int>::iterator it;
+			if ((z==slab.m_Start) && ((it=boundary.find(node))!=boundary.end()))
+				pointIdx[i] = it->second;
+			else
+			{
+				unsigned int xy = (unsigned int)(node%numNodesXY);
+				pointIdx[i] = (unsigned int)(coords.size()/3);
+				coords.push_back(m_mesh[0][GetCoarseLine(0, level, xy%(numVoxel[0]+1))]);
+				coords.push_back(m_mesh[1][GetCoarseLine(1, level, xy/(numVoxel[0]+1))]);
+				coords.push_back(m_mesh[2][GetCoarseLine(2, level, z)]);
 			}
+			if (z==slab.m_Stop)
+				nextBoundary[node] = pointIdx[i];
+		}
+		boundary.swap(nextBoundary);
+		for (size_t q=0;q<slab.m_Quads.size();++q)
+			quads.push_back(pointIdx[slab.m_Quads[q]]);
+	}
+}
+
+vtkPolyData* CSPropDiscMaterial::CreatePolyDataModel(bool mergeQuads, unsigned int level, unsigned int numThreads) const
+{
+	std::vector<double> coords;
+	std::vector<unsigned int> quads;
+	CreateSurfaceModel(coords, quads, mergeQuads, level, numThreads);
+
+	vtkPolyData* polydata = vtkPolyData::New();
+	vtkPoints *points = vtkPoints::New();
+	for (size_t i=0;i<coords.size();i+=3)
+		points->InsertNextPoint(coords[i], coords[i+1], coords[i+2]);
+	vtkCellArray *poly = vtkCellArray::New();
+	for (size_t q=0;q<quads.size();q+=4)
+	{
+		vtkIdType ids[4];
+		for (int c=0;c<4;++c)
+			ids[c] = quads[q+c];
+		poly->InsertNextCell(4, ids);
 	}
-	delete[] pointIdx[0];
-	delete[] pointIdx[1];
 
 	polydata->SetPoints(points);
 	points->Delete();
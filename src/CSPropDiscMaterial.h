@@ -17,12 +17,19 @@
 
 #pragma once
 
+#include <boost/shared_ptr.hpp>
+
 #include "CSProperties.h"
 #include "CSPropMaterial.h"
 
 typedef unsigned char uint8;
 
 class vtkPolyData;
+class CSRectGrid;
+class CSHDF5BrickCache;
+class CSVoxelBrickVolume;
+class CSVoxelPyramid;
+struct CSDiscMaterialData;
 
 //! Continuous Structure Discrete Material Property
 /*!
@@ -45,11 +52,20 @@ public:
 
 	virtual double GetDensityWeighted(const double* coords);
 
+	//! Get all weighted material values at once, the voxel position is searched only once
+	virtual void GetWeightedValues(const double* coords, WeightedValues &values);
+	virtual void GetWeightedValues(const double* coords, unsigned int numCoords, WeightedValues* values);
+
 	//! Set true if database index 0 is used as background material (default), or false if CSPropMaterial should be used as index 0
 	virtual void SetUseDataBaseForBackground(bool val) {m_DB_Background=val;}
 
-	CSTransform* GetTransform() {return m_Transform;}
+	//! Get the CSTransform if it exists already or create a new one
+	CSTransform* GetTransform();
+	//! Get the CSTransform of this property, NULL if it has none. In contrast to GetTransform() no new transformation is created.
+	const CSTransform* GetTransformPtr() const {return m_Transform;}
 
+	//! Set the scaling of the voxel mesh
+	void SetScale(double val) {m_Scale=val;}
 	double GetScale() {return m_Scale;}
 
 	virtual void Init();
@@ -57,23 +73,195 @@ public:
 	virtual bool Write2XML(TiXmlNode& root, bool parameterised=true, bool sparse=false);
 	virtual bool ReadFromXML(TiXmlNode &root);
 
+	//! Read a discrete material file, the voxel data is shared with all other properties that read the same (unmodified) file with the same storage settings
 	bool ReadHDF5(std::string filename);
 
+	//! Check if this property shares its voxel data with the given property
+	bool SharesData(const CSPropDiscMaterial* other) const {return m_Data && (m_Data==other->m_Data);}
+	//! Get the number of voxel data sets currently registered for sharing
+	static unsigned int GetNumberOfSharedData();
+
+	//! Keep the voxel data in the file and read it on demand into a cache of cacheSize MB instead of reading it completely, takes effect at the next ReadHDF5
+	void SetOutOfCore(bool val, unsigned int cacheSize=64) {m_OutOfCore=val; m_CacheSize=cacheSize;}
+	bool GetOutOfCore() const {return m_OutOfCore;}
+
+	//! Keep the voxel data in memory as compressed bricks, uniform bricks are stored as a single value, takes effect at the next ReadHDF5. Out-of-core access takes precedence.
+	void SetCompressed(bool val) {m_Compressed=val;}
+	bool GetCompressed() const {return m_Compressed;}
+
+	//! Set the number of threads used to decompress the chunks of the voxel data while reading it completely, 0 to use the number of cores (default), 1 to read it by a single H5Dread
+	void SetReadThreads(unsigned int val) {m_ReadThreads=val;}
+	unsigned int GetReadThreads() const {return m_ReadThreads;}
+
+	//! Set the number of downsampled volumes (2x, 4x and 8x voxel per direction, at most 3) built after reading the voxel data, 0 to disable (default), takes effect at the next ReadHDF5
+	void SetPyramidLevels(unsigned int levels) {m_PyramidLevels=levels;}
+	unsigned int GetPyramidLevels() const {return m_PyramidLevels;}
+
+	//! Get the number of coarse voxel (x,y,z) of a pyramid level, level 0 is the full resolution. \return false if the level was not built
+	bool GetPyramidSize(unsigned int level, unsigned int size[3]) const;
+	//! Get the database position of a coarse voxel of a pyramid level, -1 for background material
+	/*!
+	 The coarse voxel pos at level l covers the voxel pos*2^l to (pos+1)*2^l-1 and holds the material index of the majority of these voxel.
+	 mixed is set true if the covered voxel have different material indices, only then a finer level has to be queried.
+	 */
+	int GetPyramidDBPos(unsigned int level, const unsigned int pos[3], bool &mixed) const;
+
+	//! Map grid lines in direction ny to voxel indices in this direction
+	/*!
+	 This requires a cartesian coordinate input type and no rotation or shear by the transformation, since only then the voxel index in one direction is independent of the other directions.
+	 Sorted grid lines are mapped by a single sweep through the voxel mesh.
+	 \param index Array of numLines voxel indices, (unsigned int)-1 for lines outside the voxel mesh
+	 \return false if the grid lines can not be mapped independently
+	 */
+	bool MapGridLines(int ny, const double* lines, unsigned int numLines, unsigned int* index) const;
+
+	//! Get the database position of all sample points of a grid in one pass
+	/*!
+	 The sample points are all combinations of the coordinates in lines[0..2], given in the coordinate system cs.
+	 For a cartesian grid and no rotation or shear by the transformation, the voxel indices are mapped once per line (see MapGridLines) and gathered for all points, else every point is transformed.
+	 \param dbPos Array of numLines[0]*numLines[1]*numLines[2] database positions ordered x (or r) fastest, -1 for the background material
+	 \return false if no voxel data is available
+	 */
+	bool GetDBPositions(const double* const lines[3], const unsigned int numLines[3], CoordinateSystem cs, int* dbPos);
+	//! Get the database position of all cell centers (or all grid points) of a rectilinear grid, see GetDBPositions
+	bool GetDBPositions(CSRectGrid* grid, int* dbPos, bool cellCenters=true);
+
+	//! Detect if the voxel mesh coincides with a cartesian grid, every voxel mesh line has to be a grid line, at a constant number of grid cells per voxel
+	/*!
+	 The scale and a transformation without rotation or shear are taken into account, this has to be called again if either is changed.
+	 If the grid is aligned, GetAlignedDBPos and GetDBPositions for this grid use integer index offsets only.
+	 \return true if the grid is aligned
+	 */
+	bool SetAlignedGrid(CSRectGrid* grid);
+	//! Get the database position of a cell (or grid line) index of the aligned grid, see SetAlignedGrid. \return -1 for the background material or if no grid is aligned
+	int GetAlignedDBPos(const unsigned int pos[3], bool cellCenter=true) const;
+
+	//! Get the number of materials in the database
+	unsigned int GetDBSize() const {return m_DB_size;}
+	//! Get the material values of a database position. The background material at coords (in the coordinate input type) is used for dbPos<0 or values not in the database
+	void GetDataBaseValues(int dbPos, const double* coords, WeightedValues &values) {SetWeightedValues(coords, dbPos, values);}
+
 	virtual void ShowPropertyStatus(std::ostream& stream);
 
 	//! Create a vtkPolyData surface that separates the discrete material from background material
 	virtual vtkPolyData* CreatePolyDataModel() const;
+	//! Create the surface model in parallel z-slabs
+	/*!
+	 \param mergeQuads Merge coplanar neighboring faces into larger quads
+	 \param level Level of detail, coarse voxel of 2^level voxel in each direction are used, represented by their pyramid majority if built or else their center voxel
+	 \param numThreads Number of threads, 0 to use the number of cores. The result does not depend on the number of threads.
+	 */
+	vtkPolyData* CreatePolyDataModel(bool mergeQuads, unsigned int level=0, unsigned int numThreads=0) const;
+	//! Create the surface model as plain points and quads, see CreatePolyDataModel
+	/*!
+	 \param coords Coordinates of all points, x, y and z per point
+	 \param quads Four point indices per quad, counter-clockwise seen from the background material
+	 */
+	void CreateSurfaceModel(std::vector<double> &coords, std::vector<unsigned int> &quads, bool mergeQuads=false, unsigned int level=0, unsigned int numThreads=0) const;
 
 protected:
 	unsigned int GetWeightingPos(const double* coords);
+	//! Get the voxel position of a local coordinate (transformed and scaled), optionally searching the neighborhood of the previous voxel indices in hint first
+	unsigned int GetLocalWeightingPos(const double* coords, unsigned int* hint=NULL) const;
 	int GetDBPos(const double* coords);
+	//! Check if voxel data is available, either in memory, compressed or out-of-core
+	bool HasVoxelData() const {return (m_Disc_Ind!=NULL) || (m_BrickVolume!=NULL) || (m_BrickCache!=NULL);}
+	//! Get the material index of a voxel position
+	uint8 GetVoxelIndex(unsigned int pos) const;
+	//! Get the database position of a voxel position, -1 for background material
+	int GetVoxelDBPos(unsigned int pos) const;
+	//! Set all values from the database position pos, the values of the background material are used if pos<0 or a value is not in the database
+	void SetWeightedValues(const double* coords, int pos, WeightedValues &values);
+
+	//! Release the voxel data, it is deleted as soon as no other property shares it
+	void ReleaseData();
+	//! Take the ownership of the voxel data, register it for sharing if key is not empty
+	void StoreData(const std::string &key);
+	//! Use the voxel data registered for key. \return false if no data is registered
+	bool AttachData(const std::string &key);
+	//! Get the key of a file for sharing its voxel data (device and inode, modification time, size and storage settings), empty if the file does not exist
+	std::string GetDataKey(std::string filename) const;
+
+	//! Read all data from an open file
+	bool ReadHDF5(long long file_id, std::string filename);
+	//! Read the voxel data of the open dataset into m_Disc_Ind
+	bool ReadIndex(long long dataset, unsigned int numCells);
+	//! Read the voxel data of the open dataset slab by slab into the compressed brick volume
+	bool ReadCompressedIndex(long long dataset, unsigned int numCells);
+
+	//! Build the pyramid of downsampled volumes from the voxel data
+	void BuildPyramid();
+
+	//! Map lines of a cartesian coordinate in direction ny to voxel indices, see MapGridLines
+	bool MapLines(int ny, const double* lines, unsigned int numLines, unsigned int* index) const;
+
+	//! Gather the database positions through per direction voxel index maps
+	void GatherDBPositions(const std::vector<unsigned int>* index, const unsigned int numLines[3], int* dbPos) const;
+
+	//! Find the integer mapping of local (transformed and scaled) grid lines in direction ny to the voxel mesh
+	bool AlignLines(int ny, const double* lines, unsigned int numLines);
+	//! Get the voxel index of a grid cell (or grid line) index for a given grid offset and grid cells per voxel
+	unsigned int GetAlignedIndex(int ny, unsigned int pos, int offset, unsigned int ratio, bool cellCenter) const;
+	unsigned int GetAlignedIndex(int ny, unsigned int pos, bool cellCenter) const {return GetAlignedIndex(ny, pos, m_AlignedOffset[ny], m_AlignedRatio[ny], cellCenter);}
+
+	///Minimum number of (coarse) voxel layers per surface slab, quads are not merged across slabs
+	static const unsigned int MinSlabLayers = 8;
+	///Maximum number of surface slabs
+	static const unsigned int MaxSlabs = 256;
+	//! Surface of a z-slab of (coarse) voxel, created by CreateSurfaceSlabs
+	struct SurfaceSlab
+	{
+		///First and last+1 voxel layer
+		unsigned int m_Start;
+		unsigned int m_Stop;
+		///Lattice node of each point (x + y*numNodesX + z*numNodesX*numNodesY) and 4 point indices per quad
+		std::vector<unsigned long long> m_Nodes;
+		std::vector<unsigned int> m_Quads;
+	};
+	//! Create the surface of every step-th slab, starting with slab first
+	void CreateSurfaceSlabs(unsigned int level, bool mergeQuads, unsigned int first, unsigned int step, std::vector<SurfaceSlab>* slabs) const;
+	//! Check if a coarse voxel of the given level is filled with non-background material, false outside the volume. The pyramid majority is used if available.
+	bool IsCoarseVoxelFilled(unsigned int level, const unsigned int numVoxel[3], const int pos[3]) const;
+	//! Get the mesh line index of a coarse mesh line
+	unsigned int GetCoarseLine(int ny, unsigned int level, unsigned int line) const;
+
+	//! Detect a uniform voxel mesh for a direct index lookup, has to be called after the mesh was read
+	void UpdateMeshIndex();
+	//! Find the voxel index in direction ny of a local (unscaled) coordinate. \return (unsigned int)-1 if outside
+	unsigned int GetMeshIndex(int ny, double coord) const;
+	//! Find the voxel index in direction ny, searching the neighborhood of a previous index first
+	unsigned int GetMeshIndex(int ny, double coord, unsigned int hint) const;
 
 	int m_FileType;
 	std::string m_Filename;
+	///Owner of the voxel data below, which may be shared with other properties
+	boost::shared_ptr<CSDiscMaterialData> m_Data;
 	unsigned int m_Size[3];
 	unsigned int m_DB_size;
 	uint8* m_Disc_Ind;
+	///Out-of-core voxel data, used instead of m_Disc_Ind if enabled
+	CSHDF5BrickCache* m_BrickCache;
+	bool m_OutOfCore;
+	///Size of the out-of-core cache in MB
+	unsigned int m_CacheSize;
+	///Compressed voxel data, used instead of m_Disc_Ind if enabled
+	CSVoxelBrickVolume* m_BrickVolume;
+	bool m_Compressed;
+	///Number of threads to decompress the voxel data, see SetReadThreads
+	unsigned int m_ReadThreads;
+	///Downsampled volumes, built if m_PyramidLevels>0
+	CSVoxelPyramid* m_Pyramid;
+	unsigned int m_PyramidLevels;
 	float *m_mesh[3];
+	///Flag for each direction if the mesh is uniform (see UpdateMeshIndex)
+	bool m_MeshUniform[3];
+	///Inverse mesh spacing of a uniform mesh
+	double m_MeshInvDelta[3];
+	///Grid aligned with the voxel mesh (see SetAlignedGrid), its number of lines, the grid line index of the first voxel mesh line and the grid cells per voxel
+	CSRectGrid* m_AlignedGrid;
+	unsigned int m_AlignedNumLines[3];
+	int m_AlignedOffset[3];
+	unsigned int m_AlignedRatio[3];
 	float *m_Disc_epsR;
 	float *m_Disc_kappa;
 	float *m_Disc_mueR;
@@ -83,6 +271,7 @@ protected:
 	bool m_DB_Background;
 	CSTransform* m_Transform;
 
-	void* ReadDataSet(std::string filename, std::string d_name, int type_id, int &rank, unsigned int &size, bool debug=false);
+	//! Read a complete dataset from an open file
+	void* ReadDataSet(long long file_id, std::string d_name, long long type_id, int &rank, unsigned int &size, bool debug=false);
 };
 
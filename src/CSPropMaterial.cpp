@@ -60,6 +60,12 @@ double CSPropMaterial::GetWeight(ParameterScalar *ps, int ny, const double* coor
 double CSPropMaterial::GetWeight(ParameterScalar &ps, const double* coords)
 {
 	double paraVal[7];
+	GetWeightParameter(coords, paraVal);
+	return EvaluateWeight(ps, paraVal);
+}
+
+void CSPropMaterial::GetWeightParameter(const double* coords, double paraVal[7]) const
+{
 	if (coordInputType==1)
 	{
 		double rho = coords[0];
@@ -82,7 +88,10 @@ double CSPropMaterial::GetWeight(ParameterScalar &ps, const double* coords)
 		paraVal[5] = atan2(coords[1],coords[0]); //alpha
 		paraVal[6] = asin(1)-atan(coords[2]/paraVal[3]); //theta
 	}
+}
 
+double CSPropMaterial::EvaluateWeight(ParameterScalar &ps, double paraVal[7])
+{
 	int EC=0;
 	double value = ps.GetEvaluated(paraVal,EC);
 	if (EC)
@@ -92,6 +101,35 @@ double CSPropMaterial::GetWeight(ParameterScalar &ps, const double* coords)
 	return value;
 }
 
+void CSPropMaterial::GetWeightedValues(const double* coords, WeightedValues &values)
+{
+	// the weighting parameter are calculated only once for all values
+	double paraVal[7];
+	GetWeightParameter(coords, paraVal);
+	int numDir = bIsotropy ? 1 : 3;
+	for (int n=0;n<numDir;++n)
+	{
+		values.Epsilon[n] = EvaluateWeight(WeightEpsilon[n],paraVal)*Epsilon[n].GetValue();
+		values.Mue[n] = EvaluateWeight(WeightMue[n],paraVal)*Mue[n].GetValue();
+		values.Kappa[n] = EvaluateWeight(WeightKappa[n],paraVal)*Kappa[n].GetValue();
+		values.Sigma[n] = EvaluateWeight(WeightSigma[n],paraVal)*Sigma[n].GetValue();
+	}
+	for (int n=numDir;n<3;++n)
+	{
+		values.Epsilon[n] = values.Epsilon[0];
+		values.Mue[n] = values.Mue[0];
+		values.Kappa[n] = values.Kappa[0];
+		values.Sigma[n] = values.Sigma[0];
+	}
+	values.Density = EvaluateWeight(WeightDensity,paraVal)*Density.GetValue();
+}
+
+void CSPropMaterial::GetWeightedValues(const double* coords, unsigned int numCoords, WeightedValues* values)
+{
+	for (unsigned int i=0;i<numCoords;++i)
+		GetWeightedValues(&coords[3*i], values[i]);
+}
+
 void CSPropMaterial::Init()
 {
 	bIsotropy = true;
@@ -116,7 +154,9 @@ void CSPropMaterial::Init()
 		WeightSigma[n].SetParameterSet(coordParaSet);
 	}
 	Density.SetValue(0);
+	Density.SetParameterSet(clParaSet);
 	WeightDensity.SetValue(1.0);
+	WeightDensity.SetParameterSet(coordParaSet);
 	FillColor.a=EdgeColor.a=123;
 	bVisisble=true;
 }
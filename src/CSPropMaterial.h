@@ -81,6 +81,21 @@ public:
 	const std::string GetDensityWeightFunction() {return WeightDensity.GetString();}
 	virtual double GetDensityWeighted(const double* coords)	{return GetWeight(WeightDensity,coords)*GetDensity();}
 
+	//! All weighted material values at a coordinate \sa GetWeightedValues
+	struct WeightedValues
+	{
+		double Epsilon[3];
+		double Mue[3];
+		double Kappa[3];
+		double Sigma[3];
+		double Density;
+	};
+
+	//! Get all weighted material values for all three directions at once, the same as calling all Get...Weighted methods
+	virtual void GetWeightedValues(const double* coords, WeightedValues &values);
+	//! Get all weighted material values for numCoords coordinates (x1,y1,z1,x2,y2,z2,...)
+	virtual void GetWeightedValues(const double* coords, unsigned int numCoords, WeightedValues* values);
+
 	void SetIsotropy(bool val) {bIsotropy=val;}
 	bool GetIsotropy() {return bIsotropy;}
 
@@ -107,5 +122,9 @@ protected:
 
 	double GetWeight(ParameterScalar &ps, const double* coords);
 	double GetWeight(ParameterScalar *ps, int ny, const double* coords);
+	//! Calculate the parameter values (x,y,z,rho,r,alpha,theta) of a weighting function at the given coordinate
+	void GetWeightParameter(const double* coords, double paraVal[7]) const;
+	//! Evaluate a weighting function for the parameter values calculated by GetWeightParameter
+	double EvaluateWeight(ParameterScalar &ps, double paraVal[7]);
 	bool bIsotropy;
 };
@@ -51,6 +51,7 @@ CSTransform::CSTransform(CSTransform* transform)
 		m_TMatrix[n] = transform->m_TMatrix[n];
 		m_Inv_TMatrix[n] = transform->m_Inv_TMatrix[n];
 	}
+	m_MatrixType = transform->m_MatrixType;
 }
 
 CSTransform::CSTransform(ParameterSet* paraSet)
@@ -71,9 +72,10 @@ void CSTransform::Reset()
 	m_TransformArguments.clear();
 	MakeUnitMatrix(m_TMatrix);
 	MakeUnitMatrix(m_Inv_TMatrix);
+	m_MatrixType = IDENTITY_MATRIX;
 }
 
-bool CSTransform::HasTransform()
+bool CSTransform::HasTransform() const
 {
 	return (m_TransformList.size()>0);
 }
@@ -96,36 +98,124 @@ void CSTransform::UpdateInverse()
 {
 	// use vtk to do the matrix inversion
 	vtkMatrix4x4::Invert(m_TMatrix, m_Inv_TMatrix);
+	UpdateMatrixType();
 }
 
-double* CSTransform::Transform(const double inCoords[3], double outCoords[3]) const
+CSTransform::MatrixType CSTransform::ClassifyMatrix(const double matrix[16])
 {
-	double coords[4] = {inCoords[0],inCoords[1],inCoords[2],1};
+	bool diagonal = true;
+	bool unit = true;
+	bool translate = false;
 	for (int m=0;m<3;++m)
 	{
-		outCoords[m] = 0;
-		for (int n=0;n<4;++n)
-		{
-			outCoords[m] +=  m_TMatrix[4*m+n]*coords[n];
-		}
+		for (int n=0;n<3;++n)
+			if ((m!=n) && (matrix[4*m+n]!=0))
+				diagonal = false;
+		if (matrix[4*m+m]!=1)
+			unit = false;
+		if (matrix[4*m+3]!=0)
+			translate = true;
 	}
-	return outCoords;
+	if (!diagonal)
+		return GENERAL_MATRIX;
+	if (!unit)
+		return SCALE_MATRIX;
+	if (translate)
+		return TRANSLATION_MATRIX;
+	return IDENTITY_MATRIX;
 }
 
-double* CSTransform::InvertTransform(const double inCoords[3], double outCoords[3]) const
+void CSTransform::UpdateMatrixType()
 {
-	double coords[4] = {inCoords[0],inCoords[1],inCoords[2],1};
-	for (int m=0;m<3;++m)
+	// use the more general type of both matrices in case the numerical inversion is not exact
+	m_MatrixType = std::max(ClassifyMatrix(m_TMatrix), ClassifyMatrix(m_Inv_TMatrix));
+}
+
+void CSTransform::TransformCoords(const double matrix[16], MatrixType type, size_t num, const double* const inCoords[3], double* const outCoords[3])
+{
+	const double* x = inCoords[0];
+	const double* y = inCoords[1];
+	const double* z = inCoords[2];
+	double* out_x = outCoords[0];
+	double* out_y = outCoords[1];
+	double* out_z = outCoords[2];
+	// all kernels give the same result as the full matrix multiplication
+	switch (type)
 	{
-		outCoords[m] = 0;
-		for (int n=0;n<4;++n)
+	case IDENTITY_MATRIX:
+		for (size_t i=0;i<num;++i)
+		{
+			out_x[i] = x[i];
+			out_y[i] = y[i];
+			out_z[i] = z[i];
+		}
+		break;
+	case TRANSLATION_MATRIX:
+	{
+		const double t[3] = {matrix[3], matrix[7], matrix[11]};
+		for (size_t i=0;i<num;++i)
 		{
-			outCoords[m] +=  m_Inv_TMatrix[4*m+n]*coords[n];
+			out_x[i] = x[i] + t[0];
+			out_y[i] = y[i] + t[1];
+			out_z[i] = z[i] + t[2];
 		}
+		break;
 	}
+	case SCALE_MATRIX:
+	{
+		const double s[3] = {matrix[0], matrix[5], matrix[10]};
+		const double t[3] = {matrix[3], matrix[7], matrix[11]};
+		for (size_t i=0;i<num;++i)
+		{
+			out_x[i] = s[0]*x[i] + t[0];
+			out_y[i] = s[1]*y[i] + t[1];
+			out_z[i] = s[2]*z[i] + t[2];
+		}
+		break;
+	}
+	default:
+	{
+		double M[12];
+		for (int n=0;n<12;++n)
+			M[n] = matrix[n];
+		for (size_t i=0;i<num;++i)
+		{
+			double px=x[i], py=y[i], pz=z[i];
+			out_x[i] = M[0]*px + M[1]*py + M[2]*pz  + M[3];
+			out_y[i] = M[4]*px + M[5]*py + M[6]*pz  + M[7];
+			out_z[i] = M[8]*px + M[9]*py + M[10]*pz + M[11];
+		}
+		break;
+	}
+	}
+}
+
+double* CSTransform::Transform(const double inCoords[3], double outCoords[3]) const
+{
+	const double* const in[3] = {&inCoords[0], &inCoords[1], &inCoords[2]};
+	double* const out[3] = {&outCoords[0], &outCoords[1], &outCoords[2]};
+	TransformCoords(m_TMatrix, m_MatrixType, 1, in, out);
+	return outCoords;
+}
+
+double* CSTransform::InvertTransform(const double inCoords[3], double outCoords[3]) const
+{
+	const double* const in[3] = {&inCoords[0], &inCoords[1], &inCoords[2]};
+	double* const out[3] = {&outCoords[0], &outCoords[1], &outCoords[2]};
+	TransformCoords(m_Inv_TMatrix, m_MatrixType, 1, in, out);
 	return outCoords;
 }
 
+void CSTransform::Transform(size_t num, const double* const inCoords[3], double* const outCoords[3]) const
+{
+	TransformCoords(m_TMatrix, m_MatrixType, num, inCoords, outCoords);
+}
+
+void CSTransform::InvertTransform(size_t num, const double* const inCoords[3], double* const outCoords[3]) const
+{
+	TransformCoords(m_Inv_TMatrix, m_MatrixType, num, inCoords, outCoords);
+}
+
 void CSTransform::SetMatrix(const double matrix[16], bool concatenate)
 {
 	ApplyMatrix(matrix,concatenate);
@@ -42,12 +42,29 @@ public:
 		SCALE, SCALE3, TRANSLATE, ROTATE_ORIGIN, ROTATE_X, ROTATE_Y, ROTATE_Z, MATRIX
 	}; //Keep this in sync with GetNameByType and GetTypeByName and TransformByType methods!!!
 
+	//! Classification of the transformation matrix, used to select a cheaper transformation kernel
+	enum MatrixType
+	{
+		IDENTITY_MATRIX, TRANSLATION_MATRIX, SCALE_MATRIX, GENERAL_MATRIX
+	};
+
 	double* Transform(const double inCoords[3], double outCoords[3]) const;
 	double* InvertTransform(const double inCoords[3], double outCoords[3]) const;
 
+	//! Transform num coordinates given as separate x-,y- and z-arrays. The in- and output arrays may be identical.
+	void Transform(size_t num, const double* const inCoords[3], double* const outCoords[3]) const;
+	//! Invert transform num coordinates given as separate x-,y- and z-arrays. The in- and output arrays may be identical.
+	void InvertTransform(size_t num, const double* const inCoords[3], double* const outCoords[3]) const;
+
+	//! Get the type of the transformation matrix, the inverse matrix is always of the same type. A SCALE_MATRIX may contain a translation but no rotation.
+	MatrixType GetMatrixType() const {return m_MatrixType;}
+
 	void Invert();
 
-	double* GetMatrix() {return m_TMatrix;}
+	//! Get the transformation matrix, use SetMatrix to modify it
+	const double* GetMatrix() const {return m_TMatrix;}
+	//! Get the inverse transformation matrix as used by InvertTransform
+	const double* GetInverseMatrix() const {return m_Inv_TMatrix;}
 
 	//! Apply a matrix directly
 	void SetMatrix(const double matrix[16], bool concatenate=true);
@@ -86,7 +103,7 @@ public:
 	void Reset();
 
 	//! Check if this CSTransform has any transformations
-	bool HasTransform();
+	bool HasTransform() const;
 
 	//! All subsequent operations will be occur before the previous operations (not the default).
 	void SetPreMultiply() {m_PostMultiply=false;}
@@ -119,8 +136,15 @@ protected:
 	double m_TMatrix[16];
 	//inverse transform matrix
 	double m_Inv_TMatrix[16];
+	//type of both matrices
+	MatrixType m_MatrixType;
 
 	void UpdateInverse();
+	void UpdateMatrixType();
+	static MatrixType ClassifyMatrix(const double matrix[16]);
+
+	//! Apply the given matrix of the given type to num coordinates
+	static void TransformCoords(const double matrix[16], MatrixType type, size_t num, const double* const inCoords[3], double* const outCoords[3]);
 
 	bool m_PostMultiply;
 	bool m_AngleRadian;
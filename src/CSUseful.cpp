@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <sstream>
 #include <iostream>
+#include <sys/stat.h>
 
 std::string ConvertInt(int number)
 {
@@ -106,7 +107,7 @@ std::string CombineVector2String(std::vector<double> values, const char delimite
 	return ss.str();
 }
 
-std::string CombineArray2String(double* values, unsigned int numVal, const char delimiter, int accurarcy)
+std::string CombineArray2String(const double* values, unsigned int numVal, const char delimiter, int accurarcy)
 {
 	std::stringstream ss;
 	ss.precision( accurarcy );
@@ -118,7 +119,7 @@ std::string CombineArray2String(double* values, unsigned int numVal, const char
 	return ss.str();
 }
 
-std::string CombineArray2String(float* values, unsigned int numVal, const char delimiter, int accurarcy)
+std::string CombineArray2String(const float* values, unsigned int numVal, const char delimiter, int accurarcy)
 {
 	std::stringstream ss;
 	ss.precision( accurarcy );
@@ -130,7 +131,7 @@ std::string CombineArray2String(float* values, unsigned int numVal, const char d
 	return ss.str();
 }
 
-std::string CombineArray2String(int* values, unsigned int numVal, const char delimiter, int accurarcy)
+std::string CombineArray2String(const int* values, unsigned int numVal, const char delimiter, int accurarcy)
 {
 	std::stringstream ss;
 	ss.precision( accurarcy );
@@ -159,6 +160,42 @@ std::vector<int> SplitString2Int(std::string str, const char delimiter)
 	return values;
 }
 
+// modification time in ns since the epoch
+static long long ModificationTime(const struct stat &fileStat)
+{
+#if defined(WIN32)
+	return (long long)fileStat.st_mtime*1000000000LL;
+#elif defined(__APPLE__)
+	return (long long)fileStat.st_mtimespec.tv_sec*1000000000LL + fileStat.st_mtimespec.tv_nsec;
+#else
+	return (long long)fileStat.st_mtim.tv_sec*1000000000LL + fileStat.st_mtim.tv_nsec;
+#endif
+}
+
+long long GetFileModificationTime(const std::string &filename)
+{
+	struct stat fileStat;
+	if (stat(filename.c_str(), &fileStat)!=0)
+		return -1;
+	return ModificationTime(fileStat);
+}
+
+std::string GetFileIdentity(const std::string &filename)
+{
+	struct stat fileStat;
+	if (stat(filename.c_str(), &fileStat)!=0)
+		return std::string();
+	std::stringstream key;
+#if !defined(WIN32)
+	// identify the file itself, it may be given by different paths
+	key << (unsigned long long)fileStat.st_dev << ":" << (unsigned long long)fileStat.st_ino;
+#else
+	key << filename;
+#endif
+	key << "|" << ModificationTime(fileStat) << "|" << (long long)fileStat.st_size;
+	return key.str();
+}
+
 CSDebug::CSDebug()
 {
 	m_level = 0;
@@ -16,12 +16,18 @@ double CSXCAD_EXPORT String2Double(std::string number, bool &ok, int accurarcy=1
 std::vector<double> CSXCAD_EXPORT SplitString2Double(std::string str, const char delimiter);
 std::vector<std::string> CSXCAD_EXPORT SplitString2Vector(std::string str, const char delimiter);
 std::string CSXCAD_EXPORT CombineVector2String(std::vector<double> values, const char delimiter, int accurarcy=15);
-std::string CSXCAD_EXPORT CombineArray2String(double* values, unsigned int numVal, const char delimiter, int accurarcy=15);
-std::string CSXCAD_EXPORT CombineArray2String(float* values, unsigned int numVal, const char delimiter, int accurarcy=15);
-std::string CSXCAD_EXPORT CombineArray2String(int* values, unsigned int numVal, const char delimiter, int accurarcy=15);
+std::string CSXCAD_EXPORT CombineArray2String(const double* values, unsigned int numVal, const char delimiter, int accurarcy=15);
+std::string CSXCAD_EXPORT CombineArray2String(const float* values, unsigned int numVal, const char delimiter, int accurarcy=15);
+std::string CSXCAD_EXPORT CombineArray2String(const int* values, unsigned int numVal, const char delimiter, int accurarcy=15);
 
 std::vector<int> CSXCAD_EXPORT SplitString2Int(std::string str, const char delimiter);
 
+//! Get the modification time of a file in ns since the epoch (in s resolution on Windows), -1 if the file does not exist
+long long CSXCAD_EXPORT GetFileModificationTime(const std::string &filename);
+
+//! Get a key identifying a file and its modification state (device and inode, modification time in ns and size), empty if the file does not exist
+std::string CSXCAD_EXPORT GetFileIdentity(const std::string &filename);
+
 class CSXCAD_EXPORT CSDebug
 {
 public:
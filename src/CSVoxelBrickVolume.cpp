@@ -0,0 +1,158 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <algorithm>
+
+#include "CSVoxelBrickVolume.h"
+
+const unsigned int CSVoxelBrickVolume::BrickSize;
+
+CSVoxelBrickVolume::CSVoxelBrickVolume()
+{
+	for (int n=0;n<3;++n)
+		m_Size[n] = m_NumBricks[n] = 0;
+}
+
+CSVoxelBrickVolume::~CSVoxelBrickVolume()
+{
+}
+
+void CSVoxelBrickVolume::Create(const unsigned int size[3])
+{
+	Clear();
+	for (int n=0;n<3;++n)
+	{
+		m_Size[n] = size[n];
+		m_NumBricks[n] = (size[n]+BrickSize-1)/BrickSize;
+	}
+	BrickInfo empty;
+	empty.m_Offset = 0;
+	empty.m_Bits = 0;
+	empty.m_Value = 0;
+	m_Bricks.assign((size_t)m_NumBricks[0]*m_NumBricks[1]*m_NumBricks[2], empty);
+}
+
+void CSVoxelBrickVolume::Create(const unsigned int size[3], const unsigned char* data)
+{
+	Create(size);
+	size_t slabSize = (size_t)size[0]*size[1]*BrickSize;
+	for (unsigned int s=0;s<m_NumBricks[2];++s)
+		SetSlab(s, data+s*slabSize);
+}
+
+void CSVoxelBrickVolume::Clear()
+{
+	for (int n=0;n<3;++n)
+		m_Size[n] = m_NumBricks[n] = 0;
+	m_Bricks.clear();
+	m_Data.clear();
+}
+
+void CSVoxelBrickVolume::SetSlab(unsigned int slab, const unsigned char* data)
+{
+	if (slab>=m_NumBricks[2])
+		return;
+	const unsigned int brickVoxel = BrickSize*BrickSize*BrickSize;
+	unsigned char voxel[brickVoxel];
+	unsigned char valid[brickVoxel];
+	unsigned int numZ = std::min(BrickSize, m_Size[2]-slab*BrickSize);
+	for (unsigned int by=0;by<m_NumBricks[1];++by)
+		for (unsigned int bx=0;bx<m_NumBricks[0];++bx)
+		{
+			unsigned int numX = std::min(BrickSize, m_Size[0]-bx*BrickSize);
+			unsigned int numY = std::min(BrickSize, m_Size[1]-by*BrickSize);
+			memset(voxel, 0, brickVoxel);
+			memset(valid, 0, brickVoxel);
+			for (unsigned int z=0;z<numZ;++z)
+				for (unsigned int y=0;y<numY;++y)
+				{
+					const unsigned char* line = data + (size_t)bx*BrickSize + ((size_t)by*BrickSize+y)*m_Size[0] + (size_t)z*m_Size[0]*m_Size[1];
+					memcpy(&voxel[y*BrickSize+z*BrickSize*BrickSize], line, numX);
+					memset(&valid[y*BrickSize+z*BrickSize*BrickSize], 1, numX);
+				}
+			SetBrick(bx + by*m_NumBricks[0] + slab*m_NumBricks[0]*m_NumBricks[1], voxel, valid);
+		}
+}
+
+void CSVoxelBrickVolume::SetBrick(unsigned int brick, const unsigned char* voxel, const unsigned char* valid)
+{
+	const unsigned int brickVoxel = BrickSize*BrickSize*BrickSize;
+	// collect all values inside the volume, the padding uses the first palette entry
+	int paletteIndex[256];
+	for (int n=0;n<256;++n)
+		paletteIndex[n] = -1;
+	unsigned char palette[256];
+	unsigned int numValues = 0;
+	for (unsigned int i=0;i<brickVoxel;++i)
+		if (valid[i] && (paletteIndex[voxel[i]]<0))
+		{
+			paletteIndex[voxel[i]] = numValues;
+			palette[numValues++] = voxel[i];
+		}
+
+	BrickInfo &info = m_Bricks[brick];
+	info.m_Offset = 0;
+	info.m_Bits = 0;
+	info.m_Value = (numValues>0) ? palette[0] : 0;
+	if (numValues<=1)
+		return;
+
+	info.m_Offset = m_Data.size();
+	if (numValues>16)
+	{
+		// store all voxel unpacked
+		info.m_Bits = 8;
+		m_Data.insert(m_Data.end(), voxel, voxel+brickVoxel);
+		return;
+	}
+	info.m_Bits = (numValues<=2) ? 1 : ((numValues<=4) ? 2 : 4);
+	unsigned int paletteSize = 1<<info.m_Bits;
+	m_Data.resize(info.m_Offset + paletteSize + brickVoxel*info.m_Bits/8, 0);
+	unsigned char* data = &m_Data[info.m_Offset];
+	for (unsigned int n=0;n<numValues;++n)
+		data[n] = palette[n];
+	unsigned char* packed = data + paletteSize;
+	for (unsigned int i=0;i<brickVoxel;++i)
+	{
+		if (valid[i]==0)
+			continue;
+		unsigned int bit = i*info.m_Bits;
+		packed[bit>>3] |= (unsigned char)(paletteIndex[voxel[i]] << (bit&7));
+	}
+}
+
+bool CSVoxelBrickVolume::IsUniformBrick(unsigned int x, unsigned int y, unsigned int z, unsigned char &value) const
+{
+	const BrickInfo &info = m_Bricks[x/BrickSize + (y/BrickSize)*m_NumBricks[0] + (z/BrickSize)*m_NumBricks[0]*m_NumBricks[1]];
+	value = info.m_Value;
+	return info.m_Bits==0;
+}
+
+unsigned int CSVoxelBrickVolume::GetQtyUniformBricks() const
+{
+	unsigned int num = 0;
+	for (size_t i=0;i<m_Bricks.size();++i)
+		if (m_Bricks[i].m_Bits==0)
+			++num;
+	return num;
+}
+
+size_t CSVoxelBrickVolume::GetMemoryUsage() const
+{
+	return m_Bricks.size()*sizeof(BrickInfo) + m_Data.size();
+}
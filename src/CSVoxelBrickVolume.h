@@ -0,0 +1,98 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include "CSXCAD_Global.h"
+
+//! Compressed uint8 voxel volume made of bricks
+/*!
+ The volume is divided into bricks of BrickSize^3 voxel. A uniform brick is stored as a single value, all other bricks are stored as a palette of their values and bit-packed palette indices (1, 2, 4 or 8 bit per voxel).
+ The volume is filled slab by slab (BrickSize planes in z-direction), so the uncompressed volume never has to be kept in memory.
+ */
+class CSXCAD_EXPORT CSVoxelBrickVolume
+{
+public:
+	CSVoxelBrickVolume();
+	~CSVoxelBrickVolume();
+
+	static const unsigned int BrickSize = 16;
+
+	//! Create an empty volume of the given size (x,y,z), all voxel are zero
+	void Create(const unsigned int size[3]);
+	//! Set a slab of BrickSize z-planes (less for the last slab) starting at z = slab*BrickSize, data is ordered x fastest
+	void SetSlab(unsigned int slab, const unsigned char* data);
+	//! Create the volume from dense data (x fastest)
+	void Create(const unsigned int size[3], const unsigned char* data);
+	void Clear();
+
+	const unsigned int* GetSize() const {return m_Size;}
+	unsigned int GetQtySlabs() const {return m_NumBricks[2];}
+
+	//! Get the value at voxel position pos = x + y*size_x + z*size_x*size_y
+	unsigned char GetValue(unsigned int pos) const;
+	unsigned char GetValue(unsigned int x, unsigned int y, unsigned int z) const;
+
+	//! Check if the brick containing the voxel (x,y,z) is uniform and get its value
+	bool IsUniformBrick(unsigned int x, unsigned int y, unsigned int z, unsigned char &value) const;
+
+	//! Get the number of bricks stored as a single value
+	unsigned int GetQtyUniformBricks() const;
+	//! Get the total memory used by the compressed volume in bytes
+	size_t GetMemoryUsage() const;
+
+protected:
+	//! Storage of a brick: m_Bits==0 for a uniform brick of m_Value, else the palette and packed data start at m_Offset in m_Data
+	struct BrickInfo
+	{
+		size_t m_Offset;
+		unsigned char m_Bits;
+		unsigned char m_Value;
+	};
+
+	//! Compress a brick of BrickSize^3 voxel, only voxel with a non-zero valid flag are inside the volume
+	void SetBrick(unsigned int brick, const unsigned char* voxel, const unsigned char* valid);
+
+	unsigned int m_Size[3];
+	unsigned int m_NumBricks[3];
+	std::vector<BrickInfo> m_Bricks;
+	std::vector<unsigned char> m_Data;
+};
+
+inline unsigned char CSVoxelBrickVolume::GetValue(unsigned int x, unsigned int y, unsigned int z) const
+{
+	const BrickInfo &info = m_Bricks[x/BrickSize + (y/BrickSize)*m_NumBricks[0] + (z/BrickSize)*m_NumBricks[0]*m_NumBricks[1]];
+	if (info.m_Bits==0)
+		return info.m_Value;
+	unsigned int local = (x%BrickSize) + (y%BrickSize)*BrickSize + (z%BrickSize)*BrickSize*BrickSize;
+	const unsigned char* palette = &m_Data[info.m_Offset];
+	if (info.m_Bits==8)
+		return palette[local];
+	const unsigned char* packed = palette + (1<<info.m_Bits);
+	unsigned int bit = local*info.m_Bits;
+	return palette[(packed[bit>>3] >> (bit&7)) & ((1<<info.m_Bits)-1)];
+}
+
+inline unsigned char CSVoxelBrickVolume::GetValue(unsigned int pos) const
+{
+	unsigned int x = pos%m_Size[0];
+	pos /= m_Size[0];
+	return GetValue(x, pos%m_Size[1], pos/m_Size[1]);
+}
@@ -0,0 +1,145 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+#include <algorithm>
+
+#include "CSVoxelPyramid.h"
+
+const unsigned int CSVoxelPyramid::MaxLevels;
+
+CSVoxelPyramid::CSVoxelPyramid()
+{
+	m_NumLevels = 0;
+	for (unsigned int l=0;l<=MaxLevels;++l)
+		for (int n=0;n<3;++n)
+			m_Size[l][n] = 0;
+}
+
+CSVoxelPyramid::~CSVoxelPyramid()
+{
+}
+
+void CSVoxelPyramid::Create(const unsigned int size[3], unsigned int numLevels)
+{
+	Clear();
+	m_NumLevels = std::min(numLevels, MaxLevels);
+	for (int n=0;n<3;++n)
+		m_Size[0][n] = size[n];
+	for (unsigned int l=1;l<=m_NumLevels;++l)
+	{
+		for (int n=0;n<3;++n)
+			m_Size[l][n] = (size[n] + (1u<<l) - 1)>>l;
+		size_t numVoxel = (size_t)m_Size[l][0]*m_Size[l][1]*m_Size[l][2];
+		m_Value[l-1].assign(numVoxel, 0);
+		m_Mixed[l-1].assign(numVoxel, false);
+	}
+}
+
+void CSVoxelPyramid::Clear()
+{
+	m_NumLevels = 0;
+	for (unsigned int l=0;l<=MaxLevels;++l)
+		for (int n=0;n<3;++n)
+			m_Size[l][n] = 0;
+	for (unsigned int l=0;l<MaxLevels;++l)
+	{
+		m_Value[l].clear();
+		m_Mixed[l].clear();
+	}
+}
+
+void CSVoxelPyramid::SetBlock(const unsigned int block[3], const unsigned char* voxel)
+{
+	if (m_NumLevels==0)
+		return;
+	const unsigned int blockSize = GetBlockSize();
+	unsigned int num[3];
+	for (int n=0;n<3;++n)
+	{
+		if (block[n]*blockSize>=m_Size[0][n])
+			return;
+		num[n] = std::min(blockSize, m_Size[0][n]-block[n]*blockSize);
+	}
+
+	// a uniform block sets all its coarse voxel at once
+	bool uniform = true;
+	for (unsigned int z=0;(z<num[2]) && uniform;++z)
+		for (unsigned int y=0;(y<num[1]) && uniform;++y)
+		{
+			const unsigned char* line = voxel + (y + z*blockSize)*blockSize;
+			for (unsigned int x=0;x<num[0];++x)
+				if (line[x]!=voxel[0])
+				{
+					uniform = false;
+					break;
+				}
+		}
+
+	unsigned int count[256];
+	memset(count, 0, sizeof(count));
+	unsigned char used[256];
+	for (unsigned int l=1;l<=m_NumLevels;++l)
+	{
+		const unsigned int cell = 1u<<l;
+		const unsigned int numCells = blockSize>>l;
+		for (unsigned int cz=0;(cz<numCells) && (cz*cell<num[2]);++cz)
+			for (unsigned int cy=0;(cy<numCells) && (cy*cell<num[1]);++cy)
+				for (unsigned int cx=0;(cx<numCells) && (cx*cell<num[0]);++cx)
+				{
+					unsigned char value = voxel[0];
+					unsigned int numUsed = 1;
+					if (uniform==false)
+					{
+						// majority vote, ties are resolved to the lower value
+						numUsed = 0;
+						for (unsigned int z=cz*cell;z<std::min((cz+1)*cell, num[2]);++z)
+							for (unsigned int y=cy*cell;y<std::min((cy+1)*cell, num[1]);++y)
+							{
+								const unsigned char* line = voxel + (y + z*blockSize)*blockSize;
+								for (unsigned int x=cx*cell;x<std::min((cx+1)*cell, num[0]);++x)
+									if (count[line[x]]++==0)
+										used[numUsed++] = line[x];
+							}
+						value = used[0];
+						for (unsigned int i=1;i<numUsed;++i)
+							if ((count[used[i]]>count[value]) || ((count[used[i]]==count[value]) && (used[i]<value)))
+								value = used[i];
+						for (unsigned int i=0;i<numUsed;++i)
+							count[used[i]] = 0;
+					}
+					size_t pos = (block[0]*numCells+cx) + (size_t)m_Size[l][0]*((block[1]*numCells+cy) + (size_t)m_Size[l][1]*(block[2]*numCells+cz));
+					m_Value[l-1][pos] = value;
+					m_Mixed[l-1][pos] = (numUsed>1);
+				}
+	}
+}
+
+size_t CSVoxelPyramid::GetQtyMixed(unsigned int level) const
+{
+	if ((level==0) || (level>m_NumLevels))
+		return 0;
+	return std::count(m_Mixed[level-1].begin(), m_Mixed[level-1].end(), true);
+}
+
+size_t CSVoxelPyramid::GetMemoryUsage() const
+{
+	size_t mem = 0;
+	for (unsigned int l=0;l<m_NumLevels;++l)
+		mem += m_Value[l].size() + m_Mixed[l].size()/8;
+	return mem;
+}
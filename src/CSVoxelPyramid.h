@@ -0,0 +1,69 @@
+/*
+*	Copyright (C) 2008-2012 Thorsten Liebig (Thorsten.Liebig@gmx.de)
+*
+*	This program is free software: you can redistribute it and/or modify
+*	it under the terms of the GNU Lesser General Public License as published
+*	by the Free Software Foundation, either version 3 of the License, or
+*	(at your option) any later version.
+*
+*	This program is distributed in the hope that it will be useful,
+*	but WITHOUT ANY WARRANTY; without even the implied warranty of
+*	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*	GNU Lesser General Public License for more details.
+*
+*	You should have received a copy of the GNU Lesser General Public License
+*	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+
+#include "CSXCAD_Global.h"
+
+//! Downsampled levels of a uint8 voxel volume
+/*!
+ Level l (1..numLevels) merges 2^l voxel per direction into one coarse voxel, which stores the majority value of its voxel and a mixed flag if it contains more than one value.
+ The volume is filled block by block, a block has 2^numLevels voxel per direction and covers exactly one voxel of the coarsest level.
+ */
+class CSXCAD_EXPORT CSVoxelPyramid
+{
+public:
+	CSVoxelPyramid();
+	~CSVoxelPyramid();
+
+	static const unsigned int MaxLevels = 3;
+
+	//! Create the pyramid for a volume of the given size (x,y,z) with at most MaxLevels levels
+	void Create(const unsigned int size[3], unsigned int numLevels);
+	//! Set a block of voxel (x fastest, padded to GetBlockSize()^3) at block position (x,y,z)
+	void SetBlock(const unsigned int block[3], const unsigned char* voxel);
+	void Clear();
+
+	unsigned int GetQtyLevels() const {return m_NumLevels;}
+	unsigned int GetBlockSize() const {return 1u<<m_NumLevels;}
+	//! Get the size (x,y,z) of a level, level 0 is the full resolution volume
+	const unsigned int* GetSize(unsigned int level) const {return m_Size[level];}
+
+	//! Get the majority value of a coarse voxel, mixed is set true if the coarse voxel contains different values
+	unsigned char GetValue(unsigned int level, unsigned int x, unsigned int y, unsigned int z, bool &mixed) const;
+
+	//! Get the number of mixed coarse voxel of a level
+	size_t GetQtyMixed(unsigned int level) const;
+	//! Get the total memory used by all levels in bytes
+	size_t GetMemoryUsage() const;
+
+protected:
+	unsigned int m_NumLevels;
+	unsigned int m_Size[MaxLevels+1][3];
+	std::vector<unsigned char> m_Value[MaxLevels];
+	std::vector<bool> m_Mixed[MaxLevels];
+};
+
+inline unsigned char CSVoxelPyramid::GetValue(unsigned int level, unsigned int x, unsigned int y, unsigned int z, bool &mixed) const
+{
+	size_t pos = x + (size_t)m_Size[level][0]*(y + (size_t)m_Size[level][1]*z);
+	mixed = m_Mixed[level-1][pos];
+	return m_Value[level-1][pos];
+}
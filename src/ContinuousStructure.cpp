@@ -32,6 +32,7 @@
 #include "CSPrimCurve.h"
 #include "CSPrimWire.h"
 #include "CSPrimUserDefined.h"
+#include "CSPrimGroup.h"
 
 #include "CSPropUnknown.h"
 #include "CSPropMaterial.h"
@@ -457,6 +458,8 @@ bool ContinuousStructure::Write2XML(TiXmlNode* rootNode, bool parameterised, boo
 
 	clParaSet->Write2XML(Struct);
 
+	// shared group children are written once per file
+	CSPrimGroup::NewXMLPass();
 	TiXmlElement Properties("Properties");
 	for (size_t i=0;i<vProperties.size();++i)
 	{
@@ -490,6 +493,7 @@ bool ContinuousStructure::Write2XML(std::string file, bool parameterised, bool s
 const char* ContinuousStructure::ReadFromXML(TiXmlNode* rootNode)
 {
 	clear();
+	CSPrimGroup::NewXMLPass();
 	TiXmlNode* root = rootNode->FirstChild("ContinuousStructure");
 	if (root==NULL) { ErrString.append("Error: No ContinuousStructure found!!!\n"); return ErrString.c_str();}
 
@@ -592,26 +596,9 @@ bool ContinuousStructure::ReadPropertyPrimitives(TiXmlElement* PropNode, CSPrope
 	while (PrimNode!=NULL)
 	{
 		const char* cPrim=PrimNode->Value();
-		if (strcmp(cPrim,"Box")==0) newPrim = new CSPrimBox(clParaSet,prop);
-		else if (strcmp(cPrim,"MultiBox")==0) newPrim = new CSPrimMultiBox(clParaSet,prop);
-		else if (strcmp(cPrim,"Sphere")==0) newPrim = new CSPrimSphere(clParaSet,prop);
-		else if (strcmp(cPrim,"SphericalShell")==0) newPrim = new CSPrimSphericalShell(clParaSet,prop);
-		else if (strcmp(cPrim,"Cylinder")==0) newPrim = new CSPrimCylinder(clParaSet,prop);
-		else if (strcmp(cPrim,"CylindricalShell")==0) newPrim = new CSPrimCylindricalShell(clParaSet,prop);
-		else if (strcmp(cPrim,"Polygon")==0) newPrim = new CSPrimPolygon(clParaSet,prop);
-		else if (strcmp(cPrim,"LinPoly")==0) newPrim = new CSPrimLinPoly(clParaSet,prop);
-		else if (strcmp(cPrim,"RotPoly")==0) newPrim = new CSPrimRotPoly(clParaSet,prop);
-		else if (strcmp(cPrim,"Polyhedron")==0) newPrim = new CSPrimPolyhedron(clParaSet,prop);
-		else if (strcmp(cPrim,"PolyhedronReader")==0) newPrim = new CSPrimPolyhedronReader(clParaSet,prop);
-		else if (strcmp(cPrim,"Curve")==0) newPrim = new CSPrimCurve(clParaSet,prop);
-		else if (strcmp(cPrim,"Wire")==0) newPrim = new CSPrimWire(clParaSet,prop);
-		else if (strcmp(cPrim,"UserDefined")==0) newPrim = new CSPrimUserDefined(clParaSet,prop);
-		else if (strcmp(cPrim,"Point")==0) newPrim = new CSPrimPoint(clParaSet,prop);
-		else
-		{
+		newPrim = CreatePrimitive(cPrim,clParaSet,prop);
+		if (newPrim==NULL)
 			std::cerr << "ContinuousStructure::ReadFromXML: Primitive with type: " << cPrim << " is unknown... " << std::endl;
-			newPrim=NULL;
-		}
 		if (newPrim)
 		{
 			if (newPrim->ReadFromXML(*PrimNode))
@@ -633,6 +620,28 @@ bool ContinuousStructure::ReadPropertyPrimitives(TiXmlElement* PropNode, CSPrope
 	return true;
 }
 
+CSPrimitives* ContinuousStructure::CreatePrimitive(const char* typeName, ParameterSet* paraSet, CSProperties* prop)
+{
+	if (typeName==NULL) return NULL;
+	if (strcmp(typeName,"Box")==0) return new CSPrimBox(paraSet,prop);
+	if (strcmp(typeName,"MultiBox")==0) return new CSPrimMultiBox(paraSet,prop);
+	if (strcmp(typeName,"Sphere")==0) return new CSPrimSphere(paraSet,prop);
+	if (strcmp(typeName,"SphericalShell")==0) return new CSPrimSphericalShell(paraSet,prop);
+	if (strcmp(typeName,"Cylinder")==0) return new CSPrimCylinder(paraSet,prop);
+	if (strcmp(typeName,"CylindricalShell")==0) return new CSPrimCylindricalShell(paraSet,prop);
+	if (strcmp(typeName,"Polygon")==0) return new CSPrimPolygon(paraSet,prop);
+	if (strcmp(typeName,"LinPoly")==0) return new CSPrimLinPoly(paraSet,prop);
+	if (strcmp(typeName,"RotPoly")==0) return new CSPrimRotPoly(paraSet,prop);
+	if (strcmp(typeName,"Polyhedron")==0) return new CSPrimPolyhedron(paraSet,prop);
+	if (strcmp(typeName,"PolyhedronReader")==0) return new CSPrimPolyhedronReader(paraSet,prop);
+	if (strcmp(typeName,"Curve")==0) return new CSPrimCurve(paraSet,prop);
+	if (strcmp(typeName,"Wire")==0) return new CSPrimWire(paraSet,prop);
+	if (strcmp(typeName,"UserDefined")==0) return new CSPrimUserDefined(paraSet,prop);
+	if (strcmp(typeName,"Point")==0) return new CSPrimPoint(paraSet,prop);
+	if (strcmp(typeName,"Group")==0) return new CSPrimGroup(paraSet,prop);
+	return NULL;
+}
+
 const char* ContinuousStructure::ReadFromXML(const char* file)
 {
 	ErrString.clear();
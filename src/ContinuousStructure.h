@@ -135,7 +135,7 @@ public:
 	//! Get a primitives array of a certian type
 	std::vector<CSPrimitives*>  GetPrimitivesByType(CSPrimitives::PrimitiveType type);
 
-	//! Get a primitives array inside a bounding box and with a certian property type (default is any)
+	//! Get a primitives array inside a bounding box and with a certian property type (default is any). The box must be given in the coordinate input type of the primitives.
 	std::vector<CSPrimitives*>  GetPrimitivesByBoundBox(const double* boundbox, bool sorted=false, CSProperties::PropertyType type=CSProperties::ANY);
 
 	//! Get the internal index of the property.
@@ -196,6 +196,9 @@ public:
 	//! Get a Info-Line containing lib-name, -version etc. 
 	static std::string GetInfoLine(bool shortInfo=false);
 
+	//! Create a new primitive by its XML type name, e.g. "Box". \return NULL if the type is unknown
+	static CSPrimitives* CreatePrimitive(const char* typeName, ParameterSet* paraSet, CSProperties* prop);
+
 protected:
 	ParameterSet* clParaSet;
 	CSRectGrid clGrid;